@@ -0,0 +1,1069 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <pthread.h>
+#include "common.h"
+#include "nand.h"
+#include "ftl.h"
+
+
+/* mount scan of a thread */
+struct ftl_scan {
+	struct ftl *ftl;
+	int first; // block range
+	int last;
+	unsigned long long *latest; // seq << 32 | ppa of lba, shared by threads
+	int *written; // programmed pages of block
+	unsigned int seq; // largest sequence number
+	unsigned long long page;
+	unsigned long long time;
+};
+
+
+static void ftl_free_push(struct ftl *ftl, int block)
+{
+	struct ftl_block *b = &ftl->block[block];
+
+	b->state = BLOCK_FREE;
+	b->valid = 0;
+	if (b->wl_node.index != HEAP_INVALID_INDEX)
+		heap_remove(ftl->closed, &b->wl_node);
+	b->free_node.key = b->pe_cycle;
+	heap_push(ftl->free, &b->free_node);
+}
+
+
+/* dynamic wear leveling: least worn free block is used first */
+static int ftl_free_pop(struct ftl *ftl)
+{
+	struct heap_node *node;
+
+	node = heap_pop(ftl->free);
+	if (!node)
+		return -1;
+	return container_of(node, struct ftl_block, free_node) - ftl->block;
+}
+
+
+static void ftl_update_pe(struct ftl *ftl, int block)
+{
+	struct nand_block info;
+
+	if (nand_block_info(ftl->nand, block * ftl->page_num_per_block, &info))
+		return;
+	ftl->pe_sum += info.pe_cycle - ftl->block[block].pe_cycle;
+	ftl->block[block].pe_cycle = info.pe_cycle;
+}
+
+
+/*
+ * a closed block without valid page needs no GC, it is freed at once and
+ * the simulator drops its data, so trimmed space does not stay on disk
+ */
+static void ftl_reclaim(struct ftl *ftl, int block)
+{
+	gc_remove(ftl->gc_index, block);
+	nand_discard_block(ftl->nand, block * ftl->page_num_per_block);
+	ftl_free_push(ftl, block);
+	ftl->stat.reclaim++;
+}
+
+
+static void ftl_invalidate(struct ftl *ftl, unsigned int ppa)
+{
+	int block = ppa / ftl->page_num_per_block;
+
+	ASSERT(bitmap_get(ftl->valid, ppa));
+	bitmap_clear(ftl->valid, ppa);
+	ftl->block[block].valid--;
+	if (ftl->block[block].state != BLOCK_FULL)
+		return;
+	if (ftl->block[block].valid)
+		gc_update(ftl->gc_index, block, ftl->block[block].valid);
+	else
+		ftl_reclaim(ftl, block);
+}
+
+
+/* bad block table of nand, a page read only if nand has no block info */
+static bool ftl_block_bad(struct ftl *ftl, int block)
+{
+	struct nand_block info;
+	int row = block * ftl->page_num_per_block;
+
+	if (!nand_block_info(ftl->nand, row, &info))
+		return info.bad;
+	return nand_bad_block(ftl->nand, row) != FLASH_OK;
+}
+
+
+/* blocks are erased when they are opened */
+static int ftl_open_block(struct ftl *ftl, struct ftl_wp *wp)
+{
+	int block;
+
+	while ((block = ftl_free_pop(ftl)) >= 0) {
+		if (nand_erase_block(ftl->nand, block * ftl->page_num_per_block) == FLASH_OK) {
+			ftl->stat.erase++;
+			ftl_update_pe(ftl, block);
+			ftl->block[block].state = BLOCK_ACTIVE;
+			wp->block = block;
+			wp->page = 0;
+			return 0;
+		}
+		LOG(LOG_WARN, "erase fail, retire block %d", block);
+		ftl->block[block].state = BLOCK_BAD;
+		ftl->bad_num++;
+		ftl->pe_sum -= ftl->block[block].pe_cycle;
+	}
+	LOG(LOG_ERR, "no free block");
+	return -1;
+}
+
+
+static void ftl_close_block(struct ftl *ftl, struct ftl_wp *wp)
+{
+	struct ftl_block *b = &ftl->block[wp->block];
+
+	b->state = BLOCK_FULL;
+	gc_insert(ftl->gc_index, wp->block, b->valid, ftl->stat.nand_write);
+	b->wl_node.key = b->pe_cycle;
+	heap_push(ftl->closed, &b->wl_node);
+	if (!b->valid)
+		ftl_reclaim(ftl, wp->block);
+	wp->block = -1;
+}
+
+
+/*
+ * program data to next page of write point
+ *
+ * Returns physical page address, otherwise FTL_INVALID_PPA
+ */
+static unsigned int ftl_program(struct ftl *ftl, struct ftl_wp *wp, unsigned int lba,
+								void *data)
+{
+	int ret;
+	unsigned int ppa;
+	struct ftl_oob *oob;
+	struct nand_base *nand = ftl->nand;
+
+	oob = (struct ftl_oob *)ftl->oob;
+	memset(oob, 0xFF, nand->spare_size);
+	oob->magic = FTL_OOB_MAGIC;
+	oob->lba = lba;
+	oob->seq = ftl->seq++;
+
+	for (;;) {
+		if (wp->block < 0 && ftl_open_block(ftl, wp))
+			return FTL_INVALID_PPA;
+
+		ppa = wp->block * ftl->page_num_per_block + wp->page;
+		ret = nand_write_page(nand, ppa, 0, data, oob);
+		ftl->stat.nand_write++;
+		wp->page++;
+		if (ret == FLASH_OK) {
+			bitmap_set(ftl->valid, ppa);
+			ftl->block[wp->block].valid++;
+			if (wp->page == ftl->page_num_per_block)
+				ftl_close_block(ftl, wp);
+			return ppa;
+		}
+		/* program fail, valid pages of the block are moved by GC */
+		LOG(LOG_WARN, "program fail at %u", ppa);
+		ftl_close_block(ftl, wp);
+	}
+}
+
+
+/*
+ * write evicted dirty translation pages to nand, pages not written stay in
+ * write batch and are tried again by the next flush
+ */
+static int ftl_map_flush(struct ftl *ftl)
+{
+	int i, num, size;
+	unsigned int ppa, page;
+	struct ftl_map *map = ftl->map;
+
+	size = ftl->nand->page_size;
+	for (i = 0; i < map->batch_num; i++) {
+		page = map->batch_page[i];
+		ppa = ftl_program(ftl, &map->wp, FTL_MAP_FLAG | page, map->batch + i * size);
+		if (ppa == FTL_INVALID_PPA)
+			break;
+		ftl->stat.map_write++;
+		if (map->gtd[page] != FTL_INVALID_PPA)
+			ftl_invalidate(ftl, map->gtd[page]);
+		map->gtd[page] = ppa;
+	}
+	num = map->batch_num - i;
+	if (num && i) {
+		memmove(map->batch, map->batch + i * size, num * size);
+		memmove(map->batch_page, map->batch_page + i, num * sizeof(unsigned int));
+	}
+	map->batch_num = num;
+	return num ? -1 : 0;
+}
+
+
+/* clean translation page is dropped, dirty one waits in write batch */
+static int ftl_map_evict(void *data, void **userdata)
+{
+	int size;
+	struct lru_node *node;
+	struct ftl *ftl;
+	struct ftl_map *map;
+
+	node = (struct lru_node *)data;
+	ftl = (struct ftl *)(*userdata);
+	map = ftl->map;
+	size = ftl->nand->page_size;
+	if (!bitmap_get(map->dirty, node->key))
+		return 0;
+
+	bitmap_clear(map->dirty, node->key);
+	/* batch left full by a failed flush */
+	if (map->batch_num == FTL_MAP_BATCH_NUM && ftl_map_flush(ftl)) {
+		LOG(LOG_ERR, "translation page %u write fail, mapping lost", node->key);
+		return -1;
+	}
+	memcpy(map->batch + map->batch_num * size, node->buffer, size);
+	map->batch_page[map->batch_num++] = node->key;
+	if (map->batch_num == FTL_MAP_BATCH_NUM && ftl_map_flush(ftl))
+		LOG(LOG_WARN, "translation page write fail, %d kept in batch", map->batch_num);
+	return 0;
+}
+
+
+/*
+ * take translation page out of write batch
+ *
+ * Returns zero if it is in the batch, otherwise -1
+ */
+static int ftl_map_batch_take(struct ftl *ftl, unsigned int page, void *buf)
+{
+	int i, size;
+	struct ftl_map *map = ftl->map;
+
+	size = ftl->nand->page_size;
+	for (i = 0; i < map->batch_num; i++) {
+		if (map->batch_page[i] != page)
+			continue;
+		memcpy(buf, map->batch + i * size, size);
+		map->batch_num--;
+		if (i != map->batch_num) {
+			memcpy(map->batch + i * size, map->batch + map->batch_num * size, size);
+			map->batch_page[i] = map->batch_page[map->batch_num];
+		}
+		return 0;
+	}
+	return -1;
+}
+
+
+/*
+ * mapping entry of lba, translation page is loaded on cache miss
+ *
+ * Returns entry address, valid until next mapping access
+ */
+static unsigned int *ftl_map_entry(struct ftl *ftl, unsigned int lba)
+{
+	int ret, size;
+	unsigned int page, *entry;
+	struct ftl_map *map = ftl->map;
+	struct nand_base *nand = ftl->nand;
+
+	if (!map)
+		return &ftl->l2p[lba];
+
+	page = lba / map->entry_num;
+	entry = lru_get(map->cache, page);
+	if (entry) {
+		ftl->stat.map_hit++;
+		return entry + lba % map->entry_num;
+	}
+
+	ftl->stat.map_miss++;
+	size = nand->page_size;
+	entry = lru_set(map->cache, page, ftl_map_evict, (void **)&ftl);
+	if (!ftl_map_batch_take(ftl, page, entry)) {
+		/* still dirty, taken back from write batch */
+		bitmap_set(map->dirty, page);
+		ftl->stat.map_batch++;
+		return entry + lba % map->entry_num;
+	}
+
+	if (map->gtd[page] == FTL_INVALID_PPA) {
+		memset(entry, 0xFF, size);
+		return entry + lba % map->entry_num;
+	}
+	ret = nand_read_page(nand, map->gtd[page], 0, entry, ftl->buf + size);
+	ftl->stat.nand_read++;
+	ftl->stat.map_read++;
+	if (ret == FLASH_ERROR || ret == FLASH_BAD) {
+		LOG(LOG_ERR, "translation page %u read fail, mapping lost", page);
+		memset(entry, 0xFF, size);
+	}
+	return entry + lba % map->entry_num;
+}
+
+
+/* cached translation page of lba is updated */
+static void ftl_map_dirty(struct ftl *ftl, unsigned int lba)
+{
+	if (ftl->map)
+		bitmap_set(ftl->map->dirty, lba / ftl->map->entry_num);
+}
+
+
+/* spare of the page is lost, find the owner from mapping table */
+static unsigned int ftl_lba_search(struct ftl *ftl, unsigned int ppa)
+{
+	unsigned int lba;
+
+	for (lba = 0; ftl->map && lba < ftl->map->page_num; lba++) {
+		if (ftl->map->gtd[lba] == ppa)
+			return FTL_MAP_FLAG | lba;
+	}
+	for (lba = 0; lba < ftl->lba_num; lba++) {
+		if (*ftl_map_entry(ftl, lba) == ppa)
+			return lba;
+	}
+	return FTL_INVALID_PPA;
+}
+
+
+/*
+ * move a valid translation page in ftl->buf to translation write point;
+ * a newer copy dirty in cache or write batch is written instead, so the
+ * moved page is not written again soon after
+ */
+static int ftl_move_map(struct ftl *ftl, unsigned int ppa, unsigned int page)
+{
+	int size, batch;
+	unsigned int new_ppa;
+	unsigned char *buf = ftl->buf;
+	struct ftl_map *map = ftl->map;
+
+	if (!map || page >= map->page_num || map->gtd[page] != ppa) {
+		LOG(LOG_ERR, "page %u of translation page %u is not mapped", ppa, page);
+		ftl_invalidate(ftl, ppa);
+		return 0;
+	}
+
+	size = ftl->nand->page_size;
+	batch = ftl_map_batch_take(ftl, page, buf);
+	if (bitmap_get(map->dirty, page))
+		buf = lru_get(map->cache, page);
+	new_ppa = ftl_program(ftl, &map->wp, FTL_MAP_FLAG | page, buf);
+	if (new_ppa == FTL_INVALID_PPA) {
+		if (!batch) {
+			memcpy(map->batch + map->batch_num * size, buf, size);
+			map->batch_page[map->batch_num++] = page;
+		}
+		return -1;
+	}
+	bitmap_clear(map->dirty, page);
+	ftl_invalidate(ftl, ppa);
+	map->gtd[page] = new_ppa;
+	return 0;
+}
+
+
+/* move a valid page to GC write point */
+static int ftl_move_page(struct ftl *ftl, unsigned int ppa)
+{
+	int ret;
+	unsigned int lba, new_ppa, *entry;
+	struct ftl_oob *oob;
+	struct nand_base *nand = ftl->nand;
+
+	oob = (struct ftl_oob *)(ftl->buf + nand->page_size);
+	ret = nand_read_page(nand, ppa, 0, ftl->buf, oob);
+	ftl->stat.nand_read++;
+	lba = oob->lba;
+	if (ret == FLASH_ERROR || ret == FLASH_BAD || oob->magic != FTL_OOB_MAGIC) {
+		LOG(LOG_ERR, "gc read fail at %u, data lost", ppa);
+		lba = ftl_lba_search(ftl, ppa);
+	}
+	if (lba != FTL_INVALID_PPA && (lba & FTL_MAP_FLAG))
+		return ftl_move_map(ftl, ppa, lba & ~FTL_MAP_FLAG);
+	if (lba >= ftl->lba_num || *(entry = ftl_map_entry(ftl, lba)) != ppa) {
+		LOG(LOG_ERR, "page %u of lba %u is not mapped", ppa, lba);
+		ftl_invalidate(ftl, ppa);
+		return 0;
+	}
+
+	new_ppa = ftl_program(ftl, &ftl->gc, lba, ftl->buf);
+	if (new_ppa == FTL_INVALID_PPA)
+		return -1;
+	ftl_invalidate(ftl, ppa);
+	*entry = new_ppa;
+	ftl_map_dirty(ftl, lba);
+	return 0;
+}
+
+
+static int ftl_gc(struct ftl *ftl)
+{
+	int i, victim;
+	unsigned int ppa;
+	unsigned long long clock;
+	struct nand_base *nand = ftl->nand;
+
+	victim = gc_victim(ftl->gc_index, ftl->stat.nand_write);
+	if (victim < 0 || ftl->block[victim].valid == ftl->page_num_per_block) {
+		LOG(LOG_ERR, "no block to collect");
+		return -1;
+	}
+	gc_remove(ftl->gc_index, victim);
+	ftl->block[victim].state = BLOCK_MOVING;
+
+	ftl->stat.gc++;
+	clock = nand->clock;
+	for (i = 0; i < ftl->page_num_per_block && ftl->block[victim].valid; i++) {
+		ppa = victim * ftl->page_num_per_block + i;
+		if (!bitmap_get(ftl->valid, ppa))
+			continue;
+		if (ftl_move_page(ftl, ppa))
+			return -1;
+		ftl->stat.gc_move++;
+	}
+	nand_discard_block(nand, victim * ftl->page_num_per_block);
+	ftl_free_push(ftl, victim);
+	ftl->stat.gc_time += nand->clock - clock;
+	return 0;
+}
+
+
+/*
+ * static wear leveling: when the least worn closed block falls behind the
+ * average PE cycle by threshold, its cold data is moved out a few pages per
+ * host write, the block then goes back to free blocks and takes hot data;
+ * average rather than maximum keeps a few weak blocks from triggering it
+ */
+static void ftl_wl_step(struct ftl *ftl)
+{
+	int i, block;
+	unsigned int ppa;
+	struct heap_node *node;
+
+	if (ftl->wl.block < 0) {
+		node = heap_top(ftl->closed);
+		if (!node || node->key + ftl->wl_threshold >
+				ftl->pe_sum / (ftl->block_num - ftl->bad_num))
+			return;
+		block = container_of(node, struct ftl_block, wl_node) - ftl->block;
+		heap_remove(ftl->closed, node);
+		/* GC never sees a block being migrated */
+		gc_remove(ftl->gc_index, block);
+		ftl->block[block].state = BLOCK_MOVING;
+		ftl->wl.block = block;
+		ftl->wl.page = 0;
+		ftl->stat.wl++;
+	}
+
+	block = ftl->wl.block;
+	for (i = 0; i < FTL_WL_PAGE_NUM && ftl->wl.page < ftl->page_num_per_block; ftl->wl.page++) {
+		ppa = block * ftl->page_num_per_block + ftl->wl.page;
+		if (!bitmap_get(ftl->valid, ppa))
+			continue;
+		if (ftl_move_page(ftl, ppa))
+			return;
+		ftl->stat.wl_move++;
+		i++;
+	}
+	if (ftl->wl.page == ftl->page_num_per_block) {
+		nand_discard_block(ftl->nand, block * ftl->page_num_per_block);
+		ftl_free_push(ftl, block);
+		ftl->wl.block = -1;
+	}
+}
+
+
+/*
+ * hot/cold separation: the sketch counts recent updates of lba, sectors
+ * updated 2^n times go to stream n, so blocks of hot stream are mostly
+ * invalid when GC picks them and cold data is not copied again and again
+ */
+static int ftl_stream(struct ftl *ftl, unsigned int lba, int hint)
+{
+	unsigned int count;
+
+	if (!ftl->sketch)
+		return 0;
+	count = sketch_add(ftl->sketch, lba);
+	if (hint != FTL_STREAM_AUTO)
+		return hint;
+	return MIN(calc_msb_index(count), ftl->stream_num - 1);
+}
+
+
+static int ftl_write_sector(struct ftl *ftl, unsigned int lba, void *data, int hint)
+{
+	int stream;
+	unsigned int ppa, *entry;
+	struct ftl_wp *wp;
+
+	stream = ftl_stream(ftl, lba, hint);
+	wp = &ftl->stream[stream];
+	ftl->stat.stream_write[stream]++;
+
+	/* GC before a new host block, keep free blocks for GC itself */
+	if (wp->block < 0) {
+		while (ftl->free->num < ftl->gc_threshold) {
+			if (ftl_gc(ftl))
+				return -1;
+		}
+	}
+
+	ppa = ftl_program(ftl, wp, lba, data);
+	if (ppa == FTL_INVALID_PPA)
+		return -1;
+	entry = ftl_map_entry(ftl, lba);
+	if (*entry != FTL_INVALID_PPA)
+		ftl_invalidate(ftl, *entry);
+	*entry = ppa;
+	ftl_map_dirty(ftl, lba);
+
+	if (ftl->wl_threshold > 0 && ftl->free->num > ftl->gc_threshold)
+		ftl_wl_step(ftl);
+	return 0;
+}
+
+
+static struct ftl_map *ftl_map_create(struct ftl *ftl, int cache_num)
+{
+	struct ftl_map *map;
+	struct nand_base *nand = ftl->nand;
+
+	map = mem_alloc(sizeof(struct ftl_map));
+	map->entry_num = nand->page_size / sizeof(unsigned int);
+	map->page_num = (ftl->lba_num + map->entry_num - 1) / map->entry_num;
+	map->gtd = mem_alloc(map->page_num * sizeof(unsigned int));
+	memset(map->gtd, 0xFF, map->page_num * sizeof(unsigned int));
+	map->cache = lru_create(nand->page_size, MIN(cache_num, map->page_num));
+	map->dirty = bitmap_create(map->page_num, 0);
+	map->batch = mem_alloc(FTL_MAP_BATCH_NUM * nand->page_size);
+	map->wp.block = -1;
+	return map;
+}
+
+
+static void ftl_map_delete(struct ftl_map *map)
+{
+	if (!map)
+		return;
+	mem_free(map->batch);
+	bitmap_delete(map->dirty);
+	lru_delete(map->cache);
+	mem_free(map->gtd);
+	mem_free(map);
+}
+
+
+/* all blocks but bad ones are left free */
+static struct ftl *ftl_alloc(struct nand_base *nand, int op_ratio, int map_cache, int stream_num)
+{
+	int i, good;
+	struct ftl *ftl;
+
+	if (!nand || op_ratio <= 0 || op_ratio > 90 || map_cache < 0 ||
+		stream_num <= 0 || stream_num > FTL_STREAM_MAX)
+		return NULL;
+
+	ftl = mem_alloc(sizeof(struct ftl));
+	ftl->nand = nand;
+	ftl->page_num_per_block = nand->block_size / nand->page_size;
+	ftl->block_num = nand->block_num;
+	ftl->op_ratio = op_ratio;
+	ftl->block = mem_alloc(ftl->block_num * sizeof(struct ftl_block));
+	ftl->free = heap_create(ftl->block_num);
+	ftl->closed = heap_create(ftl->block_num);
+	ftl->wl_threshold = MAX(nand->max_pe_cycle / 20, 1);
+	ftl->valid = bitmap_create(ftl->block_num * ftl->page_num_per_block, 0);
+	ftl->buf = mem_alloc(nand->page_size + nand->spare_size);
+	ftl->oob = mem_alloc(nand->spare_size);
+	ftl->seq = 1;
+	/*
+	 * translation write point draws free blocks at any time, GC or not:
+	 * keep its next block and the blocks of a whole write batch
+	 */
+	ftl->gc_threshold = FTL_GC_THRESHOLD;
+	if (map_cache)
+		ftl->gc_threshold += 1 + (FTL_MAP_BATCH_NUM + ftl->page_num_per_block - 1) /
+								ftl->page_num_per_block;
+	ftl->stream_num = stream_num;
+	for (i = 0; i < FTL_STREAM_MAX; i++)
+		ftl->stream[i].block = -1;
+	ftl->gc.block = -1;
+	ftl->wl.block = -1;
+	ftl->gc_index = gc_create(ftl->block_num, ftl->page_num_per_block, GC_GREEDY, 0);
+
+	for (i = 0; i < ftl->block_num; i++) {
+		ftl->block[i].free_node.index = HEAP_INVALID_INDEX;
+		ftl->block[i].wl_node.index = HEAP_INVALID_INDEX;
+		if (ftl_block_bad(ftl, i)) {
+			ftl->block[i].state = BLOCK_BAD;
+			ftl->bad_num++;
+		} else {
+			ftl_update_pe(ftl, i);
+		}
+	}
+
+	/* host and gc write blocks are not counted */
+	good = ftl->block_num - ftl->bad_num - ftl->gc_threshold - stream_num - 1;
+	/* neither are translation write block and translation blocks */
+	if (map_cache)
+		good -= 2 + good / (nand->page_size / sizeof(unsigned int));
+	if (good <= 0) {
+		LOG(LOG_ERR, "too few good blocks %d", ftl->block_num - ftl->bad_num);
+		ftl_delete(ftl);
+		return NULL;
+	}
+	ftl->lba_num = (unsigned long long)good * ftl->page_num_per_block * (100 - op_ratio) / 100;
+	if (map_cache) {
+		ftl->map = ftl_map_create(ftl, map_cache);
+	} else {
+		ftl->l2p = mem_alloc(ftl->lba_num * sizeof(unsigned int));
+		memset(ftl->l2p, 0xFF, ftl->lba_num * sizeof(unsigned int));
+	}
+	/* about one count per lba between two aging */
+	if (stream_num > 1)
+		ftl->sketch = sketch_create(MIN(ftl->lba_num, FTL_SKETCH_WIDTH_MAX), ftl->lba_num);
+	ftl->start = nand->clock;
+
+	LOG(LOG_WARN, "ftl lba_num: %u bad_num: %d op: %d%% map cache: %d",
+				ftl->lba_num, ftl->bad_num, op_ratio, map_cache);
+	return ftl;
+}
+
+
+struct ftl *ftl_create(struct nand_base *nand, int op_ratio, int map_cache, int stream_num)
+{
+	int i;
+	struct ftl *ftl;
+
+	ftl = ftl_alloc(nand, op_ratio, map_cache, stream_num);
+	if (!ftl)
+		return NULL;
+	/* data of an earlier FTL is dropped, a later mount must not find it */
+	for (i = 0; i < ftl->block_num; i++) {
+		if (ftl->block[i].state == BLOCK_BAD)
+			continue;
+		nand_discard_block(nand, i * ftl->page_num_per_block);
+		ftl_free_push(ftl, i);
+	}
+	return ftl;
+}
+
+
+/* keep the page of largest sequence number, lock free among threads */
+static void ftl_scan_latest(unsigned long long *latest, unsigned long long value)
+{
+	unsigned long long old;
+
+	do {
+		old = *latest;
+		if (old >= value)
+			return;
+	} while (!__sync_bool_compare_and_swap(latest, old, value));
+}
+
+
+/* pages of a block are programmed in order, scan stops at first erased page */
+static void *ftl_scan_thread(void *arg)
+{
+	int i, block;
+	unsigned int ppa, time;
+	unsigned char *buf;
+	struct ftl_oob *oob;
+	struct ftl_scan *scan = arg;
+	struct ftl *ftl = scan->ftl;
+	struct nand_base *nand = ftl->nand;
+
+	time = nand->timing.t_r + nand_xfer_time(&nand->timing, nand->spare_size);
+	buf = mem_alloc(ftl->page_num_per_block * nand->spare_size);
+	for (block = scan->first; block < scan->last; block++) {
+		ppa = block * ftl->page_num_per_block;
+		if (ftl->block[block].state == BLOCK_BAD ||
+			nand_read_spare(nand, ppa, ftl->page_num_per_block, buf))
+			continue;
+		for (i = 0; i < ftl->page_num_per_block; i++, ppa++) {
+			oob = (struct ftl_oob *)(buf + i * nand->spare_size);
+			scan->page++;
+			scan->time += time;
+			if (oob->magic != FTL_OOB_MAGIC)
+				break;
+			scan->written[block]++;
+			scan->seq = MAX(scan->seq, oob->seq);
+			if (oob->lba < ftl->lba_num)
+				ftl_scan_latest(&scan->latest[oob->lba],
+								(unsigned long long)oob->seq << 32 | ppa);
+		}
+	}
+	mem_free(buf);
+	return NULL;
+}
+
+
+/* translation pages are written again from scanned mapping in ftl->l2p */
+static int ftl_map_rebuild(struct ftl *ftl)
+{
+	int i, num;
+	unsigned int lba, page, ppa, *entry;
+	struct ftl_map *map = ftl->map;
+
+	entry = (unsigned int *)ftl->buf;
+	for (lba = page = 0; page < map->page_num; page++) {
+		memset(entry, 0xFF, ftl->nand->page_size);
+		for (i = num = 0; i < map->entry_num && lba < ftl->lba_num; i++, lba++) {
+			if (ftl->l2p[lba] != FTL_INVALID_PPA) {
+				entry[i] = ftl->l2p[lba];
+				num++;
+			}
+		}
+		if (!num)
+			continue;
+		ppa = ftl_program(ftl, &map->wp, FTL_MAP_FLAG | page, entry);
+		if (ppa == FTL_INVALID_PPA)
+			return -1;
+		ftl->stat.map_write++;
+		map->gtd[page] = ppa;
+	}
+	return 0;
+}
+
+
+struct ftl *ftl_mount(struct nand_base *nand, int op_ratio, int map_cache, int stream_num,
+						int thread_num)
+{
+	int i, num, *written;
+	unsigned int lba, ppa;
+	unsigned long long *latest;
+	pthread_t thread[FTL_SCAN_THREAD_MAX];
+	struct ftl_scan scan[FTL_SCAN_THREAD_MAX];
+	struct ftl_wp wp;
+	struct ftl_map *map;
+	struct ftl *ftl;
+
+	if (thread_num <= 0 || thread_num > FTL_SCAN_THREAD_MAX)
+		return NULL;
+	ftl = ftl_alloc(nand, op_ratio, map_cache, stream_num);
+	if (!ftl)
+		return NULL;
+
+	latest = mem_alloc(ftl->lba_num * sizeof(unsigned long long));
+	written = mem_alloc(ftl->block_num * sizeof(int));
+	num = (ftl->block_num + thread_num - 1) / thread_num;
+	memset(scan, 0, sizeof(scan));
+	for (i = 0; i < thread_num; i++) {
+		scan[i].ftl = ftl;
+		scan[i].first = MIN(i * num, ftl->block_num);
+		scan[i].last = MIN(scan[i].first + num, ftl->block_num);
+		scan[i].latest = latest;
+		scan[i].written = written;
+		if (pthread_create(&thread[i], NULL, ftl_scan_thread, &scan[i])) {
+			LOG(LOG_WARN, "create scan thread %d fail", i);
+			ftl_scan_thread(&scan[i]);
+			scan[i].ftl = NULL;
+		}
+	}
+	/* dies are scanned in parallel, threads stand for them */
+	for (i = 0; i < thread_num; i++) {
+		if (scan[i].ftl)
+			pthread_join(thread[i], NULL);
+		ftl->seq = MAX(ftl->seq, scan[i].seq + 1);
+		ftl->stat.mount_page += scan[i].page;
+		ftl->stat.mount_time = MAX(ftl->stat.mount_time, scan[i].time);
+	}
+
+	/* old translation pages are left invalid, GC uses mapping in memory till rewritten */
+	map = ftl->map;
+	if (map) {
+		ftl->map = NULL;
+		ftl->l2p = mem_alloc(ftl->lba_num * sizeof(unsigned int));
+		memset(ftl->l2p, 0xFF, ftl->lba_num * sizeof(unsigned int));
+	}
+	for (lba = 0; lba < ftl->lba_num; lba++) {
+		if (!latest[lba])
+			continue;
+		ppa = (unsigned int)latest[lba];
+		bitmap_set(ftl->valid, ppa);
+		ftl->block[ppa / ftl->page_num_per_block].valid++;
+		ftl->l2p[lba] = ppa;
+	}
+	mem_free(latest);
+	for (i = 0; i < ftl->block_num; i++) {
+		if (ftl->block[i].state == BLOCK_BAD)
+			continue;
+		if (!written[i]) {
+			ftl_free_push(ftl, i);
+			continue;
+		}
+		wp.block = i;
+		wp.page = ftl->page_num_per_block;
+		ftl_close_block(ftl, &wp);
+	}
+	mem_free(written);
+
+	/* partial written blocks are closed, GC takes back free blocks for write points */
+	while (ftl->free->num < ftl->gc_threshold) {
+		if (ftl_gc(ftl))
+			break;
+	}
+	if (map) {
+		ftl->map = map;
+		num = ftl_map_rebuild(ftl);
+		mem_free(ftl->l2p);
+		ftl->l2p = NULL;
+		if (num) {
+			LOG(LOG_ERR, "rebuild translation pages fail");
+			ftl_delete(ftl);
+			return NULL;
+		}
+	}
+	return ftl;
+}
+
+
+int ftl_read(struct ftl *ftl, unsigned int lba, int num, void *data)
+{
+	int i, ret;
+	unsigned int ppa;
+	char *buf = data;
+	struct nand_base *nand = ftl->nand;
+
+	if (lba >= ftl->lba_num || num > ftl->lba_num - lba) {
+		LOG(LOG_WARN, "read out of range %u %d", lba, num);
+		return -1;
+	}
+
+	for (i = 0; i < num; i++, buf += nand->page_size) {
+		ftl->stat.host_read++;
+		ppa = *ftl_map_entry(ftl, lba + i);
+		if (ppa == FTL_INVALID_PPA) {
+			memset(buf, 0, nand->page_size);
+			continue;
+		}
+		ret = nand_read_page(nand, ppa, 0, buf, ftl->buf + nand->page_size);
+		ftl->stat.nand_read++;
+		if (ret == FLASH_ERROR || ret == FLASH_BAD) {
+			LOG(LOG_ERR, "read fail lba %u ppa %u", lba + i, ppa);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+int ftl_write(struct ftl *ftl, unsigned int lba, int num, void *data)
+{
+	return ftl_write_stream(ftl, lba, num, data, FTL_STREAM_AUTO);
+}
+
+
+int ftl_write_stream(struct ftl *ftl, unsigned int lba, int num, void *data, int stream)
+{
+	int i;
+	char *buf = data;
+	struct nand_base *nand = ftl->nand;
+
+	if (lba >= ftl->lba_num || num > ftl->lba_num - lba) {
+		LOG(LOG_WARN, "write out of range %u %d", lba, num);
+		return -1;
+	}
+	if (stream != FTL_STREAM_AUTO && (stream < 0 || stream >= ftl->stream_num)) {
+		LOG(LOG_WARN, "invalid stream %d", stream);
+		return -1;
+	}
+
+	for (i = 0; i < num; i++, buf += nand->page_size) {
+		ftl->stat.host_write++;
+		if (ftl_write_sector(ftl, lba + i, buf, stream))
+			return -1;
+	}
+	return 0;
+}
+
+
+int ftl_trim(struct ftl *ftl, unsigned int lba, int num)
+{
+	int i;
+	unsigned int *entry;
+
+	if (lba >= ftl->lba_num || num > ftl->lba_num - lba) {
+		LOG(LOG_WARN, "trim out of range %u %d", lba, num);
+		return -1;
+	}
+
+	for (i = 0; i < num; i++) {
+		ftl->stat.host_trim++;
+		entry = ftl_map_entry(ftl, lba + i);
+		if (*entry == FTL_INVALID_PPA)
+			continue;
+		ftl_invalidate(ftl, *entry);
+		*entry = FTL_INVALID_PPA;
+		ftl_map_dirty(ftl, lba + i);
+	}
+	return 0;
+}
+
+
+int ftl_flush(struct ftl *ftl)
+{
+	ftl->stat.flush++;
+	return nand_sync(ftl->nand);
+}
+
+
+int ftl_gc_policy(struct ftl *ftl, int policy, int window)
+{
+	if (policy < 0 || policy >= GC_POLICY_NUM)
+		return -1;
+	ftl->gc_index->policy = policy;
+	ftl->gc_index->window = window > 0 ? window : GC_DEFAULT_WINDOW;
+	return 0;
+}
+
+
+void ftl_wl_threshold(struct ftl *ftl, int threshold)
+{
+	ftl->wl_threshold = MAX(threshold, 0);
+}
+
+
+double ftl_waf(struct ftl *ftl)
+{
+	if (!ftl->stat.host_write)
+		return 0.0;
+	return (double)ftl->stat.nand_write / ftl->stat.host_write;
+}
+
+
+/* erase count distribution of good blocks */
+static void ftl_dump_pe(struct ftl *ftl, FILE *fp)
+{
+	int i, num, width;
+	unsigned int min, max;
+	unsigned long long sum;
+	int hist[FTL_WL_HIST_NUM] = {0};
+
+	min = ~0U;
+	max = sum = num = 0;
+	for (i = 0; i < ftl->block_num; i++) {
+		if (ftl->block[i].state == BLOCK_BAD)
+			continue;
+		min = MIN(min, ftl->block[i].pe_cycle);
+		max = MAX(max, ftl->block[i].pe_cycle);
+		sum += ftl->block[i].pe_cycle;
+		num++;
+	}
+	if (!num)
+		return;
+
+	width = (max - min) / FTL_WL_HIST_NUM + 1;
+	for (i = 0; i < ftl->block_num; i++) {
+		if (ftl->block[i].state != BLOCK_BAD)
+			hist[(ftl->block[i].pe_cycle - min) / width]++;
+	}
+	fprintf(fp, "pe cycle min: %u max: %u avg: %.2f\n", min, max, (double)sum / num);
+	for (i = 0; i < FTL_WL_HIST_NUM && min + i * width <= max; i++)
+		fprintf(fp, "  [%u, %u]: %d\n", min + i * width, min + (i + 1) * width - 1, hist[i]);
+}
+
+
+/* mapping cache hit ratio and translation page overhead */
+static void ftl_dump_map(struct ftl *ftl, FILE *fp)
+{
+	unsigned long long access;
+	struct ftl_stat *stat = &ftl->stat;
+
+	access = MAX(stat->map_hit + stat->map_miss, 1);
+	fprintf(fp, "map cache: %u of %u pages hit: %llu miss: %llu batch: %llu hit ratio: %.2f%%\n",
+				ftl->map->cache->num, ftl->map->page_num, stat->map_hit,
+				stat->map_miss, stat->map_batch, stat->map_hit * 100.0 / access);
+	fprintf(fp, "map read: %llu (%.3f per host io) write: %llu (%.3f per host write)\n",
+				stat->map_read, (double)stat->map_read /
+				MAX(stat->host_read + stat->host_write, 1),
+				stat->map_write, (double)stat->map_write / MAX(stat->host_write, 1));
+}
+
+
+static void ftl_dump_stream(struct ftl *ftl, FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "streams: %d classifier: %u bytes\n", ftl->stream_num,
+				SKETCH_DEPTH * ftl->sketch->width);
+	for (i = 0; i < ftl->stream_num; i++)
+		fprintf(fp, "  stream %d write: %llu\n", i, ftl->stat.stream_write[i]);
+}
+
+
+void ftl_dump(struct ftl *ftl, FILE *fp)
+{
+	double time;
+	struct ftl_stat *stat = &ftl->stat;
+
+	time = (ftl->nand->clock - ftl->start) / 1e9;
+	time = time > 0 ? time : 1.0;
+	fprintf(fp, "lba_num: %u free: %u bad: %d op: %d%%\n", ftl->lba_num,
+				ftl->free->num, ftl->bad_num, ftl->op_ratio);
+	fprintf(fp, "host read: %llu write: %llu trim: %llu flush: %llu\n", stat->host_read,
+				stat->host_write, stat->host_trim, stat->flush);
+	fprintf(fp, "nand read: %llu write: %llu erase: %llu\n", stat->nand_read,
+				stat->nand_write, stat->erase);
+	fprintf(fp, "gc: %llu moved: %llu waf: %.3f\n", stat->gc, stat->gc_move, ftl_waf(ftl));
+	if (stat->gc)
+		fprintf(fp, "gc policy: %d avg moved: %.2f avg time: %llu us\n",
+					ftl->gc_index->policy, (double)stat->gc_move / stat->gc,
+					stat->gc_time / stat->gc / 1000);
+	fprintf(fp, "wear leveling: %llu moved: %llu threshold: %d\n", stat->wl,
+				stat->wl_move, ftl->wl_threshold);
+	fprintf(fp, "reclaim: %llu\n", stat->reclaim);
+	if (ftl->map)
+		ftl_dump_map(ftl, fp);
+	if (ftl->sketch)
+		ftl_dump_stream(ftl, fp);
+	if (stat->mount_page)
+		fprintf(fp, "mount scan: %llu pages, simulated time: %llu us\n",
+					stat->mount_page, stat->mount_time / 1000);
+	ftl_dump_pe(ftl, fp);
+	fprintf(fp, "simulated time: %.3f s iops: %.0f\n", time,
+				(stat->host_read + stat->host_write) / time);
+}
+
+
+void ftl_delete(struct ftl *ftl)
+{
+	if (ftl->sketch)
+		sketch_delete(ftl->sketch);
+	ftl_map_delete(ftl->map);
+	mem_free(ftl->l2p);
+	mem_free(ftl->oob);
+	mem_free(ftl->buf);
+	bitmap_delete(ftl->valid);
+	gc_delete(ftl->gc_index);
+	heap_delete(ftl->closed);
+	heap_delete(ftl->free);
+	mem_free(ftl->block);
+	mem_free(ftl);
+}
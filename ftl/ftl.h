@@ -0,0 +1,290 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FTL_H__
+#define __FTL_H__
+
+#include "bitmap.h"
+#include "lru.h"
+#include "sketch.h"
+#include "nand.h"
+#include "gc.h"
+
+/*
+ * page-level mapping FTL
+ * a logical sector has the size of a nand page, lba maps to a physical
+ * page address (ppa = row of nand), lba and sequence number of every page
+ * are kept in spare, mount rebuilds mapping from them
+ *
+ * mapping table is either all in memory, or demand paged (DFTL): it is
+ * split into translation pages stored in nand, only a few of them are
+ * cached, the directory of translation pages stays in memory
+ */
+#define FTL_INVALID_PPA					0xffffffff
+#define FTL_MAP_FLAG					0x80000000 // spare lba of translation page
+#define FTL_MAP_BATCH_NUM				8 // evicted dirty translation pages written together
+#define FTL_GC_THRESHOLD				2 // free blocks kept for GC
+#define FTL_WL_PAGE_NUM					1 // pages migrated by wear leveling per host write
+#define FTL_WL_HIST_NUM					8
+#define FTL_STREAM_MAX					8 // host write streams
+#define FTL_STREAM_AUTO					-1 // stream by update frequency
+#define FTL_SKETCH_WIDTH_MAX			(1 << 16) // classifier memory: SKETCH_DEPTH * 64KB
+#define FTL_OOB_MAGIC					0x314c5446 // "FTL1"
+#define FTL_SCAN_THREAD_MAX				64
+
+
+enum ftl_block_state {
+	BLOCK_FREE,
+	BLOCK_ACTIVE,
+	BLOCK_FULL,
+	BLOCK_MOVING, // GC victim or wear leveling source
+	BLOCK_BAD
+};
+
+
+/* head of spare area */
+struct ftl_oob {
+	unsigned int magic;
+	unsigned int lba;
+	unsigned int seq; // program order of ftl
+};
+
+
+/* write point of a block being programmed */
+struct ftl_wp {
+	int block; // -1 for none
+	int page;
+};
+
+
+struct ftl_block {
+	int state;
+	int valid; // valid page number
+	unsigned int pe_cycle;
+	struct heap_node free_node; // key: pe_cycle
+	struct heap_node wl_node; // closed block, key: pe_cycle
+};
+
+
+/* demand-paged mapping table */
+struct ftl_map {
+	unsigned int entry_num; // mapping entries per translation page
+	unsigned int page_num; // translation page number
+	unsigned int *gtd; // global translation directory, ppa of translation pages
+	struct lru_cache *cache; // cached translation pages, key: translation page
+	struct bitmap *dirty; // cached translation page is updated
+	int batch_num;
+	unsigned int batch_page[FTL_MAP_BATCH_NUM];
+	unsigned char *batch; // evicted dirty translation pages not yet written
+	struct ftl_wp wp;
+};
+
+
+struct ftl_stat {
+	unsigned long long host_read;
+	unsigned long long host_write;
+	unsigned long long host_trim;
+	unsigned long long flush;
+	unsigned long long nand_read;
+	unsigned long long nand_write;
+	unsigned long long erase;
+	unsigned long long gc;
+	unsigned long long gc_move;
+	unsigned long long gc_time; // nand time of GC in ns
+	unsigned long long wl; // static wear leveling of a block
+	unsigned long long wl_move;
+	unsigned long long reclaim; // closed block without valid page freed at once
+	unsigned long long map_hit;
+	unsigned long long map_miss;
+	unsigned long long map_batch; // miss served by write batch
+	unsigned long long map_read; // translation page read
+	unsigned long long map_write; // translation page write
+	unsigned long long stream_write[FTL_STREAM_MAX];
+	unsigned long long mount_page; // spare read by mount scan
+	unsigned long long mount_time; // simulated time of mount scan in ns
+};
+
+
+struct ftl {
+	struct nand_base *nand;
+	int page_num_per_block;
+	int block_num;
+	int bad_num;
+	int op_ratio; // over-provisioning percent of good blocks
+	int gc_threshold; // free blocks kept for GC
+	unsigned int lba_num;
+	unsigned int *l2p; // all in memory mapping table, NULL for demand paged
+	struct ftl_map *map; // demand-paged mapping table, NULL for all in memory
+	struct bitmap *valid; // valid physical page
+	struct ftl_block *block;
+	struct heap *free; // free blocks, least worn first
+	struct heap *closed; // closed blocks, least worn holds cold data
+	unsigned long long pe_sum; // PE cycle of good blocks
+	int wl_threshold; // average PE cycle over the least worn to start static wear leveling
+	int stream_num;
+	struct ftl_wp stream[FTL_STREAM_MAX]; // host write points, hotter data on higher stream
+	struct sketch *sketch; // update frequency of lba
+	struct ftl_wp gc;
+	struct ftl_wp wl; // block of cold data being migrated, page to check
+	struct gc_index *gc_index; // victim of closed blocks
+	unsigned char *buf; // page and spare
+	unsigned char *oob; // spare to program
+	unsigned int seq; // sequence number of next program
+	unsigned long long start; // nand clock after create
+	struct ftl_stat stat;
+};
+
+
+/*
+ * ftl_create - create page mapping FTL on a nand, all data are discarded
+ * @nand: created nand_base object
+ * @op_ratio: over-provisioning percent of good blocks, 1 ~ 90
+ * @map_cache: cached translation pages of demand-paged mapping table,
+ *             zero to keep all mapping table in memory
+ * @stream_num: open host write blocks, 1 ~ FTL_STREAM_MAX, data of
+ *              similar update frequency goes to the same block
+ *
+ * Returns ftl object if success, otherwise NULL
+ */
+struct ftl *ftl_create(struct nand_base *nand, int op_ratio, int map_cache, int stream_num);
+
+
+/*
+ * ftl_mount - create FTL on a nand programmed by FTL before, mapping is
+ *             rebuilt from spare area: the page of largest sequence number
+ *             of a lba is valid; trim is not persisted, trimmed sector may
+ *             come back; partial written blocks are closed
+ * @nand: created nand_base object
+ * @op_ratio: same as ftl_create
+ * @map_cache: same as ftl_create
+ * @stream_num: same as ftl_create
+ * @thread_num: threads to scan spare area, 1 ~ FTL_SCAN_THREAD_MAX
+ *
+ * Returns ftl object if success, otherwise NULL
+ */
+struct ftl *ftl_mount(struct nand_base *nand, int op_ratio, int map_cache, int stream_num,
+						int thread_num);
+
+
+/*
+ * ftl_read - read logical sectors
+ * @ftl: ftl object
+ * @lba: first logical sector
+ * @num: sector number
+ * @data: num * page_size buffer, unwritten sector is filled with zero
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int ftl_read(struct ftl *ftl, unsigned int lba, int num, void *data);
+
+
+/*
+ * ftl_write - write logical sectors
+ * @ftl: ftl object
+ * @lba: first logical sector
+ * @num: sector number
+ * @data: num * page_size buffer
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int ftl_write(struct ftl *ftl, unsigned int lba, int num, void *data);
+
+
+/*
+ * ftl_write_stream - write logical sectors with host stream hint
+ * @ftl: ftl object
+ * @lba: first logical sector
+ * @num: sector number
+ * @data: num * page_size buffer
+ * @stream: 0 ~ stream_num - 1, higher for hotter data,
+ *          FTL_STREAM_AUTO to classify by update frequency
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int ftl_write_stream(struct ftl *ftl, unsigned int lba, int num, void *data, int stream);
+
+
+/*
+ * ftl_trim - discard logical sectors, a closed block left without valid
+ *            page goes back to free blocks and its nand storage is released
+ * @ftl: ftl object
+ * @lba: first logical sector
+ * @num: sector number
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int ftl_trim(struct ftl *ftl, unsigned int lba, int num);
+
+
+/*
+ * ftl_flush - make written sectors durable, the nand writes back its
+ *             storage; mapping needs no flush, it is rebuilt from spare
+ *             at mount
+ * @ftl: ftl object
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int ftl_flush(struct ftl *ftl);
+
+
+/*
+ * ftl_gc_policy - select GC victim policy
+ * @ftl: ftl object
+ * @policy: enum gc_policy
+ * @window: window of GC_WINDOWED, zero for default
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int ftl_gc_policy(struct ftl *ftl, int policy, int window);
+
+
+/*
+ * ftl_wl_threshold - set static wear leveling threshold
+ * @ftl: ftl object
+ * @threshold: average PE cycle minus the least worn closed block to migrate
+ *             its cold data, zero to disable
+ */
+void ftl_wl_threshold(struct ftl *ftl, int threshold);
+
+
+/*
+ * ftl_waf - write amplification factor
+ * @ftl: ftl object
+ *
+ * Returns nand page write / host sector write
+ */
+double ftl_waf(struct ftl *ftl);
+
+
+/*
+ * ftl_dump - print statistics of ftl
+ * @ftl: ftl object
+ * @fp: output file
+ */
+void ftl_dump(struct ftl *ftl, FILE *fp);
+
+
+/*
+ * ftl_delete - destory the ftl, mapping is not persisted
+ * @ftl: ftl object
+ */
+void ftl_delete(struct ftl *ftl);
+
+#endif // __FTL_H__
@@ -0,0 +1,194 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "common.h"
+#include "gc.h"
+
+
+static char *gc_policy_name[GC_POLICY_NUM] = {
+	"greedy",
+	"cost-benefit",
+	"windowed",
+};
+
+
+struct gc_index *gc_create(int block_num, int page_num_per_block, int policy, int window)
+{
+	int i;
+	struct gc_index *gc;
+
+	if (block_num <= 0 || page_num_per_block <= 0 || policy < 0 || policy >= GC_POLICY_NUM)
+		return NULL;
+
+	gc = mem_alloc(sizeof(struct gc_index));
+	gc->policy = policy;
+	gc->window = window > 0 ? window : GC_DEFAULT_WINDOW;
+	gc->block_num = block_num;
+	gc->page_num_per_block = page_num_per_block;
+	gc->min = page_num_per_block + 1;
+	gc->head = gc->tail = -1;
+	gc->node = mem_alloc(block_num * sizeof(struct gc_node));
+	for (i = 0; i < block_num; i++) {
+		gc->node[i].valid = -1;
+		gc->node[i].hnode.index = HEAP_INVALID_INDEX;
+	}
+	gc->bucket = mem_alloc((page_num_per_block + 1) * sizeof(struct heap *));
+	for (i = 0; i <= page_num_per_block; i++)
+		gc->bucket[i] = heap_create(16);
+	LOG(LOG_WARN, "gc policy: %s", gc_policy_name[policy]);
+	return gc;
+}
+
+
+void gc_insert(struct gc_index *gc, int block, int valid, unsigned long long time)
+{
+	struct gc_node *node = &gc->node[block];
+
+	ASSERT(node->valid < 0 && valid >= 0 && valid <= gc->page_num_per_block);
+	node->valid = valid;
+	node->hnode.key = time;
+	heap_push(gc->bucket[valid], &node->hnode);
+	gc->min = MIN(gc->min, valid);
+
+	/* close order */
+	node->next = -1;
+	node->prev = gc->tail;
+	if (gc->tail >= 0)
+		gc->node[gc->tail].next = block;
+	else
+		gc->head = block;
+	gc->tail = block;
+	gc->num++;
+}
+
+
+void gc_update(struct gc_index *gc, int block, int valid)
+{
+	struct gc_node *node = &gc->node[block];
+
+	if (node->valid < 0 || node->valid == valid)
+		return;
+	heap_remove(gc->bucket[node->valid], &node->hnode);
+	node->valid = valid;
+	heap_push(gc->bucket[valid], &node->hnode);
+	gc->min = MIN(gc->min, valid);
+}
+
+
+void gc_remove(struct gc_index *gc, int block)
+{
+	struct gc_node *node = &gc->node[block];
+
+	if (node->valid < 0)
+		return;
+	heap_remove(gc->bucket[node->valid], &node->hnode);
+	node->valid = -1;
+
+	if (node->prev >= 0)
+		gc->node[node->prev].next = node->next;
+	else
+		gc->head = node->next;
+	if (node->next >= 0)
+		gc->node[node->next].prev = node->prev;
+	else
+		gc->tail = node->prev;
+	gc->num--;
+}
+
+
+static int gc_greedy(struct gc_index *gc)
+{
+	while (gc->min <= gc->page_num_per_block && !gc->bucket[gc->min]->num)
+		gc->min++;
+	if (gc->min > gc->page_num_per_block)
+		return -1;
+	return container_of(heap_top(gc->bucket[gc->min]), struct gc_node, hnode) - gc->node;
+}
+
+
+/* oldest block of each bucket has the best score of the bucket */
+static int gc_cost_benefit(struct gc_index *gc, unsigned long long now)
+{
+	int v, victim;
+	double score, best;
+	struct heap_node *top;
+
+	victim = -1;
+	best = -1.0;
+	for (v = gc->min; v < gc->page_num_per_block; v++) {
+		top = heap_top(gc->bucket[v]);
+		if (!top)
+			continue;
+		score = (double)(gc->page_num_per_block - v) * (now - top->key + 1) /
+					(gc->page_num_per_block + v);
+		if (score > best) {
+			best = score;
+			victim = container_of(top, struct gc_node, hnode) - gc->node;
+		}
+	}
+	return victim;
+}
+
+
+/* greedy of all blocks if nothing is reclaimable in window, e.g. cold blocks */
+static int gc_windowed(struct gc_index *gc)
+{
+	int i, block, victim;
+
+	victim = -1;
+	for (i = 0, block = gc->head; i < gc->window && block >= 0;
+			i++, block = gc->node[block].next) {
+		if (victim < 0 || gc->node[block].valid < gc->node[victim].valid)
+			victim = block;
+	}
+	if (victim < 0 || gc->node[victim].valid == gc->page_num_per_block)
+		return gc_greedy(gc);
+	return victim;
+}
+
+
+int gc_victim(struct gc_index *gc, unsigned long long now)
+{
+	if (!gc->num)
+		return -1;
+
+	switch (gc->policy) {
+	case GC_GREEDY:
+		return gc_greedy(gc);
+	case GC_COST_BENEFIT:
+		return gc_cost_benefit(gc, now);
+	case GC_WINDOWED:
+		return gc_windowed(gc);
+	default:
+		ASSERT(0);
+	}
+	return -1;
+}
+
+
+void gc_delete(struct gc_index *gc)
+{
+	int i;
+
+	for (i = 0; i <= gc->page_num_per_block; i++)
+		heap_delete(gc->bucket[i]);
+	mem_free(gc->bucket);
+	mem_free(gc->node);
+	mem_free(gc);
+}
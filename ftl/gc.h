@@ -0,0 +1,124 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GC_H__
+#define __GC_H__
+
+#include "heap.h"
+
+#define GC_DEFAULT_WINDOW				16
+
+
+/*
+ * greedy: least valid pages, oldest first on tie
+ * cost-benefit: max (1 - u) * age / (1 + u), u is valid ratio
+ * windowed: least valid pages in the oldest window of closed blocks
+ */
+enum gc_policy {
+	GC_GREEDY,
+	GC_COST_BENEFIT,
+	GC_WINDOWED,
+	GC_POLICY_NUM
+};
+
+
+/* closed block, node of a valid count bucket and of the close order list */
+struct gc_node {
+	struct heap_node hnode; // key: close time
+	int prev;
+	int next;
+	int valid; // -1 if not indexed
+};
+
+
+/*
+ * every bucket of valid count is a heap of close time, its top is the
+ * oldest block, so victim is found by looking at bucket tops only
+ */
+struct gc_index {
+	int policy;
+	int window;
+	int block_num;
+	int page_num_per_block;
+	int num;
+	int min; // no block has less valid pages
+	int head; // oldest closed block
+	int tail;
+	struct gc_node *node;
+	struct heap **bucket;
+};
+
+
+/*
+ * gc_create - create victim index of closed blocks
+ * @block_num: block number
+ * @page_num_per_block: page number of a block
+ * @policy: enum gc_policy
+ * @window: block number of GC_WINDOWED window
+ *
+ * Returns gc index if success, otherwise NULL
+ */
+struct gc_index *gc_create(int block_num, int page_num_per_block, int policy, int window);
+
+
+/*
+ * gc_insert - index a closed block
+ * @gc: gc index
+ * @block: block number
+ * @valid: valid page number
+ * @time: close time, increased with every close
+ */
+void gc_insert(struct gc_index *gc, int block, int valid, unsigned long long time);
+
+
+/*
+ * gc_update - valid page number of an indexed block is changed
+ * @gc: gc index
+ * @block: block number
+ * @valid: new valid page number
+ */
+void gc_update(struct gc_index *gc, int block, int valid);
+
+
+/*
+ * gc_remove - remove a block from index
+ * @gc: gc index
+ * @block: block number
+ */
+void gc_remove(struct gc_index *gc, int block);
+
+
+/*
+ * gc_victim - select victim by policy, block is kept in index
+ * @gc: gc index
+ * @now: current time of close time
+ *
+ * Returns victim block, -1 for none
+ */
+int gc_victim(struct gc_index *gc, unsigned long long now);
+
+
+/*
+ * gc_delete - destory gc index
+ * @gc: gc index
+ */
+void gc_delete(struct gc_index *gc);
+
+#endif // __GC_H__
@@ -0,0 +1,628 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "common.h"
+#include "nbd.h"
+
+#define NBD_MAGIC						0x4e42444d41474943ULL // "NBDMAGIC"
+#define NBD_OPT_MAGIC					0x49484156454f5054ULL // "IHAVEOPT"
+#define NBD_REP_MAGIC					0x3e889045565a9ULL
+#define NBD_REQUEST_MAGIC				0x25609513
+#define NBD_REPLY_MAGIC					0x67446698
+
+#define NBD_FLAG_FIXED_NEWSTYLE			(1 << 0)
+#define NBD_FLAG_NO_ZEROES				(1 << 1)
+
+#define NBD_FLAG_HAS_FLAGS				(1 << 0)
+#define NBD_FLAG_SEND_FLUSH				(1 << 2)
+#define NBD_FLAG_SEND_FUA				(1 << 3)
+#define NBD_FLAG_SEND_TRIM				(1 << 5)
+#define NBD_TRANS_FLAGS					(NBD_FLAG_HAS_FLAGS | NBD_FLAG_SEND_FLUSH | \
+										 NBD_FLAG_SEND_FUA | NBD_FLAG_SEND_TRIM)
+
+#define NBD_OPT_EXPORT_NAME				1
+#define NBD_OPT_ABORT					2
+#define NBD_OPT_LIST					3
+#define NBD_OPT_INFO					6
+#define NBD_OPT_GO						7
+#define NBD_OPT_LEN_MAX					4096
+
+#define NBD_REP_ACK						1
+#define NBD_REP_SERVER					2
+#define NBD_REP_INFO					3
+#define NBD_REP_ERR_UNSUP				0x80000001
+#define NBD_REP_ERR_INVALID				0x80000003
+
+#define NBD_INFO_EXPORT					0
+#define NBD_INFO_BLOCK_SIZE				3
+
+#define NBD_EIO							5
+#define NBD_EINVAL						22
+
+#define NBD_REQUEST_SIZE				28
+#define NBD_REPLY_SIZE					16
+
+
+static void nbd_put16(unsigned char *p, unsigned short v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+
+static void nbd_put32(unsigned char *p, unsigned int v)
+{
+	nbd_put16(p, v >> 16);
+	nbd_put16(p + 2, v);
+}
+
+
+static void nbd_put64(unsigned char *p, unsigned long long v)
+{
+	nbd_put32(p, v >> 32);
+	nbd_put32(p + 4, v);
+}
+
+
+static unsigned short nbd_get16(const unsigned char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+
+static unsigned int nbd_get32(const unsigned char *p)
+{
+	return ((unsigned int)nbd_get16(p) << 16) | nbd_get16(p + 2);
+}
+
+
+static unsigned long long nbd_get64(const unsigned char *p)
+{
+	return ((unsigned long long)nbd_get32(p) << 32) | nbd_get32(p + 4);
+}
+
+
+static int nbd_recv(int fd, void *buf, unsigned int len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = recv(fd, p, len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+
+static int nbd_send(int fd, const void *buf, unsigned int len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+
+static int nbd_opt_reply(struct nbd *nbd, unsigned int opt, unsigned int type,
+						const void *data, unsigned int len)
+{
+	unsigned char hdr[20];
+
+	nbd_put64(hdr, NBD_REP_MAGIC);
+	nbd_put32(hdr + 8, opt);
+	nbd_put32(hdr + 12, type);
+	nbd_put32(hdr + 16, len);
+	if (nbd_send(nbd->fd, hdr, sizeof(hdr)))
+		return -1;
+	return len ? nbd_send(nbd->fd, data, len) : 0;
+}
+
+
+/*
+ * NBD_OPT_INFO and NBD_OPT_GO, info requests of client are ignored
+ * Returns 1 if export is replied, 0 if option is invalid, negative on error
+ */
+static int nbd_opt_info(struct nbd *nbd, unsigned int opt, const unsigned char *data,
+						unsigned int len)
+{
+	unsigned char info[14];
+	unsigned int name_len;
+
+	if (len < 6 || (name_len = nbd_get32(data)) > len - 6 ||
+		len != name_len + 6 + nbd_get16(data + 4 + name_len) * 2)
+		return nbd_opt_reply(nbd, opt, NBD_REP_ERR_INVALID, NULL, 0) ? -1 : 0;
+
+	nbd_put16(info, NBD_INFO_EXPORT);
+	nbd_put64(info + 2, nbd->size);
+	nbd_put16(info + 10, NBD_TRANS_FLAGS);
+	if (nbd_opt_reply(nbd, opt, NBD_REP_INFO, info, 12))
+		return -1;
+
+	/* any alignment is served by read-modify-write */
+	nbd_put16(info, NBD_INFO_BLOCK_SIZE);
+	nbd_put32(info + 2, 1);
+	nbd_put32(info + 6, nbd->page_size);
+	nbd_put32(info + 10, NBD_REQ_MAX);
+	if (nbd_opt_reply(nbd, opt, NBD_REP_INFO, info, 14))
+		return -1;
+	return nbd_opt_reply(nbd, opt, NBD_REP_ACK, NULL, 0) ? -1 : 1;
+}
+
+
+/*
+ * fixed newstyle negotiation
+ * Returns 1 to enter transmission, 0 if client aborts, negative on error
+ */
+static int nbd_handshake(struct nbd *nbd)
+{
+	unsigned char buf[NBD_OPT_LEN_MAX + 134];
+	unsigned int client_flags, opt, len;
+	int ret, name_len = strlen(NBD_EXPORT_NAME);
+
+	nbd_put64(buf, NBD_MAGIC);
+	nbd_put64(buf + 8, NBD_OPT_MAGIC);
+	nbd_put16(buf + 16, NBD_FLAG_FIXED_NEWSTYLE | NBD_FLAG_NO_ZEROES);
+	if (nbd_send(nbd->fd, buf, 18) || nbd_recv(nbd->fd, buf, 4))
+		return -1;
+	client_flags = nbd_get32(buf);
+
+	while (1) {
+		if (nbd_recv(nbd->fd, buf, 16) || nbd_get64(buf) != NBD_OPT_MAGIC)
+			return -1;
+		opt = nbd_get32(buf + 8);
+		len = nbd_get32(buf + 12);
+		if (len > NBD_OPT_LEN_MAX) {
+			LOG(LOG_ERR, "option %u too long: %u", opt, len);
+			return -1;
+		}
+		if (nbd_recv(nbd->fd, buf, len))
+			return -1;
+
+		switch (opt) {
+		case NBD_OPT_EXPORT_NAME:
+			/* no reply header, no way to report error */
+			nbd_put64(buf, nbd->size);
+			nbd_put16(buf + 8, NBD_TRANS_FLAGS);
+			memset(buf + 10, 0, 124);
+			len = client_flags & NBD_FLAG_NO_ZEROES ? 10 : 134;
+			return nbd_send(nbd->fd, buf, len) ? -1 : 1;
+		case NBD_OPT_ABORT:
+			nbd_opt_reply(nbd, opt, NBD_REP_ACK, NULL, 0);
+			return 0;
+		case NBD_OPT_LIST:
+			nbd_put32(buf, name_len);
+			memcpy(buf + 4, NBD_EXPORT_NAME, name_len);
+			if (nbd_opt_reply(nbd, opt, NBD_REP_SERVER, buf, 4 + name_len) ||
+				nbd_opt_reply(nbd, opt, NBD_REP_ACK, NULL, 0))
+				return -1;
+			break;
+		case NBD_OPT_INFO:
+		case NBD_OPT_GO:
+			ret = nbd_opt_info(nbd, opt, buf, len);
+			if (ret < 0 || (ret && opt == NBD_OPT_GO))
+				return ret;
+			break;
+		default:
+			if (nbd_opt_reply(nbd, opt, NBD_REP_ERR_UNSUP, NULL, 0))
+				return -1;
+			break;
+		}
+	}
+}
+
+
+static struct nbd_req *nbd_req_get(struct nbd *nbd)
+{
+	struct nbd_req *req;
+
+	pthread_mutex_lock(&nbd->lock);
+	while (!nbd->free)
+		pthread_cond_wait(&nbd->free_cond, &nbd->lock);
+	req = nbd->free;
+	nbd->free = req->next;
+	nbd->inflight++;
+	nbd->stat.max_inflight = MAX(nbd->stat.max_inflight, nbd->inflight);
+	pthread_mutex_unlock(&nbd->lock);
+	return req;
+}
+
+
+static void nbd_req_put(struct nbd *nbd, struct nbd_req *req)
+{
+	pthread_mutex_lock(&nbd->lock);
+	req->next = nbd->free;
+	nbd->free = req;
+	nbd->inflight--;
+	pthread_cond_broadcast(&nbd->free_cond);
+	pthread_mutex_unlock(&nbd->lock);
+}
+
+
+static void nbd_req_queue(struct nbd *nbd, struct nbd_req *req)
+{
+	pthread_mutex_lock(&nbd->lock);
+	req->next = NULL;
+	if (nbd->tail)
+		nbd->tail->next = req;
+	else
+		nbd->head = req;
+	nbd->tail = req;
+	pthread_cond_signal(&nbd->queue_cond);
+	pthread_mutex_unlock(&nbd->lock);
+}
+
+
+/* read or write byte range, partial pages go through nbd->page */
+static int nbd_rw(struct nbd *nbd, struct nbd_req *req, bool write)
+{
+	struct ftl *ftl = nbd->ftl;
+	unsigned long long offset = req->offset;
+	unsigned int remain = req->length;
+	unsigned int lba, in, len;
+	unsigned char *buf = req->data;
+	int ret;
+
+	while (remain) {
+		lba = offset / nbd->page_size;
+		in = offset % nbd->page_size;
+		if (in || remain < nbd->page_size) {
+			len = MIN(nbd->page_size - in, remain);
+			ret = ftl_read(ftl, lba, 1, nbd->page);
+			if (!ret && write) {
+				memcpy(nbd->page + in, buf, len);
+				ret = ftl_write(ftl, lba, 1, nbd->page);
+				nbd->stat.rmw++;
+			} else if (!ret) {
+				memcpy(buf, nbd->page + in, len);
+			}
+		} else {
+			len = remain / nbd->page_size * nbd->page_size;
+			if (write)
+				ret = ftl_write(ftl, lba, len / nbd->page_size, buf);
+			else
+				ret = ftl_read(ftl, lba, len / nbd->page_size, buf);
+		}
+		if (ret)
+			return NBD_EIO;
+		offset += len;
+		buf += len;
+		remain -= len;
+	}
+	return 0;
+}
+
+
+/* only whole pages in range are discarded, the rest keeps old data */
+static int nbd_trim(struct nbd *nbd, struct nbd_req *req)
+{
+	unsigned long long first, end;
+
+	first = (req->offset + nbd->page_size - 1) / nbd->page_size;
+	end = (req->offset + req->length) / nbd->page_size;
+	if (end <= first)
+		return 0;
+	return ftl_trim(nbd->ftl, first, end - first) ? NBD_EIO : 0;
+}
+
+
+/* flush, or write durable before reply */
+static bool nbd_durable(struct nbd_req *req)
+{
+	return req->type == NBD_CMD_FLUSH ||
+			(req->type == NBD_CMD_WRITE && (req->flags & NBD_CMD_FLAG_FUA));
+}
+
+
+/* Returns NBD error of request, flush of a durable request is left to the batch */
+static int nbd_exec(struct nbd *nbd, struct nbd_req *req)
+{
+	int ret;
+
+	if (req->offset > nbd->size || req->length > nbd->size - req->offset)
+		return NBD_EINVAL;
+
+	switch (req->type) {
+	case NBD_CMD_READ:
+	case NBD_CMD_WRITE:
+	case NBD_CMD_TRIM:
+		break;
+	case NBD_CMD_FLUSH:
+		break;
+	default:
+		return NBD_EINVAL;
+	}
+
+	if (req->type == NBD_CMD_FLUSH) {
+		ret = 0;
+	} else if (req->type == NBD_CMD_TRIM) {
+		ret = nbd_trim(nbd, req);
+		nbd->stat.trim_bytes += req->length;
+	} else if (req->type == NBD_CMD_WRITE) {
+		ret = nbd_rw(nbd, req, TRUE);
+		nbd->stat.write_bytes += req->length;
+		if (req->flags & NBD_CMD_FLAG_FUA)
+			nbd->stat.fua++;
+	} else {
+		ret = nbd_rw(nbd, req, FALSE);
+		nbd->stat.read_bytes += req->length;
+	}
+	return ret;
+}
+
+
+static void nbd_reply(struct nbd *nbd, struct nbd_req *req, int error)
+{
+	unsigned char hdr[NBD_REPLY_SIZE];
+
+	nbd_put32(hdr, NBD_REPLY_MAGIC);
+	nbd_put32(hdr + 4, error);
+	nbd_put64(hdr + 8, req->handle);
+
+	/* send error is found by reader of the same connection */
+	if (error)
+		nbd->stat.error++;
+	if (!nbd_send(nbd->fd, hdr, sizeof(hdr)) && !error && req->type == NBD_CMD_READ)
+		nbd_send(nbd->fd, req->data, req->length);
+}
+
+
+/*
+ * the worker takes all queued requests as a batch, flush and FUA writes of
+ * a batch wait for one ftl_flush of block cache and warm tier below the
+ * FTL, the others are replied once done
+ */
+static void *nbd_worker(void *arg)
+{
+	struct nbd *nbd = arg;
+	struct nbd_req *req, *batch, *durable, **tail;
+	int ret;
+
+	while (1) {
+		pthread_mutex_lock(&nbd->lock);
+		while (!nbd->head && !nbd->stop)
+			pthread_cond_wait(&nbd->queue_cond, &nbd->lock);
+		batch = nbd->head;
+		nbd->head = nbd->tail = NULL;
+		pthread_mutex_unlock(&nbd->lock);
+		if (!batch)
+			break;
+
+		durable = NULL;
+		tail = &durable;
+		while (batch) {
+			req = batch;
+			batch = req->next;
+			ret = nbd_exec(nbd, req);
+			if (!ret && nbd_durable(req)) {
+				*tail = req;
+				tail = &req->next;
+				continue;
+			}
+			nbd_reply(nbd, req, ret);
+			nbd_req_put(nbd, req);
+		}
+		*tail = NULL;
+		if (!durable)
+			continue;
+
+		ret = ftl_flush(nbd->ftl) ? NBD_EIO : 0;
+		nbd->stat.flush++;
+		while (durable) {
+			req = durable;
+			durable = req->next;
+			nbd_reply(nbd, req, ret);
+			nbd_req_put(nbd, req);
+		}
+	}
+	return NULL;
+}
+
+
+/* Returns 1 to queue the request, 0 for disconnect, negative on error */
+static int nbd_recv_req(struct nbd *nbd, struct nbd_req *req)
+{
+	unsigned char hdr[NBD_REQUEST_SIZE];
+
+	if (nbd_recv(nbd->fd, hdr, sizeof(hdr)))
+		return -1;
+	if (nbd_get32(hdr) != NBD_REQUEST_MAGIC) {
+		LOG(LOG_ERR, "bad request magic 0x%x", nbd_get32(hdr));
+		return -1;
+	}
+	req->flags = nbd_get16(hdr + 4);
+	req->type = nbd_get16(hdr + 6);
+	req->handle = nbd_get64(hdr + 8);
+	req->offset = nbd_get64(hdr + 16);
+	req->length = nbd_get32(hdr + 24);
+	if (req->type < NBD_CMD_NUM)
+		nbd->stat.cmd[req->type]++;
+	if (req->type == NBD_CMD_DISC)
+		return 0;
+	if (req->type != NBD_CMD_READ && req->type != NBD_CMD_WRITE)
+		return 1;
+
+	if (req->length > NBD_REQ_MAX) {
+		LOG(LOG_ERR, "request too long: %u", req->length);
+		return -1;
+	}
+	if (req->size < req->length) {
+		mem_free(req->data);
+		req->size = MAX(req->length, nbd->page_size);
+		req->data = mem_alloc(req->size);
+	}
+	if (req->type == NBD_CMD_WRITE && nbd_recv(nbd->fd, req->data, req->length))
+		return -1;
+	return 1;
+}
+
+
+int nbd_serve(struct nbd *nbd)
+{
+	struct nbd_req *req;
+	int ret;
+
+	nbd->fd = accept(nbd->listen_fd, NULL, NULL);
+	if (nbd->fd < 0) {
+		LOG(LOG_ERR, "accept fail: %d", errno);
+		return -1;
+	}
+
+	ret = nbd_handshake(nbd);
+	while (ret > 0) {
+		req = nbd_req_get(nbd);
+		ret = nbd_recv_req(nbd, req);
+		if (ret > 0)
+			nbd_req_queue(nbd, req);
+		else
+			nbd_req_put(nbd, req);
+	}
+
+	/* replies of queued requests go out before close */
+	pthread_mutex_lock(&nbd->lock);
+	while (nbd->inflight)
+		pthread_cond_wait(&nbd->free_cond, &nbd->lock);
+	pthread_mutex_unlock(&nbd->lock);
+	close(nbd->fd);
+	nbd->fd = -1;
+	return ret;
+}
+
+
+static void nbd_free(struct nbd *nbd)
+{
+	int i;
+
+	close(nbd->listen_fd);
+	unlink(nbd->path);
+	for (i = 0; i < NBD_QUEUE_DEPTH; i++)
+		mem_free(nbd->req[i].data);
+	pthread_mutex_destroy(&nbd->lock);
+	pthread_cond_destroy(&nbd->queue_cond);
+	pthread_cond_destroy(&nbd->free_cond);
+	mem_free(nbd->req);
+	mem_free(nbd->page);
+	mem_free(nbd->path);
+	mem_free(nbd);
+}
+
+
+struct nbd *nbd_create(struct ftl *ftl, const char *path)
+{
+	struct nbd *nbd;
+	struct sockaddr_un addr;
+	int i;
+
+	if (!ftl || !path || strlen(path) >= sizeof(addr.sun_path)) {
+		LOG(LOG_ERR, "invalid parameter");
+		return NULL;
+	}
+
+	nbd = mem_alloc(sizeof(struct nbd));
+	nbd->ftl = ftl;
+	nbd->page_size = ftl->nand->page_size;
+	nbd->size = (unsigned long long)ftl->lba_num * nbd->page_size;
+	nbd->fd = -1;
+	nbd->path = mem_alloc(strlen(path) + 1);
+	strcpy(nbd->path, path);
+
+	nbd->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (nbd->listen_fd < 0) {
+		LOG(LOG_ERR, "socket fail: %d", errno);
+		goto free_nbd;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(nbd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+		listen(nbd->listen_fd, 1)) {
+		LOG(LOG_ERR, "listen on %s fail: %d", path, errno);
+		goto close_socket;
+	}
+
+	nbd->page = mem_alloc(nbd->page_size);
+	nbd->req = mem_alloc(NBD_QUEUE_DEPTH * sizeof(struct nbd_req));
+	for (i = 0; i < NBD_QUEUE_DEPTH; i++) {
+		nbd->req[i].next = nbd->free;
+		nbd->free = &nbd->req[i];
+	}
+	pthread_mutex_init(&nbd->lock, NULL);
+	pthread_cond_init(&nbd->queue_cond, NULL);
+	pthread_cond_init(&nbd->free_cond, NULL);
+
+	if (pthread_create(&nbd->worker, NULL, nbd_worker, nbd)) {
+		LOG(LOG_ERR, "create worker fail");
+		nbd_free(nbd);
+		return NULL;
+	}
+	return nbd;
+
+close_socket:
+	close(nbd->listen_fd);
+free_nbd:
+	mem_free(nbd->path);
+	mem_free(nbd);
+	return NULL;
+}
+
+
+void nbd_dump(struct nbd *nbd, FILE *fp)
+{
+	struct nbd_stat *stat = &nbd->stat;
+
+	fprintf(fp, "nbd export: %llu bytes\n", nbd->size);
+	fprintf(fp, "nbd read: %llu write: %llu trim: %llu flush: %llu error: %llu\n",
+				stat->cmd[NBD_CMD_READ], stat->cmd[NBD_CMD_WRITE], stat->cmd[NBD_CMD_TRIM],
+				stat->cmd[NBD_CMD_FLUSH], stat->error);
+	fprintf(fp, "nbd bytes read: %llu write: %llu trim: %llu rmw page: %llu fua: %llu\n",
+				stat->read_bytes, stat->write_bytes, stat->trim_bytes, stat->rmw, stat->fua);
+	fprintf(fp, "nbd ftl flush: %llu for %llu flush and fua\n", stat->flush,
+				stat->cmd[NBD_CMD_FLUSH] + stat->fua);
+	fprintf(fp, "nbd max inflight: %d\n", stat->max_inflight);
+}
+
+
+void nbd_delete(struct nbd *nbd)
+{
+	pthread_mutex_lock(&nbd->lock);
+	nbd->stop = TRUE;
+	pthread_cond_broadcast(&nbd->queue_cond);
+	pthread_mutex_unlock(&nbd->lock);
+	pthread_join(nbd->worker, NULL);
+	nbd_free(nbd);
+}
@@ -0,0 +1,134 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NBD_H__
+#define __NBD_H__
+
+#include <pthread.h>
+#include "ftl.h"
+
+/*
+ * NBD server exposing the FTL as a block device over a Unix socket,
+ * e.g. "nbd-client -unix <path> /dev/nbd0 -b 4096"
+ *
+ * fixed newstyle handshake and simple replies only; a reader thread
+ * receives requests into a queue, one worker serves them and sends replies
+ * out of order, so socket receive overlaps with the simulator
+ */
+#define NBD_EXPORT_NAME					"beansim"
+#define NBD_QUEUE_DEPTH					64 // requests in flight
+#define NBD_REQ_MAX						(32 << 20) // max bytes of a request
+
+#define NBD_CMD_READ					0
+#define NBD_CMD_WRITE					1
+#define NBD_CMD_DISC					2
+#define NBD_CMD_FLUSH					3
+#define NBD_CMD_TRIM					4
+#define NBD_CMD_NUM						5
+
+#define NBD_CMD_FLAG_FUA				(1 << 0) // write is flushed before reply
+
+
+struct nbd_req {
+	struct nbd_req *next;
+	unsigned short flags;
+	unsigned short type;
+	unsigned long long handle;
+	unsigned long long offset;
+	unsigned int length;
+	unsigned int size; // bytes of data buffer
+	unsigned char *data;
+};
+
+
+struct nbd_stat {
+	unsigned long long cmd[NBD_CMD_NUM];
+	unsigned long long read_bytes;
+	unsigned long long write_bytes;
+	unsigned long long trim_bytes;
+	unsigned long long rmw; // partial page written by read-modify-write
+	unsigned long long fua; // write flushed before reply
+	unsigned long long flush; // ftl_flush shared by flush and FUA requests of a batch
+	unsigned long long error;
+	int max_inflight;
+};
+
+
+/*
+ * FTL is single-threaded: only the worker calls it and sends replies, the
+ * reader thread receives requests; more workers would only queue up on it
+ */
+struct nbd {
+	struct ftl *ftl;
+	unsigned long long size; // export bytes
+	unsigned int page_size;
+	int listen_fd;
+	int fd; // connection, -1 for none
+	char *path;
+	pthread_t worker;
+	pthread_mutex_t lock; // queue and free list
+	pthread_cond_t queue_cond; // request queued or stop
+	pthread_cond_t free_cond; // request freed
+	struct nbd_req *head;
+	struct nbd_req *tail;
+	struct nbd_req *req; // NBD_QUEUE_DEPTH requests
+	struct nbd_req *free;
+	int inflight;
+	bool stop;
+	unsigned char *page; // read-modify-write of partial page by the worker
+	struct nbd_stat stat;
+};
+
+
+/*
+ * nbd_create - create NBD server listening on a Unix socket
+ * @ftl: created ftl object, the export size is lba_num * page_size
+ * @path: socket path, an existing file is removed
+ *
+ * Returns nbd object if success, otherwise NULL
+ */
+struct nbd *nbd_create(struct ftl *ftl, const char *path);
+
+
+/*
+ * nbd_serve - accept a client and serve it until disconnect
+ * @nbd: nbd object
+ *
+ * Returns zero if client disconnects by NBD_CMD_DISC or option abort,
+ * otherwise non-zero
+ */
+int nbd_serve(struct nbd *nbd);
+
+
+/*
+ * nbd_dump - print statistics of nbd server
+ * @nbd: nbd object
+ * @fp: output file
+ */
+void nbd_dump(struct nbd *nbd, FILE *fp);
+
+
+/*
+ * nbd_delete - stop workers and destory the nbd server
+ * @nbd: nbd object
+ */
+void nbd_delete(struct nbd *nbd);
+
+#endif // __NBD_H__
@@ -31,6 +31,7 @@
 #include <assert.h> // for assert
 #include <stdbool.h>
 #include <string.h>
+#include <stddef.h> // for offsetof
 #include <dirent.h>
 #include <io.h>
 #include <unistd.h>
@@ -57,6 +58,9 @@
 
 #define roundup(x,n) (((x)+((n)-1))&(~((n)-1))) // power 2
 
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
 
 enum LOG_LEVEL {
 	LOG_ALL,
@@ -0,0 +1,330 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include "common.h"
+#include "arena.h"
+
+#define ARENA_CLASS_HUGE				ARENA_CLASS_NUM
+
+
+/* in front of every object, keeps the object 16 bytes aligned */
+struct arena_head {
+	unsigned int class;
+	unsigned int pad[3];
+};
+
+/* a free object, over the object itself */
+struct arena_node {
+	struct arena_node *next;
+};
+
+
+/* owned by one thread, counters are read by others */
+struct arena_thread {
+	struct arena_node *free[ARENA_CLASS_NUM];
+	unsigned int num[ARENA_CLASS_NUM];
+	char *bump;
+	char *bump_end;
+	struct arena_stat stat;
+	struct arena_thread *next;
+};
+
+
+/* objects given back by threads, shared by all */
+struct arena_depot {
+	pthread_mutex_t lock;
+	struct arena_node *free;
+} __attribute__((aligned(64)));
+
+
+static struct arena_depot arena_depot[ARENA_CLASS_NUM];
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER; // thread lists and retired
+static struct arena_thread *arena_thread_list;
+static struct arena_thread *arena_park_list; // of exited threads, with rest of bump area
+static struct arena_stat arena_retired; // of exited threads
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arena_key;
+static __thread struct arena_thread *arena_self;
+
+/* only the owner writes its counters */
+#define ARENA_COUNT(t, field, n) \
+	__atomic_store_n(&(t)->stat.field, (t)->stat.field + (n), __ATOMIC_RELAXED)
+
+
+static unsigned int arena_class(unsigned long long n)
+{
+	int k, q;
+
+	if (n <= 64)
+		return 0;
+	k = 63 - __builtin_clzll(n - 1);
+	q = (n - 1 - (1ULL << k)) >> (k - 2);
+	return MIN((k - 6) * 4 + q + 1, ARENA_CLASS_HUGE);
+}
+
+
+static unsigned long long arena_class_size(unsigned int class)
+{
+	int k, q;
+
+	if (!class)
+		return 64;
+	k = (class - 1) / 4 + 6;
+	q = (class - 1) % 4;
+	return (1ULL << k) + ((unsigned long long)(q + 1) << (k - 2));
+}
+
+
+/*
+ * free lists go to depot, counters to retired, the object with its bump
+ * area is parked for next thread, so exited threads lose nothing
+ */
+static void arena_thread_exit(void *arg)
+{
+	int i;
+	struct arena_thread *t = arg, **p;
+	struct arena_node *node, *next;
+
+	for (i = 0; i < ARENA_CLASS_NUM; i++) {
+		if (!t->free[i])
+			continue;
+		pthread_mutex_lock(&arena_depot[i].lock);
+		for (node = t->free[i]; node; node = next) {
+			next = node->next;
+			node->next = arena_depot[i].free;
+			__atomic_store_n(&arena_depot[i].free, node, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&arena_depot[i].lock);
+		ARENA_COUNT(t, depot, t->num[i]);
+	}
+
+	pthread_mutex_lock(&arena_lock);
+	for (p = &arena_thread_list; *p != t; p = &(*p)->next)
+		;
+	*p = t->next;
+	arena_retired.alloc += t->stat.alloc;
+	arena_retired.free += t->stat.free;
+	arena_retired.sys += t->stat.sys;
+	arena_retired.sys_bytes += t->stat.sys_bytes;
+	arena_retired.depot += t->stat.depot;
+	memset(t->free, 0, sizeof(t->free));
+	memset(t->num, 0, sizeof(t->num));
+	memset(&t->stat, 0, sizeof(t->stat));
+	t->next = arena_park_list;
+	arena_park_list = t;
+	pthread_mutex_unlock(&arena_lock);
+	arena_self = NULL;
+}
+
+
+static void arena_key_create(void)
+{
+	int i;
+
+	pthread_key_create(&arena_key, arena_thread_exit);
+	for (i = 0; i < ARENA_CLASS_NUM; i++)
+		pthread_mutex_init(&arena_depot[i].lock, NULL);
+}
+
+
+static struct arena_thread *arena_thread(void)
+{
+	struct arena_thread *t = arena_self;
+
+	if (t)
+		return t;
+	pthread_once(&arena_once, arena_key_create);
+	pthread_mutex_lock(&arena_lock);
+	t = arena_park_list;
+	if (t) {
+		arena_park_list = t->next;
+	} else {
+		t = calloc(1, sizeof(struct arena_thread));
+		ASSERT(t);
+		t->stat.sys = 1;
+		t->stat.sys_bytes = sizeof(struct arena_thread);
+	}
+	t->next = arena_thread_list;
+	arena_thread_list = t;
+	pthread_mutex_unlock(&arena_lock);
+	pthread_setspecific(arena_key, t);
+	arena_self = t;
+	return t;
+}
+
+
+/* take a batch, no more than half of what a thread may keep, at least one */
+static struct arena_node *arena_depot_take(struct arena_thread *t, unsigned int class)
+{
+	int n, max = MAX(MIN(ARENA_CACHE_SIZE / arena_class_size(class) / 2, ARENA_DEPOT_BATCH), 1);
+	struct arena_node *node, *last;
+	struct arena_depot *d = &arena_depot[class];
+
+	if (!__atomic_load_n(&d->free, __ATOMIC_RELAXED))
+		return NULL;
+	pthread_mutex_lock(&d->lock);
+	node = last = d->free;
+	for (n = 1; last && n < max && last->next; n++)
+		last = last->next;
+	if (node) {
+		__atomic_store_n(&d->free, last->next, __ATOMIC_RELAXED);
+		last->next = NULL;
+	}
+	pthread_mutex_unlock(&d->lock);
+	if (!node)
+		return NULL;
+
+	ARENA_COUNT(t, depot, n);
+	t->free[class] = node->next;
+	t->num[class] = n - 1;
+	return node;
+}
+
+
+static void arena_depot_give(struct arena_thread *t, unsigned int class)
+{
+	unsigned int i, n = t->num[class] / 2;
+	struct arena_node *node, *last;
+	struct arena_depot *d = &arena_depot[class];
+
+	node = last = t->free[class];
+	for (i = 1; i < n; i++)
+		last = last->next;
+	t->free[class] = last->next;
+	t->num[class] -= n;
+	ARENA_COUNT(t, depot, n);
+
+	pthread_mutex_lock(&d->lock);
+	last->next = d->free;
+	__atomic_store_n(&d->free, node, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&d->lock);
+}
+
+
+/* small classes carve the bump area, a new area drops the rest of the old */
+static void *arena_carve(struct arena_thread *t, unsigned long long size)
+{
+	void *mem;
+
+	if (size > ARENA_CHUNK_SIZE / 4) {
+		mem = malloc(size);
+		ASSERT(mem);
+		ARENA_COUNT(t, sys, 1);
+		ARENA_COUNT(t, sys_bytes, size);
+		return mem;
+	}
+	if (t->bump_end - t->bump < (long)size) {
+		t->bump = malloc(ARENA_CHUNK_SIZE);
+		ASSERT(t->bump);
+		t->bump_end = t->bump + ARENA_CHUNK_SIZE;
+		ARENA_COUNT(t, sys, 1);
+		ARENA_COUNT(t, sys_bytes, ARENA_CHUNK_SIZE);
+	}
+	mem = t->bump;
+	t->bump += size;
+	return mem;
+}
+
+
+void *arena_alloc(unsigned int size)
+{
+	unsigned int class;
+	unsigned long long n = (unsigned long long)size + ARENA_HEAD_SIZE;
+	struct arena_thread *t;
+	struct arena_head *head;
+	struct arena_node *node;
+
+	if (!size)
+		return NULL;
+	t = arena_thread();
+	ARENA_COUNT(t, alloc, 1);
+	class = arena_class(n);
+	if (class == ARENA_CLASS_HUGE) {
+		head = malloc(n);
+		ASSERT(head);
+		ARENA_COUNT(t, sys, 1);
+		ARENA_COUNT(t, sys_bytes, n);
+	} else if ((node = t->free[class])) {
+		t->free[class] = node->next;
+		t->num[class]--;
+		head = (struct arena_head *)node;
+	} else if ((node = arena_depot_take(t, class))) {
+		head = (struct arena_head *)node;
+	} else {
+		head = arena_carve(t, arena_class_size(class));
+	}
+	head->class = class;
+	return (char *)head + ARENA_HEAD_SIZE;
+}
+
+
+void *arena_zalloc(unsigned int size)
+{
+	void *mem = arena_alloc(size);
+
+	if (mem)
+		memset(mem, 0, size);
+	return mem;
+}
+
+
+void arena_free(void *mem)
+{
+	unsigned int class;
+	struct arena_thread *t;
+	struct arena_head *head;
+	struct arena_node *node;
+
+	if (!mem)
+		return;
+	t = arena_thread();
+	ARENA_COUNT(t, free, 1);
+	head = (struct arena_head *)((char *)mem - ARENA_HEAD_SIZE);
+	class = head->class;
+	if (class == ARENA_CLASS_HUGE) {
+		free(head);
+		return;
+	}
+	ASSERT(class < ARENA_CLASS_NUM);
+	node = (struct arena_node *)head;
+	node->next = t->free[class];
+	t->free[class] = node;
+	t->num[class]++;
+	if (t->num[class] > 1 && t->num[class] * arena_class_size(class) > ARENA_CACHE_SIZE)
+		arena_depot_give(t, class);
+}
+
+
+void arena_get_stat(struct arena_stat *stat)
+{
+	struct arena_thread *t;
+
+	pthread_mutex_lock(&arena_lock);
+	*stat = arena_retired;
+	for (t = arena_thread_list; t; t = t->next) {
+		stat->alloc += __atomic_load_n(&t->stat.alloc, __ATOMIC_RELAXED);
+		stat->free += __atomic_load_n(&t->stat.free, __ATOMIC_RELAXED);
+		stat->sys += __atomic_load_n(&t->stat.sys, __ATOMIC_RELAXED);
+		stat->sys_bytes += __atomic_load_n(&t->stat.sys_bytes, __ATOMIC_RELAXED);
+		stat->depot += __atomic_load_n(&t->stat.depot, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&arena_lock);
+}
@@ -0,0 +1,80 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+/*
+ * size classes are 4 steps per power of 2 from 64 bytes to 64 MB, header
+ * included, every class is a multiple of 16; larger objects go to malloc
+ * directly
+ */
+#define ARENA_HEAD_SIZE					16
+#define ARENA_CLASS_NUM					81
+#define ARENA_CHUNK_SIZE				(1 << 20) // bump area of a thread
+#define ARENA_CACHE_SIZE				(256 << 10) // free bytes kept by a thread per class
+#define ARENA_DEPOT_BATCH				32 // objects taken from global list at a time
+
+
+/* counters of all threads, objects may be freed by another thread */
+struct arena_stat {
+	unsigned long long alloc;
+	unsigned long long free;
+	unsigned long long sys; // malloc calls, chunks and objects beyond bump area
+	unsigned long long sys_bytes;
+	unsigned long long depot; // objects moved between threads and global lists
+};
+
+
+/*
+ * arena_alloc - allocate from free list of the size class of current thread,
+ *               then from global list, then from bump area of the thread;
+ *               memory is not zeroed
+ * @size: bytes
+ *
+ * Returns buffer, NULL if size is zero
+ */
+void *arena_alloc(unsigned int size);
+
+
+/*
+ * arena_zalloc - arena_alloc and zero the buffer
+ * @size: bytes
+ *
+ * Returns zeroed buffer, NULL if size is zero
+ */
+void *arena_zalloc(unsigned int size);
+
+
+/*
+ * arena_free - give a buffer back to free list of current thread, a list
+ *              grown over ARENA_CACHE_SIZE moves half to global list
+ * @mem: buffer of arena_alloc, NULL for none
+ */
+void arena_free(void *mem);
+
+
+/*
+ * arena_get_stat - sum counters of all threads, running and exited
+ * @stat: return counters
+ */
+void arena_get_stat(struct arena_stat *stat);
+
+#endif // __ARENA_H__
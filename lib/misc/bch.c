@@ -0,0 +1,775 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "bch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BCH_X86
+#endif
+
+#define BCH_WORDS_MAX		((BCH_M_MAX * BCH_T_MAX + 63) / 64)
+#define BCH_FOLD_MAX		((BCH_WORDS_MAX + 2) & ~1)
+#define BCH_FOLD_GROUP		(BCH_FOLD_MAX * 4)
+#define BCH_FOLD_WORDS		32
+
+typedef void (*BCH_REM_FUNC)(struct bch *bch, const unsigned char *data, int len);
+typedef int (*BCH_CHIEN_FUNC)(struct bch *bch, int l, int bits, int *pos);
+typedef void (*BCH_CLMUL_FUNC)(struct bch *bch, const unsigned long long *a, int num,
+							int row, int words, unsigned long long *out);
+
+/* primitive polynomial of GF(2^m), m = BCH_M_MIN ~ BCH_M_MAX */
+static const unsigned int bch_prim_poly[BCH_M_MAX - BCH_M_MIN + 1] = {
+	0x25, 0x43, 0x83, 0x11d, 0x211, 0x409, 0x805, 0x1053, 0x201b, 0x402b, 0x8003
+};
+
+
+static inline unsigned short gf_mul(struct bch *bch, unsigned short a, unsigned short b)
+{
+	if (!a || !b)
+		return 0;
+	return bch->exp[bch->log[a] + bch->log[b]];
+}
+
+
+static inline unsigned short gf_div(struct bch *bch, unsigned short a, unsigned short b)
+{
+	if (!a)
+		return 0;
+	return bch->exp[bch->log[a] + bch->n - bch->log[b]];
+}
+
+
+static void bch_gf_init(struct bch *bch)
+{
+	int i;
+	unsigned int x = 1;
+
+	bch->exp = mem_alloc(2 * bch->n * sizeof(unsigned short));
+	bch->log = mem_alloc((bch->n + 1) * sizeof(unsigned short));
+	for (i = 0; i < bch->n; i++) {
+		bch->exp[i] = bch->exp[i + bch->n] = x;
+		bch->log[x] = i;
+		x <<= 1;
+		if (x & (1 << bch->m))
+			x ^= bch_prim_poly[bch->m - BCH_M_MIN];
+	}
+}
+
+
+/*
+ * g(x) is the product of minimal polynomials of alpha^1, alpha^3 ...
+ * alpha^(2t - 1), g[i] is the binary coefficient of x^i
+ *
+ * Returns degree of g(x)
+ */
+static int bch_gen_poly(struct bch *bch, unsigned char *g)
+{
+	int i, j, k, deg, mdeg;
+	unsigned short *mp;
+	unsigned char *done, v;
+
+	mp = mem_alloc((bch->m + 1) * sizeof(unsigned short));
+	done = mem_alloc(bch->n);
+	g[0] = 1;
+	deg = 0;
+	for (i = 1; i < 2 * bch->t; i += 2) {
+		if (done[i])
+			continue;
+		/* minimal polynomial is the product of (x + alpha^j) over the coset of i */
+		memset(mp, 0, (bch->m + 1) * sizeof(unsigned short));
+		mp[0] = 1;
+		mdeg = 0;
+		for (j = i; !done[j]; j = j * 2 % bch->n) {
+			done[j] = 1;
+			for (k = ++mdeg; k > 0; k--)
+				mp[k] = mp[k - 1] ^ gf_mul(bch, mp[k], bch->exp[j]);
+			mp[0] = gf_mul(bch, mp[0], bch->exp[j]);
+		}
+		/* its coefficients are 0 or 1, multiply g(x) in place from the top */
+		for (j = deg + mdeg; j >= 0; j--) {
+			v = j <= deg ? g[j] : 0;
+			for (k = 1; k <= MIN(j, mdeg); k++) {
+				if (mp[k])
+					v ^= g[j - k];
+			}
+			g[j] = v;
+		}
+		deg += mdeg;
+	}
+	mem_free(done);
+	mem_free(mp);
+	return deg;
+}
+
+
+/* table[b] = b(x) * x^ecc_bits mod g(x), computed by the bit-serial LFSR */
+static void bch_table_init(struct bch *bch, unsigned char *g)
+{
+	int b, i, j, q, fb;
+	unsigned long long *r, gen[BCH_WORDS_MAX] = {0};
+
+	/* coefficient of x^j is bit (ecc_bits - 1 - j) from the left */
+	for (j = 0; j < bch->ecc_bits; j++) {
+		q = bch->ecc_bits - 1 - j;
+		if (g[j])
+			gen[q >> 6] |= 1ULL << (63 - (q & 63));
+	}
+
+	bch->table = mem_alloc(256 * bch->words * sizeof(unsigned long long));
+	for (b = 0; b < 256; b++) {
+		r = bch->table + b * bch->words;
+		for (i = 7; i >= 0; i--) {
+			fb = (r[0] >> 63) ^ ((b >> i) & 1);
+			for (j = 0; j < bch->words - 1; j++)
+				r[j] = (r[j] << 1) | (r[j + 1] >> 63);
+			r[bch->words - 1] <<= 1;
+			if (fb) {
+				for (j = 0; j < bch->words; j++)
+					r[j] ^= gen[j];
+			}
+		}
+	}
+}
+
+
+/*
+ * fold[q] = x^(64(q + BCH_FOLD_WORDS)) mod g(x) and fold[BCH_FOLD_WORDS + q]
+ * = x^(64q + ecc_bits) mod g(x), little-endian words of BCH_FOLD_MAX each;
+ * Barrett constants x^(ecc_bits + 64) / g(x) and g(x), both without the
+ * top term, follow at row 2 * BCH_FOLD_WORDS and 2 * BCH_FOLD_WORDS + 4.
+ * fold_pack has the same rows 4 a group for VPCLMULQDQ: vector v of a
+ * group holds word 2v of row 0 ~ 3 then word 2v + 1 of them
+ */
+static void bch_fold_init(struct bch *bch, unsigned char *g)
+{
+	int e, i, j, q, v, fw, r = bch->ecc_bits;
+	unsigned long long gen[BCH_WORDS_MAX + 1] = {0}, x[BCH_WORDS_MAX + 2] = {0};
+	unsigned long long *mu, *k;
+
+	/* a step of 256 bytes hides latency of the accumulator from one to the next */
+	fw = BCH_FOLD_WORDS;
+	for (j = 0; j <= r; j++) {
+		if (g[j])
+			gen[j >> 6] |= 1ULL << (j & 63);
+	}
+
+	bch->fold = mem_alloc((2 * fw + 8) * BCH_FOLD_MAX * sizeof(unsigned long long));
+	x[0] = 1;
+	for (e = 0; e < 64 * 2 * fw; e++) {
+		q = e / 64 - fw;
+		if (!(e & 63) && q >= 0)
+			memcpy(bch->fold + q * BCH_FOLD_MAX, x, bch->words * sizeof(unsigned long long));
+		q = (e - r) / 64;
+		if (e >= r && !((e - r) & 63) && q < fw)
+			memcpy(bch->fold + (fw + q) * BCH_FOLD_MAX, x,
+					bch->words * sizeof(unsigned long long));
+		for (j = bch->words; j > 0; j--)
+			x[j] = (x[j] << 1) | (x[j - 1] >> 63);
+		x[0] <<= 1;
+		if ((x[r >> 6] >> (r & 63)) & 1) {
+			for (j = 0; j <= bch->words; j++)
+				x[j] ^= gen[j];
+		}
+	}
+
+	/* long division of x^(ecc_bits + 64), quotient bit i comes with x^(ecc_bits + i) */
+	mu = bch->fold + 2 * fw * BCH_FOLD_MAX;
+	memset(x, 0, sizeof(x));
+	x[(r + 64) >> 6] = 1ULL << ((r + 64) & 63);
+	for (i = 64; i >= 0; i--) {
+		if (!((x[(r + i) >> 6] >> ((r + i) & 63)) & 1))
+			continue;
+		if (i < 64)
+			mu[0] |= 1ULL << i;
+		for (j = 0; j <= r; j++) {
+			if (g[j])
+				x[(j + i) >> 6] ^= 1ULL << ((j + i) & 63);
+		}
+	}
+	gen[r >> 6] &= ~(1ULL << (r & 63));
+	memcpy(mu + 4 * BCH_FOLD_MAX, gen, bch->words * sizeof(unsigned long long));
+
+	bch->fold_pack = mem_alloc((2 * fw + 8) * BCH_FOLD_MAX * sizeof(unsigned long long));
+	for (q = 0; q < 2 * fw + 8; q++) {
+		k = bch->fold_pack + (q >> 2) * BCH_FOLD_GROUP;
+		for (v = 0; v < BCH_FOLD_MAX; v++)
+			k[(v >> 1) * 8 + (v & 1) * 4 + (q & 3)] = bch->fold[q * BCH_FOLD_MAX + v];
+	}
+}
+
+
+/* syn_row[k * t + j] = alpha^((2j + 1) * k) */
+static void bch_syndrome_init(struct bch *bch)
+{
+	int j, k;
+
+	bch->syn_row = mem_alloc(bch->ecc_bits * bch->t * sizeof(unsigned short));
+	for (k = 0; k < bch->ecc_bits; k++) {
+		for (j = 0; j < bch->t; j++)
+			bch->syn_row[k * bch->t + j] = bch->exp[(2 * j + 1) * k % bch->n];
+	}
+}
+
+
+struct bch *bch_create(int len, int t)
+{
+	int m;
+	struct bch *bch;
+	unsigned char g[BCH_M_MAX * BCH_T_MAX + 1];
+
+	if (len <= 0 || t <= 0 || t > BCH_T_MAX)
+		return NULL;
+	for (m = BCH_M_MIN; m <= BCH_M_MAX; m++) {
+		if ((1 << m) - 1 >= len * 8 + m * t)
+			break;
+	}
+	if (m > BCH_M_MAX) {
+		LOG(LOG_WARN, "no BCH code for %d bytes and %d bits", len, t);
+		return NULL;
+	}
+
+	bch = mem_alloc(sizeof(struct bch));
+	bch->m = m;
+	bch->n = (1 << m) - 1;
+	bch->t = t;
+	bch->len = len;
+	bch_gf_init(bch);
+	memset(g, 0, sizeof(g));
+	bch->ecc_bits = bch_gen_poly(bch, g);
+	if (bch->ecc_bits < 8) {
+		/* the byte-wise table needs 8 bits of remainder at least */
+		LOG(LOG_WARN, "parity of %d bits is too short", bch->ecc_bits);
+		bch_delete(bch);
+		return NULL;
+	}
+	bch->ecc_bytes = (bch->ecc_bits + 7) >> 3;
+	bch->words = (bch->ecc_bits + 63) >> 6;
+	bch_table_init(bch, g);
+	bch_fold_init(bch, g);
+	bch_syndrome_init(bch);
+	bch->rem = mem_alloc(bch->words * sizeof(unsigned long long));
+	bch->syn = mem_alloc(2 * t * sizeof(unsigned short));
+	bch->elp = mem_alloc(3 * (2 * t + 1) * sizeof(unsigned short));
+	bch_select(bch, BCH_AUTO);
+	return bch;
+}
+
+
+/*
+ * remainder of data(x) * x^ecc_bits by g(x): the top byte of the
+ * remainder and a data byte select a table entry, then the remainder
+ * shifts left by a byte and xors the entry, a whole 64-bit word a time
+ */
+static void bch_remainder(struct bch *bch, const unsigned char *data, int len)
+{
+	int i, j, words = bch->words;
+	unsigned long long *r = bch->rem, *tab;
+
+	memset(r, 0, words * sizeof(unsigned long long));
+	if (words == 1) {
+		for (i = 0; i < len; i++)
+			r[0] = (r[0] << 8) ^ bch->table[(r[0] >> 56) ^ data[i]];
+		return;
+	}
+	for (i = 0; i < len; i++) {
+		tab = bch->table + ((r[0] >> 56) ^ data[i]) * words;
+		for (j = 0; j < words - 1; j++)
+			r[j] = ((r[j] << 8) | (r[j + 1] >> 56)) ^ tab[j];
+		r[j] = (r[j] << 8) ^ tab[j];
+	}
+}
+
+
+#ifdef BCH_X86
+/*
+ * out = sum of a[i] * fold[row + i] over num rows of words, out is words + 1
+ * long: even and odd words of a row are multiplied apart, the odd products
+ * are shifted up by a word when merged
+ */
+__attribute__((target("pclmul")))
+static void bch_clmul_pclmul(struct bch *bch, const unsigned long long *a, int num,
+							int row, int words, unsigned long long *out)
+{
+	int i, j;
+	const unsigned long long *k = bch->fold + row * BCH_FOLD_MAX;
+	__m128i x, y, even, odd, prev = _mm_setzero_si128();
+
+	for (j = 0; j < words; j += 2) {
+		even = odd = _mm_setzero_si128();
+		for (i = 0; i < num; i++) {
+			x = _mm_loadl_epi64((const __m128i *)(a + i));
+			y = _mm_loadu_si128((const __m128i *)(k + i * BCH_FOLD_MAX + j));
+			even = _mm_xor_si128(even, _mm_clmulepi64_si128(y, x, 0x00));
+			odd = _mm_xor_si128(odd, _mm_clmulepi64_si128(y, x, 0x01));
+		}
+		even = _mm_xor_si128(even, _mm_slli_si128(odd, 8));
+		_mm_storeu_si128((__m128i *)(out + j), _mm_xor_si128(even, _mm_srli_si128(prev, 8)));
+		prev = odd;
+	}
+	_mm_storeu_si128((__m128i *)(out + j), _mm_srli_si128(prev, 8));
+}
+
+
+/*
+ * 4 rows a time from fold_pack: a[i ~ i + 3] are broadcast to both halves,
+ * so lane 0 multiplies row i and i + 1 by its low and high word, lane 1 row
+ * i + 2 and i + 3, both products of a lane go to the same word; a is read
+ * up to 4 rows aligned, which must be zero over num
+ */
+__attribute__((target("avx512f,vpclmulqdq")))
+static void bch_clmul_vpclmul(struct bch *bch, const unsigned long long *a, int num,
+							int row, int words, unsigned long long *out)
+{
+	int i, j;
+	const unsigned long long *k = bch->fold_pack + (row >> 2) * BCH_FOLD_GROUP;
+	unsigned long long lane[8], carry = 0;
+	__m512i x, y, acc;
+
+	for (j = 0; j < words; j += 2) {
+		acc = _mm512_setzero_si512();
+		for (i = 0; i < num; i += 4) {
+			x = _mm512_broadcast_i64x4(_mm256_loadu_si256((const __m256i *)(a + i)));
+			y = _mm512_loadu_si512(k + (i >> 2) * BCH_FOLD_GROUP + j * 4);
+			acc = _mm512_ternarylogic_epi64(acc, _mm512_clmulepi64_epi128(y, x, 0x00),
+										_mm512_clmulepi64_epi128(y, x, 0x11), 0x96);
+		}
+		/* lane 0, 1 are at word j, lane 2, 3 at word j + 1 */
+		_mm512_storeu_si512(lane, acc);
+		out[j] = carry ^ lane[0] ^ lane[2];
+		out[j + 1] = lane[1] ^ lane[3] ^ lane[4] ^ lane[6];
+		carry = lane[5] ^ lane[7];
+	}
+	out[j] = carry;
+}
+
+
+/*
+ * data is taken as big-endian words after leading zeros, which shift into
+ * an accumulator A of BCH_FOLD_WORDS a block at a time: the words shifted
+ * over x^(64 BCH_FOLD_WORDS) are replaced by products with fold constants.
+ * A * x^ecc_bits is reduced the same way to ecc_bits + 64 bits at last,
+ * the word W over ecc_bits leaves W * x^ecc_bits mod g(x) = Q * g(x) mod
+ * x^ecc_bits by Barrett, Q = W + (W * mu >> 64)
+ */
+static inline void bch_remainder_clmul(struct bch *bch, const unsigned char *data, int len,
+							BCH_CLMUL_FUNC clmul)
+{
+	int i, j, m, n, s, used, fw = BCH_FOLD_WORDS, r = bch->ecc_bits;
+	unsigned long long a[BCH_FOLD_WORDS + 4] = {0}, b[4] = {0}, w;
+	unsigned long long p[BCH_FOLD_MAX + 8], q[BCH_FOLD_MAX + 8];
+
+	for (i = 0, w = 0; i < (len & 7); i++)
+		w = (w << 8) | data[i];
+	a[0] = w;
+	used = i ? 1 : 0;
+	data += i;
+	n = len >> 3;
+	for (i = 0; i < n; i += m, data += m * 8) {
+		m = MIN(fw, n - i);
+		if (used + m > fw)
+			clmul(bch, a + fw - m, m, 0, bch->words, p);
+		memmove(a + m, a, (fw - m) * sizeof(unsigned long long));
+		for (j = 0; j < m; j++) {
+			memcpy(&w, data + j * 8, 8);
+			a[m - 1 - j] = __builtin_bswap64(w);
+		}
+		if (used + m > fw) {
+			for (j = 0; j <= bch->words; j++)
+				a[j] ^= p[j];
+		}
+		used = MIN(used + m, fw);
+	}
+
+	/* words over used are zero */
+	clmul(bch, a, used, fw, bch->words, p);
+	j = r >> 6;
+	s = r & 63;
+	b[0] = s ? (p[j] >> s) | (p[j + 1] << (64 - s)) : p[j];
+	clmul(bch, b, 1, 2 * fw, 1, q);
+	b[0] ^= q[1];
+	clmul(bch, b, 1, 2 * fw + 4, bch->words, q);
+	for (i = 0; i < bch->words; i++)
+		p[i] ^= q[i];
+	if (s)
+		p[j] &= (1ULL << s) - 1;
+	/* left align the bits below x^ecc_bits */
+	s = 64 * bch->words - r;
+	for (i = 0; i < bch->words; i++) {
+		w = p[i] << s;
+		if (s && i)
+			w |= p[i - 1] >> (64 - s);
+		bch->rem[bch->words - 1 - i] = w;
+	}
+}
+
+
+__attribute__((target("pclmul")))
+static void bch_remainder_avx2(struct bch *bch, const unsigned char *data, int len)
+{
+	bch_remainder_clmul(bch, data, len, bch_clmul_pclmul);
+}
+
+
+__attribute__((target("avx512f,vpclmulqdq")))
+static void bch_remainder_avx512(struct bch *bch, const unsigned char *data, int len)
+{
+	bch_remainder_clmul(bch, data, len, bch_clmul_vpclmul);
+}
+#endif // BCH_X86
+
+
+static BCH_REM_FUNC bch_rem_func[BCH_TYPE_NUM] = {
+	NULL,
+	bch_remainder,
+#ifdef BCH_X86
+	bch_remainder_avx2,
+	bch_remainder_avx512,
+#endif
+};
+
+
+void bch_encode(struct bch *bch, const unsigned char *data, int len, unsigned char *ecc)
+{
+	int i;
+	unsigned long long w;
+
+	ASSERT(len <= bch->len);
+	bch_rem_func[bch->type](bch, data, len);
+	for (i = 0; i + 8 <= bch->ecc_bytes; i += 8) {
+		w = __builtin_bswap64(bch->rem[i >> 3]);
+		memcpy(ecc + i, &w, 8);
+	}
+	for (; i < bch->ecc_bytes; i++)
+		ecc[i] = bch->rem[i >> 3] >> (56 - ((i & 7) << 3));
+}
+
+
+/*
+ * S[j - 1] = R(alpha^j) for j = 1 ~ 2t, R is the remainder of received word;
+ * power k of R adds row k of alpha^(jk) over odd j, t lanes at once
+ */
+static void bch_syndrome(struct bch *bch)
+{
+	int i, j, k, b, t = bch->t;
+	unsigned long long w;
+	unsigned short odd[BCH_T_MAX] = {0}, *row, *s = bch->syn;
+
+	for (i = 0; i < bch->words; i++) {
+		for (w = bch->rem[i]; w; w ^= 1ULL << b) {
+			b = fls64(w) - 1;
+			k = bch->ecc_bits - 1 - ((i << 6) + 63 - b);
+			row = bch->syn_row + k * t;
+			for (j = 0; j < t; j++)
+				odd[j] ^= row[j];
+		}
+	}
+	/* S(2j) = S(j)^2 in GF(2^m) */
+	for (j = 1; j <= 2 * t; j++)
+		s[j - 1] = j & 1 ? odd[j >> 1] : gf_mul(bch, s[j / 2 - 1], s[j / 2 - 1]);
+}
+
+
+/*
+ * Berlekamp-Massey: error locator polynomial C(x) from syndromes
+ *
+ * Returns degree of C(x)
+ */
+static int bch_berlekamp(struct bch *bch)
+{
+	int i, r, l = 0, shift = 1, num = 2 * bch->t + 1;
+	unsigned short *c = bch->elp, *b = c + num, *tmp = b + num;
+	unsigned short d, bd = 1, coef;
+
+	memset(c, 0, 2 * num * sizeof(unsigned short));
+	c[0] = b[0] = 1;
+	for (r = 0; r < 2 * bch->t; r++) {
+		d = bch->syn[r];
+		for (i = 1; i <= l; i++)
+			d ^= gf_mul(bch, c[i], bch->syn[r - i]);
+		if (!d) {
+			shift++;
+			continue;
+		}
+		coef = gf_div(bch, d, bd);
+		if (2 * l <= r) {
+			memcpy(tmp, c, num * sizeof(unsigned short));
+			for (i = 0; i + shift < num; i++)
+				c[i + shift] ^= gf_mul(bch, coef, b[i]);
+			memcpy(b, tmp, num * sizeof(unsigned short));
+			l = r + 1 - l;
+			bd = d;
+			shift = 1;
+		} else {
+			for (i = 0; i + shift < num; i++)
+				c[i + shift] ^= gf_mul(bch, coef, b[i]);
+			shift++;
+		}
+	}
+	return l;
+}
+
+
+/*
+ * Chien search: power p of received word is in error if C(alpha^-p) is
+ * zero, only powers of the shortened code are searched
+ *
+ * Returns root number found
+ */
+static int bch_chien_scalar(struct bch *bch, int l, int bits, int *pos)
+{
+	int i, p, num = 0;
+	int e[BCH_T_MAX + 1];
+	unsigned short sum, *c = bch->elp;
+
+	for (i = 1; i <= l; i++)
+		e[i] = c[i] ? bch->log[c[i]] : -1;
+	for (p = 0; p < bits && num < l; p++) {
+		sum = 1;
+		for (i = 1; i <= l; i++) {
+			if (e[i] < 0)
+				continue;
+			sum ^= bch->exp[e[i]];
+			/* e[i] = log(c[i]) - i * (p + 1) mod n */
+			e[i] -= i;
+			if (e[i] < 0)
+				e[i] += bch->n;
+		}
+		if (!sum)
+			pos[num++] = p;
+	}
+	return num;
+}
+
+
+#ifdef BCH_X86
+/*
+ * nonzero terms of C(x): e[k] = log(c[i]), deg[k] = i
+ *
+ * Returns term number
+ */
+static int bch_chien_terms(struct bch *bch, int l, int *e, int *deg)
+{
+	int i, num = 0;
+	unsigned short *c = bch->elp;
+
+	for (i = 1; i <= l; i++) {
+		if (!c[i])
+			continue;
+		e[num] = bch->log[c[i]];
+		deg[num++] = i;
+	}
+	return num;
+}
+
+
+/*
+ * lane q of a vector is power p + q, term i of it is alpha^(e[i] - i * q):
+ * 8 powers are evaluated at once by gathering from exp, e[i] then steps by
+ * 8i mod n for next 8 powers
+ */
+__attribute__((target("avx2")))
+static int bch_chien_avx2(struct bch *bch, int l, int bits, int *pos)
+{
+	int i, k, p, term, mask, num = 0;
+	int e[BCH_T_MAX], deg[BCH_T_MAX], step[BCH_T_MAX], off[BCH_T_MAX][8];
+	__m256i n, idx, sum, low;
+
+	term = bch_chien_terms(bch, l, e, deg);
+	n = _mm256_set1_epi32(bch->n);
+	low = _mm256_set1_epi32(0xffff);
+	/* i * q mod n of 8 lanes, i * q may pass n when n is small */
+	for (i = 0; i < term; i++) {
+		step[i] = 8 * deg[i] % bch->n;
+		for (k = 0; k < 8; k++)
+			off[i][k] = deg[i] * k % bch->n;
+	}
+	for (p = 0; p < bits && num < l; p += 8) {
+		sum = _mm256_set1_epi32(1);
+		for (i = 0; i < term; i++) {
+			idx = _mm256_sub_epi32(_mm256_set1_epi32(e[i]),
+								_mm256_loadu_si256((const __m256i *)off[i]));
+			idx = _mm256_add_epi32(idx, _mm256_and_si256(_mm256_srai_epi32(idx, 31), n));
+			sum = _mm256_xor_si256(sum, _mm256_i32gather_epi32((const int *)bch->exp, idx, 2));
+			e[i] -= step[i];
+			if (e[i] < 0)
+				e[i] += bch->n;
+		}
+		/* a gather reads the next entry too, its bits are dropped */
+		sum = _mm256_and_si256(sum, low);
+		mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+								_mm256_cmpeq_epi32(sum, _mm256_setzero_si256())));
+		for (; mask && num < l; mask &= mask - 1) {
+			k = p + __builtin_ctz(mask);
+			if (k < bits)
+				pos[num++] = k;
+		}
+	}
+	return num;
+}
+
+
+__attribute__((target("avx512f")))
+static int bch_chien_avx512(struct bch *bch, int l, int bits, int *pos)
+{
+	int i, k, p, term, num = 0;
+	int e[BCH_T_MAX], deg[BCH_T_MAX], step[BCH_T_MAX], off[BCH_T_MAX][16];
+	unsigned int mask;
+	__m512i n, idx, sum, low;
+
+	term = bch_chien_terms(bch, l, e, deg);
+	n = _mm512_set1_epi32(bch->n);
+	low = _mm512_set1_epi32(0xffff);
+	for (i = 0; i < term; i++) {
+		step[i] = 16 * deg[i] % bch->n;
+		for (k = 0; k < 16; k++)
+			off[i][k] = deg[i] * k % bch->n;
+	}
+	for (p = 0; p < bits && num < l; p += 16) {
+		sum = _mm512_set1_epi32(1);
+		for (i = 0; i < term; i++) {
+			idx = _mm512_sub_epi32(_mm512_set1_epi32(e[i]), _mm512_loadu_si512(off[i]));
+			idx = _mm512_mask_add_epi32(idx, _mm512_cmplt_epi32_mask(idx,
+										_mm512_setzero_si512()), idx, n);
+			sum = _mm512_xor_si512(sum, _mm512_i32gather_epi32(idx, bch->exp, 2));
+			e[i] -= step[i];
+			if (e[i] < 0)
+				e[i] += bch->n;
+		}
+		mask = _mm512_testn_epi32_mask(sum, low);
+		for (; mask && num < l; mask &= mask - 1) {
+			k = p + __builtin_ctz(mask);
+			if (k < bits)
+				pos[num++] = k;
+		}
+	}
+	return num;
+}
+#endif // BCH_X86
+
+
+static const char *bch_type_name[BCH_TYPE_NUM] = {
+	"auto",
+	"scalar",
+	"avx2",
+	"avx512",
+};
+
+static BCH_CHIEN_FUNC bch_chien_func[BCH_TYPE_NUM] = {
+	NULL,
+	bch_chien_scalar,
+#ifdef BCH_X86
+	bch_chien_avx2,
+	bch_chien_avx512,
+#endif
+};
+
+
+static bool bch_supported(int type)
+{
+	switch (type) {
+	case BCH_SCALAR:
+		return TRUE;
+#ifdef BCH_X86
+	case BCH_AVX2:
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul");
+	case BCH_AVX512:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq");
+#endif
+	default:
+		return FALSE;
+	}
+}
+
+
+int bch_select(struct bch *bch, int type)
+{
+	if (type == BCH_AUTO) {
+		for (type = BCH_TYPE_NUM - 1; !bch_supported(type); type--)
+			;
+	}
+	if (type <= BCH_AUTO || type >= BCH_TYPE_NUM || !bch_supported(type))
+		return -1;
+	bch->type = type;
+	return 0;
+}
+
+
+const char *bch_name(struct bch *bch)
+{
+	return bch_type_name[bch->type];
+}
+
+
+int bch_decode(struct bch *bch, unsigned char *data, int len, unsigned char *ecc)
+{
+	int i, k, l, pad, pos[BCH_T_MAX];
+	unsigned long long w, diff = 0;
+
+	ASSERT(len <= bch->len);
+	bch_rem_func[bch->type](bch, data, len);
+	pad = (bch->ecc_bytes << 3) - bch->ecc_bits;
+	/* the last byte is masked by pad */
+	for (i = 0; i + 8 < bch->ecc_bytes; i += 8) {
+		memcpy(&w, ecc + i, 8);
+		bch->rem[i >> 3] ^= __builtin_bswap64(w);
+	}
+	for (; i < bch->ecc_bytes; i++) {
+		k = i == bch->ecc_bytes - 1 ? ecc[i] & (0xff << pad) : ecc[i];
+		bch->rem[i >> 3] ^= (unsigned long long)k << (56 - ((i & 7) << 3));
+	}
+	for (i = 0; i < bch->words; i++)
+		diff |= bch->rem[i];
+	if (!diff)
+		return 0;
+
+	bch_syndrome(bch);
+	l = bch_berlekamp(bch);
+	if (l > bch->t || bch_chien_func[bch->type](bch, l, len * 8 + bch->ecc_bits, pos) != l)
+		return -1;
+
+	/* power p < ecc_bits is parity bit, otherwise data bit */
+	for (i = 0; i < l; i++) {
+		if (pos[i] < bch->ecc_bits) {
+			k = bch->ecc_bits - 1 - pos[i];
+			ecc[k >> 3] ^= 0x80 >> (k & 7);
+		} else {
+			k = len * 8 + bch->ecc_bits - 1 - pos[i];
+			data[k >> 3] ^= 0x80 >> (k & 7);
+		}
+	}
+	return l;
+}
+
+
+void bch_delete(struct bch *bch)
+{
+	mem_free(bch->exp);
+	mem_free(bch->log);
+	mem_free(bch->table);
+	mem_free(bch->fold);
+	mem_free(bch->fold_pack);
+	mem_free(bch->syn_row);
+	mem_free(bch->rem);
+	mem_free(bch->syn);
+	mem_free(bch->elp);
+	mem_free(bch);
+}
@@ -0,0 +1,127 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BCH_H__
+#define __BCH_H__
+
+#define BCH_M_MIN					5
+#define BCH_M_MAX					15
+#define BCH_T_MAX					64
+
+/*
+ * implementation of remainder and Chien search, the widest supported by
+ * CPU is picked at bch_create: scalar walks the byte table, avx2 folds
+ * by PCLMULQDQ, avx512 folds by VPCLMULQDQ
+ */
+enum bch_type {
+	BCH_AUTO,
+	BCH_SCALAR,
+	BCH_AVX2,
+	BCH_AVX512,
+	BCH_TYPE_NUM
+};
+
+/*
+ * binary BCH code over GF(2^m), shortened to the data length:
+ * data of len bytes followed by ecc_bits of parity is a codeword,
+ * bit 7 of first data byte is the highest degree; the parity is the
+ * remainder of data(x) * x^ecc_bits by generator g(x), computed a
+ * byte at a time through a 256-entry table, or folded a word at a time
+ * by carry-less multiply
+ */
+struct bch {
+	int m;
+	int n; // 2^m - 1
+	int t; // correctable bits
+	int len; // max data bytes
+	int ecc_bits; // degree of g(x)
+	int ecc_bytes;
+	int words; // 64-bit words of remainder
+	unsigned short *exp; // alpha^i, 2 * n entries
+	unsigned short *log;
+	unsigned long long *table; // remainder of byte * x^ecc_bits, left aligned
+	unsigned long long *fold; // x^(64k) mod g(x) to fold data by carry-less multiply
+	unsigned long long *fold_pack; // fold interleaved by 4 rows
+	unsigned long long *rem; // remainder of decode
+	unsigned short *syn; // 2t syndromes
+	unsigned short *syn_row; // alpha^(jk) of odd j, t entries for power k of remainder
+	unsigned short *elp; // error locator polynomial
+	int type; // enum bch_type in use
+};
+
+
+/*
+ * bch_create - create BCH code, m is the smallest to hold len bytes
+ * @len: max data bytes of a codeword
+ * @t: correctable bits of a codeword, 1 ~ BCH_T_MAX
+ *
+ * Returns bch object if success, otherwise NULL
+ */
+struct bch *bch_create(int len, int t);
+
+
+/*
+ * bch_encode - compute parity of data
+ * @bch: bch object
+ * @data: data buffer
+ * @len: data bytes, no more than bch->len
+ * @ecc: return ecc_bytes of parity
+ */
+void bch_encode(struct bch *bch, const unsigned char *data, int len, unsigned char *ecc);
+
+
+/*
+ * bch_decode - correct data and parity in place
+ * @bch: bch object
+ * @data: data buffer
+ * @len: data bytes, same as encoded
+ * @ecc: ecc_bytes of parity read with data
+ *
+ * Returns corrected bit number, negative if uncorrectable
+ */
+int bch_decode(struct bch *bch, unsigned char *data, int len, unsigned char *ecc);
+
+
+/*
+ * bch_select - pick implementation of remainder and Chien search
+ * @bch: bch object
+ * @type: enum bch_type
+ *
+ * Returns zero if supported by CPU, otherwise -1 and nothing changes
+ */
+int bch_select(struct bch *bch, int type);
+
+
+/*
+ * bch_name - name of implementation in use
+ * @bch: bch object
+ *
+ * Returns "scalar", "avx2" or "avx512"
+ */
+const char *bch_name(struct bch *bch);
+
+
+/*
+ * bch_delete - destory the bch object
+ * @bch: bch object
+ */
+void bch_delete(struct bch *bch);
+
+#endif // __BCH_H__
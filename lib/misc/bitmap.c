@@ -68,6 +68,40 @@ int bitmap_get(struct bitmap *bm, unsigned int index)
 }
 
 
+void bitmap_set_atomic(struct bitmap *bm, unsigned int index)
+{
+	unsigned int start, len;
+
+	if (index > (bm->base + bm->size))
+		return;
+	start = (index - bm->base) >> 3;
+	len = (index - bm->base) & 0x7;
+	__atomic_fetch_or(&bm->b[start], 1 << len, __ATOMIC_RELAXED);
+}
+
+void bitmap_clear_atomic(struct bitmap *bm, unsigned int index)
+{
+	unsigned int start, len;
+
+	if (index > (bm->base + bm->size))
+		return;
+	start = (index - bm->base) >> 3;
+	len = (index - bm->base) & 0x7;
+	__atomic_fetch_and(&bm->b[start], ~(1 << len), __ATOMIC_RELAXED);
+}
+
+int bitmap_get_atomic(struct bitmap *bm, unsigned int index)
+{
+	unsigned int start, len;
+
+	if (index > (bm->base + bm->size))
+		return -1;
+	start = (index - bm->base) >> 3;
+	len = (index - bm->base) & 0x7;
+	return __atomic_load_n(&bm->b[start], __ATOMIC_RELAXED) & (1 << len);
+}
+
+
 void bitmap_delete(struct bitmap *bm)
 {
 	mem_free(bm);
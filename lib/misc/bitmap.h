@@ -62,6 +62,15 @@ void bitmap_clear(struct bitmap *bm, unsigned int index);
 int bitmap_get(struct bitmap *bm, unsigned int index);
 
 
+/*
+ * bitmap_set_atomic, bitmap_clear_atomic, bitmap_get_atomic - same as
+ * above, safe when threads update different bits of the same byte
+ */
+void bitmap_set_atomic(struct bitmap *bm, unsigned int index);
+void bitmap_clear_atomic(struct bitmap *bm, unsigned int index);
+int bitmap_get_atomic(struct bitmap *bm, unsigned int index);
+
+
 /*
  * bitmap_delete - destory the bitmap
  * @bm: created bitmap
@@ -0,0 +1,360 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "cache.h"
+
+
+/*
+ * keys are dense ids, e.g. blocks: consecutive keys go to consecutive
+ * shards so that shards fill evenly, and to consecutive buckets of a shard
+ */
+static inline struct cache_shard *cache_shard(struct cache *cache, unsigned int key)
+{
+	return &cache->shard[key % cache->shard_num];
+}
+
+
+static inline struct cache_node **cache_bucket(struct cache *cache, struct cache_shard *shard,
+											unsigned int key)
+{
+	return &shard->table[(key / cache->shard_num) & shard->mask];
+}
+
+
+static inline struct cache_node *cache_node(void *buf)
+{
+	return container_of(buf, struct cache_node, buffer);
+}
+
+
+/*
+ * nodes are never freed before cache_delete, so a reader may walk a chain
+ * while nodes move to other chains; it misses at worst, and a found node
+ * is only trusted after it is pinned and its key is checked again
+ */
+static struct cache_node *cache_find(struct cache *cache, struct cache_shard *shard,
+									unsigned int key)
+{
+	unsigned int i;
+	struct cache_node *node;
+
+	node = __atomic_load_n(cache_bucket(cache, shard, key), __ATOMIC_ACQUIRE);
+	for (i = 0; node && i < shard->num; i++) {
+		if (__atomic_load_n(&node->key, __ATOMIC_ACQUIRE) == key)
+			return node;
+		node = __atomic_load_n(&node->h_next, __ATOMIC_ACQUIRE);
+	}
+	return NULL;
+}
+
+
+/* Returns TRUE if node is pinned and still holds key */
+static bool cache_pin(struct cache_node *node, unsigned int key)
+{
+	int ref = __atomic_load_n(&node->ref, __ATOMIC_RELAXED);
+
+	do {
+		if (ref < 0)
+			return FALSE;
+	} while (!__atomic_compare_exchange_n(&node->ref, &ref, ref + 1, 1,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	if (__atomic_load_n(&node->key, __ATOMIC_ACQUIRE) != key) {
+		__atomic_sub_fetch(&node->ref, 1, __ATOMIC_RELEASE);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+/* Returns TRUE if an unpinned node is claimed for eviction or removal */
+static bool cache_claim(struct cache_node *node)
+{
+	int ref = 0;
+
+	return __atomic_compare_exchange_n(&node->ref, &ref, -1, 0,
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+
+/* wait for an unpin under shard lock, waiter is raised before the last check */
+static void cache_wait(struct cache_shard *shard)
+{
+	pthread_cond_wait(&shard->cond, &shard->lock);
+}
+
+
+/* claim a node under shard lock, waits until it is unpinned */
+static void cache_claim_wait(struct cache_shard *shard, struct cache_node *node)
+{
+	bool claimed;
+
+	while (!cache_claim(node)) {
+		__atomic_add_fetch(&shard->waiter, 1, __ATOMIC_SEQ_CST);
+		claimed = cache_claim(node);
+		if (!claimed)
+			cache_wait(shard);
+		__atomic_sub_fetch(&shard->waiter, 1, __ATOMIC_SEQ_CST);
+		if (claimed)
+			return;
+	}
+}
+
+
+static void cache_unlink(struct cache *cache, struct cache_shard *shard, struct cache_node *node)
+{
+	struct cache_node **p;
+
+	p = cache_bucket(cache, shard, node->key);
+	while (*p != node)
+		p = &(*p)->h_next;
+	__atomic_store_n(p, node->h_next, __ATOMIC_RELEASE);
+}
+
+
+/* return a claimed node to free list under shard lock */
+static void cache_free(struct cache *cache, struct cache_shard *shard, struct cache_node *node)
+{
+	cache_unlink(cache, shard, node);
+	__atomic_store_n(&node->key, CACHE_INVALID_KEY, __ATOMIC_RELAXED);
+	__atomic_store_n(&node->clock, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&node->h_next, shard->free, __ATOMIC_RELAXED);
+	shard->free = node;
+	__atomic_store_n(&node->ref, 0, __ATOMIC_RELEASE);
+}
+
+
+/* hand skips pinned nodes and gives referenced nodes a second chance */
+static struct cache_node *cache_victim(struct cache_shard *shard)
+{
+	unsigned int i;
+	struct cache_node *node;
+
+	for (i = 0; i < 2 * shard->num; i++) {
+		node = shard->node[shard->hand];
+		shard->hand = (shard->hand + 1) % shard->num;
+		if (__atomic_load_n(&node->clock, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&node->clock, 0, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (cache_claim(node))
+			return node;
+	}
+	return NULL;
+}
+
+
+struct cache *cache_create(unsigned int size, unsigned int num, unsigned int shard_num)
+{
+	unsigned int i, j, node_size;
+	struct cache *cache;
+	struct cache_shard *shard;
+	struct cache_node *node;
+
+	if (!shard_num || shard_num > CACHE_SHARD_MAX || num < shard_num)
+		return NULL;
+
+	node_size = roundup(sizeof(struct cache_node) + size, sizeof(void *));
+	cache = mem_alloc(sizeof(struct cache));
+	cache->size = size;
+	cache->num = num;
+	cache->shard_num = shard_num;
+	cache->shard = aligned_alloc(64, shard_num * sizeof(struct cache_shard));
+	ASSERT(cache->shard);
+	memset(cache->shard, 0, shard_num * sizeof(struct cache_shard));
+	cache->mem = mem_alloc(node_size * num);
+
+	for (i = 0; i < shard_num; i++) {
+		shard = &cache->shard[i];
+		pthread_mutex_init(&shard->lock, NULL);
+		pthread_cond_init(&shard->cond, NULL);
+		/* first shards take the remainder */
+		shard->num = num / shard_num + (i < num % shard_num);
+		shard->mask = roundup_power2(shard->num) - 1;
+		shard->table = mem_alloc((shard->mask + 1) * sizeof(struct cache_node *));
+		shard->node = mem_alloc(shard->num * sizeof(struct cache_node *));
+	}
+	for (i = 0, j = 0; j < num; j++) {
+		shard = &cache->shard[j % shard_num];
+		node = (struct cache_node *)(cache->mem + j * node_size);
+		node->shard = shard;
+		node->key = CACHE_INVALID_KEY;
+		shard->node[j / shard_num] = node;
+		node->h_next = shard->free;
+		shard->free = node;
+	}
+	return cache;
+}
+
+
+void *cache_get(struct cache *cache, unsigned int key)
+{
+	struct cache_shard *shard = cache_shard(cache, key);
+	struct cache_node *node;
+
+	node = cache_find(cache, shard, key);
+	if (!node || !cache_pin(node, key)) {
+		__atomic_add_fetch(&shard->miss, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	/* approximate recency, the hand clears it */
+	if (!__atomic_load_n(&node->clock, __ATOMIC_RELAXED))
+		__atomic_store_n(&node->clock, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&shard->hit, 1, __ATOMIC_RELAXED);
+	return node->buffer;
+}
+
+
+void *cache_set(struct cache *cache, unsigned int key, CACHE_CALLBACK cb, void *userdata)
+{
+	struct cache_shard *shard = cache_shard(cache, key);
+	struct cache_node *node;
+
+	pthread_mutex_lock(&shard->lock);
+	for (;;) {
+		/* nodes are only claimed under lock, a found node is pinned */
+		node = cache_find(cache, shard, key);
+		if (node && cache_pin(node, key)) {
+			pthread_mutex_unlock(&shard->lock);
+			return node->buffer;
+		}
+
+		node = shard->free;
+		if (node) {
+			shard->free = node->h_next;
+			/* a reader may hold a stale pin for a moment */
+			while (!cache_claim(node))
+				;
+			break;
+		}
+		node = cache_victim(shard);
+		if (!node) {
+			/* every node is pinned, look again after the wait is seen */
+			__atomic_add_fetch(&shard->waiter, 1, __ATOMIC_SEQ_CST);
+			node = cache_victim(shard);
+			if (!node)
+				cache_wait(shard);
+			__atomic_sub_fetch(&shard->waiter, 1, __ATOMIC_SEQ_CST);
+			if (!node)
+				continue;
+		}
+		if (cb)
+			cb(node->key, node->buffer, userdata);
+		cache_unlink(cache, shard, node);
+		shard->evict++;
+		break;
+	}
+
+	__atomic_store_n(&node->key, key, __ATOMIC_RELAXED);
+	__atomic_store_n(&node->clock, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&node->h_next, *cache_bucket(cache, shard, key), __ATOMIC_RELAXED);
+	/* pinned by caller, key and chain are published with it */
+	__atomic_store_n(&node->ref, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(cache_bucket(cache, shard, key), node, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&shard->lock);
+	return node->buffer;
+}
+
+
+void cache_put(void *buf)
+{
+	struct cache_node *node = cache_node(buf);
+	struct cache_shard *shard = node->shard;
+
+	ASSERT(__atomic_load_n(&node->ref, __ATOMIC_RELAXED) > 0);
+	if (__atomic_sub_fetch(&node->ref, 1, __ATOMIC_SEQ_CST) == 0 &&
+		__atomic_load_n(&shard->waiter, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&shard->lock);
+		pthread_cond_broadcast(&shard->cond);
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+
+int cache_remove(struct cache *cache, unsigned int key)
+{
+	struct cache_shard *shard = cache_shard(cache, key);
+	struct cache_node *node;
+
+	pthread_mutex_lock(&shard->lock);
+	node = cache_find(cache, shard, key);
+	if (!node) {
+		pthread_mutex_unlock(&shard->lock);
+		return -1;
+	}
+	cache_claim_wait(shard, node);
+	cache_free(cache, shard, node);
+	pthread_mutex_unlock(&shard->lock);
+	return 0;
+}
+
+
+void cache_flush(struct cache *cache, CACHE_CALLBACK cb, void *userdata)
+{
+	unsigned int i, j;
+	struct cache_shard *shard;
+	struct cache_node *node;
+
+	for (i = 0; i < cache->shard_num; i++) {
+		shard = &cache->shard[i];
+		pthread_mutex_lock(&shard->lock);
+		for (j = 0; j < shard->num; j++) {
+			node = shard->node[j];
+			if (node->key == CACHE_INVALID_KEY)
+				continue;
+			cache_claim_wait(shard, node);
+			if (cb)
+				cb(node->key, node->buffer, userdata);
+			cache_free(cache, shard, node);
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+
+void cache_dump(struct cache *cache, FILE *fp)
+{
+	unsigned int i;
+	unsigned long long hit = 0, miss = 0, evict = 0;
+
+	for (i = 0; i < cache->shard_num; i++) {
+		hit += __atomic_load_n(&cache->shard[i].hit, __ATOMIC_RELAXED);
+		miss += __atomic_load_n(&cache->shard[i].miss, __ATOMIC_RELAXED);
+		evict += __atomic_load_n(&cache->shard[i].evict, __ATOMIC_RELAXED);
+	}
+	fprintf(fp, "cache: %u x %u bytes in %u shards, hit: %llu miss: %llu evict: %llu\n",
+			cache->num, cache->size, cache->shard_num, hit, miss, evict);
+}
+
+
+void cache_delete(struct cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->shard_num; i++) {
+		pthread_mutex_destroy(&cache->shard[i].lock);
+		pthread_cond_destroy(&cache->shard[i].cond);
+		mem_free(cache->shard[i].table);
+		mem_free(cache->shard[i].node);
+	}
+	free(cache->shard);
+	mem_free(cache->mem);
+	mem_free(cache);
+}
@@ -0,0 +1,150 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <pthread.h>
+
+#define CACHE_INVALID_KEY	0xffffffff
+#define CACHE_SHARD_MAX		64
+
+typedef int (*CACHE_CALLBACK)(unsigned int key, void *buf, void *userdata);
+
+/*
+ * ref is the pin count of users, -1 while the node is claimed to be
+ * evicted or removed; key, h_next and ref are read without lock
+ */
+struct cache_node {
+	struct cache_node *h_next;
+	struct cache_shard *shard;
+	unsigned int key;
+	int ref;
+	unsigned char clock; // referenced since the hand passed
+	char buffer[];
+};
+
+
+/* key modulo shard_num picks the shard, a shard replaces its own nodes by CLOCK */
+struct cache_shard {
+	pthread_mutex_t lock; // insert, evict and remove
+	pthread_cond_t cond; // a node is unpinned
+	int waiter;
+	unsigned int num;
+	unsigned int hand;
+	unsigned int mask; // of hash table
+	struct cache_node **table;
+	struct cache_node **node;
+	struct cache_node *free;
+	unsigned long long hit;
+	unsigned long long miss;
+	unsigned long long evict;
+} __attribute__((aligned(64)));
+
+
+struct cache {
+	unsigned int size;
+	unsigned int num;
+	unsigned int shard_num;
+	struct cache_shard *shard;
+	char *mem;
+};
+
+
+/*
+ * cache_create - create a sharded cache of fixed buffers
+ * @size: buffer size
+ * @num: buffer number, split evenly to shards
+ * @shard_num: shard number, 1 ~ CACHE_SHARD_MAX and no more than num
+ *
+ * Returns cache object if success, otherwise NULL
+ */
+struct cache *cache_create(unsigned int size, unsigned int num, unsigned int shard_num);
+
+
+/*
+ * cache_get - look up and pin the buffer of key, without lock; a hit only
+ *             marks the buffer referenced for CLOCK
+ * @cache: cache object
+ * @key: key of buffer
+ *
+ * Returns pinned buffer, NULL if key is not cached
+ */
+void *cache_get(struct cache *cache, unsigned int key);
+
+
+/*
+ * cache_set - pin the buffer of key, a free or evicted buffer is taken if
+ *             key is not cached; waits if every buffer of the shard is
+ *             pinned, so a thread pins one buffer at a time. A new buffer
+ *             is filled by its caller before any other thread gets the key
+ * @cache: cache object
+ * @key: key of buffer
+ * @cb: called with an evicted buffer under shard lock, may be NULL
+ * @userdata: passed to cb
+ *
+ * Returns pinned buffer, contents of an evicted buffer are left in place
+ */
+void *cache_set(struct cache *cache, unsigned int key, CACHE_CALLBACK cb, void *userdata);
+
+
+/*
+ * cache_put - unpin a buffer of cache_get or cache_set
+ * @buf: pinned buffer
+ */
+void cache_put(void *buf);
+
+
+/*
+ * cache_remove - drop the buffer of key without callback, waits until
+ *                it is unpinned
+ * @cache: cache object
+ * @key: key of buffer
+ *
+ * Returns zero if success, otherwise non-zero if key is not cached
+ */
+int cache_remove(struct cache *cache, unsigned int key);
+
+
+/*
+ * cache_flush - evict every buffer with callback, waits until they are
+ *               unpinned
+ * @cache: cache object
+ * @cb: called with each buffer under shard lock, may be NULL
+ * @userdata: passed to cb
+ */
+void cache_flush(struct cache *cache, CACHE_CALLBACK cb, void *userdata);
+
+
+/*
+ * cache_dump - print hit, miss and eviction of cache
+ * @cache: cache object
+ * @fp: output file
+ */
+void cache_dump(struct cache *cache, FILE *fp);
+
+
+/*
+ * cache_delete - destory the cache object
+ * @cache: cache object
+ */
+void cache_delete(struct cache *cache);
+
+#endif // __CACHE_H__
@@ -18,26 +18,164 @@
  * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include "common.h"
-#include "lru.h"
+#include "arena.h"
+#include "cache.h"
 #include "file.h"
 #include "brotli/encode.h"
 #include "brotli/decode.h"
 
+#define FILE_WARM_BUCKET_MIN			256
+#define FILE_SINK_SUFFIX				".sink" // file of sink thread before rename
 
-void data_compress(char *in_data, int in_size, char *out_data, int *out_size, int compress_type)
+
+/* a block in warm tier, in the table by id and in the age list */
+struct file_warm {
+	struct file_warm *h_next;
+	struct file_warm *prev; // newer
+	struct file_warm *next; // older
+	unsigned int id;
+	int size;
+	bool sink; // taken by sink thread, off the age list
+	bool drop; // removed from table while sinking, sink thread frees it
+	char data[];
+};
+
+
+/*
+ * compressed data buffer of a thread; brotli 1.0 has no reset of a
+ * finished stream, an instance lives for one stream and all its memory
+ * comes from the arena of the thread, so a stream costs state init and no
+ * allocation, and an idle thread keeps no encoder state
+ */
+struct file_codec {
+	char *scratch;
+	int scratch_size;
+};
+
+static pthread_once_t file_codec_once = PTHREAD_ONCE_INIT;
+static pthread_key_t file_codec_key;
+static __thread struct file_codec *file_codec_self;
+
+
+static void *file_codec_alloc(void *opaque, size_t size)
 {
+	(void)opaque;
+	return arena_alloc(size);
+}
+
+
+static void file_codec_free(void *opaque, void *mem)
+{
+	(void)opaque;
+	arena_free(mem);
+}
+
+
+static void file_codec_exit(void *arg)
+{
+	struct file_codec *codec = arg;
+
+	arena_free(codec->scratch);
+	mem_free(codec);
+	file_codec_self = NULL;
+}
+
+
+static void file_codec_key_create(void)
+{
+	pthread_key_create(&file_codec_key, file_codec_exit);
+}
+
+
+static struct file_codec *file_codec(void)
+{
+	struct file_codec *codec = file_codec_self;
+
+	if (codec)
+		return codec;
+	pthread_once(&file_codec_once, file_codec_key_create);
+	codec = mem_alloc(sizeof(struct file_codec));
+	pthread_setspecific(file_codec_key, codec);
+	file_codec_self = codec;
+	return codec;
+}
+
+
+/* buffer of compressed data, kept by the thread and grown to the largest */
+static char *file_scratch(int size)
+{
+	struct file_codec *codec = file_codec();
+
+	if (codec->scratch_size < size) {
+		arena_free(codec->scratch);
+		codec->scratch = arena_alloc(size);
+		codec->scratch_size = size;
+	}
+	return codec->scratch;
+}
+
+
+static bool brotli_compress(char *in_data, int in_size, char *out_data, int *out_size,
+							int quality)
+{
+	BrotliEncoderState *s;
+	size_t avail_in = in_size, avail_out = *out_size, total = 0;
+	const uint8_t *next_in = (const uint8_t *)in_data;
+	uint8_t *next_out = (uint8_t *)out_data;
 	BROTLI_BOOL ret;
 
+	s = BrotliEncoderCreateInstance(file_codec_alloc, file_codec_free, NULL);
+	if (!s)
+		return FALSE;
+	BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, quality);
+	BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, BROTLI_DEFAULT_WINDOW);
+	BrotliEncoderSetParameter(s, BROTLI_PARAM_MODE, BROTLI_DEFAULT_MODE);
+	BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT, in_size);
+	ret = BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH, &avail_in, &next_in,
+									&avail_out, &next_out, &total);
+	ret = ret && BrotliEncoderIsFinished(s);
+	/* the next stream starts on fresh state, from the memory just freed */
+	BrotliEncoderDestroyInstance(s);
+	if (ret)
+		*out_size = total;
+	return ret;
+}
+
+
+static bool brotli_decompress(char *in_data, int in_size, char *out_data, int *out_size)
+{
+	BrotliDecoderState *s;
+	size_t avail_in = in_size, avail_out = *out_size, total = 0;
+	const uint8_t *next_in = (const uint8_t *)in_data;
+	uint8_t *next_out = (uint8_t *)out_data;
+	BrotliDecoderResult ret;
+
+	s = BrotliDecoderCreateInstance(file_codec_alloc, file_codec_free, NULL);
+	if (!s)
+		return FALSE;
+	ret = BrotliDecoderDecompressStream(s, &avail_in, &next_in, &avail_out, &next_out, &total);
+	BrotliDecoderDestroyInstance(s);
+	if (ret == BROTLI_DECODER_RESULT_SUCCESS)
+		*out_size = total;
+	return ret == BROTLI_DECODER_RESULT_SUCCESS;
+}
+
+
+void data_compress(char *in_data, int in_size, char *out_data, int *out_size, int compress_type)
+{
 	ASSERT(out_data);
 	switch (compress_type) {
 	case COMPRESS_NONE:
 		memcpy(out_data, in_data, *out_size);
 		break;
 	case COMPRESS_BROTLI:
-		ret = BrotliEncoderCompress(BROTLI_DEFAULT_QUALITY, BROTLI_DEFAULT_WINDOW,
-				BROTLI_DEFAULT_MODE, in_size, in_data, (size_t *)out_size, out_data);
-		if (ret == BROTLI_FALSE)
+		if (!brotli_compress(in_data, in_size, out_data, out_size, BROTLI_DEFAULT_QUALITY))
+			memcpy(out_data, in_data, *out_size);
+		break;
+	case COMPRESS_BROTLI_FAST:
+		if (!brotli_compress(in_data, in_size, out_data, out_size, FILE_FAST_QUALITY))
 			memcpy(out_data, in_data, *out_size);
 		break;
 	default:
@@ -48,16 +186,14 @@ void data_compress(char *in_data, int in_size, char *out_data, int *out_size, in
 
 void data_decompress(char *in_data, int in_size, char *out_data, int *out_size, int compress_type)
 {
-	BROTLI_BOOL ret;
-
 	ASSERT(out_data);
 	switch (compress_type) {
 	case COMPRESS_NONE:
 		memcpy(out_data, in_data, *out_size);
 		break;
 	case COMPRESS_BROTLI:
-		ret = BrotliDecoderDecompress(in_size, in_data, (size_t *)out_size, out_data);
-		if (ret == BROTLI_FALSE)
+	case COMPRESS_BROTLI_FAST:
+		if (!brotli_decompress(in_data, in_size, out_data, out_size))
 			memcpy(out_data, in_data, *out_size);
 		break;
 	default:
@@ -66,36 +202,261 @@ void data_decompress(char *in_data, int in_size, char *out_data, int *out_size,
 }
 
 
-static int file_lru_cb(void *data, void **userdata)
-{
-	char *buf, *wbuf;
-	int out_size;
-	FILE *fp = NULL;
-	struct lru_node *node;
-	struct file_info *info;
-	unsigned long value;
 
-	node = (struct lru_node *)data;
-	info = (struct file_info *)(*userdata);
 
-	wbuf = buf = node->buffer;
-	value = *(unsigned long *)(buf + info->size);
-	fp = (FILE *)value;
+/* write data of id to its file plus suffix, the file is created or truncated */
+static int file_store(struct file_info *info, unsigned int id, const char *suffix,
+					char *data, int size)
+{
+	FILE *fp;
+	int ret;
+	char name[FILE_NAME_MAX + 16] = {'\0'};
+
+	sprintf(name, "%s/%u%s", info->name, id, suffix);
+	fp = fopen(name, "wb");
 	if (!fp) {
-		LOG(LOG_WARN, "file handler is NULL");
-		return 0;
+		LOG(LOG_WARN, "Cannot write file %s", name);
+		return -1;
 	}
-	out_size = info->size;
-	if (info->compress) {
-		//wbuf = mem_alloc(out_size);
-		data_compress(buf, info->size, wbuf, &out_size, info->compress);
+	ret = fwrite(data, 1, size, fp) != (size_t)size;
+	ret |= fclose(fp);
+	if (ret)
+		LOG(LOG_WARN, "Write file %s fail", name);
+	return ret ? -1 : 0;
+}
+
+
+static inline struct file_warm **file_warm_bucket(struct file_info *info, unsigned int id)
+{
+	return &info->warm_table[id & info->warm_mask];
+}
+
+
+/* take node off the age list under warm lock */
+static void file_warm_age_unlink(struct file_info *info, struct file_warm *node)
+{
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		info->warm_head = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+	else
+		info->warm_tail = node->prev;
+	node->prev = node->next = NULL;
+}
+
+
+/*
+ * take node of id out of table under warm lock, wakes file_flush when
+ * warm tier is empty; a sinking node is only marked dropped, it is still
+ * read and then freed by sink thread
+ *
+ * Returns node of id, NULL if id is not warm
+ */
+static struct file_warm *file_warm_unlink(struct file_info *info, unsigned int id)
+{
+	struct file_warm **p, *node;
+
+	for (p = file_warm_bucket(info, id); *p && (*p)->id != id; p = &(*p)->h_next)
+		;
+	node = *p;
+	if (!node)
+		return NULL;
+	*p = node->h_next;
+	if (!--info->warm_num && info->flush)
+		pthread_cond_broadcast(&info->flush_cond);
+	__atomic_sub_fetch(&info->warm_bytes, node->size, __ATOMIC_RELAXED);
+	if (node->sink)
+		node->drop = TRUE;
+	else
+		file_warm_age_unlink(info, node);
+	return node;
+}
+
+
+/* no room in warm tier, eviction writes the file itself */
+static inline bool file_warm_full(struct file_info *info)
+{
+	return !info->warm_on || __atomic_load_n(&info->warm_bytes, __ATOMIC_RELAXED) >
+			FILE_WARM_HARD * info->warm_max;
+}
+
+
+/* compress a hot block by the fast codec into warm tier as the newest */
+static void file_warm_demote(struct file_info *info, unsigned int id, char *data)
+{
+	int out_size = info->size;
+	char *buf = file_scratch(info->size);
+	struct file_warm *node;
+
+	data_compress(data, info->size, buf, &out_size, COMPRESS_BROTLI_FAST);
+	node = mem_alloc(sizeof(struct file_warm) + out_size);
+	node->id = id;
+	node->size = out_size;
+	memcpy(node->data, buf, out_size);
+
+	pthread_mutex_lock(&info->warm_lock);
+	node->h_next = *file_warm_bucket(info, id);
+	*file_warm_bucket(info, id) = node;
+	node->next = info->warm_head;
+	if (info->warm_head)
+		info->warm_head->prev = node;
+	else
+		info->warm_tail = node;
+	info->warm_head = node;
+	info->warm_num++;
+	info->demote++;
+	if (__atomic_add_fetch(&info->warm_bytes, out_size, __ATOMIC_RELAXED) > info->warm_max)
+		pthread_cond_signal(&info->warm_cond);
+	pthread_mutex_unlock(&info->warm_lock);
+}
+
+
+/*
+ * move warm data of id to a pinned cache buffer, decompressed outside the
+ * lock; data of a sinking node is copied first, sink thread frees it
+ *
+ * Returns zero if success, otherwise non-zero if id is not warm
+ */
+static int file_warm_promote(struct file_info *info, unsigned int id, char *buf)
+{
+	int size, out_size = info->size;
+	char *data;
+	struct file_warm *node;
+
+	pthread_mutex_lock(&info->warm_lock);
+	node = file_warm_unlink(info, id);
+	if (!node) {
+		pthread_mutex_unlock(&info->warm_lock);
+		return -1;
 	}
-	fwrite(wbuf, 1, out_size, fp);
-	memset(buf, 0, info->size);
-	//if (info->compress)
-	//	mem_free(wbuf);
-	fclose(fp);
-	*(unsigned long *)(buf + info->size) = (unsigned long)NULL;
+	info->promote++;
+	size = node->size;
+	data = node->data;
+	if (node->sink) {
+		data = file_scratch(size);
+		memcpy(data, node->data, size);
+		node = NULL;
+	}
+	pthread_mutex_unlock(&info->warm_lock);
+
+	data_decompress(data, size, buf, &out_size, COMPRESS_BROTLI_FAST);
+	mem_free(node);
+	return 0;
+}
+
+
+/* drop warm data of id, a sinking node is left to sink thread */
+static void file_warm_drop(struct file_info *info, unsigned int id)
+{
+	struct file_warm *node;
+
+	if (!info->warm_on)
+		return;
+	pthread_mutex_lock(&info->warm_lock);
+	node = file_warm_unlink(info, id);
+	if (node && node->sink)
+		node = NULL;
+	pthread_mutex_unlock(&info->warm_lock);
+	mem_free(node);
+}
+
+
+/*
+ * oldest warm blocks are recompressed by the codec of file and written
+ * while warm tier is over budget or flushed; a node stays in table until
+ * its file is written, so a reader finds it either warm or cold. The file
+ * is written aside without lock, then renamed in place under warm lock,
+ * so eviction and reads never wait for block I/O, and a discard or new
+ * block of id never sees the file come back
+ */
+static void *file_warm_thread(void *arg)
+{
+	struct file_info *info = arg;
+	struct file_warm *node;
+	char *plain, *buf;
+	int out_size, ret;
+	bool drop;
+	char name[FILE_NAME_MAX + 16] = {'\0'};
+	char sink_name[FILE_NAME_MAX + 32] = {'\0'};
+
+	plain = mem_alloc(info->size);
+	pthread_mutex_lock(&info->warm_lock);
+	for (;;) {
+		while (!info->stop && !(info->warm_tail &&
+				(info->flush || info->warm_bytes > info->warm_max)))
+			pthread_cond_wait(&info->warm_cond, &info->warm_lock);
+		if (info->stop)
+			break;
+		node = info->warm_tail;
+		file_warm_age_unlink(info, node);
+		node->sink = TRUE;
+		pthread_mutex_unlock(&info->warm_lock);
+
+		out_size = info->size;
+		data_decompress(node->data, node->size, plain, &out_size, COMPRESS_BROTLI_FAST);
+		buf = file_scratch(info->size);
+		out_size = info->size;
+		data_compress(plain, info->size, buf, &out_size, info->compress);
+		sprintf(name, "%s/%u", info->name, node->id);
+		sprintf(sink_name, "%s%s", name, FILE_SINK_SUFFIX);
+		ret = file_store(info, node->id, FILE_SINK_SUFFIX, buf, out_size);
+
+		pthread_mutex_lock(&info->warm_lock);
+		/* dropped by a read or discard, the file is theirs */
+		drop = node->drop;
+		if (!drop) {
+			if (!ret && rename(sink_name, name))
+				LOG(LOG_WARN, "Cannot rename file %s", sink_name);
+			file_warm_unlink(info, node->id);
+			info->sink++;
+		}
+		mem_free(node);
+		if (drop && !ret) {
+			pthread_mutex_unlock(&info->warm_lock);
+			remove(sink_name);
+			pthread_mutex_lock(&info->warm_lock);
+		}
+	}
+	pthread_mutex_unlock(&info->warm_lock);
+	mem_free(plain);
+	return NULL;
+}
+
+
+/* behind data of a cache buffer, TRUE if the file of id holds the same data */
+static inline bool *file_cold(struct file_info *info, char *buf)
+{
+	return (bool *)(buf + info->size);
+}
+
+
+/*
+ * evicted buffers go to warm tier, or to file if it is full; a buffer
+ * its file still holds is only dropped
+ */
+static int file_cache_cb(unsigned int key, void *data, void *userdata)
+{
+	char *buf = data, *wbuf = data;
+	int out_size;
+	struct file_info *info = userdata;
+
+	if (*file_cold(info, buf)) {
+		__atomic_add_fetch(&info->clean, 1, __ATOMIC_RELAXED);
+	} else if (!file_warm_full(info)) {
+		file_warm_demote(info, key, buf);
+	} else {
+		out_size = info->size;
+		if (info->compress) {
+			wbuf = file_scratch(out_size);
+			data_compress(buf, info->size, wbuf, &out_size, info->compress);
+		}
+		file_store(info, key, "", wbuf, out_size);
+		__atomic_add_fetch(&info->direct, 1, __ATOMIC_RELAXED);
+	}
+	/* a free buffer is zeroed */
+	memset(buf, 0, info->size + sizeof(bool));
 	return 0;
 }
 
@@ -105,7 +466,7 @@ struct file_info *file_create(char name[], int size, int num, enum file_compress
 	int sz;
 	struct file_info *info;
 
-	sz = MIN(strlen(name), 15);
+	sz = MIN(strlen(name), FILE_NAME_MAX - 1);
 	info = mem_alloc(sizeof(struct file_info));
 	memcpy(info->name, name, sz);
 	info->compress = comp;
@@ -113,34 +474,45 @@ struct file_info *file_create(char name[], int size, int num, enum file_compress
 	num = roundup_power2(num);
 	info->num = MIN(FILE_MAX_HANDLER, num);
 	printf("num: %d", info->num);
-	info->cache = lru_create(size + sizeof(FILE *), info->num);
+	/* a shard keeps four buffers at least, ids are not spread evenly */
+	info->cache = cache_create(size + sizeof(bool), info->num, MIN(MAX(info->num / 4, 1), CACHE_SHARD_MAX));
 
 	if (access(info->name, 0))
 		mkdir(info->name, 0777);
 
+	/* a warm block is a few times smaller than hot, ids are dense */
+	info->warm_max = (unsigned long long)size * info->num * FILE_WARM_RATIO / 100;
+	info->warm_mask = MAX(FILE_WARM_BUCKET_MIN, roundup_power2(16 * info->num)) - 1;
+	info->warm_table = mem_alloc((info->warm_mask + 1) * sizeof(struct file_warm *));
+	pthread_mutex_init(&info->warm_lock, NULL);
+	pthread_cond_init(&info->warm_cond, NULL);
+	pthread_cond_init(&info->flush_cond, NULL);
+	if (comp != COMPRESS_NONE)
+		info->warm_on = !pthread_create(&info->warm_thread, NULL, file_warm_thread, info);
+
 	return info;
 }
 
 
-void *file_read(struct file_info *info, int id)
+/* Returns pinned buffer of id loaded from a lower tier, NULL if id has no file */
+static char *file_load(struct file_info *info, int id)
 {
-	int ret, size, out_size;
+	int size, out_size;
 	FILE *fp = NULL;
 	char *buf, *rbuf;
-	char name[16] = {'\0'};
-
-	buf = lru_get(info->cache, id);
-	if (buf)
-		return buf;
+	char name[FILE_NAME_MAX + 16] = {'\0'};
 
 	sprintf(name, "%s/%d", info->name, id);
 	fp = fopen(name, "rb");
-	if (!fp) {
-		LOG(LOG_WARN, "Cannot read file %s", name);
+	if (!fp)
 		return NULL;
-	}
 
-	rbuf = buf = lru_set(info->cache, id, file_lru_cb, (void **)&info);
+	/* eviction of id runs under the same shard lock, it is warm by now */
+	rbuf = buf = cache_set(info->cache, id, file_cache_cb, info);
+	if (info->warm_on && !file_warm_promote(info, id, buf)) {
+		fclose(fp);
+		return buf;
+	}
 
 	fseek(fp, 0, SEEK_END);
 	size = ftell(fp);
@@ -148,81 +520,170 @@ void *file_read(struct file_info *info, int id)
 
 	ASSERT(size <= info->size);
 	if (info->compress)
-		rbuf = mem_alloc(size);
+		rbuf = file_scratch(size);
 
 	fread(rbuf, 1, size, fp);
 	fclose(fp);
-	fp = fopen(name, "wb+");
 
-	if (info->compress) {
+	if (info->compress && size) {
 		out_size = info->size;
 		data_decompress(rbuf, size, buf, &out_size, info->compress);
-		mem_free(rbuf);
 	}
+	*file_cold(info, buf) = TRUE;
+	__atomic_add_fetch(&info->cold_read, 1, __ATOMIC_RELAXED);
 
-	ASSERT(fp);
-	*(unsigned long *)(buf + info->size) = (unsigned long)fp;
+	return buf;
+}
+
+
+void *file_read(struct file_info *info, int id)
+{
+	char *buf;
+
+	buf = cache_get(info->cache, id);
+	if (buf)
+		return buf;
+	return file_load(info, id);
+}
 
+
+void *file_modify(struct file_info *info, int id)
+{
+	char *buf;
+
+	buf = cache_get(info->cache, id);
+	if (!buf)
+		buf = file_load(info, id);
+	if (!buf)
+		return file_write_cache(info, id);
+	*file_cold(info, buf) = FALSE;
 	return buf;
 }
 
 
 int file_write(struct file_info *info, int id)
 {
-	FILE *fp = NULL;
 	char *buf, *wbuf;
 	int out_size;
-	unsigned long value;
 
-	wbuf = buf = lru_get(info->cache, id);
+	wbuf = buf = cache_get(info->cache, id);
 	if (!buf)
 		return -1;
 
-	value = *(unsigned long *)(buf + info->size);
-	fp = (FILE *)value;
 	out_size = info->size;
 	if (info->compress) {
-		//wbuf = mem_alloc(out_size);
+		wbuf = file_scratch(out_size);
 		data_compress(buf, info->size, wbuf, &out_size, info->compress);
 	}
-	fwrite(wbuf, 1, out_size, fp);
-	//if (info->compress)
-		//mem_free(wbuf);
-	fclose(fp);
-	*(unsigned long *)(buf + info->size) = (unsigned long)NULL;
+	*file_cold(info, buf) = !file_store(info, id, "", wbuf, out_size);
+	cache_put(buf);
 	return 0;
 }
 
 
 int file_flush(struct file_info *info)
 {
-	return lru_for_each(info->cache, file_lru_cb, (void **)&info);
+	cache_flush(info->cache, file_cache_cb, info);
+	if (!info->warm_on)
+		return 0;
+
+	pthread_mutex_lock(&info->warm_lock);
+	info->flush++;
+	pthread_cond_signal(&info->warm_cond);
+	while (info->warm_num)
+		pthread_cond_wait(&info->flush_cond, &info->warm_lock);
+	info->flush--;
+	pthread_mutex_unlock(&info->warm_lock);
+	return 0;
+}
+
+
+void file_put(struct file_info *info, void *buf)
+{
+	(void)info;
+	cache_put(buf);
 }
 
 
 void *file_write_cache(struct file_info *info, int id)
 {
 	FILE *fp = NULL;
-	unsigned long value;
-	unsigned char *buf;
-	char name[16] = {'\0'};
-
-	buf = lru_set(info->cache, id, file_lru_cb, (void **)&info);
-	value = *(unsigned long *)(buf + info->size);
-	fp = (FILE *)value;
-	if (fp == NULL) {
-		sprintf(name, "%s/%d", info->name, id);
-		fp = fopen(name, "wb+");
-		ASSERT(fp);
-		*(unsigned long *)(buf + info->size) = (unsigned long)fp;
+	char *buf;
+	char name[FILE_NAME_MAX + 16] = {'\0'};
+
+	buf = cache_get(info->cache, id);
+	if (buf) {
+		*file_cold(info, buf) = FALSE;
+		return buf;
 	}
+
+	/* a new block, older data of id is gone with the empty file */
+	buf = cache_set(info->cache, id, file_cache_cb, info);
+	file_warm_drop(info, id);
+	sprintf(name, "%s/%d", info->name, id);
+	fp = fopen(name, "wb");
+	ASSERT(fp);
+	fclose(fp);
 	return buf;
 }
 
 
+void file_discard(struct file_info *info, int id)
+{
+	char *buf;
+	char name[FILE_NAME_MAX + 16] = {'\0'};
+
+	buf = cache_get(info->cache, id);
+	if (buf) {
+		/* same as written back, a free buffer is zeroed */
+		memset(buf, 0, info->size + sizeof(bool));
+		cache_put(buf);
+	}
+	/* also waits for an eviction of id, which makes it warm */
+	cache_remove(info->cache, id);
+	file_warm_drop(info, id);
+	sprintf(name, "%s/%d", info->name, id);
+	remove(name);
+}
+
+
+void file_dump(struct file_info *info, FILE *fp)
+{
+	cache_dump(info->cache, fp);
+	pthread_mutex_lock(&info->warm_lock);
+	fprintf(fp, "warm: %u blocks %llu of %llu KB, demote: %llu promote: %llu sink: %llu\n",
+			info->warm_num, info->warm_bytes >> 10, info->warm_max >> 10,
+			info->demote, info->promote, info->sink);
+	pthread_mutex_unlock(&info->warm_lock);
+	fprintf(fp, "cold: read %llu direct write %llu clean drop %llu\n",
+			__atomic_load_n(&info->cold_read, __ATOMIC_RELAXED),
+			__atomic_load_n(&info->direct, __ATOMIC_RELAXED),
+			__atomic_load_n(&info->clean, __ATOMIC_RELAXED));
+}
+
+
 void file_delete(struct file_info *info)
 {
-	lru_delete(info->cache);
+	unsigned int i;
+	struct file_warm *node, *next;
+
+	if (info->warm_on) {
+		pthread_mutex_lock(&info->warm_lock);
+		info->stop = TRUE;
+		pthread_cond_signal(&info->warm_cond);
+		pthread_mutex_unlock(&info->warm_lock);
+		pthread_join(info->warm_thread, NULL);
+	}
+	for (i = 0; i <= info->warm_mask; i++) {
+		for (node = info->warm_table[i]; node; node = next) {
+			next = node->h_next;
+			mem_free(node);
+		}
+	}
+	mem_free(info->warm_table);
+	pthread_mutex_destroy(&info->warm_lock);
+	pthread_cond_destroy(&info->warm_cond);
+	pthread_cond_destroy(&info->flush_cond);
+	cache_delete(info->cache);
 	mem_free(info);
 }
-
@@ -20,22 +20,60 @@
 #ifndef __FILE_H__
 #define __FILE_H__
 
+#include <pthread.h>
+
 #define FILE_COMPRESS_BROTLI
-#define FILE_MAX_HANDLER	(32)
+#define FILE_MAX_HANDLER	(256)
+#define FILE_NAME_MAX		(64) // folder of files
+#define FILE_FAST_QUALITY	(1) // brotli quality of warm tier
+#define FILE_WARM_RATIO		(100) // warm tier bytes in percent of cache
+#define FILE_WARM_HARD		(2) // over this many budgets eviction writes files itself
 
 
 enum file_compress {
 	COMPRESS_NONE,
-	COMPRESS_BROTLI
+	COMPRESS_BROTLI,
+	COMPRESS_BROTLI_FAST // warm tier only
 };
 
 
+struct file_warm;
+
+/*
+ * data of an id is hot in cache uncompressed, warm in memory compressed
+ * by the fast codec, or cold in its file; eviction only makes a block
+ * warm, a sink thread writes the oldest warm blocks to files when warm
+ * tier is over budget, a read promotes a warm block to hot. The file of
+ * an id exists while the id has data in any tier, maybe empty; a hot
+ * block loaded from its file and not modified since is dropped at
+ * eviction without any write
+ */
 struct file_info {
-	char name[16];
+	char name[FILE_NAME_MAX];
 	int compress;
 	int size;
 	int num;
-	struct lru_cache *cache;
+	struct cache *cache; // shared by threads working on different ids
+	pthread_t warm_thread;
+	pthread_mutex_t warm_lock; // warm table, age list and nodes
+	pthread_cond_t warm_cond; // sink thread waits for work
+	pthread_cond_t flush_cond; // warm tier is empty
+	bool warm_on; // sink thread runs, compressed files only
+	bool stop;
+	int flush; // threads waiting in file_flush
+	unsigned int warm_mask;
+	struct file_warm **warm_table;
+	struct file_warm *warm_head; // newest
+	struct file_warm *warm_tail; // oldest, next to sink
+	unsigned int warm_num;
+	unsigned long long warm_bytes;
+	unsigned long long warm_max;
+	unsigned long long demote; // hot to warm
+	unsigned long long promote; // warm to hot
+	unsigned long long sink; // warm to cold
+	unsigned long long direct; // hot to cold, warm tier full
+	unsigned long long cold_read; // cold to hot
+	unsigned long long clean; // hot dropped at eviction, its file holds it
 };
 
 
@@ -51,15 +89,29 @@ struct file_info *file_create(char name[], int size, int num, enum file_compress
 
 
 /*
- * file_read - read file of id to cache
+ * file_read - read data of id to cache from warm tier or file, threads
+ *             read and write different ids in parallel; data must not be
+ *             modified, see file_modify
  * @info: file object
  * @id: file id
  *
- * Returns data address if success, otherwise NULL
+ * Returns data address pinned until file_put, NULL if id has no data
  */
 void *file_read(struct file_info *info, int id);
 
 
+/*
+ * file_modify - get cache address of id to modify, data of id is loaded
+ *               like file_read, or a new block is taken like
+ *               file_write_cache if id has no data
+ * @info: file object
+ * @id: file id
+ *
+ * Returns data address pinned until file_put
+ */
+void *file_modify(struct file_info *info, int id);
+
+
 /*
  * file_write - write file data of id to cache or file
  * @info: file object
@@ -72,7 +124,7 @@ int file_write(struct file_info *info, int id);
 
 
 /*
- * file_flush - flush cache to file
+ * file_flush - flush cache and warm tier to files, both are left empty
  * @info: file object
  *
  * Returns zero if success, otherwise non-zero
@@ -81,17 +133,43 @@ int file_flush(struct file_info *info);
 
 
 /*
- * file_write_cache - get cache address of id to write
+ * file_write_cache - get cache address of id to write, data of id not in
+ *                    cache is dropped from lower tiers
  * @info: file object
  * @id: file id
  *
- * Returns cache address if success, otherwise NULL
+ * Returns cache address pinned until file_put if success, otherwise NULL
  */
 void *file_write_cache(struct file_info *info, int id);
 
 
 /*
- * file_delete - delete file object
+ * file_put - unpin address of file_read or file_write_cache, a thread
+ *            keeps one address pinned at a time
+ * @info: file object
+ * @buf: pinned address
+ */
+void file_put(struct file_info *info, void *buf);
+
+
+/*
+ * file_discard - drop data of id in every tier without writeback
+ * @info: file object
+ * @id: file id
+ */
+void file_discard(struct file_info *info, int id);
+
+
+/*
+ * file_dump - print cache and tier movements of file object
+ * @info: file object
+ * @fp: output file
+ */
+void file_dump(struct file_info *info, FILE *fp);
+
+
+/*
+ * file_delete - delete file object, warm data not flushed is lost
  * @info: file object
  */
 void file_delete(struct file_info *info);
@@ -0,0 +1,147 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "heap.h"
+
+
+static void heap_swap(struct heap *h, unsigned int i, unsigned int j)
+{
+	struct heap_node *tmp;
+
+	tmp = h->node[i];
+	h->node[i] = h->node[j];
+	h->node[j] = tmp;
+	h->node[i]->index = i;
+	h->node[j]->index = j;
+}
+
+
+static void heap_sift_up(struct heap *h, unsigned int i)
+{
+	unsigned int parent;
+
+	while (i > 0) {
+		parent = (i - 1) >> 1;
+		if (h->node[parent]->key <= h->node[i]->key)
+			break;
+		heap_swap(h, i, parent);
+		i = parent;
+	}
+}
+
+
+static void heap_sift_down(struct heap *h, unsigned int i)
+{
+	unsigned int child;
+
+	while ((child = (i << 1) + 1) < h->num) {
+		if (child + 1 < h->num && h->node[child + 1]->key < h->node[child]->key)
+			child++;
+		if (h->node[i]->key <= h->node[child]->key)
+			break;
+		heap_swap(h, i, child);
+		i = child;
+	}
+}
+
+
+struct heap *heap_create(unsigned int size)
+{
+	struct heap *h;
+
+	h = mem_alloc(sizeof(struct heap));
+	h->size = MAX(size, 1);
+	h->num = 0;
+	h->node = mem_alloc(h->size * sizeof(struct heap_node *));
+	return h;
+}
+
+
+void heap_push(struct heap *h, struct heap_node *node)
+{
+	struct heap_node **tmp;
+
+	if (h->num == h->size) {
+		tmp = mem_alloc(h->size * 2 * sizeof(struct heap_node *));
+		memcpy(tmp, h->node, h->size * sizeof(struct heap_node *));
+		mem_free(h->node);
+		h->node = tmp;
+		h->size *= 2;
+	}
+	node->index = h->num;
+	h->node[h->num++] = node;
+	heap_sift_up(h, node->index);
+}
+
+
+struct heap_node *heap_top(struct heap *h)
+{
+	return h->num ? h->node[0] : NULL;
+}
+
+
+struct heap_node *heap_pop(struct heap *h)
+{
+	struct heap_node *node;
+
+	if (!h->num)
+		return NULL;
+	node = h->node[0];
+	heap_remove(h, node);
+	return node;
+}
+
+
+void heap_remove(struct heap *h, struct heap_node *node)
+{
+	unsigned int i = node->index;
+	struct heap_node *last;
+
+	ASSERT(i < h->num && h->node[i] == node);
+	h->num--;
+	if (i != h->num) {
+		last = h->node[h->num];
+		h->node[i] = last;
+		last->index = i;
+		heap_sift_up(h, i);
+		heap_sift_down(h, last->index);
+	}
+	node->index = HEAP_INVALID_INDEX;
+}
+
+
+void heap_update(struct heap *h, struct heap_node *node, unsigned long long key)
+{
+	unsigned long long old = node->key;
+
+	node->key = key;
+	if (key < old)
+		heap_sift_up(h, node->index);
+	else
+		heap_sift_down(h, node->index);
+}
+
+
+void heap_delete(struct heap *h)
+{
+	mem_free(h->node);
+	mem_free(h);
+}
@@ -0,0 +1,97 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __HEAP_H__
+#define __HEAP_H__
+
+#define HEAP_INVALID_INDEX		0xffffffff
+
+/* embed in user object, get it back by container_of */
+struct heap_node {
+	unsigned long long key;
+	unsigned int index;
+};
+
+
+struct heap {
+	unsigned int size;
+	unsigned int num;
+	struct heap_node **node;
+};
+
+
+/*
+ * heap_create - create min-heap object
+ * @size: initial node number, grows when full
+ *
+ * Returns heap object if success, otherwise NULL
+ */
+struct heap *heap_create(unsigned int size);
+
+
+/*
+ * heap_push - insert node with its key
+ * @h: heap object
+ * @node: node to insert, must not be in any heap
+ */
+void heap_push(struct heap *h, struct heap_node *node);
+
+
+/*
+ * heap_top - get node of minimal key
+ * @h: heap object
+ *
+ * Returns node if heap not empty, otherwise NULL
+ */
+struct heap_node *heap_top(struct heap *h);
+
+
+/*
+ * heap_pop - remove node of minimal key
+ * @h: heap object
+ *
+ * Returns removed node if heap not empty, otherwise NULL
+ */
+struct heap_node *heap_pop(struct heap *h);
+
+
+/*
+ * heap_remove - remove node from any position
+ * @h: heap object
+ * @node: node in heap
+ */
+void heap_remove(struct heap *h, struct heap_node *node);
+
+
+/*
+ * heap_update - change key of node in heap
+ * @h: heap object
+ * @node: node in heap
+ * @key: new key
+ */
+void heap_update(struct heap *h, struct heap_node *node, unsigned long long key);
+
+
+/*
+ * heap_delete - destory the heap, nodes are owned by user
+ * @h: heap object
+ */
+void heap_delete(struct heap *h);
+
+#endif // __HEAP_H__
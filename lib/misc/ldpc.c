@@ -0,0 +1,512 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "ldpc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LDPC_X86
+#endif
+
+#define LDPC_ROW_DEG_MAX(ldpc)		((ldpc)->kb + 3)
+#define LDPC_LAYER_FAIL				1 // some check of the layer fails
+#define LDPC_LAYER_FLIP				2 // some hard decision is flipped by the layer
+
+typedef int (*LDPC_LAYER_FUNC)(struct ldpc *ldpc, int i, short *msg);
+
+
+/* pseudo random number of (a, b, c) */
+static unsigned int ldpc_hash(int a, int b, int c)
+{
+	unsigned int x = (a + 1) * 0x9e3779b1 ^ (b + 1) * 0x85ebca77 ^ c * 0xc2b2ae3d;
+
+	x ^= x >> 15;
+	x *= 0x2c1b3c6d;
+	x ^= x >> 12;
+	return x;
+}
+
+
+/* Returns TRUE if column a is column b rotated, they make codewords of weight 2 */
+static bool ldpc_column_same(const int *a, const int *b, int mb, int z)
+{
+	int i, d = -1;
+
+	for (i = 0; i < mb; i++) {
+		if ((a[i] < 0) != (b[i] < 0))
+			return FALSE;
+		if (a[i] < 0)
+			continue;
+		if (d < 0)
+			d = (a[i] - b[i] + z) % z;
+		else if (d != (a[i] - b[i] + z) % z)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+/*
+ * pseudo random shifts of data column j in its rows, -1 for no block;
+ * shifts of a column are kept apart by 2 at least, otherwise a data
+ * bit and a few bits of the weight-2 parity columns make a low weight
+ * codeword, and no column is a rotation of a former one
+ */
+static void ldpc_column_shift(struct ldpc *ldpc, int *cs, int j, int weight, int stride)
+{
+	int c, k, d, row, z = ldpc->z, try = 0;
+	int *shift = cs + j * ldpc->mb;
+
+retry:
+	for (k = 0; k < ldpc->mb; k++)
+		shift[k] = -1;
+	for (c = 0; c < weight; c++) {
+		row = (j + c * stride) % ldpc->mb;
+		shift[row] = ldpc_hash(c, j, try++) % z;
+		for (k = 0; k < ldpc->mb; k++) {
+			d = (shift[row] - shift[k] + z) % z;
+			if (k != row && shift[k] >= 0 && (d <= 1 || d == z - 1))
+				break;
+		}
+		if (k < ldpc->mb) {
+			shift[row] = -1;
+			c--;
+		}
+	}
+	for (k = 0; k < j; k++) {
+		if (ldpc_column_same(shift, cs + k * ldpc->mb, ldpc->mb, z))
+			goto retry;
+	}
+}
+
+
+static void ldpc_base_init(struct ldpc *ldpc)
+{
+	int i, j, k, mid = ldpc->mb / 2;
+	int weight = MIN(LDPC_COL_WEIGHT, ldpc->mb);
+	int *col, *shift, *cs;
+
+	cs = mem_alloc(ldpc->kb * ldpc->mb * sizeof(int));
+	for (j = 0; j < ldpc->kb; j++)
+		ldpc_column_shift(ldpc, cs, j, weight, ldpc->mb / weight);
+
+	ldpc->row_deg = mem_alloc(ldpc->mb * sizeof(int));
+	ldpc->row_col = mem_alloc(ldpc->mb * LDPC_ROW_DEG_MAX(ldpc) * sizeof(int));
+	ldpc->row_shift = mem_alloc(ldpc->mb * LDPC_ROW_DEG_MAX(ldpc) * sizeof(int));
+	for (i = 0; i < ldpc->mb; i++) {
+		col = ldpc->row_col + i * LDPC_ROW_DEG_MAX(ldpc);
+		shift = ldpc->row_shift + i * LDPC_ROW_DEG_MAX(ldpc);
+		for (j = 0, k = 0; j < ldpc->kb; j++) {
+			if (cs[j * ldpc->mb + i] < 0)
+				continue;
+			col[k] = j;
+			shift[k++] = cs[j * ldpc->mb + i];
+		}
+		/* first parity column */
+		if (i == 0 || i == mid || i == ldpc->mb - 1) {
+			col[k] = ldpc->kb;
+			shift[k++] = i == mid ? 0 : 1;
+		}
+		/* dual diagonal, parity column c links row c - 1 and row c */
+		if (i > 0) {
+			col[k] = ldpc->kb + i;
+			shift[k++] = 0;
+		}
+		if (i < ldpc->mb - 1) {
+			col[k] = ldpc->kb + i + 1;
+			shift[k++] = 0;
+		}
+		ldpc->row_deg[i] = k;
+	}
+	mem_free(cs);
+}
+
+
+struct ldpc *ldpc_create(int len, int parity, int max_iter)
+{
+	int z, i, n, edge = 0;
+	struct ldpc *ldpc;
+
+	if (len <= 0 || parity <= 0 || max_iter <= 0)
+		return NULL;
+	for (z = LDPC_Z_MAX; z >= LDPC_Z_MIN; z >>= 1) {
+		if (parity * 8 % z == 0 && parity * 8 / z >= LDPC_MB_MIN)
+			break;
+	}
+	if (z < LDPC_Z_MIN) {
+		LOG(LOG_WARN, "no QC-LDPC code of %d bytes parity", parity);
+		return NULL;
+	}
+
+	ldpc = mem_alloc(sizeof(struct ldpc));
+	ldpc->z = z;
+	ldpc->kb = (len * 8 + z - 1) / z;
+	ldpc->mb = parity * 8 / z;
+	ldpc->len = len;
+	ldpc->parity_bytes = parity;
+	ldpc->max_iter = max_iter;
+	ldpc_base_init(ldpc);
+	for (i = 0; i < 256; i++) {
+		for (n = 0; n < 8; n++)
+			ldpc->expand[i][n] = (i >> (7 - n)) & 1;
+	}
+
+	n = (ldpc->kb + ldpc->mb) * z;
+	for (i = 0; i < ldpc->mb; i++)
+		edge += ldpc->row_deg[i] * z;
+	ldpc->llr = mem_alloc(n * sizeof(short));
+	ldpc->msg = mem_alloc(edge * sizeof(short));
+	ldpc->tmp = mem_alloc(LDPC_ROW_DEG_MAX(ldpc) * z * sizeof(short));
+	ldpc->sign = mem_alloc(z);
+	ldpc->bit = mem_alloc(n);
+	ldpc->orig = mem_alloc(n);
+	ldpc_select(ldpc, LDPC_AUTO);
+	return ldpc;
+}
+
+
+static void ldpc_unpack(struct ldpc *ldpc, const unsigned char *src, int bits, unsigned char *dst)
+{
+	int k;
+
+	for (k = 0; k < bits >> 3; k++)
+		memcpy(dst + (k << 3), ldpc->expand[src[k]], 8);
+	for (k <<= 3; k < bits; k++)
+		dst[k] = (src[k >> 3] >> (7 - (k & 7))) & 1;
+}
+
+
+static void ldpc_pack(const unsigned char *src, int bits, unsigned char *dst)
+{
+	int k;
+	const unsigned char *s;
+
+	for (k = 0; k < bits >> 3; k++) {
+		s = src + (k << 3);
+		dst[k] = s[0] << 7 | s[1] << 6 | s[2] << 5 | s[3] << 4 |
+				s[4] << 3 | s[5] << 2 | s[6] << 1 | s[7];
+	}
+}
+
+
+/* dst[r] ^= src[(r + s) % z] */
+static inline void ldpc_xor_rotate(unsigned char *dst, const unsigned char *src, int z, int s)
+{
+	int r;
+
+	for (r = 0; r < z - s; r++)
+		dst[r] ^= src[r + s];
+	for (; r < z; r++)
+		dst[r] ^= src[r + s - z];
+}
+
+
+void ldpc_encode(struct ldpc *ldpc, const unsigned char *data, int len, unsigned char *parity)
+{
+	int i, k, z = ldpc->z, mid = ldpc->mb / 2;
+	int *col, *shift;
+	unsigned char *bit = ldpc->bit, *lam = ldpc->orig, *p;
+
+	ASSERT(len <= ldpc->len);
+	memset(bit, 0, ldpc->kb * z);
+	ldpc_unpack(ldpc, data, len * 8, bit);
+
+	/* lam[i] = sum of P^s * d over data blocks of row i */
+	memset(lam, 0, ldpc->mb * z);
+	for (i = 0; i < ldpc->mb; i++) {
+		col = ldpc->row_col + i * LDPC_ROW_DEG_MAX(ldpc);
+		shift = ldpc->row_shift + i * LDPC_ROW_DEG_MAX(ldpc);
+		for (k = 0; col[k] < ldpc->kb; k++)
+			ldpc_xor_rotate(lam + i * z, bit + col[k] * z, z, shift[k]);
+	}
+
+	/* rows sum to p0 = sum of lam, then p1 from row 0 and p(i + 1) from row i */
+	p = bit + ldpc->kb * z;
+	memset(p, 0, ldpc->mb * z);
+	for (i = 0; i < ldpc->mb; i++)
+		ldpc_xor_rotate(p, lam + i * z, z, 0);
+	ldpc_xor_rotate(p + z, lam, z, 0);
+	ldpc_xor_rotate(p + z, p, z, 1);
+	for (i = 1; i < ldpc->mb - 1; i++) {
+		ldpc_xor_rotate(p + (i + 1) * z, lam + i * z, z, 0);
+		ldpc_xor_rotate(p + (i + 1) * z, p + i * z, z, 0);
+		if (i == mid)
+			ldpc_xor_rotate(p + (i + 1) * z, p, z, 0);
+	}
+	ldpc_pack(p, ldpc->mb * z, parity);
+}
+
+
+/* Returns TRUE if all checks are satisfied by hard bits */
+static bool ldpc_check(struct ldpc *ldpc, const unsigned char *bit)
+{
+	int i, k, r, z = ldpc->z;
+	int *col, *shift;
+	unsigned char *acc = ldpc->sign, fail;
+
+	for (i = 0; i < ldpc->mb; i++) {
+		col = ldpc->row_col + i * LDPC_ROW_DEG_MAX(ldpc);
+		shift = ldpc->row_shift + i * LDPC_ROW_DEG_MAX(ldpc);
+		memset(acc, 0, z);
+		for (k = 0; k < ldpc->row_deg[i]; k++)
+			ldpc_xor_rotate(acc, bit + col[k] * z, z, shift[k]);
+		for (r = 0, fail = 0; r < z; r++)
+			fail |= acc[r];
+		if (fail)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+static inline short ldpc_sat(int x)
+{
+	return MAX(MIN(x, LDPC_LLR_MAX), -LDPC_LLR_MAX);
+}
+
+
+/*
+ * one layer: z checks of block row i, msg holds its check to bit messages;
+ * lanes are 16-bit so that every loop vectorizes without widening, sign,
+ * parity and flip keep the xor or or of sign bits in bit 15. It is inlined
+ * to each target below, which vectorizes it as wide as the target.
+ *
+ * Returns LDPC_LAYER_FAIL if hard decisions of the updated posteriors
+ * fail some of the z checks, LDPC_LAYER_FLIP if any of them changes
+ */
+static inline __attribute__((always_inline)) int ldpc_layer_body(struct ldpc *ldpc, int i,
+															short *msg)
+{
+	int k, r, s, z = ldpc->z, deg = ldpc->row_deg[i];
+	int *col = ldpc->row_col + i * LDPC_ROW_DEG_MAX(ldpc);
+	int *shift = ldpc->row_shift + i * LDPC_ROW_DEG_MAX(ldpc);
+	short a, m, neg, *q, *llr;
+	short min1[LDPC_Z_MAX], min2[LDPC_Z_MAX], idx[LDPC_Z_MAX];
+	short sign[LDPC_Z_MAX], parity[LDPC_Z_MAX], flip[LDPC_Z_MAX], fail = 0, change = 0;
+
+	for (r = 0; r < z; r++) {
+		min1[r] = min2[r] = LDPC_LLR_MAX;
+		idx[r] = sign[r] = parity[r] = flip[r] = 0;
+	}
+	/* bit to check: posterior minus the message of this check */
+	for (k = 0; k < deg; k++, msg += z) {
+		q = ldpc->tmp + k * z;
+		llr = ldpc->llr + col[k] * z;
+		s = shift[k];
+		for (r = 0; r < z - s; r++)
+			q[r] = ldpc_sat(llr[r + s] - msg[r]);
+		for (; r < z; r++)
+			q[r] = ldpc_sat(llr[r + s - z] - msg[r]);
+		/* two minimums by min and max only */
+		for (r = 0; r < z; r++) {
+			a = q[r] < 0 ? -q[r] : q[r];
+			sign[r] ^= q[r];
+			min2[r] = MIN(MAX(a, min1[r]), min2[r]);
+			idx[r] = a < min1[r] ? k : idx[r];
+			min1[r] = MIN(a, min1[r]);
+		}
+	}
+	/* check to bit: minimum of the others, normalized by 3/4 */
+	msg -= deg * z;
+	for (k = 0; k < deg; k++, msg += z) {
+		q = ldpc->tmp + k * z;
+		for (r = 0; r < z; r++) {
+			m = idx[r] == k ? min2[r] : min1[r];
+			m -= m >> 2;
+			neg = (sign[r] ^ q[r]) >> 15;
+			m = (m ^ neg) - neg;
+			/* old posterior is q + old message, of the same sign if saturated */
+			a = q[r] + msg[r];
+			msg[r] = m;
+			q[r] = ldpc_sat(q[r] + m);
+			parity[r] ^= q[r];
+			flip[r] |= a ^ q[r];
+		}
+		llr = ldpc->llr + col[k] * z;
+		s = shift[k];
+		memcpy(llr + s, q, (z - s) * sizeof(short));
+		memcpy(llr, q + z - s, s * sizeof(short));
+	}
+	for (r = 0; r < z; r++) {
+		fail |= parity[r];
+		change |= flip[r];
+	}
+	return (fail < 0 ? LDPC_LAYER_FAIL : 0) | (change < 0 ? LDPC_LAYER_FLIP : 0);
+}
+
+
+static int ldpc_layer_scalar(struct ldpc *ldpc, int i, short *msg)
+{
+	return ldpc_layer_body(ldpc, i, msg);
+}
+
+
+#ifdef LDPC_X86
+__attribute__((target("avx2")))
+static int ldpc_layer_avx2(struct ldpc *ldpc, int i, short *msg)
+{
+	return ldpc_layer_body(ldpc, i, msg);
+}
+
+
+__attribute__((target("avx512f,avx512bw")))
+static int ldpc_layer_avx512(struct ldpc *ldpc, int i, short *msg)
+{
+	return ldpc_layer_body(ldpc, i, msg);
+}
+#endif // LDPC_X86
+
+
+static const char *ldpc_type_name[LDPC_TYPE_NUM] = {
+	"auto",
+	"scalar",
+	"avx2",
+	"avx512",
+};
+
+static LDPC_LAYER_FUNC ldpc_layer_func[LDPC_TYPE_NUM] = {
+	NULL,
+	ldpc_layer_scalar,
+#ifdef LDPC_X86
+	ldpc_layer_avx2,
+	ldpc_layer_avx512,
+#endif
+};
+
+
+static bool ldpc_supported(int type)
+{
+	switch (type) {
+	case LDPC_SCALAR:
+		return TRUE;
+#ifdef LDPC_X86
+	case LDPC_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case LDPC_AVX512:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+	default:
+		return FALSE;
+	}
+}
+
+
+int ldpc_select(struct ldpc *ldpc, int type)
+{
+	if (type == LDPC_AUTO) {
+		for (type = LDPC_TYPE_NUM - 1; !ldpc_supported(type); type--)
+			;
+	}
+	if (type <= LDPC_AUTO || type >= LDPC_TYPE_NUM || !ldpc_supported(type))
+		return -1;
+	ldpc->type = type;
+	return 0;
+}
+
+
+const char *ldpc_name(struct ldpc *ldpc)
+{
+	return ldpc_type_name[ldpc->type];
+}
+
+
+/* channel LLR of bits from..to - 1, weak bit of k is weak[k + off] */
+static void ldpc_llr_init(struct ldpc *ldpc, const unsigned char *weak, int from, int to, int off)
+{
+	int k;
+	short mag;
+
+	for (k = from; k < to; k++) {
+		mag = !weak ? LDPC_LLR_HARD : weak[k + off] ? LDPC_LLR_WEAK : LDPC_LLR_STRONG;
+		ldpc->llr[k] = ldpc->orig[k] ? -mag : mag;
+	}
+}
+
+
+int ldpc_decode(struct ldpc *ldpc, unsigned char *data, int len, unsigned char *parity,
+				const unsigned char *weak, int *iter)
+{
+	int i, k, it, num, edge, ret, pass = 0;
+	int n = (ldpc->kb + ldpc->mb) * ldpc->z, pb = ldpc->kb * ldpc->z;
+	unsigned char *orig = ldpc->orig, *w = NULL;
+
+	ASSERT(len <= ldpc->len);
+	*iter = 0;
+	memset(orig, 0, pb);
+	ldpc_unpack(ldpc, data, len * 8, orig);
+	ldpc_unpack(ldpc, parity, ldpc->mb * ldpc->z, orig + pb);
+	if (ldpc_check(ldpc, orig))
+		return 0;
+
+	/* weak bits are unpacked to bit, which is not used until the end */
+	if (weak) {
+		w = ldpc->bit;
+		ldpc_unpack(ldpc, weak, (len + ldpc->parity_bytes) * 8, w);
+	}
+	ldpc_llr_init(ldpc, w, 0, len * 8, 0);
+	/* padding bits are known zero */
+	for (k = len * 8; k < pb; k++)
+		ldpc->llr[k] = LDPC_LLR_MAX;
+	ldpc_llr_init(ldpc, w, pb, n, len * 8 - pb);
+	for (i = 0, edge = 0; i < ldpc->mb; i++)
+		edge += ldpc->row_deg[i] * ldpc->z;
+	memset(ldpc->msg, 0, edge * sizeof(short));
+
+	/*
+	 * a layer tells if its checks hold for the posteriors it leaves, which
+	 * stays true until another layer flips a hard decision: all checks
+	 * hold once mb layers in a row pass, no one but the first flipping
+	 */
+	for (it = 1; it <= ldpc->max_iter && pass < ldpc->mb; it++) {
+		for (i = 0, edge = 0; i < ldpc->mb && pass < ldpc->mb; i++) {
+			ret = ldpc_layer_func[ldpc->type](ldpc, i, ldpc->msg + edge);
+			edge += ldpc->row_deg[i] * ldpc->z;
+			if (ret & LDPC_LAYER_FLIP)
+				pass = 0;
+			pass = ret & LDPC_LAYER_FAIL ? 0 : pass + 1;
+		}
+	}
+	*iter = it - 1;
+	if (pass < ldpc->mb)
+		return -1;
+
+	for (k = 0, num = 0; k < n; k++) {
+		ldpc->bit[k] = ldpc->llr[k] < 0;
+		num += ldpc->bit[k] ^ orig[k];
+	}
+	ldpc_pack(ldpc->bit, len * 8, data);
+	ldpc_pack(ldpc->bit + pb, ldpc->mb * ldpc->z, parity);
+	return num;
+}
+
+
+void ldpc_delete(struct ldpc *ldpc)
+{
+	mem_free(ldpc->row_deg);
+	mem_free(ldpc->row_col);
+	mem_free(ldpc->row_shift);
+	mem_free(ldpc->llr);
+	mem_free(ldpc->msg);
+	mem_free(ldpc->tmp);
+	mem_free(ldpc->sign);
+	mem_free(ldpc->bit);
+	mem_free(ldpc->orig);
+	mem_free(ldpc);
+}
@@ -0,0 +1,141 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LDPC_H__
+#define __LDPC_H__
+
+#define LDPC_Z_MAX					256
+#define LDPC_Z_MIN					8
+#define LDPC_MB_MIN					4 // 3 for parity structure, 4 to spread data columns
+#define LDPC_COL_WEIGHT				4 // block rows of a data column
+#define LDPC_LLR_HARD				4 // channel LLR of hard-decision read
+#define LDPC_LLR_STRONG				8 // soft read: bit far from read threshold
+#define LDPC_LLR_WEAK				1 // soft read: bit near read threshold
+#define LDPC_LLR_MAX				1023
+
+/* implementation of layers, the widest supported by CPU is picked at ldpc_create */
+enum ldpc_type {
+	LDPC_AUTO,
+	LDPC_SCALAR,
+	LDPC_AVX2,
+	LDPC_AVX512,
+	LDPC_TYPE_NUM
+};
+
+/*
+ * quasi-cyclic LDPC code: the parity check matrix is mb x (kb + mb)
+ * blocks of z x z circulants, block P^s maps check r to bit (r + s) % z
+ * of its column block.
+ *
+ * data column j has LDPC_COL_WEIGHT blocks spread over rows from j % mb,
+ * each of pseudo random shift; parity blocks are dual-diagonal with
+ * the first parity column of shift 1, 0, 1 at the first, middle and
+ * last row, so that encoding is a recursion over rows; data shorter
+ * than kb * z bits is padded with known zero bits.
+ *
+ * decoding is layered min-sum normalized by 3/4 over 16-bit LLRs,
+ * positive LLR for bit 0; a layer handles z checks together so that
+ * the inner loops run over contiguous arrays of z.
+ */
+struct ldpc {
+	int z; // circulant size
+	int kb; // data block columns
+	int mb; // parity block columns and block rows
+	int len; // max data bytes
+	int parity_bytes; // mb * z / 8
+	int max_iter;
+	int *row_deg; // blocks of each block row
+	int *row_col; // column block of row i is row_col[i * (kb + 3) + k]
+	int *row_shift;
+	short *llr; // posterior of every bit
+	short *msg; // check to bit messages, row_deg * z of each row
+	short *tmp; // bit to check messages of a layer
+	unsigned char *sign; // check sums of ldpc_check
+	unsigned char *bit; // hard decision
+	unsigned char *orig; // received hard bits
+	unsigned char expand[256][8]; // bits of a byte, MSB first
+	int type; // enum ldpc_type in use
+};
+
+
+/*
+ * ldpc_create - create QC-LDPC code, z is the largest power of 2 that
+ *               gives LDPC_MB_MIN parity blocks at least
+ * @len: max data bytes of a codeword
+ * @parity: parity bytes of a codeword
+ * @max_iter: iterations before decode gives up
+ *
+ * Returns ldpc object if success, otherwise NULL
+ */
+struct ldpc *ldpc_create(int len, int parity, int max_iter);
+
+
+/*
+ * ldpc_encode - compute parity of data
+ * @ldpc: ldpc object
+ * @data: data buffer
+ * @len: data bytes, no more than ldpc->len
+ * @parity: return parity_bytes of parity
+ */
+void ldpc_encode(struct ldpc *ldpc, const unsigned char *data, int len, unsigned char *parity);
+
+
+/*
+ * ldpc_decode - correct data and parity in place
+ * @ldpc: ldpc object
+ * @data: data buffer
+ * @len: data bytes, same as encoded
+ * @parity: parity read with data
+ * @weak: bitmap of bits near read threshold over data and parity,
+ *        from read retry sensing; NULL for hard decision
+ * @iter: return iterations run, 0 if the codeword is clean
+ *
+ * Returns corrected bit number, negative if decode fails
+ */
+int ldpc_decode(struct ldpc *ldpc, unsigned char *data, int len, unsigned char *parity,
+				const unsigned char *weak, int *iter);
+
+
+/*
+ * ldpc_select - pick implementation of layers
+ * @ldpc: ldpc object
+ * @type: enum ldpc_type
+ *
+ * Returns zero if supported by CPU, otherwise -1 and nothing changes
+ */
+int ldpc_select(struct ldpc *ldpc, int type);
+
+
+/*
+ * ldpc_name - name of implementation in use
+ * @ldpc: ldpc object
+ *
+ * Returns "scalar", "avx2" or "avx512"
+ */
+const char *ldpc_name(struct ldpc *ldpc);
+
+
+/*
+ * ldpc_delete - destory the ldpc object
+ * @ldpc: ldpc object
+ */
+void ldpc_delete(struct ldpc *ldpc);
+
+#endif // __LDPC_H__
@@ -83,7 +83,8 @@ static void hash_delete(struct lru_cache *lru, unsigned int key)
 
 	ASSERT(tmp);
 	if (last == tmp) {
-		lru->table[index] = NULL;
+		lru->table[index] = tmp->h_next;
+		tmp->h_next = NULL;
 	} else {
 		last->h_next = tmp->h_next;
 		tmp->h_next = NULL;
@@ -214,6 +215,19 @@ void* lru_set(struct lru_cache *lru, unsigned int key, LRU_CALLBACK lru_cb, void
 }
 
 
+int lru_remove(struct lru_cache *lru, unsigned int key)
+{
+	struct lru_node *node;
+
+	node = hash_find(lru, key);
+	if (!node)
+		return -1;
+	hash_delete(lru, key);
+	lru_delete_node(&lru->head, &lru->free, node);
+	return 0;
+}
+
+
 int lru_for_each(struct lru_cache *lru, LRU_CALLBACK lru_cb, void **userdata)
 {
 	int ret = 0;
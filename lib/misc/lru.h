@@ -75,6 +75,16 @@ void *lru_get(struct lru_cache *lru, unsigned int key);
 void* lru_set(struct lru_cache *lru, unsigned int key, LRU_CALLBACK lru_cb, void **userdata);
 
 
+/*
+ * lru_remove - drop the buffer of key without callback
+ * @lru: allocated lru cache object
+ * @key: key of buffer
+ *
+ * Returns zero if success, otherwise non-zero if key is not cached
+ */
+int lru_remove(struct lru_cache *lru, unsigned int key);
+
+
 /*
  * lru_for_each - iterate lru list node for each
  * @lru: allocated lru cache object
@@ -0,0 +1,106 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sched.h>
+#include "common.h"
+#include "ring.h"
+
+
+struct ring *ring_create(unsigned int size, unsigned int entry_size)
+{
+	unsigned int i;
+	struct ring *ring;
+
+	if (!size || size > (1U << 30) || !entry_size)
+		return NULL;
+
+	ring = aligned_alloc(64, sizeof(struct ring));
+	ASSERT(ring);
+	memset(ring, 0, sizeof(struct ring));
+	for (ring->size = 1; ring->size < size; ring->size <<= 1)
+		;
+	ring->mask = ring->size - 1;
+	ring->entry_size = entry_size;
+	ring->seq = mem_alloc(ring->size * sizeof(unsigned long long));
+	ring->entry = mem_alloc(ring->size * entry_size);
+	for (i = 0; i < ring->size; i++)
+		ring->seq[i] = i;
+	return ring;
+}
+
+
+/*
+ * the consumer frees slots in order, the last slot being free means all
+ * of them are; a full ring is waited out by yield, the consumer may share
+ * the CPU with producers
+ */
+unsigned long long ring_reserve(struct ring *ring, int num)
+{
+	unsigned long long pos, last;
+
+	ASSERT(num > 0 && num <= (int)ring->size);
+	pos = __atomic_fetch_add(&ring->tail, num, __ATOMIC_RELAXED);
+	last = pos + num - 1;
+	while (__atomic_load_n(&ring->seq[last & ring->mask], __ATOMIC_ACQUIRE) != last)
+		sched_yield();
+	return pos;
+}
+
+
+void ring_commit(struct ring *ring, unsigned long long pos, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		__atomic_store_n(&ring->seq[(pos + i) & ring->mask], pos + i + 1, __ATOMIC_RELEASE);
+}
+
+
+/* producers commit out of order, count stops at the first hole */
+int ring_peek(struct ring *ring, int max)
+{
+	int n;
+	unsigned long long pos = ring->head;
+
+	for (n = 0; n < max; n++, pos++) {
+		if (__atomic_load_n(&ring->seq[pos & ring->mask], __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+	}
+	return n;
+}
+
+
+void ring_release(struct ring *ring, int num)
+{
+	int i;
+	unsigned long long pos = ring->head;
+
+	for (i = 0; i < num; i++, pos++)
+		__atomic_store_n(&ring->seq[pos & ring->mask], pos + ring->size, __ATOMIC_RELEASE);
+	ring->head = pos;
+}
+
+
+void ring_delete(struct ring *ring)
+{
+	mem_free(ring->entry);
+	mem_free(ring->seq);
+	free(ring);
+}
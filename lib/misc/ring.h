@@ -0,0 +1,107 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+/*
+ * bounded ring of fixed size entries, many producers and one consumer, no
+ * lock; a producer reserves slots by one atomic add, fills them in place
+ * and commits them, the consumer takes committed slots in order; seq of a
+ * slot is pos while free for position pos, pos + 1 once committed
+ */
+struct ring {
+	unsigned int size; // slots, power of 2
+	unsigned int mask;
+	unsigned int entry_size;
+	unsigned long long *seq;
+	char *entry;
+	unsigned long long tail __attribute__((aligned(64))); // next to reserve, producers
+	unsigned long long head __attribute__((aligned(64))); // next to consume, consumer only
+};
+
+
+/*
+ * ring_create - create a ring
+ * @size: slot number, rounded up to power of 2
+ * @entry_size: bytes of an entry
+ *
+ * Returns ring object if success, otherwise NULL
+ */
+struct ring *ring_create(unsigned int size, unsigned int entry_size);
+
+
+/*
+ * ring_reserve - reserve contiguous slots, waits while the ring is full
+ * @ring: ring object
+ * @num: slot number, no more than size
+ *
+ * Returns position of first slot
+ */
+unsigned long long ring_reserve(struct ring *ring, int num);
+
+
+/*
+ * ring_entry - entry of a reserved or consumed slot
+ * @ring: ring object
+ * @pos: position of slot
+ *
+ * Returns entry buffer
+ */
+static inline void *ring_entry(struct ring *ring, unsigned long long pos)
+{
+	return ring->entry + (pos & ring->mask) * ring->entry_size;
+}
+
+
+/*
+ * ring_commit - hand filled slots to the consumer
+ * @ring: ring object
+ * @pos: position of first slot, returned by ring_reserve
+ * @num: slot number
+ */
+void ring_commit(struct ring *ring, unsigned long long pos, int num);
+
+
+/*
+ * ring_peek - count committed slots from head, consumer only
+ * @ring: ring object
+ * @max: most slots to count
+ *
+ * Returns slot number, entries are at head, head + 1 ...
+ */
+int ring_peek(struct ring *ring, int max);
+
+
+/*
+ * ring_release - free slots from head to producers, consumer only
+ * @ring: ring object
+ * @num: slot number, no more than ring_peek returns
+ */
+void ring_release(struct ring *ring, int num);
+
+
+/*
+ * ring_delete - destory the ring
+ * @ring: ring object
+ */
+void ring_delete(struct ring *ring);
+
+#endif // __RING_H__
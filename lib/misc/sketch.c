@@ -0,0 +1,98 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "sketch.h"
+
+/* odd multipliers of multiply-shift hash, one per row */
+static const unsigned int sketch_seed[SKETCH_DEPTH] = {
+	0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f
+};
+
+
+static inline unsigned char *sketch_counter(struct sketch *sk, int row, unsigned int key)
+{
+	return &sk->count[row * sk->width + ((key * sketch_seed[row]) >> sk->shift)];
+}
+
+
+static void sketch_age(struct sketch *sk)
+{
+	unsigned int i;
+
+	for (i = 0; i < SKETCH_DEPTH * sk->width; i++)
+		sk->count[i] >>= 1;
+	sk->add = 0;
+}
+
+
+struct sketch *sketch_create(unsigned int width, unsigned int age)
+{
+	struct sketch *sk;
+
+	width = roundup_power2(MAX(width, 2));
+	sk = mem_alloc(sizeof(struct sketch) + SKETCH_DEPTH * width);
+	sk->width = width;
+	sk->shift = 32 - calc_msb_index(width);
+	sk->age = age;
+	return sk;
+}
+
+
+/* conservative update: only the minimal counters are increased */
+unsigned int sketch_add(struct sketch *sk, unsigned int key)
+{
+	int i;
+	unsigned int min;
+	unsigned char *c[SKETCH_DEPTH];
+
+	if (sk->age && ++sk->add >= sk->age)
+		sketch_age(sk);
+
+	min = SKETCH_COUNT_MAX;
+	for (i = 0; i < SKETCH_DEPTH; i++) {
+		c[i] = sketch_counter(sk, i, key);
+		min = MIN(min, *c[i]);
+	}
+	if (min == SKETCH_COUNT_MAX)
+		return min;
+	for (i = 0; i < SKETCH_DEPTH; i++) {
+		if (*c[i] == min)
+			(*c[i])++;
+	}
+	return min + 1;
+}
+
+
+unsigned int sketch_get(struct sketch *sk, unsigned int key)
+{
+	int i;
+	unsigned int min = SKETCH_COUNT_MAX;
+
+	for (i = 0; i < SKETCH_DEPTH; i++)
+		min = MIN(min, *sketch_counter(sk, i, key));
+	return min;
+}
+
+
+void sketch_delete(struct sketch *sk)
+{
+	mem_free(sk);
+}
@@ -0,0 +1,78 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SKETCH_H__
+#define __SKETCH_H__
+
+#define SKETCH_DEPTH				4
+#define SKETCH_COUNT_MAX			255
+
+/*
+ * count-min sketch of key frequency in fixed memory, every row counts
+ * keys by its own hash, the minimal counter of rows is the estimate;
+ * counters are halved periodically so that the estimate follows
+ * recent frequency
+ */
+struct sketch {
+	unsigned int shift; // 32 - log2(width)
+	unsigned int width; // counters per row
+	unsigned int add; // additions since last aging
+	unsigned int age; // additions between two aging
+	unsigned char count[]; // SKETCH_DEPTH rows of counters
+};
+
+
+/*
+ * sketch_create - create count-min sketch
+ * @width: counters per row, rounded up to power of 2
+ * @age: halve all counters after this number of additions, zero for never
+ *
+ * Returns sketch object if success, otherwise NULL
+ */
+struct sketch *sketch_create(unsigned int width, unsigned int age);
+
+
+/*
+ * sketch_add - count a key once
+ * @sk: sketch object
+ * @key: key to count
+ *
+ * Returns estimated count of key after the addition
+ */
+unsigned int sketch_add(struct sketch *sk, unsigned int key);
+
+
+/*
+ * sketch_get - estimate count of a key
+ * @sk: sketch object
+ * @key: key to estimate
+ *
+ * Returns estimated count of key, never less than real count since aging
+ */
+unsigned int sketch_get(struct sketch *sk, unsigned int key);
+
+
+/*
+ * sketch_delete - destory the sketch
+ * @sk: sketch object
+ */
+void sketch_delete(struct sketch *sk);
+
+#endif // __SKETCH_H__
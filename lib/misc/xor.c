@@ -0,0 +1,171 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "xor.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XOR_X86
+#endif
+
+typedef void (*XOR_FUNC)(void *dst, const void *src, int size);
+
+
+static void xor_scalar(void *dst, const void *src, int size)
+{
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	unsigned long long a, b;
+
+	for (; size >= (int)sizeof(a); size -= sizeof(a), d += sizeof(a), s += sizeof(a)) {
+		memcpy(&a, d, sizeof(a));
+		memcpy(&b, s, sizeof(b));
+		a ^= b;
+		memcpy(d, &a, sizeof(a));
+	}
+	while (size--)
+		*d++ ^= *s++;
+}
+
+
+#ifdef XOR_X86
+/* 4 vectors in flight per loop, tail by narrower code */
+__attribute__((target("avx2")))
+static void xor_avx2(void *dst, const void *src, int size)
+{
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	__m256i a0, a1, a2, a3;
+
+	for (; size >= 128; size -= 128, d += 128, s += 128) {
+		a0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)d),
+							_mm256_loadu_si256((const __m256i *)s));
+		a1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(d + 32)),
+							_mm256_loadu_si256((const __m256i *)(s + 32)));
+		a2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(d + 64)),
+							_mm256_loadu_si256((const __m256i *)(s + 64)));
+		a3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(d + 96)),
+							_mm256_loadu_si256((const __m256i *)(s + 96)));
+		_mm256_storeu_si256((__m256i *)d, a0);
+		_mm256_storeu_si256((__m256i *)(d + 32), a1);
+		_mm256_storeu_si256((__m256i *)(d + 64), a2);
+		_mm256_storeu_si256((__m256i *)(d + 96), a3);
+	}
+	for (; size >= 32; size -= 32, d += 32, s += 32) {
+		a0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)d),
+							_mm256_loadu_si256((const __m256i *)s));
+		_mm256_storeu_si256((__m256i *)d, a0);
+	}
+	xor_scalar(d, s, size);
+}
+
+
+__attribute__((target("avx512f")))
+static void xor_avx512(void *dst, const void *src, int size)
+{
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	__m512i a0, a1, a2, a3;
+
+	for (; size >= 256; size -= 256, d += 256, s += 256) {
+		a0 = _mm512_xor_si512(_mm512_loadu_si512(d), _mm512_loadu_si512(s));
+		a1 = _mm512_xor_si512(_mm512_loadu_si512(d + 64), _mm512_loadu_si512(s + 64));
+		a2 = _mm512_xor_si512(_mm512_loadu_si512(d + 128), _mm512_loadu_si512(s + 128));
+		a3 = _mm512_xor_si512(_mm512_loadu_si512(d + 192), _mm512_loadu_si512(s + 192));
+		_mm512_storeu_si512(d, a0);
+		_mm512_storeu_si512(d + 64, a1);
+		_mm512_storeu_si512(d + 128, a2);
+		_mm512_storeu_si512(d + 192, a3);
+	}
+	for (; size >= 64; size -= 64, d += 64, s += 64)
+		_mm512_storeu_si512(d, _mm512_xor_si512(_mm512_loadu_si512(d), _mm512_loadu_si512(s)));
+	xor_scalar(d, s, size);
+}
+#endif // XOR_X86
+
+
+static const char *xor_type_name[XOR_TYPE_NUM] = {
+	"auto",
+	"scalar",
+	"avx2",
+	"avx512",
+};
+
+static XOR_FUNC xor_func[XOR_TYPE_NUM] = {
+	NULL,
+	xor_scalar,
+#ifdef XOR_X86
+	xor_avx2,
+	xor_avx512,
+#endif
+};
+
+static int xor_type; // XOR_AUTO until first use
+
+
+static bool xor_supported(int type)
+{
+	switch (type) {
+	case XOR_SCALAR:
+		return TRUE;
+#ifdef XOR_X86
+	case XOR_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case XOR_AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return FALSE;
+	}
+}
+
+
+int xor_select(int type)
+{
+	if (type == XOR_AUTO) {
+		for (type = XOR_TYPE_NUM - 1; !xor_supported(type); type--)
+			;
+	}
+	if (type <= XOR_AUTO || type >= XOR_TYPE_NUM || !xor_supported(type))
+		return -1;
+	__atomic_store_n(&xor_type, type, __ATOMIC_RELAXED);
+	return 0;
+}
+
+
+void xor_block(void *dst, const void *src, int size)
+{
+	int type = __atomic_load_n(&xor_type, __ATOMIC_RELAXED);
+
+	if (type == XOR_AUTO) {
+		xor_select(XOR_AUTO);
+		type = __atomic_load_n(&xor_type, __ATOMIC_RELAXED);
+	}
+	xor_func[type](dst, src, size);
+}
+
+
+const char *xor_name(void)
+{
+	if (__atomic_load_n(&xor_type, __ATOMIC_RELAXED) == XOR_AUTO)
+		xor_select(XOR_AUTO);
+	return xor_type_name[__atomic_load_n(&xor_type, __ATOMIC_RELAXED)];
+}
@@ -0,0 +1,59 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __XOR_H__
+#define __XOR_H__
+
+/* the widest supported by CPU is picked at first use */
+enum xor_type {
+	XOR_AUTO,
+	XOR_SCALAR,
+	XOR_AVX2,
+	XOR_AVX512,
+	XOR_TYPE_NUM
+};
+
+
+/*
+ * xor_block - dst ^= src
+ * @dst: destination buffer
+ * @src: source buffer
+ * @size: bytes, any alignment
+ */
+void xor_block(void *dst, const void *src, int size);
+
+
+/*
+ * xor_select - pick implementation of xor_block
+ * @type: enum xor_type
+ *
+ * Returns zero if supported by CPU, otherwise -1 and nothing changes
+ */
+int xor_select(int type);
+
+
+/*
+ * xor_name - name of implementation in use
+ *
+ * Returns "scalar", "avx2" or "avx512"
+ */
+const char *xor_name(void);
+
+#endif // __XOR_H__
@@ -17,9 +17,12 @@
  * You should have received a copy of the GNU General Public License
  * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <fcntl.h>
 #include "common.h"
+#include "arena.h"
 #include "nand.h"
 #include "common_nand.h"
+#include "nand_sched.h"
 
 
 static char *common_nand_info[COMMON_NAND_INFO_NUM] = {
@@ -34,6 +37,15 @@ static char *common_nand_info[COMMON_NAND_INFO_NUM] = {
 	"Max_PE_Cycle", // 8
 	"Weak_PE_Cycle", // 9
 	"Temperature(C)", // 10
+	"tR(us)", // 11
+	"tPROG(us)", // 12
+	"tBERS(us)", // 13
+	"Bus_Rate(MT/s)", // 14
+	"tRCBSY(us)", // 15
+	"tCBSY(us)", // 16
+	"Cell_Type", // 17
+	"LUN_Num", // 18
+	"Read_Retry_Num", // 19
 };
 
 static int common_nand_value[COMMON_NAND_INFO_NUM] = {
@@ -48,8 +60,50 @@ static int common_nand_value[COMMON_NAND_INFO_NUM] = {
 	3000,
 	2000,
 	25,
+	50,
+	600,
+	3000,
+	800,
+	3,
+	3,
+	1,
+	1,
+	8,
+};
+
+/*
+ * percent of tR, tPROG and error bit of each page type, averaged to 100,
+ * one-shot program: lower pages are latched and programmed with the last one
+ */
+static const int common_nand_read_factor[CELL_QLC + 1][PAGE_TYPE_NUM] = {
+	[CELL_SLC] = {100},
+	[CELL_MLC] = {80, 120},
+	[CELL_TLC] = {70, 100, 130},
+	[CELL_QLC] = {60, 90, 110, 140},
 };
 
+static const int common_nand_prog_factor[CELL_QLC + 1][PAGE_TYPE_NUM] = {
+	[CELL_SLC] = {100},
+	[CELL_MLC] = {40, 160},
+	[CELL_TLC] = {20, 20, 260},
+	[CELL_QLC] = {10, 10, 10, 370},
+};
+
+static const int common_nand_err_factor[CELL_QLC + 1][PAGE_TYPE_NUM] = {
+	[CELL_SLC] = {100},
+	[CELL_MLC] = {50, 150},
+	[CELL_TLC] = {40, 100, 160},
+	[CELL_QLC] = {30, 80, 120, 170},
+};
+
+/* pseudo-SLC block */
+#define PSLC_READ_FACTOR				50
+#define PSLC_PROG_FACTOR				25
+#define PSLC_ERR_FACTOR					10
+
+/* extra sensing of a shifted read level, percent of tR per retry level */
+#define READ_RETRY_TIME_FACTOR			10
+
 static void common_nand_bad_block_alloc(struct common_nand *com_nand)
 {
 	int i, j, num;
@@ -60,10 +114,9 @@ static void common_nand_bad_block_alloc(struct common_nand *com_nand)
 	block_num = com_nand->base.block_num - 1;
 
 	/* skip block 0 */
-	srand(time(0));
 	for (i = 0; i < num; i++) {
 repeat:
-		block = rand() % block_num + 1;
+		block = rand_r(&com_nand->base.seed) % block_num + 1;
 		/* repeat check */ 
 		for (j = 0; j < i; j++) {
 			if (block == com_nand->bad_block[j])
@@ -71,9 +124,9 @@ repeat:
 		}
 		com_nand->bad_block[i] = block;
 		row = block * com_nand->page_num_per_block;
-		bitmap_set(com_nand->page_map, row);
-		bitmap_set(com_nand->page_map, row + 1);
-		bitmap_set(com_nand->page_map, row + com_nand->page_num_per_block - 1);
+		bitmap_set_atomic(com_nand->page_map, row);
+		bitmap_set_atomic(com_nand->page_map, row + 1);
+		bitmap_set_atomic(com_nand->page_map, row + com_nand->page_num_per_block - 1);
 		if (i >= com_nand->bad_block_num) {
 			com_nand->block_info[block].pe_cycle = com_nand->weak_pe_cycle;
 			com_nand->block_info[block].read_count = 0;
@@ -87,10 +140,10 @@ static int common_nand_bad_block(struct common_nand *com_nand, int block_num)
 	int i, row;
 
 	row = block_num * com_nand->page_num_per_block;
-	if ((bitmap_get(com_nand->page_map, row) == 1) &&
-		(bitmap_get(com_nand->page_map, row + 1) == 1) &&
-		(bitmap_get(com_nand->page_map, row + 2) == 0) &&
-		(bitmap_get(com_nand->page_map, row + com_nand->page_num_per_block - 1) == 1))
+	if ((bitmap_get_atomic(com_nand->page_map, row) == 1) &&
+		(bitmap_get_atomic(com_nand->page_map, row + 1) == 1) &&
+		(bitmap_get_atomic(com_nand->page_map, row + 2) == 0) &&
+		(bitmap_get_atomic(com_nand->page_map, row + com_nand->page_num_per_block - 1) == 1))
 			return 1;
 	for (i = 0; i < com_nand->bad_block_num; i++) {
 		if (block_num == com_nand->bad_block[i]) 
@@ -112,16 +165,51 @@ static int common_nand_weak_block(struct common_nand *com_nand, int block_num)
 	return 0;
 }
 
+static struct nand_lun *common_nand_lun(struct common_nand *com_nand, int row)
+{
+	int lun;
+
+	lun = row / com_nand->page_num_per_block / com_nand->block_num_per_lun;
+	return &com_nand->lun[MIN(MAX(lun, 0), com_nand->base.lun_num - 1)];
+}
+
+
+/*
+ * read levels drift with wear, the optimal retry level of a block moves
+ * from 0 to the last level over its PE cycle budget; error bits are divided
+ * by the gain of the optimal level and grow with distance to it
+ */
+static int common_nand_retry_err(struct common_nand *com_nand, int block, int err_bit)
+{
+	int level, best;
+
+	level = common_nand_lun(com_nand, block * com_nand->page_num_per_block)
+				->feature[NAND_FEATURE_READ_RETRY][0];
+	best = (unsigned long long)com_nand->block_info[block].pe_cycle * com_nand->retry_num /
+				(com_nand->base.max_pe_cycle + 1);
+	best = MIN(best, com_nand->retry_num - 1);
+	return err_bit * (1 + abs(level - best)) / (1 + best);
+}
+
+
 /*
  * BER=-226.8+0.1432*pe_cycle+3.499*read_count-1.40e-05*pe_cycle^2
  *     -0.000953*pe_cycle*read_count+7.27e-10*pe_cycle^3+pe_cycle^2*read_count;
  * reference: Reserch on error characteristics modeling of nand flash and applications
  */
-static int common_nand_err_bit_gen(struct common_nand *com_nand, int block)
+static int common_nand_err_bit_gen(struct common_nand *com_nand, int row)
 {
+	int block, factor;
 	unsigned int pe_cycle, read_count;
 	double err_bit = 0.0;
 
+	block = row / com_nand->page_num_per_block;
+	if (bitmap_get_atomic(com_nand->slc_map, block))
+		factor = PSLC_ERR_FACTOR;
+	else
+		factor = common_nand_err_factor[com_nand->base.cell_type]
+					[com_nand->page_type[row % com_nand->page_num_per_block]];
+
 	pe_cycle = com_nand->block_info[block].pe_cycle;
 	read_count = com_nand->block_info[block].read_count;
 
@@ -138,108 +226,634 @@ static int common_nand_err_bit_gen(struct common_nand *com_nand, int block)
 		ASSERT(0);
 	}
 	
+	err_bit = err_bit * factor / 100;
 	LOG(LOG_WARN, "BER: %f\n", err_bit);
 
-	return MAX((int)err_bit, 0);
+	return common_nand_retry_err(com_nand, block, MAX((int)err_bit, 0));
 }
 
-/************************CALLBACK FUNCTION IMPLEMENT***************************/
-static int common_nand_erase(struct nand_base *nand, int row)
+
+static unsigned int common_nand_read_time(struct common_nand *com_nand, int row)
 {
-	int first_row, i, block;
-	struct common_nand *com_nand = (struct common_nand *)nand;
+	int factor, level;
 
-	com_nand->status = 0;
-	first_row = row / com_nand->page_num_per_block * com_nand->page_num_per_block;
-	block = first_row / com_nand->page_num_per_block;
-	if (common_nand_bad_block(com_nand, block)) {
-		LOG(LOG_WARN, "Erase fail at block %d", block);
-		com_nand->status |= (1 << STATUS_FAIL);
+	if (bitmap_get_atomic(com_nand->slc_map, row / com_nand->page_num_per_block))
+		factor = PSLC_READ_FACTOR;
+	else
+		factor = common_nand_read_factor[com_nand->base.cell_type]
+					[com_nand->page_type[row % com_nand->page_num_per_block]];
+	level = common_nand_lun(com_nand, row)->feature[NAND_FEATURE_READ_RETRY][0];
+	factor = factor * (100 + level * READ_RETRY_TIME_FACTOR) / 100;
+	return (unsigned long long)com_nand->base.timing.t_r * factor / 100;
+}
+
+
+/* account an array read to the current retry level of LUN */
+static void common_nand_retry_record(struct common_nand *com_nand, int row, int err_bit)
+{
+	struct nand_retry_stat *stat;
+
+	stat = &com_nand->retry_stat[common_nand_lun(com_nand, row)
+									->feature[NAND_FEATURE_READ_RETRY][0]];
+	/* LUNs of different threads share the retry level statistics */
+	__atomic_add_fetch(&stat->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stat->time, common_nand_read_time(com_nand, row), __ATOMIC_RELAXED);
+	if (err_bit > 0) {
+		__atomic_add_fetch(&stat->err_bit, err_bit, __ATOMIC_RELAXED);
+		if (err_bit > com_nand->base.ecc_required)
+			__atomic_add_fetch(&stat->fail, 1, __ATOMIC_RELAXED);
+	}
+}
+
+
+static unsigned int common_nand_prog_time(struct common_nand *com_nand, int row)
+{
+	int factor;
+
+	if (bitmap_get_atomic(com_nand->slc_map, row / com_nand->page_num_per_block))
+		factor = PSLC_PROG_FACTOR;
+	else
+		factor = common_nand_prog_factor[com_nand->base.cell_type]
+					[com_nand->page_type[row % com_nand->page_num_per_block]];
+	return (unsigned long long)com_nand->base.timing.t_prog * factor / 100;
+}
+
+
+/*
+ * pages of a block are programmed in order on multi-level cell,
+ * pseudo-SLC block only has the first 1/cell_type pages
+ */
+static int common_nand_prog_check(struct common_nand *com_nand, int row)
+{
+	int page = row % com_nand->page_num_per_block;
+
+	if (bitmap_get_atomic(com_nand->slc_map, row / com_nand->page_num_per_block) &&
+		page >= com_nand->page_num_per_block / com_nand->base.cell_type) {
+		LOG(LOG_WARN, "program page %d out of SLC block", row);
 		return -1;
 	}
-	
-	for (i = 0; i < com_nand->page_num_per_block; i++) {
-		bitmap_clear(com_nand->page_map, first_row + i);
+	if (com_nand->base.cell_type > CELL_SLC && page &&
+		bitmap_get_atomic(com_nand->page_map, row - 1) == 0) {
+		LOG(LOG_WARN, "program page %d out of order", row);
+		return -1;
 	}
-	com_nand->block_info[block].pe_cycle++;
 	return 0;
 }
 
-static int common_nand_read_page(struct nand_base *nand, int row, void *data)
+/* sense a page from array, returns error bit number or negative if bad block */
+static int common_nand_sense(struct common_nand *com_nand, int row, void *data)
 {
 	unsigned char *buf;
-	int block, size;
-	struct common_nand *com_nand = (struct common_nand *)nand;
+	int block, page, size;
 
-	com_nand->status = 0;
 	block = row / com_nand->page_num_per_block;
-	row = row % com_nand->page_num_per_block;
+	page = row % com_nand->page_num_per_block;
 
 	if (common_nand_bad_block(com_nand, block)) {
 		LOG(LOG_WARN, "read bad block %d", block);
 		return -1;
 	}
 
-	size = nand->page_size + nand->spare_size;
+	size = com_nand->base.page_size + com_nand->base.spare_size;
 
-	if (bitmap_get(com_nand->page_map, row) == 0) {
+	if (bitmap_get_atomic(com_nand->page_map, row) == 0) {
 		memset(data, 0xFF, size);
 		return 0;
 	}
 	buf = file_read(com_nand->block_file, block);
-	memcpy(data, buf + row * size, size);
+	if (!buf) {
+		/* programmed without data, e.g. bad block mark */
+		memset(data, 0xFF, size);
+		return 0;
+	}
+	memcpy(data, buf + page * size, size);
+	file_put(com_nand->block_file, buf);
 	com_nand->block_info[block].read_count++;
-	return common_nand_err_bit_gen(com_nand, block);
+	return common_nand_err_bit_gen(com_nand, row);
 }
 
-static int common_nand_program_page(struct nand_base *nand, int row, void *data)
+
+/*
+ * spare of a page is written through to one uncompressed file at program,
+ * page data goes to block files at eviction or nand_sync; mount reads
+ * spare without decompressing any block. It is kept inverted, so a hole
+ * of the sparse file or a cleared range reads as erased 0xFF
+ * @spare: num * spare_size bytes, NULL to erase
+ */
+static void common_nand_spare_write(struct common_nand *com_nand, int row, int num,
+									const unsigned char *spare)
+{
+	int i, size;
+	unsigned char *buf;
+
+	size = num * com_nand->base.spare_size;
+	buf = arena_zalloc(size);
+	for (i = 0; spare && i < size; i++)
+		buf[i] = ~spare[i];
+	if (pwrite(com_nand->spare_fd, buf, size,
+				(off_t)row * com_nand->base.spare_size) != size)
+		LOG(LOG_WARN, "write spare of page %d fail", row);
+	arena_free(buf);
+}
+
+
+/* page map is lost, a page is programmed if its spare is not erased */
+static void common_nand_spare_scan(struct common_nand *com_nand)
+{
+	int i, j, row, size;
+	unsigned char *buf;
+
+	size = com_nand->base.spare_size;
+	buf = mem_alloc(size * com_nand->page_num_per_block);
+	for (i = 0; i < com_nand->base.block_num; i++) {
+		if (common_nand_bad_block(com_nand, i))
+			continue;
+		row = i * com_nand->page_num_per_block;
+		com_nand->base.read_spare(&com_nand->base, row, com_nand->page_num_per_block, buf);
+		for (j = 0; j < size * com_nand->page_num_per_block; j++) {
+			if (buf[j] != 0xFF)
+				bitmap_set_atomic(com_nand->page_map, row + j / size);
+		}
+	}
+	mem_free(buf);
+}
+
+
+static int common_nand_store(struct common_nand *com_nand, int row, void *data)
 {
 	unsigned char *buf;
 	int block, size, offset;
-	struct common_nand *com_nand = (struct common_nand *)nand;
 
-	com_nand->status = 0;
-	if (bitmap_get(com_nand->page_map, row) != 0) {
+	if (bitmap_get_atomic(com_nand->page_map, row) != 0) {
 		LOG(LOG_WARN, "re-program page %d", row);
-		com_nand->status |= (1 << STATUS_FAIL);
 		return -1;
 	}
 
-	bitmap_set(com_nand->page_map, row);
+	if (data && common_nand_prog_check(com_nand, row))
+		return -1;
+
+	bitmap_set_atomic(com_nand->page_map, row);
 	if (data == NULL) {
 		LOG(LOG_WARN, "No data program");
 		return 0;
 	}
 
 	block = row / com_nand->page_num_per_block;
-	size = nand->page_size + nand->spare_size;
+	size = com_nand->base.page_size + com_nand->base.spare_size;
 	offset = row % com_nand->page_num_per_block * size;
 
-	if (com_nand->block_info[block].pe_cycle > nand->max_pe_cycle) {
+	if (com_nand->block_info[block].pe_cycle > com_nand->base.max_pe_cycle) {
 		LOG(LOG_WARN, " %d", row);
-		com_nand->status |= (1 << STATUS_FAIL);
 		return -2;
 	}
 
-	buf = file_write_cache(com_nand->block_file, block);
+	/* keep pages programmed before the block was evicted */
+	buf = file_modify(com_nand->block_file, block);
 	memcpy(buf + offset, data, size);
+	file_put(com_nand->block_file, buf);
+	common_nand_spare_write(com_nand, row, 1,
+							(unsigned char *)data + com_nand->base.page_size);
 	// for test
 	//file_write(com_nand->block_file, block);
 	return 0;
 }
 
+
+/*
+ * move page inside storage, page register to block buffer, no ECC on the
+ * way: error bits of source are flipped into destination
+ */
+static int common_nand_move(struct common_nand *com_nand, unsigned char *src, int row,
+							void *data, int col, int err_bit)
+{
+	unsigned char *buf, *dst;
+	int block, size, offset, bit;
+	struct nand_lun *lun = common_nand_lun(com_nand, row);
+
+	if (bitmap_get_atomic(com_nand->page_map, row) != 0) {
+		LOG(LOG_WARN, "re-program page %d", row);
+		return -1;
+	}
+
+	if (common_nand_prog_check(com_nand, row))
+		return -1;
+
+	block = row / com_nand->page_num_per_block;
+	if (com_nand->block_info[block].pe_cycle > com_nand->base.max_pe_cycle) {
+		LOG(LOG_WARN, " %d", row);
+		return -2;
+	}
+	bitmap_set_atomic(com_nand->page_map, row);
+
+	size = com_nand->base.page_size + com_nand->base.spare_size;
+	offset = row % com_nand->page_num_per_block * size;
+	buf = file_modify(com_nand->block_file, block);
+	dst = buf + offset;
+	memcpy(dst, src, size);
+
+	if (data && col >= 0)
+		memcpy(dst + col, (unsigned char *)data + col, size - col);
+
+	__atomic_add_fetch(&com_nand->copyback_num, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&com_nand->copyback_err_bit, err_bit, __ATOMIC_RELAXED);
+	while (err_bit-- > 0) {
+		bit = rand_r(&lun->seed) % (size << 3);
+		dst[bit >> 3] ^= 1 << (bit & 0x7);
+	}
+	common_nand_spare_write(com_nand, row, 1, dst + com_nand->base.page_size);
+	file_put(com_nand->block_file, buf);
+	return 0;
+}
+
+
+/*
+ * time a command of LUN on the device scheduler, its array stage waits
+ * R/B# of a running cache operation; device clock follows the latest
+ * completion
+ *
+ * Returns completion time
+ */
+static unsigned long long common_nand_issue(struct common_nand *com_nand, struct nand_lun *lun,
+							int op, unsigned int bus_in, unsigned int array,
+							unsigned int bus_out, unsigned int background)
+{
+	unsigned long long time;
+
+	time = sched_issue(com_nand->base.sched, op, lun - com_nand->lun, bus_in, array,
+						bus_out, background);
+	nand_clock_wait(&com_nand->base, time);
+	return time;
+}
+
+
+static unsigned int common_nand_xfer_time(struct common_nand *com_nand)
+{
+	return nand_xfer_time(&com_nand->base.timing,
+				com_nand->base.page_size + com_nand->base.spare_size);
+}
+
+
+static FILE *common_nand_meta_open(struct common_nand *com_nand, const char *file,
+									const char *mode)
+{
+	char name[NAND_NAME_MAX + 32];
+
+	sprintf(name, file, com_nand->name);
+	return fopen(name, mode);
+}
+
+
+static void common_nand_meta_write(struct common_nand *com_nand, const char *file,
+									void *data, int size)
+{
+	FILE *fp;
+
+	fp = common_nand_meta_open(com_nand, file, "wb");
+	if (fp) {
+		fwrite(data, 1, size, fp);
+		fclose(fp);
+	}
+}
+
+
+/************************CALLBACK FUNCTION IMPLEMENT***************************/
+static int common_nand_erase(struct nand_base *nand, int row)
+{
+	int first_row, i, block;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+	struct nand_lun *lun = common_nand_lun(com_nand, row);
+
+	lun->status = 0;
+	if (lun->cache_state == CACHE_READ ||
+		lun->cache_state == CACHE_PROGRAM) {
+		LOG(LOG_WARN, "Erase in cache operation %d", lun->cache_state);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+	lun->cache_state = CACHE_IDLE;
+
+	first_row = row / com_nand->page_num_per_block * com_nand->page_num_per_block;
+	block = first_row / com_nand->page_num_per_block;
+	if (common_nand_bad_block(com_nand, block)) {
+		LOG(LOG_WARN, "Erase fail at block %d", block);
+		common_nand_issue(com_nand, lun, SCHED_ERASE, nand->timing.t_cmd, 0, 0, 0);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+	
+	for (i = 0; i < com_nand->page_num_per_block; i++) {
+		bitmap_clear_atomic(com_nand->page_map, first_row + i);
+	}
+	/* old data is never read again, next program starts a new block file */
+	file_discard(com_nand->block_file, block);
+	common_nand_spare_write(com_nand, first_row, com_nand->page_num_per_block, NULL);
+	/* SLC mode is a no-op on SLC device */
+	if (lun->slc_mode && com_nand->base.cell_type > CELL_SLC)
+		bitmap_set_atomic(com_nand->slc_map, block);
+	else
+		bitmap_clear_atomic(com_nand->slc_map, block);
+	com_nand->block_info[block].pe_cycle++;
+	common_nand_issue(com_nand, lun, SCHED_ERASE, nand->timing.t_cmd, nand->timing.t_bers, 0, 0);
+	return 0;
+}
+
+static int common_nand_read_page(struct nand_base *nand, int row, void *data)
+{
+	int ret;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+	struct nand_lun *lun = common_nand_lun(com_nand, row);
+
+	lun->status = 0;
+	if (lun->cache_state == CACHE_PROGRAM) {
+		LOG(LOG_WARN, "read page %d in cache program", row);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+	/* a new page read terminates cache read */
+	lun->cache_state = CACHE_IDLE;
+	lun->page_row = -1;
+
+	ret = common_nand_sense(com_nand, row, data);
+	common_nand_retry_record(com_nand, row, ret);
+	common_nand_issue(com_nand, lun, SCHED_READ, nand->timing.t_cmd,
+					common_nand_read_time(com_nand, row), common_nand_xfer_time(com_nand), 0);
+	return ret;
+}
+
+static int common_nand_program_page(struct nand_base *nand, int row, void *data)
+{
+	int ret;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+	struct nand_lun *lun = common_nand_lun(com_nand, row);
+
+	lun->status = 0;
+	if (lun->cache_state == CACHE_READ) {
+		LOG(LOG_WARN, "program page %d in cache read", row);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+
+	/* data input, then wait last cache program */
+	lun->cache_state = CACHE_IDLE;
+	ret = common_nand_store(com_nand, row, data);
+	common_nand_issue(com_nand, lun, SCHED_PROGRAM,
+					nand->timing.t_cmd + common_nand_xfer_time(com_nand),
+					ret ? 0 : common_nand_prog_time(com_nand, row), 0, 0);
+	if (ret) {
+		lun->status |= (1 << STATUS_FAIL);
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * 30h: sense page N to page register
+ * 31h: wait page register, move it to cache register and sense next page
+ * 3Fh: wait page register, move it to cache register, end of cache read
+ * data out of cache register overlaps with sensing of next page
+ */
+static int common_nand_cache_read(struct nand_base *nand, int row, void *data, int cmd)
+{
+	int ret, row_num;
+	unsigned int sense = 0;
+	unsigned char *tmp;
+	struct nand_lun *lun;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+
+	/* 31h and 3Fh without address go to LUN of the last 30h */
+	if (cmd == CMD_READ_2ND || row >= 0) {
+		lun = common_nand_lun(com_nand, row);
+		__atomic_store_n(&com_nand->cache_lun, lun, __ATOMIC_RELAXED);
+	} else {
+		lun = __atomic_load_n(&com_nand->cache_lun, __ATOMIC_RELAXED);
+	}
+
+	lun->status = 0;
+	row_num = com_nand->page_num_per_block * nand->block_num;
+	if (cmd == CMD_READ_2ND) {
+		if (lun->cache_state == CACHE_PROGRAM) {
+			LOG(LOG_WARN, "cache read page %d in cache program", row);
+			lun->status |= (1 << STATUS_FAIL);
+			return -1;
+		}
+		lun->page_err = common_nand_sense(com_nand, row, lun->page_reg);
+		common_nand_retry_record(com_nand, row, lun->page_err);
+		lun->page_row = row;
+		lun->cache_state = CACHE_READ;
+		common_nand_issue(com_nand, lun, SCHED_READ, nand->timing.t_cmd,
+						common_nand_read_time(com_nand, row), 0, 0);
+		return MIN(lun->page_err, 0);
+	}
+
+	if (lun->cache_state != CACHE_READ) {
+		LOG(LOG_WARN, "cache read %02x without page read", cmd);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+
+	if (cmd != CMD_READ_CACHE_END) {
+		if (row == -1) {
+			row = lun->page_row + 1;
+			if (row % com_nand->page_num_per_block == 0) {
+				LOG(LOG_WARN, "sequential cache read cross block at %d", row);
+				lun->status |= (1 << STATUS_FAIL);
+				return -1;
+			}
+		}
+		if (row < 0 || row >= row_num) {
+			LOG(LOG_WARN, "cache read invalid page %d", row);
+			lun->status |= (1 << STATUS_FAIL);
+			return -1;
+		}
+	}
+
+	tmp = lun->cache_reg;
+	lun->cache_reg = lun->page_reg;
+	lun->page_reg = tmp;
+	ret = lun->page_err;
+
+	if (cmd == CMD_READ_CACHE_END) {
+		lun->cache_state = CACHE_IDLE;
+		lun->page_row = -1;
+	} else {
+		lun->page_err = common_nand_sense(com_nand, row, lun->page_reg);
+		common_nand_retry_record(com_nand, row, lun->page_err);
+		lun->page_row = row;
+		sense = common_nand_read_time(com_nand, row);
+	}
+
+	if (data)
+		memcpy(data, lun->cache_reg, nand->page_size + nand->spare_size);
+	common_nand_issue(com_nand, lun, SCHED_READ, nand->timing.t_cmd, nand->timing.t_rcbsy,
+					common_nand_xfer_time(com_nand), sense);
+	return ret;
+}
+
+/* 15h: wait last program, move cache register to page register, program in background */
+static int common_nand_cache_program(struct nand_base *nand, int row, void *data)
+{
+	int ret;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+	struct nand_lun *lun = common_nand_lun(com_nand, row);
+
+	lun->status = 0;
+	if (lun->cache_state == CACHE_READ) {
+		LOG(LOG_WARN, "cache program page %d in cache read", row);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+
+	ret = common_nand_store(com_nand, row, data);
+	common_nand_issue(com_nand, lun, SCHED_PROGRAM,
+					nand->timing.t_cmd + common_nand_xfer_time(com_nand), nand->timing.t_cbsy,
+					0, ret ? 0 : common_nand_prog_time(com_nand, row));
+	if (ret) {
+		lun->status |= (1 << STATUS_FAIL) | (1 << STATUS_FAILC);
+		lun->cache_state = CACHE_IDLE;
+		return ret;
+	}
+	lun->cache_state = CACHE_PROGRAM;
+	return 0;
+}
+
+/* 35h: sense source page to page register, data is moved at copyback program */
+static int common_nand_copyback_read(struct nand_base *nand, int row)
+{
+	int block;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+	struct nand_lun *lun = common_nand_lun(com_nand, row);
+
+	lun->status = 0;
+	if (lun->cache_state == CACHE_PROGRAM) {
+		LOG(LOG_WARN, "copyback read page %d in cache program", row);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+
+	block = row / com_nand->page_num_per_block;
+	lun->cache_state = CACHE_IDLE;
+	if (common_nand_bad_block(com_nand, block)) {
+		LOG(LOG_WARN, "copyback read bad block %d", block);
+		common_nand_issue(com_nand, lun, SCHED_READ, nand->timing.t_cmd, 0, 0, 0);
+		return -1;
+	}
+
+	lun->page_err = common_nand_sense(com_nand, row, lun->page_reg);
+	common_nand_retry_record(com_nand, row, lun->page_err);
+	lun->page_row = row;
+	lun->cache_state = CACHE_COPYBACK;
+	common_nand_issue(com_nand, lun, SCHED_READ, nand->timing.t_cmd,
+					common_nand_read_time(com_nand, row), 0, 0);
+	return 0;
+}
+
+/* 85h-10h: program page register to row, optional data injected from col */
+static int common_nand_copyback_program(struct nand_base *nand, int row, void *data, int col)
+{
+	int ret, len;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+	struct nand_lun *lun = common_nand_lun(com_nand, row);
+
+	lun->status = 0;
+	if (lun->cache_state != CACHE_COPYBACK) {
+		LOG(LOG_WARN, "copyback program page %d without copyback read", row);
+		lun->status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+	lun->cache_state = CACHE_IDLE;
+
+	len = (data && col >= 0) ? nand->page_size + nand->spare_size - col : 0;
+	ret = common_nand_move(com_nand, lun->page_reg, row, data, col, lun->page_err);
+	lun->page_row = -1;
+	common_nand_issue(com_nand, lun, SCHED_PROGRAM,
+					nand->timing.t_cmd + nand_xfer_time(&nand->timing, len),
+					ret ? 0 : common_nand_prog_time(com_nand, row), 0, 0);
+	if (ret) {
+		lun->status |= (1 << STATUS_FAIL);
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * EEh/EFh: feature address of all LUNs, LUN 0 is read back
+ * D4h/D5h: addr is (lun << 8) | feature address
+ * status is reported by the addressed LUNs, by LUN 0 for an invalid LUN
+ */
+static int common_nand_feature(struct common_nand *com_nand, int cmd, int addr,
+								unsigned char *buf)
+{
+	int i, first, last, fa;
+	unsigned int xfer;
+	struct nand_lun *lun;
+	struct nand_timing *timing;
+
+	fa = addr & (NAND_FEATURE_NUM - 1);
+	first = 0;
+	last = com_nand->base.lun_num - 1;
+	if (cmd == CMD_LUN_GET_FEATURE || cmd == CMD_LUN_SET_FEATURE) {
+		first = last = addr >> 8;
+		if (first < 0 || first >= com_nand->base.lun_num) {
+			LOG(LOG_WARN, "feature of invalid lun %d", first);
+			com_nand->lun[0].status = (1 << STATUS_FAIL);
+			return -1;
+		}
+	}
+	for (i = first; i <= last; i++)
+		com_nand->lun[i].status = 0;
+	if (!buf)
+		return -1;
+
+	timing = &com_nand->base.timing;
+	xfer = nand_xfer_time(timing, NAND_FEATURE_PARAM_NUM);
+	if (cmd == CMD_GET_FEATURE || cmd == CMD_LUN_GET_FEATURE) {
+		memcpy(buf, com_nand->lun[first].feature[fa], NAND_FEATURE_PARAM_NUM);
+		common_nand_issue(com_nand, &com_nand->lun[first], SCHED_FEATURE, timing->t_cmd,
+						timing->t_feat, xfer, 0);
+		return 0;
+	}
+
+	if (fa == NAND_FEATURE_READ_RETRY && buf[0] >= com_nand->retry_num) {
+		LOG(LOG_WARN, "invalid read retry level %d", buf[0]);
+		common_nand_issue(com_nand, &com_nand->lun[first], SCHED_FEATURE,
+						timing->t_cmd + xfer, 0, 0, 0);
+		for (i = first; i <= last; i++)
+			com_nand->lun[i].status |= (1 << STATUS_FAIL);
+		return -1;
+	}
+	/* parameters go over the bus once, every addressed LUN is busy tFEAT */
+	for (i = first; i <= last; i++) {
+		lun = &com_nand->lun[i];
+		memcpy(lun->feature[fa], buf, NAND_FEATURE_PARAM_NUM);
+		common_nand_issue(com_nand, lun, SCHED_FEATURE, i == first ? timing->t_cmd + xfer : 0,
+						timing->t_feat, 0, 0);
+	}
+	return 0;
+}
+
 static int common_nand_command(struct nand_base *nand, int cmd, int addr, void *data)
 {
-	int i;
+	int i, first, last;
 	unsigned char *buf = data;
+	struct nand_lun *lun;
 	struct common_nand *com_nand = (struct common_nand *)nand;
 
 	switch (cmd) {
 	case CMD_READ_STATUS:
 	case CMD_READ_STATUS_EX:
-		if (buf) 
-			buf[0] = com_nand->status;
-		com_nand->status = 0;
+		/* status of the last operation of every LUN */
+		if (buf)
+			buf[0] = 0;
+		for (i = 0; i < nand->lun_num; i++) {
+			if (buf)
+				buf[0] |= com_nand->lun[i].status;
+			com_nand->lun[i].status = 0;
+		}
+		break;
+	case CMD_SLC_MODE_ENABLE:
+	case CMD_SLC_MODE_DISABLE:
+		for (i = 0; i < nand->lun_num; i++)
+			com_nand->lun[i].slc_mode = (cmd == CMD_SLC_MODE_ENABLE);
 		break;
 	case CMD_READ_ID:
 		if (buf) {
@@ -249,15 +863,22 @@ static int common_nand_command(struct nand_base *nand, int cmd, int addr, void *
 		break;
 	case CMD_GET_FEATURE:
 	case CMD_LUN_GET_FEATURE:
-		/* Todo */
-		break;
 	case CMD_SET_FEATURE:
 	case CMD_LUN_SET_FEATURE:
-		/* Todo */
-		break;
+		return common_nand_feature(com_nand, cmd, addr, buf);
 	case CMD_RESET_LUN:
 	case CMD_SYNC_RESET:
 	case CMD_RESET:
+		/* abort cache operation, FAh resets the LUN of row addr */
+		first = 0;
+		last = nand->lun_num - 1;
+		if (cmd == CMD_RESET_LUN && addr >= 0)
+			first = last = common_nand_lun(com_nand, addr) - com_nand->lun;
+		for (i = first; i <= last; i++) {
+			lun = &com_nand->lun[i];
+			lun->cache_state = CACHE_IDLE;
+			lun->page_row = -1;
+		}
 		file_flush(com_nand->block_file);
 		break;
 	default:
@@ -267,6 +888,82 @@ static int common_nand_command(struct nand_base *nand, int cmd, int addr, void *
 	}
 	return 0;
 }
+
+/* spare file only, past its end nothing is programmed */
+static int common_nand_read_spare(struct nand_base *nand, int row, int num, void *oob)
+{
+	unsigned char *spare = oob;
+	int i, size;
+	ssize_t ret;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+
+	size = num * nand->spare_size;
+	ret = pread(com_nand->spare_fd, oob, size, (off_t)row * nand->spare_size);
+	if (ret < 0)
+		return -1;
+	memset(spare + ret, 0, size - ret);
+	for (i = 0; i < size; i++)
+		spare[i] = ~spare[i];
+	return 0;
+}
+
+static int common_nand_block_info(struct nand_base *nand, int block, struct nand_block *info)
+{
+	struct common_nand *com_nand = (struct common_nand *)nand;
+
+	*info = com_nand->block_info[block];
+	info->bad = common_nand_bad_block(com_nand, block);
+	return 0;
+}
+
+/* pages stay programmed, they read as erased without block file and spare */
+static int common_nand_discard(struct nand_base *nand, int row)
+{
+	struct common_nand *com_nand = (struct common_nand *)nand;
+	int block = row / com_nand->page_num_per_block;
+
+	file_discard(com_nand->block_file, block);
+	common_nand_spare_write(com_nand, block * com_nand->page_num_per_block,
+							com_nand->page_num_per_block, NULL);
+	__atomic_add_fetch(&com_nand->discard_num, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * block cache and warm tier go to block files, wear and SLC state to their
+ * files, LUNs may run meanwhile; page map is only written at deinit
+ */
+static int common_nand_sync(struct nand_base *nand)
+{
+	struct common_nand *com_nand = (struct common_nand *)nand;
+
+	common_nand_meta_write(com_nand, BLOCK_INFO_FILE_NAME, com_nand->block_info,
+			com_nand->base.block_num * sizeof(struct nand_block));
+	common_nand_meta_write(com_nand, SLC_BLOCK_FILE_NAME, com_nand->slc_map->b,
+			roundup(com_nand->base.block_num, 8) >> 3);
+	return file_flush(com_nand->block_file);
+}
+
+static void common_nand_dump(struct nand_base *nand, FILE *fp)
+{
+	int i;
+	struct nand_retry_stat *stat;
+	struct common_nand *com_nand = (struct common_nand *)nand;
+
+	fprintf(fp, "clock: %llu ns\n", __atomic_load_n(&nand->clock, __ATOMIC_RELAXED));
+	fprintf(fp, "copyback: %llu err_bit: %llu\n", com_nand->copyback_num,
+				com_nand->copyback_err_bit);
+	fprintf(fp, "discard: %llu blocks\n", com_nand->discard_num);
+	file_dump(com_nand->block_file, fp);
+	for (i = 0; i < com_nand->retry_num; i++) {
+		stat = &com_nand->retry_stat[i];
+		if (!stat->count)
+			continue;
+		fprintf(fp, "retry level %d: read %llu avg err_bit %.2f fail %llu avg tR %llu ns\n",
+					i, stat->count, (double)stat->err_bit / stat->count,
+					stat->fail, stat->time / stat->count);
+	}
+}
 /************************CALLBACK FUNCTION END***************************/
 
 
@@ -276,7 +973,11 @@ struct nand_base *common_nand_init(char *name)
 	FILE *fp;
 	struct common_nand *com_nand;
 	char buf[64] = {'\0'};
-	int value[COMMON_NAND_INFO_NUM] = {-1};
+	char path[NAND_NAME_MAX + 32];
+	int value[COMMON_NAND_INFO_NUM];
+
+	/* keys missing in an old info file keep default value */
+	memcpy(value, common_nand_value, sizeof(value));
 
 	/* open nand info file */
 	sprintf(buf, NAND_INFO_FOLDER"/%s.ini", name);
@@ -327,10 +1028,39 @@ struct nand_base *common_nand_init(char *name)
 	com_nand->bad_block_num = value[6];
 	com_nand->weak_block_num = value[7];
 	com_nand->weak_pe_cycle = value[9];
+	com_nand->base.timing.t_cmd = NAND_CMD_ADDR_TIME;
+	com_nand->base.timing.t_r = value[11] * 1000;
+	com_nand->base.timing.t_prog = value[12] * 1000;
+	com_nand->base.timing.t_bers = value[13] * 1000;
+	com_nand->base.timing.bus_rate = MAX(value[14], 1);
+	com_nand->base.timing.t_rcbsy = value[15] * 1000;
+	com_nand->base.timing.t_cbsy = value[16] * 1000;
+	com_nand->base.timing.t_feat = NAND_FEATURE_TIME;
+	com_nand->base.cell_type = MIN(MAX(value[17], CELL_SLC), CELL_QLC);
+	com_nand->base.lun_num = value[18];
+	if (com_nand->base.lun_num <= 0 || com_nand->base.block_num % com_nand->base.lun_num) {
+		LOG(LOG_WARN, "block_num %d is not divided by lun_num %d",
+				com_nand->base.block_num, com_nand->base.lun_num);
+		com_nand->base.lun_num = 1;
+	}
+	com_nand->block_num_per_lun = com_nand->base.block_num / com_nand->base.lun_num;
+	/* level is P1 of the feature */
+	com_nand->retry_num = MIN(MAX(value[19], 1), 256);
 	com_nand->base.erase = common_nand_erase;
 	com_nand->base.read = common_nand_read_page;
 	com_nand->base.program = common_nand_program_page;
+	com_nand->base.cache_read = common_nand_cache_read;
+	com_nand->base.cache_program = common_nand_cache_program;
+	com_nand->base.copyback_read = common_nand_copyback_read;
+	com_nand->base.copyback_program = common_nand_copyback_program;
 	com_nand->base.command = common_nand_command;
+	com_nand->base.dump = common_nand_dump;
+	com_nand->base.block_info = common_nand_block_info;
+	com_nand->base.read_spare = common_nand_read_spare;
+	com_nand->base.discard = common_nand_discard;
+	com_nand->base.sync = common_nand_sync;
+	/* devices created in the same second get different bad blocks */
+	com_nand->base.seed = time(0) ^ (unsigned int)(unsigned long)com_nand;
 
 	LOG(LOG_WARN, "block_size: %d", com_nand->base.block_size);
 	LOG(LOG_WARN, "page_size: %d", com_nand->base.page_size);
@@ -343,38 +1073,92 @@ struct nand_base *common_nand_init(char *name)
 	LOG(LOG_WARN, "bad_block_num: %d", com_nand->bad_block_num);
 	LOG(LOG_WARN, "weak_block_num: %d", com_nand->weak_block_num);
 	LOG(LOG_WARN, "weak_pe_cycle: %d", com_nand->weak_pe_cycle);
-	
+	LOG(LOG_WARN, "tR: %u ns", com_nand->base.timing.t_r);
+	LOG(LOG_WARN, "tPROG: %u ns", com_nand->base.timing.t_prog);
+	LOG(LOG_WARN, "tBERS: %u ns", com_nand->base.timing.t_bers);
+	LOG(LOG_WARN, "bus_rate: %u MT/s", com_nand->base.timing.bus_rate);
+	LOG(LOG_WARN, "tRCBSY: %u ns", com_nand->base.timing.t_rcbsy);
+	LOG(LOG_WARN, "tCBSY: %u ns", com_nand->base.timing.t_cbsy);
+	LOG(LOG_WARN, "cell_type: %d", com_nand->base.cell_type);
+	LOG(LOG_WARN, "lun_num: %d", com_nand->base.lun_num);
+	LOG(LOG_WARN, "retry_num: %d", com_nand->retry_num);
+
+	/*
+	 * block buffers are shared by LUNs in a sharded cache, LUNs load and
+	 * evict blocks in parallel; a LUN pins one buffer at a time
+	 */
+	strncpy(com_nand->name, name, NAND_NAME_MAX - 1);
+	com_nand->block_file = file_create(name, (com_nand->base.page_size +
+							com_nand->base.spare_size) * com_nand->page_num_per_block,
+							MAX(2 * com_nand->base.lun_num, 4), COMPRESS_BROTLI);
+	com_nand->lun = mem_alloc(com_nand->base.lun_num * sizeof(struct nand_lun));
+	for (i = 0; i < com_nand->base.lun_num; i++) {
+		com_nand->lun[i].page_reg = mem_alloc(com_nand->base.page_size + com_nand->base.spare_size);
+		com_nand->lun[i].cache_reg = mem_alloc(com_nand->base.page_size + com_nand->base.spare_size);
+		com_nand->lun[i].page_row = -1;
+		com_nand->lun[i].cache_state = CACHE_IDLE;
+		com_nand->lun[i].seed = com_nand->base.seed + i;
+	}
+	com_nand->cache_lun = com_nand->lun;
+	com_nand->retry_stat = mem_alloc(com_nand->retry_num * sizeof(struct nand_retry_stat));
+
+	/* pages of a word line are adjacent: LSB, CSB, MSB ... */
+	com_nand->page_type = mem_alloc(com_nand->page_num_per_block);
+	for (i = 0; i < com_nand->page_num_per_block; i++)
+		com_nand->page_type[i] = i % com_nand->base.cell_type;
+
 	com_nand->page_map = bitmap_create(
 							com_nand->page_num_per_block * com_nand->base.block_num, 0);
+	com_nand->slc_map = bitmap_create(com_nand->base.block_num, 0);
 
-	fp = fopen(NAND_INFO_FOLDER"/"PAGE_MAP_FILE_NAME, "rb");
+	fp = common_nand_meta_open(com_nand, SLC_BLOCK_FILE_NAME, "rb");
 	if (fp) {
-		fread(com_nand->page_map, 1,
-				com_nand->page_num_per_block * com_nand->base.block_num >> 3, fp);
+		fread(com_nand->slc_map->b, 1, roundup(com_nand->base.block_num, 8) >> 3, fp);
 		fclose(fp);
 	}
 
-	com_nand->block_file = file_create(name, (com_nand->base.page_size +
-							com_nand->base.spare_size) * com_nand->page_num_per_block,
-							4, COMPRESS_BROTLI); // FILE_MAX_HANDLER
-
 	com_nand->block_info = (struct nand_block *)mem_alloc(com_nand->base.block_num *
 															sizeof(struct nand_block));
 
-	fp = fopen(NAND_INFO_FOLDER"/"BLOCK_INFO_FILE_NAME, "rb");
+	fp = common_nand_meta_open(com_nand, BLOCK_INFO_FILE_NAME, "rb");
 	if (fp) {
 		fread(com_nand->block_info, sizeof(struct nand_block),
 				com_nand->base.block_num, fp);
 		fclose(fp);
 	}
 
-	fp = fopen(NAND_INFO_FOLDER"/"BAD_BLOCK_FILE_NANE, "rb");
+	fp = common_nand_meta_open(com_nand, BAD_BLOCK_FILE_NANE, "rb");
 	if (fp) {
 		fread(com_nand->bad_block, sizeof(int),
 				com_nand->bad_block_num + com_nand->weak_block_num, fp);
 		fclose(fp);
 	} else {
+		/* a new device, its bad blocks stay the same even after a crash */
 		common_nand_bad_block_alloc(com_nand);
+		common_nand_meta_write(com_nand, BAD_BLOCK_FILE_NANE, com_nand->bad_block,
+				(com_nand->bad_block_num + com_nand->weak_block_num) * sizeof(int));
+		common_nand_meta_write(com_nand, BLOCK_INFO_FILE_NAME, com_nand->block_info,
+				com_nand->base.block_num * sizeof(struct nand_block));
+	}
+
+	sprintf(path, SPARE_FILE_NAME, name);
+	com_nand->spare_fd = open(path, O_RDWR | O_CREAT, 0666);
+	if (com_nand->spare_fd < 0)
+		LOG(LOG_WARN, "Cannot open file %s", path);
+
+	/*
+	 * page map is only valid until the device is opened, deinit writes it
+	 * again; after a crash it is missing and rebuilt from spare
+	 */
+	sprintf(path, PAGE_MAP_FILE_NAME, name);
+	fp = fopen(path, "rb");
+	if (fp) {
+		fread(com_nand->page_map->b, 1,
+				com_nand->page_num_per_block * com_nand->base.block_num >> 3, fp);
+		fclose(fp);
+		remove(path);
+	} else {
+		common_nand_spare_scan(com_nand);
 	}
 
 	return (struct nand_base *)com_nand;
@@ -383,26 +1167,32 @@ struct nand_base *common_nand_init(char *name)
 
 void common_nand_deinit(struct nand_base *nand)
 {
-	FILE *fp;
+	int i;
 	struct common_nand *com_nand;
 
 	com_nand = (struct common_nand *)nand;
-	fp = fopen(NAND_INFO_FOLDER"/"PAGE_MAP_FILE_NAME, "wb");
-	if (fp) {
-		fwrite(com_nand->page_map, 1,
-				com_nand->page_num_per_block * com_nand->base.block_num >> 3, fp);
-		fclose(fp);
-	}
-	fp = fopen(NAND_INFO_FOLDER"/"BLOCK_INFO_FILE_NAME, "wb");
-	if (fp) {
-		fwrite(com_nand->block_info, 1,
-				com_nand->base.block_num * sizeof(struct nand_block), fp);
-		fclose(fp);
+	common_nand_meta_write(com_nand, PAGE_MAP_FILE_NAME, com_nand->page_map->b,
+			com_nand->page_num_per_block * com_nand->base.block_num >> 3);
+	common_nand_meta_write(com_nand, BLOCK_INFO_FILE_NAME, com_nand->block_info,
+			com_nand->base.block_num * sizeof(struct nand_block));
+	common_nand_meta_write(com_nand, SLC_BLOCK_FILE_NAME, com_nand->slc_map->b,
+			roundup(com_nand->base.block_num, 8) >> 3);
+	common_nand_meta_write(com_nand, BAD_BLOCK_FILE_NANE, com_nand->bad_block,
+			(com_nand->bad_block_num + com_nand->weak_block_num) * sizeof(int));
+	for (i = 0; i < nand->lun_num; i++) {
+		mem_free(com_nand->lun[i].page_reg);
+		mem_free(com_nand->lun[i].cache_reg);
 	}
+	mem_free(com_nand->lun);
+	mem_free(com_nand->retry_stat);
+	mem_free(com_nand->page_type);
+	bitmap_delete(com_nand->slc_map);
 	mem_free(com_nand->block_info);
 	bitmap_delete(com_nand->page_map);
 	file_flush(com_nand->block_file);
 	file_delete(com_nand->block_file);
+	if (com_nand->spare_fd >= 0)
+		close(com_nand->spare_fd);
 	mem_free(com_nand);
 }
 
@@ -25,10 +25,13 @@
 #include "file.h"
 
 
-#define PAGE_MAP_FILE_NAME				"page_map.bin"
-#define BLOCK_INFO_FILE_NAME			"block_info.bin"
-#define BAD_BLOCK_FILE_NANE				"bad_block.bin"
-#define COMMON_NAND_INFO_NUM			11
+/* metadata of a device is kept in the folder of its block files */
+#define PAGE_MAP_FILE_NAME				"%s/page_map.bin"
+#define BLOCK_INFO_FILE_NAME			"%s/block_info.bin"
+#define BAD_BLOCK_FILE_NANE				"%s/bad_block.bin"
+#define SLC_BLOCK_FILE_NAME				"%s/slc_block.bin"
+#define SPARE_FILE_NAME					"%s/spare.bin"
+#define COMMON_NAND_INFO_NUM			20
 
 #define COMMON_NAND_NAME				"COMMON_NAND"
 
@@ -45,22 +48,79 @@ enum nand_status {
 };
 
 
-struct nand_block {
-	unsigned int pe_cycle;
-	unsigned int read_count;
+enum nand_cell_type {
+	CELL_SLC = 1,
+	CELL_MLC,
+	CELL_TLC,
+	CELL_QLC
+};
+
+
+/* page type is the bit index of a cell, e.g. TLC: LSB CSB MSB */
+enum nand_page_type {
+	PAGE_LSB,
+	PAGE_CSB,
+	PAGE_MSB,
+	PAGE_TSB,
+	PAGE_TYPE_NUM
+};
+
+
+enum nand_cache_state {
+	CACHE_IDLE,
+	CACHE_READ, // page register sensing next page
+	CACHE_PROGRAM, // page register programming
+	CACHE_COPYBACK // page register holds source page of copyback
+};
+
+
+/*
+ * data of a page register is valid when page_row != -1; a LUN is driven
+ * under its lock in nand_base
+ */
+struct nand_lun {
+	unsigned int status;
+	unsigned int seed; // rand_r state of error injection
+	unsigned char *page_reg;
+	unsigned char *cache_reg;
+	int page_row;
+	int page_err;
+	int cache_state;
+	int slc_mode; // erase block to pseudo-SLC
+	unsigned char feature[NAND_FEATURE_NUM][NAND_FEATURE_PARAM_NUM];
+};
+
+
+/* reads sensed at a read retry level */
+struct nand_retry_stat {
+	unsigned long long count;
+	unsigned long long err_bit;
+	unsigned long long fail; // error bits over ECC
+	unsigned long long time; // array time in ns
 };
 
 
 struct common_nand {
 	struct nand_base base;
 	struct bitmap *page_map;
+	struct bitmap *slc_map; // pseudo-SLC block
+	unsigned char *page_type; // page type of each page in block
+	char name[NAND_NAME_MAX]; // folder of block, spare and metadata files
 	struct file_info *block_file;
+	int spare_fd; // spare of all pages uncompressed, see common_nand_spare_write
 	struct nand_block *block_info;
 	int page_num_per_block;
 	int bad_block_num;
 	int weak_block_num;
 	int weak_pe_cycle;
-	unsigned int status;
+	unsigned long long copyback_num;
+	unsigned long long copyback_err_bit; // bitflips carried over without ECC
+	unsigned long long discard_num; // blocks released before erase
+	int block_num_per_lun;
+	int retry_num; // read retry levels, level 0 is default
+	struct nand_retry_stat *retry_stat;
+	struct nand_lun *lun;
+	struct nand_lun *cache_lun; // LUN of last cache read, atomic
 	int bad_block[];
 };
 
@@ -19,10 +19,12 @@
  */
 
 #include <common.h>
+#include "arena.h"
 #include "nand.h"
+#include "nand_ecc.h"
+#include "nand_sched.h"
 
 #define STORE_CMD_TO_FILE
-#define CMDQ_FILE_NAME					"commandq.log"
 
 #define CMD_READ_ERR		1
 #define CMD_PROGRAM_ERR		2
@@ -35,21 +37,19 @@ extern struct nand_base *micron_nand_init(char *name);
 extern void micron_nand_deinit(struct nand_base *nand);
 /***********************************************************/
 
-static FILE *cmd_record_fp = NULL;
-
 #ifdef STORE_CMD_TO_FILE
-static void store_cmdq(int cmd_num, struct nand_cmdq *cmdq)
+static void store_cmdq(struct nand_base *nand, int cmd_num, struct nand_cmdq *cmdq)
 {
 	int i, size;
 	char *buf;
 	time_t t;
-	struct tm *p;
+	struct tm tm, *p = &tm;
 
-	if (!cmd_record_fp)
+	if (!nand->trace)
 		return;
-	buf = mem_alloc((cmd_num + 2) * 24);
+	buf = arena_alloc((cmd_num + 2) * 24);
 	time(&t);
-	p = localtime(&t);
+	localtime_r(&t, p);
 	// 22
 	sprintf(buf, "[%04d-%02d-%02d %02d:%02d:%02d]\n",
 					1900 + p->tm_year, 1 + p->tm_mon, p->tm_mday,
@@ -61,11 +61,11 @@ static void store_cmdq(int cmd_num, struct nand_cmdq *cmdq)
 		sprintf(buf + strlen(buf), "  %08x %02x\n", cmdq[i].row, cmdq[i].cmd);
 	}
 
-	fwrite(buf, 1, strlen(buf), cmd_record_fp);
-	mem_free(buf);
+	fwrite(buf, 1, strlen(buf), nand->trace);
+	arena_free(buf);
 }
 #else
-#define  store_cmdq(cmd_num, cmdq)
+#define  store_cmdq(nand, cmd_num, cmdq)
 #endif
 
 
@@ -73,36 +73,53 @@ struct nand_ops *nand_ops_alloc(int cmd_num, int buf_size)
 {
 	struct nand_ops *ops;
 
-	ops = (struct nand_ops *)mem_alloc(sizeof(struct nand_ops) +
+	ops = (struct nand_ops *)arena_zalloc(sizeof(struct nand_ops) +
 								cmd_num * sizeof(struct nand_cmdq));
 	ops->cmd_num = cmd_num;
-	ops->buffer = mem_alloc(buf_size);
+	ops->buffer = arena_alloc(buf_size);
 	return ops;
 }
 
 
 void nand_ops_free(struct nand_ops *ops)
 {
-	mem_free(ops->buffer);
-	mem_free(ops);
+	arena_free(ops->buffer);
+	arena_free(ops);
 }
 
-int nand_cmd(struct nand_base *nand, struct nand_ops *ops)
+/* 30h followed by 31h, or by 00h-31h of random cache read */
+static bool nand_cache_read_follow(struct nand_ops *ops, int i)
+{
+	if (i + 1 < ops->cmd_num && ops->cmdq[i + 1].cmd == CMD_READ_CACHE_SEQ)
+		return TRUE;
+	if (i + 2 < ops->cmd_num && ops->cmdq[i + 1].cmd == CMD_READ_1ST &&
+		ops->cmdq[i + 2].cmd == CMD_READ_CACHE_RANDOM_2ND)
+		return TRUE;
+	return FALSE;
+}
+
+static int nand_cmd_run(struct nand_base *nand, struct nand_ops *ops)
 {
-	int i, ret;
+	int i, ret, row, size;
+	int err_bit, col;
+	bool copyback = FALSE;
 	char *buf;
 	int rcount, wcount, ecount;
 	int cc_read, cc_write;
 
 	rcount = wcount = ecount = 0;
 	cc_read = cc_write = 0;
+	col = -1;
+	size = nand->page_size + nand->spare_size;
 
-	ret = 0;
+	ret = err_bit = 0;
 	for (i = 0; i < ops->cmd_num; i++) {
-		if (ret) {
+		/* positive is bitflip number, keep going */
+		if (ret < 0) {
 			LOG(LOG_WARN, "command fail %d\n", ret);
 			return ret;
 		}
+		err_bit = MAX(err_bit, ret);
 
 		buf = ops->buffer;
 
@@ -111,12 +128,35 @@ int nand_cmd(struct nand_base *nand, struct nand_ops *ops)
 			rcount++;
 			break;
 
-		case CMD_READ_CACHE_SEQ:
+		case CMD_READ_CACHE_SEQ: // CMD_READ_CACHE_RANDOM_2ND
 		case CMD_READ_CACHE_END:
-			buf = (char *)ops->buffer + cc_read * (nand->page_size + nand->spare_size);
+			buf = (char *)ops->buffer + cc_read * size;
 			cc_read++;
+			row = -1;
+			if (rcount == 1 && ops->cmdq[i].cmd == CMD_READ_CACHE_RANDOM_2ND) {
+				rcount = 0;
+				row = ops->cmdq[i].row;
+			}
+			if (rcount == 0)
+				ret = nand->cache_read(nand, row, buf, ops->cmdq[i].cmd);
+			else
+				ret = -CMD_READ_ERR;
+			break;
+
 		case CMD_COPYBACK_READ_2ND:
+			if (rcount == 1) {
+				rcount = 0;
+				ret = nand->copyback_read(nand, ops->cmdq[i].row);
+			} else
+				ret = -CMD_READ_ERR;
+			break;
+
 		case CMD_READ_2ND:
+			if (rcount == 1 && nand_cache_read_follow(ops, i)) {
+				rcount = 0;
+				ret = nand->cache_read(nand, ops->cmdq[i].row, NULL, CMD_READ_2ND);
+				break;
+			}
 		case CMD_READ_MULTI_PLANE_2ND:
 			if (rcount == 1) {
 				rcount = 0;
@@ -139,15 +179,41 @@ int nand_cmd(struct nand_base *nand, struct nand_ops *ops)
 				ret = -CMD_ERASE_ERR;
 			break;
 
-		case CMD_COPYBACK_PROGRAM_1ST:
+		case CMD_COPYBACK_PROGRAM_1ST: // CMD_CHANGE_WRITE_COLUMN
+			if (wcount == 0) {
+				wcount++;
+				copyback = TRUE;
+				col = -1;
+			} else {
+				/* change write column, row is column address */
+				col = ops->cmdq[i].row;
+			}
+			break;
+
 		case CMD_PROGRAM_1ST:
 			wcount++;
+			copyback = FALSE;
 			break;
 
 		case CMD_CACHE_PROGRAM_2ND:
-			buf = (char *)ops->buffer + cc_write * (nand->page_size + nand->spare_size);
+			buf = (char *)ops->buffer + cc_write * size;
 			cc_write++;
+			if (wcount == 1) {
+				wcount = 0;
+				ret = nand->cache_program(nand, ops->cmdq[i].row, buf);
+			} else
+				ret = -CMD_PROGRAM_ERR;
+			break;
+
 		case CMD_PROGRAM_2ND:
+			/* last page of cache program */
+			buf = (char *)ops->buffer + cc_write * size;
+			if (wcount == 1 && copyback) {
+				wcount = 0;
+				copyback = FALSE;
+				ret = nand->copyback_program(nand, ops->cmdq[i].row, buf, col);
+				break;
+			}
 		case CMD_PROGRAM_MULTI_PLANE_2ND:
 			if (wcount == 1) {
 				wcount = 0;
@@ -158,6 +224,8 @@ int nand_cmd(struct nand_base *nand, struct nand_ops *ops)
 
 		case CMD_READ_STATUS:
 		case CMD_READ_STATUS_EX:
+		case CMD_SLC_MODE_ENABLE:
+		case CMD_SLC_MODE_DISABLE:
 		case CMD_READ_ID:
 		case CMD_VOLUME_SELECT:
 		case CMD_ODT_CONFIGURE:
@@ -180,7 +248,91 @@ int nand_cmd(struct nand_base *nand, struct nand_ops *ops)
 			break;
 		}
 	}
-	store_cmdq(ops->cmd_num, ops->cmdq);
+	store_cmdq(nand, ops->cmd_num, ops->cmdq);
+	return ret < 0 ? ret : MAX(err_bit, ret);
+}
+
+/*
+ * LUNs addressed by a command sequence, in [first, last]; address-less
+ * cache read continues the last cache read of any LUN, it and the
+ * commands without row address take all LUNs
+ */
+static void nand_cmd_lun(struct nand_base *nand, struct nand_ops *ops, int *first, int *last)
+{
+	int i, lun, row;
+
+	*first = nand->lun_num - 1;
+	*last = 0;
+	for (i = 0; i < ops->cmd_num; i++) {
+		row = ops->cmdq[i].row;
+		switch (ops->cmdq[i].cmd) {
+		case CMD_READ_1ST:
+		case CMD_ERASE_1ST:
+		case CMD_PROGRAM_1ST:
+		case CMD_COPYBACK_PROGRAM_1ST: // column, or row addressed again by 10h
+			continue;
+
+		case CMD_READ_CACHE_SEQ: // CMD_READ_CACHE_RANDOM_2ND
+			lun = -1;
+			if (i > 0 && ops->cmdq[i - 1].cmd == CMD_READ_1ST && row >= 0)
+				lun = nand_row_lun(nand, row);
+			break;
+
+		case CMD_READ_2ND:
+		case CMD_READ_MULTI_PLANE_2ND:
+		case CMD_COPYBACK_READ_2ND:
+		case CMD_ERASE_2ND:
+		case CMD_ERASE_MULTI_PLANE_2ND:
+		case CMD_PROGRAM_2ND:
+		case CMD_PROGRAM_MULTI_PLANE_2ND:
+		case CMD_CACHE_PROGRAM_2ND:
+		case CMD_RESET_LUN:
+			lun = row >= 0 ? nand_row_lun(nand, row) : -1;
+			break;
+
+		default:
+			lun = -1;
+			break;
+		}
+		if (lun < 0) {
+			*first = 0;
+			*last = nand->lun_num - 1;
+			return;
+		}
+		*first = MIN(*first, lun);
+		*last = MAX(*last, lun);
+	}
+	if (*first > *last) {
+		*first = 0;
+		*last = nand->lun_num - 1;
+	}
+}
+
+/* locks are taken in ascending order of LUN */
+static void nand_lun_lock(struct nand_base *nand, int first, int last)
+{
+	int i;
+
+	for (i = first; i <= last; i++)
+		pthread_mutex_lock(&nand->lun_lock[i]);
+}
+
+static void nand_lun_unlock(struct nand_base *nand, int first, int last)
+{
+	int i;
+
+	for (i = last; i >= first; i--)
+		pthread_mutex_unlock(&nand->lun_lock[i]);
+}
+
+int nand_cmd(struct nand_base *nand, struct nand_ops *ops)
+{
+	int ret, first, last;
+
+	nand_cmd_lun(nand, ops, &first, &last);
+	nand_lun_lock(nand, first, last);
+	ret = nand_cmd_run(nand, ops);
+	nand_lun_unlock(nand, first, last);
 	return ret;
 }
 
@@ -195,7 +347,15 @@ int nand_read_page(struct nand_base *nand, int row, int col, void *data, void *o
 	ops->cmdq[1].row = row;
 	ops->cmdq[1].cmd = CMD_READ_2ND;
 	ret = nand_cmd(nand, ops);
-	if (ret >= 0 && ret <= nand->ecc_required) {
+	if (ret >= 0 && nand->ecc) {
+		ret = nand_ecc_correct(nand, row, ops->buffer, ret);
+		if (ret < 0) {
+			LOG(LOG_ERR, "Uncorrectable sector at page %d", row);
+			nand_ops_free(ops);
+			return FLASH_ERROR;
+		}
+	}
+	if (ret >= 0 && (ret <= nand->ecc_required || nand->ecc)) {
 		memcpy(data, (char *)ops->buffer + col, nand->page_size - col);
 		memcpy(oob, (char *)ops->buffer + nand->page_size, nand->spare_size);
 		ret = ret > 0 ? FLASH_BITFLIP : FLASH_OK;
@@ -220,8 +380,11 @@ int nand_write_page(struct nand_base *nand, int row, int col, void *data, void *
 	ops->cmdq[0].cmd = CMD_PROGRAM_1ST;
 	ops->cmdq[1].row = row;
 	ops->cmdq[1].cmd = CMD_PROGRAM_2ND;
+	memset(ops->buffer, 0, col);
 	memcpy((char *)ops->buffer + col, data, nand->page_size - col);
 	memcpy((char *)ops->buffer + nand->page_size, oob, nand->spare_size);
+	if (nand->ecc)
+		nand_ecc_encode(nand, row, ops->buffer);
 	ret = nand_cmd(nand, ops);
 	nand_ops_free(ops);
 	return (ret < 0 ? FLASH_BAD : FLASH_OK);
@@ -257,6 +420,130 @@ int nand_bad_block(struct nand_base *nand, int row)
 	return (ret < 0 ? FLASH_BAD : FLASH_OK);
 }
 
+int nand_copyback_page(struct nand_base *nand, int src_row, int dst_row, int col, void *data)
+{
+	int ret, size;
+	struct nand_ops *ops;
+
+	size = nand->page_size + nand->spare_size;
+	if (data && (col < 0 || col >= size))
+		return FLASH_BAD;
+
+	ops = nand_ops_alloc(data ? 5 : 4, data ? size : 0);
+	ops->cmdq[0].row = -1;
+	ops->cmdq[0].cmd = CMD_READ_1ST;
+	ops->cmdq[1].row = src_row;
+	ops->cmdq[1].cmd = CMD_COPYBACK_READ_2ND;
+	ops->cmdq[2].row = dst_row;
+	ops->cmdq[2].cmd = CMD_COPYBACK_PROGRAM_1ST;
+	if (data) {
+		ops->cmdq[3].row = col;
+		ops->cmdq[3].cmd = CMD_CHANGE_WRITE_COLUMN;
+		memcpy((char *)ops->buffer + col, data, size - col);
+	}
+	ops->cmdq[ops->cmd_num - 1].row = dst_row;
+	ops->cmdq[ops->cmd_num - 1].cmd = CMD_PROGRAM_2ND;
+	ret = nand_cmd(nand, ops);
+	nand_ops_free(ops);
+	return (ret < 0 ? FLASH_BAD : FLASH_OK);
+}
+
+void nand_slc_mode(struct nand_base *nand, bool enable)
+{
+	struct nand_ops *ops;
+
+	ops = nand_ops_alloc(1, 0);
+	ops->cmdq[0].row = -1;
+	ops->cmdq[0].cmd = enable ? CMD_SLC_MODE_ENABLE : CMD_SLC_MODE_DISABLE;
+	nand_cmd(nand, ops);
+	nand_ops_free(ops);
+}
+
+static int nand_feature(struct nand_base *nand, int cmd, int addr, unsigned char *param)
+{
+	int ret;
+	struct nand_ops *ops;
+
+	ops = nand_ops_alloc(1, NAND_FEATURE_PARAM_NUM);
+	ops->cmdq[0].row = addr;
+	ops->cmdq[0].cmd = cmd;
+	if (cmd == CMD_SET_FEATURE || cmd == CMD_LUN_SET_FEATURE)
+		memcpy(ops->buffer, param, NAND_FEATURE_PARAM_NUM);
+	ret = nand_cmd(nand, ops);
+	if (ret == 0 && (cmd == CMD_GET_FEATURE || cmd == CMD_LUN_GET_FEATURE))
+		memcpy(param, ops->buffer, NAND_FEATURE_PARAM_NUM);
+	nand_ops_free(ops);
+	return ret;
+}
+
+int nand_set_feature(struct nand_base *nand, int lun, int addr, unsigned char *param)
+{
+	if (lun < 0)
+		return nand_feature(nand, CMD_SET_FEATURE, addr, param);
+	return nand_feature(nand, CMD_LUN_SET_FEATURE, (lun << 8) | addr, param);
+}
+
+int nand_get_feature(struct nand_base *nand, int lun, int addr, unsigned char *param)
+{
+	if (lun < 0)
+		return nand_feature(nand, CMD_GET_FEATURE, addr, param);
+	return nand_feature(nand, CMD_LUN_GET_FEATURE, (lun << 8) | addr, param);
+}
+
+int nand_block_info(struct nand_base *nand, int row, struct nand_block *info)
+{
+	int block = row / (nand->block_size / nand->page_size);
+	int ret, lun;
+
+	if (!nand->block_info || row < 0 || block >= nand->block_num)
+		return -1;
+	lun = nand_row_lun(nand, row);
+	nand_lun_lock(nand, lun, lun);
+	ret = nand->block_info(nand, block, info);
+	nand_lun_unlock(nand, lun, lun);
+	return ret;
+}
+
+int nand_read_spare(struct nand_base *nand, int row, int num, void *oob)
+{
+	int page_num = nand->block_num * (nand->block_size / nand->page_size);
+
+	if (!nand->read_spare || row < 0 || num < 0 || num > page_num - row)
+		return -1;
+	return nand->read_spare(nand, row, num, oob);
+}
+
+int nand_discard_block(struct nand_base *nand, int row)
+{
+	int block = row / (nand->block_size / nand->page_size);
+	int ret, lun;
+
+	if (!nand->discard || row < 0 || block >= nand->block_num)
+		return -1;
+	lun = nand_row_lun(nand, row);
+	nand_lun_lock(nand, lun, lun);
+	ret = nand->discard(nand, row);
+	nand_lun_unlock(nand, lun, lun);
+	return ret;
+}
+
+int nand_sync(struct nand_base *nand)
+{
+	if (!nand->sync)
+		return 0;
+	return nand->sync(nand);
+}
+
+void nand_dump(struct nand_base *nand, FILE *fp)
+{
+	nand_lun_lock(nand, 0, nand->lun_num - 1);
+	if (nand->dump)
+		nand->dump(nand, fp);
+	sched_dump(nand->sched, fp);
+	nand_ecc_dump(nand, fp);
+	nand_lun_unlock(nand, 0, nand->lun_num - 1);
+}
+
 void nand_mark_block(struct nand_base *nand, int row)
 {
 	int ret;
@@ -282,7 +569,16 @@ void nand_mark_block(struct nand_base *nand, int row)
 
 struct nand_base *nand_init(enum flash_type nand_type, char *nand_name)
 {
+	int i;
 	struct nand_base *nand;
+#ifdef STORE_CMD_TO_FILE
+	char name[NAND_NAME_MAX + 16];
+#endif
+
+	if (strlen(nand_name) >= NAND_NAME_MAX) {
+		LOG(LOG_WARN, "nand name %s is too long", nand_name);
+		return NULL;
+	}
 
 	switch (nand_type) {
 	case COMMON:
@@ -302,14 +598,36 @@ struct nand_base *nand_init(enum flash_type nand_type, char *nand_name)
 		nand = NULL;
 		break;
 	}
-	if (!cmd_record_fp)
-		cmd_record_fp = fopen(CMDQ_FILE_NAME, "w");
+	if (!nand)
+		return NULL;
+
+	nand->lun_lock = mem_alloc(nand->lun_num * sizeof(pthread_mutex_t));
+	for (i = 0; i < nand->lun_num; i++)
+		pthread_mutex_init(&nand->lun_lock[i], NULL);
+	nand->sched = sched_create(&nand->timing, nand->page_size + nand->spare_size, 1,
+								nand->lun_num);
+#ifdef STORE_CMD_TO_FILE
+	sprintf(name, NAND_TRACE_FILE_NAME, nand_name);
+	nand->trace = fopen(name, "w");
+#endif
 	return nand;
 }
 
 
 void nand_deinit(enum flash_type nand_type, struct nand_base *nand)
 {
+	int i;
+
+	nand_ecc_disable(nand);
+	if (nand->trace)
+		fclose(nand->trace);
+	nand->trace = NULL;
+	for (i = 0; i < nand->lun_num; i++)
+		pthread_mutex_destroy(&nand->lun_lock[i]);
+	mem_free(nand->lun_lock);
+	nand->lun_lock = NULL;
+	sched_delete(nand->sched);
+	nand->sched = NULL;
 	switch (nand_type) {
 	case COMMON:
 		common_nand_deinit(nand);
@@ -327,6 +645,4 @@ void nand_deinit(enum flash_type nand_type, struct nand_base *nand)
 		LOG(LOG_WARN, "not found nand type %d", nand_type);
 		break;
 	}
-	if (cmd_record_fp)
-		fclose(cmd_record_fp);
 }
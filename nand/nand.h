@@ -20,6 +20,8 @@
 
 #ifndef __NAND_H__
 #define __NAND_H__
+
+#include <pthread.h>
 /*
  * Nand_Info: format
  * Name: COMMON_NAND
@@ -33,9 +35,31 @@
  * PE_Cycle: 3000
  * Weak_PE_Cycle: 2000
  * Temperature: 28
+ * tR: 50 (us)
+ * tPROG: 600 (us)
+ * tBERS: 3000 (us)
+ * Bus_Rate: 800 (MT/s)
+ * tRCBSY: 3 (us)
+ * tCBSY: 3 (us)
+ * Cell_Type: 1 (bits per cell, 1:SLC 2:MLC 3:TLC 4:QLC)
+ * LUN_Num: 1
+ * Read_Retry_Num: 8
  * ... vendor defined
  */
 #define NAND_INFO_FOLDER				"NandInfo"
+/* a device keeps block files, metadata and command trace in folder of its name */
+#define NAND_NAME_MAX					64
+#define NAND_TRACE_FILE_NAME			"%s/commandq.log"
+
+/* command + 5 address + confirm cycles, tWC 25ns */
+#define NAND_CMD_ADDR_TIME				(7 * 25)
+/* tFEAT, busy time of get/set feature */
+#define NAND_FEATURE_TIME				1000
+
+/* feature address table, 4 parameters P1~P4 per address */
+#define NAND_FEATURE_NUM				256
+#define NAND_FEATURE_PARAM_NUM			4
+#define NAND_FEATURE_READ_RETRY			0x89 // P1: read retry level, 0 for default
 
 
 #define CMD_READ_1ST					0x00
@@ -60,6 +84,8 @@
 #define CMD_COPYBACK_PROGRAM_1ST		0x85
 #define CMD_CHANGE_WRITE_COLUMN			0x85
 #define CMD_CHANGE_ROW_ADDRESS			0x85
+#define CMD_SLC_MODE_ENABLE				0xda
+#define CMD_SLC_MODE_DISABLE			0xdf
 #define CMD_READ_ID						0x90
 #define CMD_VOLUME_SELECT				0xe1
 #define CMD_ODT_CONFIGURE				0xe2
@@ -67,6 +93,7 @@
 #define CMD_UNIQUE_ID					0xed
 #define CMD_GET_FEATURE					0xee
 #define CMD_SET_FEATURE					0xef
+/* address of LUN get/set feature is (lun << 8) | feature address */
 #define CMD_LUN_GET_FEATURE				0xd4
 #define CMD_LUN_SET_FEATURE				0xd5
 #define CMD_ZQ_CALIBRATION_SHORT		0xd9
@@ -112,6 +139,42 @@ struct nand_ops {
 };
 
 
+/* all time in ns */
+struct nand_timing {
+	unsigned int t_cmd; // command and address cycles
+	unsigned int t_r; // page read, array to register
+	unsigned int t_prog; // page program, register to array
+	unsigned int t_bers; // block erase
+	unsigned int t_rcbsy; // cache read, page register to cache register
+	unsigned int t_cbsy; // cache program, cache register to page register
+	unsigned int t_feat; // get/set feature
+	unsigned int bus_rate; // MT/s of 8-bit bus, equal to MB/s
+};
+
+
+/*
+ * nand_xfer_time - data transfer time of bus
+ * @timing: nand timing
+ * @size: transfer size in byte
+ *
+ * Returns transfer time in ns
+ */
+static inline unsigned int nand_xfer_time(const struct nand_timing *timing, int size)
+{
+	return (unsigned long long)size * 1000 / timing->bus_rate;
+}
+
+
+struct nand_ecc;
+struct sched;
+
+struct nand_block {
+	unsigned int pe_cycle;
+	unsigned int read_count;
+	unsigned int bad; // in bad block table of device, no page is read
+};
+
+
 struct nand_base {
 	int block_size;
 	int page_size;
@@ -120,19 +183,94 @@ struct nand_base {
 	int ecc_required;
 	int max_pe_cycle;
 	int temperature;
+	int cell_type; // bits per cell
+	int lun_num; // blocks are split evenly to LUNs
+	struct nand_timing timing;
+	unsigned long long clock; // simulated time in ns, the latest completion
+	/*
+	 * one channel shared by a die per LUN, every command is timed by its
+	 * stages here: commands of a LUN queue back to back, LUNs overlap
+	 */
+	struct sched *sched;
+	struct nand_ecc *ecc; // NULL for ecc_required threshold
+	/*
+	 * all state is per device, devices are driven by different threads in
+	 * parallel; in a device, a command sequence holds the locks of LUNs it
+	 * addresses, so commands of different LUNs run in parallel
+	 */
+	pthread_mutex_t *lun_lock;
+	unsigned int seed; // rand_r state at init, LUNs and ECC inject errors by their own
+	FILE *trace; // command record, NULL for none
 	/* private method start */
 	int (*erase)(struct nand_base *nand, int row);
 	int (*read)(struct nand_base *nand, int row, void *data); // read page
 	int (*program)(struct nand_base *nand, int row, void *data); // program page
+	/* cmd: CMD_READ_2ND to start, CMD_READ_CACHE_SEQ/RANDOM_2ND or CMD_READ_CACHE_END, row -1 for sequential */
+	int (*cache_read)(struct nand_base *nand, int row, void *data, int cmd);
+	int (*cache_program)(struct nand_base *nand, int row, void *data); // CMD_CACHE_PROGRAM_2ND
+	int (*copyback_read)(struct nand_base *nand, int row); // CMD_COPYBACK_READ_2ND
+	/* program page register to row, data from col to page end is injected if col >= 0 */
+	int (*copyback_program)(struct nand_base *nand, int row, void *data, int col);
 	int (*command)(struct nand_base *nand, int cmd, int addr, void *data);
+	void (*dump)(struct nand_base *nand, FILE *fp); // statistics
+	int (*block_info)(struct nand_base *nand, int block, struct nand_block *info);
+	int (*read_spare)(struct nand_base *nand, int row, int num, void *oob); // no data, no timing
+	int (*discard)(struct nand_base *nand, int row); // release storage of block, no timing
+	int (*sync)(struct nand_base *nand); // write back storage, no timing
 	/* private method end */
 };
 
 
+/*
+ * nand_clock_add - advance simulated time by controller work like ECC
+ *                  decoding, called from threads of different LUNs
+ * @nand: nand_base object
+ * @time: time in ns
+ *
+ * Returns simulated time after advance
+ */
+static inline unsigned long long nand_clock_add(struct nand_base *nand, unsigned long long time)
+{
+	return __atomic_add_fetch(&nand->clock, time, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * nand_clock_wait - move simulated time forward to at least time
+ * @nand: nand_base object
+ * @time: time in ns
+ */
+static inline void nand_clock_wait(struct nand_base *nand, unsigned long long time)
+{
+	unsigned long long now = __atomic_load_n(&nand->clock, __ATOMIC_RELAXED);
+
+	while (now < time && !__atomic_compare_exchange_n(&nand->clock, &now, time, 0,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+
+/*
+ * nand_row_lun - LUN of a row
+ * @nand: nand_base object
+ * @row: row address, rows beyond the device go to the last LUN
+ *
+ * Returns LUN index
+ */
+static inline int nand_row_lun(struct nand_base *nand, int row)
+{
+	int lun;
+
+	lun = row / (nand->block_size / nand->page_size) / (nand->block_num / nand->lun_num);
+	return MIN(lun, nand->lun_num - 1);
+}
+
+
 /*
  * nand_init - init a nand object from Nand_Info folder
  * @nand_type: customized nand type of info & operations
- * @nand_name: Nand_Info name
+ * @nand_name: Nand_Info name, shorter than NAND_NAME_MAX, also the folder
+ *             of device data; devices of different names are independent
  *
  * Returns nand_base pbject, otherwise NULL
  */
@@ -147,6 +285,13 @@ struct nand_base *nand_init(enum flash_type nand_type, char *nand_name);
 void nand_deinit(enum flash_type nand_type, struct nand_base *nand);
 
 
+/*
+ * nand_ops_alloc - allocate command sequence from arena of current thread
+ * @cmd_num: command number, commands are zeroed
+ * @buf_size: data buffer size, buffer is not zeroed
+ *
+ * Returns nand_ops object, freed by nand_ops_free from any thread
+ */
 struct nand_ops *nand_ops_alloc(int cmd_num, int buf_size);
 void nand_ops_free(struct nand_ops *ops);
 /*
@@ -162,6 +307,109 @@ int nand_cmd(struct nand_base *nand, struct nand_ops *ops);
 int nand_read_page(struct nand_base *nand, int row, int col, void *data, void *oob);
 int nand_write_page(struct nand_base *nand, int row, int col, void *data, void *oob);
 int nand_erase_block(struct nand_base *nand, int row);
+
+
+/*
+ * nand_copyback_page - move a page inside nand without data out
+ * @nand: created nand_base object
+ * @src_row: source page
+ * @dst_row: destination page, must be erased
+ * @col: column of injected data, ignored if data is NULL
+ * @data: injected data from col to the end of page and spare, NULL for none
+ *
+ * Returns FLASH_OK if success, otherwise FLASH_BAD
+ */
+int nand_copyback_page(struct nand_base *nand, int src_row, int dst_row, int col, void *data);
 int nand_bad_block(struct nand_base *nand, int row);
+
+
+/*
+ * nand_block_info - wear statistics and bad state of the block of a row
+ * @nand: created nand_base object
+ * @row: any page of the block
+ * @info: return PE cycle, read count and bad state
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int nand_block_info(struct nand_base *nand, int row, struct nand_block *info);
+
+
+/*
+ * nand_read_spare - read spare area of pages without page data, for mount
+ *                   scan; nand clock is not advanced, and it can be called
+ *                   from several threads
+ * @nand: created nand_base object
+ * @row: first page
+ * @num: page number, pages may cross blocks
+ * @oob: return num * spare_size bytes, erased page is all 0xFF
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int nand_read_spare(struct nand_base *nand, int row, int num, void *oob);
+
+
+/*
+ * nand_discard_block - release backing storage of a block holding no valid
+ *                      data, its pages read as erased and cannot be
+ *                      programmed until next erase; nand clock is not
+ *                      advanced, it is a simulator operation
+ * @nand: created nand_base object
+ * @row: any page of the block
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int nand_discard_block(struct nand_base *nand, int row);
+
+
+/*
+ * nand_sync - write back cached storage of programmed pages, so data and
+ *             spare survive the simulator process; nand clock is not
+ *             advanced, it is a simulator operation
+ * @nand: created nand_base object
+ *
+ * Returns zero if success or nothing is cached, otherwise non-zero
+ */
+int nand_sync(struct nand_base *nand);
+
+
+/*
+ * nand_slc_mode - blocks erased in SLC mode are pseudo-SLC until next erase,
+ *                 only first 1/cell_type pages of pseudo-SLC block are usable
+ * @nand: created nand_base object
+ * @enable: TRUE for SLC mode
+ */
+void nand_slc_mode(struct nand_base *nand, bool enable);
+
+
+/*
+ * nand_set_feature - set parameters of a feature address
+ * @nand: created nand_base object
+ * @lun: target LUN, -1 for all LUNs
+ * @addr: feature address, e.g. NAND_FEATURE_READ_RETRY
+ * @param: NAND_FEATURE_PARAM_NUM bytes of P1~P4
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int nand_set_feature(struct nand_base *nand, int lun, int addr, unsigned char *param);
+
+
+/*
+ * nand_get_feature - get parameters of a feature address
+ * @nand: created nand_base object
+ * @lun: target LUN, -1 for LUN 0
+ * @addr: feature address
+ * @param: return NAND_FEATURE_PARAM_NUM bytes of P1~P4
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int nand_get_feature(struct nand_base *nand, int lun, int addr, unsigned char *param);
+
+
+/*
+ * nand_dump - print statistics of nand
+ * @nand: created nand_base object
+ * @fp: output file
+ */
+void nand_dump(struct nand_base *nand, FILE *fp);
 void nand_mark_block(struct nand_base *nand, int row);
 #endif
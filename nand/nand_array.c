@@ -0,0 +1,525 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#include "common.h"
+#include "xor.h"
+#include "nand.h"
+#include "nand_exec.h"
+#include "nand_array.h"
+
+
+static unsigned long long array_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* left symmetric: parity moves one device down every stripe */
+static int array_parity_dev(struct nand_array *array, unsigned int stripe)
+{
+	return array->dev_num - 1 - stripe % array->dev_num;
+}
+
+
+/* device and row of a logical page */
+static void array_map(struct nand_array *array, unsigned int page, int *dev, int *row)
+{
+	unsigned int unit = page / array->stripe_page;
+	unsigned int stripe = unit / array->data_num;
+
+	*dev = unit % array->data_num;
+	*row = stripe * array->stripe_page + page % array->stripe_page;
+	if (array->mode == ARRAY_PARITY && *dev >= array_parity_dev(array, stripe))
+		(*dev)++;
+}
+
+
+/* dst ^= src of page and spare, timed for parity throughput */
+static void array_xor(struct nand_array *array, unsigned char *dst, const unsigned char *data,
+						const unsigned char *oob)
+{
+	unsigned long long start = array_now();
+
+	xor_block(dst, data, array->page_size);
+	xor_block(dst + array->page_size, oob, array->spare_size);
+	array->stat.xor_time += array_now() - start;
+	array->stat.xor_bytes += array->page_size + array->spare_size;
+}
+
+
+static void array_job(struct exec_job *job, int op, int row, void *data, void *oob)
+{
+	memset(job, 0, sizeof(struct exec_job));
+	job->op = op;
+	job->row = row;
+	job->data = data;
+	job->oob = oob;
+}
+
+
+static void array_wait(struct nand_array *array)
+{
+	int i;
+
+	for (i = 0; i < array->dev_num; i++)
+		exec_wait(array->dev[i].exec);
+}
+
+
+/* error of the first failed job */
+static int array_ret(struct nand_array *array, struct exec_job *job, int num)
+{
+	int i, ret = FLASH_OK;
+
+	for (i = 0; i < num; i++) {
+		if (job[i].ret == FLASH_OK)
+			continue;
+		if (job[i].ret == FLASH_BITFLIP && job[i].op == EXEC_READ) {
+			ret = ret == FLASH_OK ? FLASH_BITFLIP : ret;
+			continue;
+		}
+		if (ret == FLASH_OK || ret == FLASH_BITFLIP)
+			ret = job[i].ret;
+		array->stat.error++;
+	}
+	return ret;
+}
+
+
+/* rebuild needs the last programmed row of every array block */
+static void array_block_row(struct nand_array *array, int row)
+{
+	int block = row / array->page_num_per_block;
+
+	array->block_row[block] = MAX(array->block_row[block], row % array->page_num_per_block + 1);
+}
+
+
+static int array_dev_open(struct nand_array *array, int dev, char *name)
+{
+	struct nand_base *nand;
+
+	nand = nand_init(COMMON, name);
+	if (!nand) {
+		LOG(LOG_ERR, "init device %s fail", name);
+		return -1;
+	}
+	/* first device gives the geometry */
+	if (!array->page_size) {
+		array->page_size = nand->page_size;
+		array->spare_size = nand->spare_size;
+		array->page_num_per_block = nand->block_size / nand->page_size;
+		array->block_num = nand->block_num;
+	}
+	if (nand->page_size != array->page_size || nand->spare_size != array->spare_size ||
+		nand->block_size / nand->page_size != array->page_num_per_block ||
+		nand->block_num != array->block_num) {
+		LOG(LOG_ERR, "device %s has different geometry", name);
+		nand_deinit(COMMON, nand);
+		return -1;
+	}
+	array->dev[dev].nand = nand;
+	array->dev[dev].exec = exec_create(nand, array->worker_num, NULL);
+	if (!array->dev[dev].exec) {
+		LOG(LOG_ERR, "create queue of device %s fail", name);
+		return -1;
+	}
+	return 0;
+}
+
+
+static void array_dev_close(struct nand_array *array, int dev)
+{
+	if (array->dev[dev].exec)
+		exec_delete(array->dev[dev].exec);
+	if (array->dev[dev].nand)
+		nand_deinit(COMMON, array->dev[dev].nand);
+	array->dev[dev].exec = NULL;
+	array->dev[dev].nand = NULL;
+}
+
+
+/*
+ * read rows of the other devices, num rows from row, and XOR them to
+ * unit_size buffers of page and spare; a peer row of error fails its row
+ */
+static int array_recover(struct nand_array *array, int dev, int row, int num, unsigned char *out,
+						int *ret)
+{
+	int i, j, k, peer = array->dev_num - 1, unit_size = array->page_size + array->spare_size;
+	unsigned char *buf;
+	struct exec_job *job;
+
+	for (i = 0; i < num; i++)
+		ret[i] = FLASH_ERROR;
+	if (array->mode != ARRAY_PARITY)
+		return FLASH_ERROR;
+	for (i = 0; i < array->dev_num; i++) {
+		if (i != dev && array->dev[i].fail)
+			return FLASH_ERROR;
+	}
+
+	buf = mem_alloc(num * peer * unit_size);
+	job = mem_alloc(num * peer * sizeof(struct exec_job));
+	for (j = 0; j < num; j++) {
+		for (i = 0, k = j * peer; i < array->dev_num; i++) {
+			if (i == dev)
+				continue;
+			array_job(&job[k], EXEC_READ, row + j, buf + k * unit_size,
+					buf + k * unit_size + array->page_size);
+			exec_submit(array->dev[i].exec, &job[k++]);
+		}
+	}
+	array_wait(array);
+
+	for (j = 0; j < num; j++) {
+		memset(out + j * unit_size, 0, unit_size);
+		ret[j] = FLASH_OK;
+		for (k = j * peer; k < (j + 1) * peer; k++) {
+			if (job[k].ret < FLASH_BITFLIP) {
+				ret[j] = job[k].ret;
+				array->stat.error++;
+				break;
+			}
+			array_xor(array, out + j * unit_size, buf + k * unit_size,
+					buf + k * unit_size + array->page_size);
+		}
+	}
+	mem_free(job);
+	mem_free(buf);
+	for (j = 0; j < num; j++) {
+		if (ret[j] != FLASH_OK)
+			return ret[j];
+	}
+	return FLASH_OK;
+}
+
+
+struct nand_array *nand_array_create(char *name[], int dev_num, int stripe_page, int mode,
+									int worker_num)
+{
+	int i;
+	struct nand_array *array;
+
+	if (dev_num < 1 || dev_num > ARRAY_DEV_MAX || (mode == ARRAY_PARITY && dev_num < 3) ||
+		stripe_page < 1 || (stripe_page & (stripe_page - 1)))
+		return NULL;
+
+	array = mem_alloc(sizeof(struct nand_array));
+	array->mode = mode;
+	array->dev_num = dev_num;
+	array->data_num = mode == ARRAY_PARITY ? dev_num - 1 : dev_num;
+	array->stripe_page = stripe_page;
+	array->worker_num = worker_num;
+	array->fill = ARRAY_NO_FILL;
+	array->dev = mem_alloc(dev_num * sizeof(struct array_dev));
+	for (i = 0; i < dev_num; i++) {
+		if (array_dev_open(array, i, name[i]))
+			goto fail;
+	}
+	if (stripe_page > array->page_num_per_block) {
+		LOG(LOG_ERR, "stripe_page %d over pages of a block", stripe_page);
+		goto fail;
+	}
+	array->page_num = (unsigned int)array->block_num * array->page_num_per_block * array->data_num;
+	array->block_row = mem_alloc(array->block_num * sizeof(int));
+	if (mode == ARRAY_PARITY)
+		array->parity = mem_alloc(stripe_page * (array->page_size + array->spare_size));
+	return array;
+
+fail:
+	nand_array_delete(array);
+	return NULL;
+}
+
+
+int nand_array_read(struct nand_array *array, unsigned int page, int num, void *data, void *oob)
+{
+	int i, dev, row, ret, rec, unit_size = array->page_size + array->spare_size;
+	unsigned int stripe_len = array->stripe_page * array->data_num;
+	unsigned char *spare = NULL, *buf = NULL;
+	struct exec_job *job;
+
+	if (num < 1 || page >= array->page_num || (unsigned int)num > array->page_num - page)
+		return FLASH_ERROR;
+
+	if (!oob)
+		oob = spare = mem_alloc(num * array->spare_size);
+	job = mem_alloc(num * sizeof(struct exec_job));
+	for (i = 0; i < num; i++) {
+		array_map(array, page + i, &dev, &row);
+		array_job(&job[i], EXEC_READ, row, (char *)data + i * array->page_size,
+				(char *)oob + i * array->spare_size);
+		if (array->dev[dev].fail)
+			job[i].ret = FLASH_ERROR;
+		else
+			exec_submit(array->dev[dev].exec, &job[i]);
+	}
+	array_wait(array);
+
+	/* degraded read, the open stripe has no parity yet */
+	for (i = 0; i < num; i++) {
+		if (job[i].ret >= FLASH_BITFLIP)
+			continue;
+		array_map(array, page + i, &dev, &row);
+		if (array->fill != ARRAY_NO_FILL && (page + i) / stripe_len == array->fill / stripe_len)
+			continue;
+		if (!buf)
+			buf = mem_alloc(unit_size);
+		if (array_recover(array, dev, row, 1, buf, &rec) != FLASH_OK)
+			continue;
+		memcpy(job[i].data, buf, array->page_size);
+		memcpy(job[i].oob, buf + array->page_size, array->spare_size);
+		job[i].ret = FLASH_OK;
+		array->stat.degraded_read++;
+	}
+	ret = array_ret(array, job, num);
+	array->stat.read += num;
+	mem_free(buf);
+	mem_free(job);
+	mem_free(spare);
+	return ret;
+}
+
+
+int nand_array_write(struct nand_array *array, unsigned int page, int num, void *data, void *oob)
+{
+	int i, j, dev, row, ret, job_num = 0, unit_size, full = 0, filled = 0;
+	unsigned int lp, stripe_len = array->stripe_page * array->data_num;
+	unsigned char *spare = NULL, *parity = NULL, *p;
+	struct exec_job *job;
+
+	if (num < 1 || page >= array->page_num || (unsigned int)num > array->page_num - page)
+		return FLASH_ERROR;
+	if (array->mode == ARRAY_PARITY) {
+		/* parity of the open stripe is only in memory until it is filled */
+		if (array->fill != ARRAY_NO_FILL ? page != array->fill : page % stripe_len) {
+			LOG(LOG_ERR, "write of page %u starts no stripe and open stripe is at %u",
+				page, array->fill);
+			return FLASH_ERROR;
+		}
+		full = (page % stripe_len + num) / stripe_len;
+	}
+
+	if (!oob)
+		oob = spare = mem_alloc(num * array->spare_size);
+	job = mem_alloc((num + full * array->stripe_page) * sizeof(struct exec_job));
+	/* parity units of stripes filled by this write, page and spare */
+	unit_size = array->page_size + array->spare_size;
+	if (full)
+		parity = mem_alloc(full * array->stripe_page * unit_size);
+
+	for (i = 0; i < num; i++) {
+		lp = page + i;
+		array_map(array, lp, &dev, &row);
+		array_block_row(array, row);
+		array_job(&job[job_num], EXEC_PROGRAM, row, (char *)data + i * array->page_size,
+				(char *)oob + i * array->spare_size);
+		if (!array->dev[dev].fail)
+			exec_submit(array->dev[dev].exec, &job[job_num]);
+		job_num++;
+		if (array->mode != ARRAY_PARITY)
+			continue;
+
+		/* parity is built up while the stripe is filled */
+		if (!(lp % stripe_len))
+			memset(array->parity, 0, array->stripe_page * unit_size);
+		array_xor(array, array->parity + lp % array->stripe_page * unit_size,
+				(unsigned char *)data + i * array->page_size,
+				(unsigned char *)oob + i * array->spare_size);
+		if ((lp + 1) % stripe_len)
+			continue;
+
+		/* stripe is filled, parity unit follows the data of its rows */
+		p = parity + filled++ * array->stripe_page * unit_size;
+		memcpy(p, array->parity, array->stripe_page * unit_size);
+		dev = array_parity_dev(array, lp / stripe_len);
+		row = row - array->stripe_page + 1;
+		for (j = 0; j < array->stripe_page; j++, p += unit_size) {
+			array_job(&job[job_num], EXEC_PROGRAM, row + j, p, p + array->page_size);
+			if (!array->dev[dev].fail)
+				exec_submit(array->dev[dev].exec, &job[job_num]);
+			job_num++;
+		}
+		array->stat.parity_write += array->stripe_page;
+	}
+	if (array->mode == ARRAY_PARITY)
+		array->fill = (page + num) % stripe_len ? page + num : ARRAY_NO_FILL;
+	array_wait(array);
+	ret = array_ret(array, job, job_num);
+	array->stat.write += num;
+	mem_free(parity);
+	mem_free(job);
+	mem_free(spare);
+	return ret;
+}
+
+
+int nand_array_erase(struct nand_array *array, int block)
+{
+	int i, ret, row, page_num = array->page_num_per_block * array->data_num;
+	struct exec_job *job;
+
+	if (block < 0 || block >= array->block_num)
+		return FLASH_ERROR;
+
+	row = block * array->page_num_per_block;
+	job = mem_alloc(array->dev_num * sizeof(struct exec_job));
+	for (i = 0; i < array->dev_num; i++) {
+		array_job(&job[i], EXEC_ERASE, row, NULL, NULL);
+		if (!array->dev[i].fail)
+			exec_submit(array->dev[i].exec, &job[i]);
+	}
+	array_wait(array);
+	ret = array_ret(array, job, array->dev_num);
+	array->block_row[block] = 0;
+	if (array->fill != ARRAY_NO_FILL && array->fill / page_num == (unsigned int)block)
+		array->fill = ARRAY_NO_FILL;
+	array->stat.erase++;
+	mem_free(job);
+	return ret == FLASH_OK ? FLASH_OK : FLASH_BAD;
+}
+
+
+int nand_array_fail(struct nand_array *array, int dev)
+{
+	if (dev < 0 || dev >= array->dev_num || array->dev[dev].fail)
+		return -1;
+	array->dev[dev].fail = TRUE;
+	return 0;
+}
+
+
+int nand_array_rebuild(struct nand_array *array, int dev, char *name)
+{
+	int i, j, num, row, block, last, error = 0, unit_size = array->page_size + array->spare_size;
+	int rec[ARRAY_REBUILD_ROW];
+	unsigned int stripe_len = array->stripe_page * array->data_num;
+	unsigned long long start, clock;
+	unsigned char *buf;
+	struct exec_job *job;
+	struct exec_job erase;
+
+	if (array->mode != ARRAY_PARITY || dev < 0 || dev >= array->dev_num || !array->dev[dev].fail)
+		return FLASH_ERROR;
+
+	array_dev_close(array, dev);
+	if (array_dev_open(array, dev, name)) {
+		array_dev_close(array, dev);
+		return FLASH_ERROR;
+	}
+
+	start = array_now();
+	clock = __atomic_load_n(&array->dev[dev].nand->clock, __ATOMIC_RELAXED);
+	buf = mem_alloc(ARRAY_REBUILD_ROW * unit_size);
+	job = mem_alloc(ARRAY_REBUILD_ROW * sizeof(struct exec_job));
+	for (block = 0; block < array->block_num; block++) {
+		last = array->block_row[block];
+		if (!last)
+			continue;
+		/* rows of the open stripe have no parity */
+		if (array->fill != ARRAY_NO_FILL &&
+			array->fill / stripe_len * array->stripe_page / array->page_num_per_block ==
+			(unsigned int)block)
+			last = array->fill / stripe_len * array->stripe_page % array->page_num_per_block;
+
+		row = block * array->page_num_per_block;
+		array_job(&erase, EXEC_ERASE, row, NULL, NULL);
+		exec_submit(array->dev[dev].exec, &erase);
+		exec_wait(array->dev[dev].exec);
+		if (erase.ret != FLASH_OK) {
+			LOG(LOG_ERR, "erase block %d of new device fail", block);
+			error++;
+			continue;
+		}
+
+		for (i = 0; i < last; i += num) {
+			num = MIN(ARRAY_REBUILD_ROW, last - i);
+			array_recover(array, dev, row + i, num, buf, rec);
+			for (j = 0; j < num; j++) {
+				array_job(&job[j], EXEC_PROGRAM, row + i + j, buf + j * unit_size,
+						buf + j * unit_size + array->page_size);
+				if (rec[j] == FLASH_OK)
+					exec_submit(array->dev[dev].exec, &job[j]);
+				else
+					error++;
+			}
+			exec_wait(array->dev[dev].exec);
+			for (j = 0; j < num; j++) {
+				if (rec[j] == FLASH_OK && job[j].ret != FLASH_OK)
+					error++;
+			}
+			array->stat.rebuild_page += num;
+		}
+	}
+	array->dev[dev].fail = FALSE;
+	array->stat.rebuild_time += array_now() - start;
+	array->stat.rebuild_clock += __atomic_load_n(&array->dev[dev].nand->clock, __ATOMIC_RELAXED) -
+								clock;
+	mem_free(job);
+	mem_free(buf);
+	return error ? FLASH_ERROR : FLASH_OK;
+}
+
+
+void nand_array_dump(struct nand_array *array, FILE *fp)
+{
+	int i;
+	struct array_stat *stat = &array->stat;
+
+	fprintf(fp, "array: %d devices, %s, stripe %d pages, %u logical pages\n", array->dev_num,
+			array->mode == ARRAY_PARITY ? "parity" : "stripe", array->stripe_page, array->page_num);
+	fprintf(fp, "array read: %llu write: %llu parity write: %llu erase: %llu error: %llu\n",
+			stat->read, stat->write, stat->parity_write, stat->erase, stat->error);
+	if (array->mode == ARRAY_PARITY) {
+		fprintf(fp, "parity xor %s: %llu bytes in %llu us, %.2f GB/s\n", xor_name(),
+				stat->xor_bytes, stat->xor_time / 1000,
+				stat->xor_time ? (double)stat->xor_bytes / stat->xor_time : 0);
+		fprintf(fp, "degraded read: %llu rebuild: %llu pages in %llu us, simulated %llu us\n",
+				stat->degraded_read, stat->rebuild_page, stat->rebuild_time / 1000,
+				stat->rebuild_clock / 1000);
+	}
+	for (i = 0; i < array->dev_num; i++) {
+		if (!array->dev[i].nand) {
+			fprintf(fp, "device %d: none\n", i);
+			continue;
+		}
+		fprintf(fp, "device %d%s clock: %llu ns\n", i, array->dev[i].fail ? " failed" : "",
+				__atomic_load_n(&array->dev[i].nand->clock, __ATOMIC_RELAXED));
+		exec_dump(array->dev[i].exec, fp);
+	}
+}
+
+
+void nand_array_delete(struct nand_array *array)
+{
+	int i;
+
+	for (i = 0; i < array->dev_num; i++)
+		array_dev_close(array, i);
+	mem_free(array->parity);
+	mem_free(array->block_row);
+	mem_free(array->dev);
+	mem_free(array);
+}
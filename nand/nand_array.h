@@ -0,0 +1,179 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NAND_ARRAY_H__
+#define __NAND_ARRAY_H__
+
+#include "nand.h"
+#include "nand_exec.h"
+
+#define ARRAY_DEV_MAX					64
+#define ARRAY_NO_FILL					0xffffffff
+#define ARRAY_REBUILD_ROW				16 // rows rebuilt together
+
+
+enum array_mode {
+	ARRAY_STRIPE, // RAID-0
+	ARRAY_PARITY // RAID-5 or die level RAIN, parity unit rotates over devices
+};
+
+
+struct array_dev {
+	struct nand_base *nand;
+	struct exec *exec; // command queue of device
+	bool fail; // pages are rebuilt from peers, nothing is programmed
+};
+
+
+struct array_stat {
+	unsigned long long read; // logical pages
+	unsigned long long write;
+	unsigned long long erase; // array blocks
+	unsigned long long parity_write; // parity pages
+	unsigned long long degraded_read; // pages rebuilt from peers
+	unsigned long long error;
+	unsigned long long xor_bytes;
+	unsigned long long xor_time; // host time in ns
+	unsigned long long rebuild_page;
+	unsigned long long rebuild_time; // host time in ns
+	unsigned long long rebuild_clock; // simulated time of new device in ns
+};
+
+
+/*
+ * logical pages are split to units of stripe_page pages, units go to
+ * devices in turn; a stripe is one unit of every device at the same rows,
+ * in parity mode one unit of a stripe is XOR of the others, built up as
+ * the stripe is filled and programmed when it is full; an array block is
+ * the same block of all devices
+ */
+struct nand_array {
+	int mode;
+	int dev_num;
+	int data_num; // data units of a stripe
+	int stripe_page; // pages of a unit
+	int worker_num; // of every device
+	int page_size;
+	int spare_size;
+	int page_num_per_block;
+	int block_num; // array blocks
+	unsigned int page_num; // logical pages
+	unsigned int fill; // next page of the open stripe, ARRAY_NO_FILL for none
+	unsigned char *parity; // page and spare of parity unit of the open stripe
+	int *block_row; // rows programmed of array block
+	struct array_dev *dev;
+	struct array_stat stat;
+};
+
+
+/*
+ * nand_array_create - create array of devices of the same geometry
+ * @name: Nand_Info name of every device, different names
+ * @dev_num: device number, 1 ~ ARRAY_DEV_MAX, 3 at least in parity mode
+ * @stripe_page: pages of a unit, power of 2 no more than pages of a block
+ * @mode: enum array_mode
+ * @worker_num: worker threads of every device
+ *
+ * Returns array object if success, otherwise NULL
+ */
+struct nand_array *nand_array_create(char *name[], int dev_num, int stripe_page, int mode,
+									int worker_num);
+
+
+/*
+ * nand_array_read - read logical pages, devices work in parallel; a page
+ *                   of failed device or uncorrectable is rebuilt from
+ *                   the other units of its stripe in parity mode
+ * @array: array object
+ * @page: first logical page
+ * @num: page number
+ * @data: num * page_size buffer
+ * @oob: num * spare_size buffer, NULL for none
+ *
+ * Returns FLASH_OK or FLASH_BITFLIP if success, otherwise error of a page
+ */
+int nand_array_read(struct nand_array *array, unsigned int page, int num, void *data, void *oob);
+
+
+/*
+ * nand_array_write - program logical pages, devices work in parallel;
+ *                    pages of a block are programmed in order, in parity
+ *                    mode a write continues the open stripe, or starts a
+ *                    stripe if none is open
+ * @array: array object
+ * @page: first logical page
+ * @num: page number
+ * @data: num * page_size buffer
+ * @oob: num * spare_size buffer, NULL for none
+ *
+ * Returns FLASH_OK if success, otherwise error of a page
+ */
+int nand_array_write(struct nand_array *array, unsigned int page, int num, void *data, void *oob);
+
+
+/*
+ * nand_array_erase - erase an array block on all devices
+ * @array: array object
+ * @block: array block
+ *
+ * Returns FLASH_OK if success, FLASH_BAD if the block of a device is bad
+ */
+int nand_array_erase(struct nand_array *array, int block);
+
+
+/*
+ * nand_array_fail - take a device out as a dead die, parity mode keeps
+ *                   serving its pages from peers
+ * @array: array object
+ * @dev: device index
+ *
+ * Returns zero if success, otherwise -1
+ */
+int nand_array_fail(struct nand_array *array, int dev);
+
+
+/*
+ * nand_array_rebuild - replace a failed device with a new one and program
+ *                      its units of every programmed row from peers; the
+ *                      open stripe has no parity yet and is not rebuilt
+ * @array: array object
+ * @dev: failed device index
+ * @name: Nand_Info name of new device, same geometry
+ *
+ * Returns FLASH_OK if success, otherwise error of a page
+ */
+int nand_array_rebuild(struct nand_array *array, int dev, char *name);
+
+
+/*
+ * nand_array_dump - print statistics of array and its devices
+ * @array: array object
+ * @fp: output file
+ */
+void nand_array_dump(struct nand_array *array, FILE *fp);
+
+
+/*
+ * nand_array_delete - destory the array and deinit its devices
+ * @array: array object
+ */
+void nand_array_delete(struct nand_array *array);
+
+#endif // __NAND_ARRAY_H__
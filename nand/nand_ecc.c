@@ -0,0 +1,331 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "nand.h"
+#include "nand_ecc.h"
+
+
+static void nand_ecc_lun_free(struct nand_ecc_lun *lun)
+{
+	if (lun->bch)
+		bch_delete(lun->bch);
+	if (lun->ldpc)
+		ldpc_delete(lun->ldpc);
+	mem_free(lun->buf);
+	mem_free(lun->weak);
+	mem_free(lun->cw_weak);
+	pthread_mutex_destroy(&lun->lock);
+}
+
+
+static void nand_ecc_free(struct nand_ecc *ecc)
+{
+	int i;
+
+	if (!ecc)
+		return;
+	for (i = 0; i < ecc->lun_num; i++)
+		nand_ecc_lun_free(&ecc->lun[i]);
+	mem_free(ecc->lun);
+	mem_free(ecc);
+}
+
+
+void nand_ecc_disable(struct nand_base *nand)
+{
+	nand_ecc_free(nand->ecc);
+	nand->ecc = NULL;
+}
+
+
+/* Returns parity bytes of a codeword of len bytes, negative if no such code */
+static int nand_ecc_create(struct nand_ecc_lun *lun, int type, int len, int strength)
+{
+	if (type == NAND_ECC_BCH) {
+		lun->bch = bch_create(len, strength);
+		return lun->bch ? lun->bch->ecc_bytes : -1;
+	}
+	lun->ldpc = ldpc_create(len, strength, NAND_ECC_LDPC_ITER);
+	return lun->ldpc ? lun->ldpc->parity_bytes : -1;
+}
+
+
+int nand_ecc_enable(struct nand_base *nand, int type, int sector_size, int strength)
+{
+	struct nand_ecc *ecc;
+	struct nand_ecc_lun *lun;
+	int ecc_bytes, free_size, size = nand->page_size + nand->spare_size;
+
+	nand_ecc_disable(nand);
+	if (sector_size <= 0 || nand->page_size % sector_size) {
+		LOG(LOG_WARN, "page %d is not multiple of sector %d", nand->page_size, sector_size);
+		return -1;
+	}
+
+	/* size the code by a sector first, then by the last codeword */
+	ecc = mem_alloc(sizeof(struct nand_ecc));
+	ecc->lun_num = 1;
+	ecc->lun = mem_alloc(sizeof(struct nand_ecc_lun));
+	pthread_mutex_init(&ecc->lun[0].lock, NULL);
+	ecc_bytes = nand_ecc_create(&ecc->lun[0], type, sector_size, strength);
+	free_size = nand->spare_size - nand->page_size / sector_size * ecc_bytes;
+	nand_ecc_free(ecc);
+	if (ecc_bytes < 0 || free_size < 0) {
+		LOG(LOG_WARN, "spare %d can't hold parity of %d sectors", nand->spare_size,
+			nand->page_size / sector_size);
+		return -1;
+	}
+
+	ecc = mem_alloc(sizeof(struct nand_ecc));
+	ecc->type = type;
+	ecc->sector_size = sector_size;
+	ecc->sector_num = nand->page_size / sector_size;
+	ecc->free_size = free_size;
+	ecc->ecc_bytes = ecc_bytes;
+	ecc->lun = mem_alloc(nand->lun_num * sizeof(struct nand_ecc_lun));
+	for (ecc->lun_num = 0; ecc->lun_num < nand->lun_num; ecc->lun_num++) {
+		lun = &ecc->lun[ecc->lun_num];
+		pthread_mutex_init(&lun->lock, NULL);
+		lun->seed = nand->seed + ecc->lun_num;
+		if (nand_ecc_create(lun, type, sector_size + free_size, strength) != ecc_bytes) {
+			/* larger field for the last codeword, BCH parity grows */
+			LOG(LOG_WARN, "spare %d can't hold parity of %d sectors", nand->spare_size,
+				ecc->sector_num);
+			ecc->lun_num++;
+			nand_ecc_free(ecc);
+			return -1;
+		}
+		lun->buf = mem_alloc(sector_size + free_size);
+		lun->weak = mem_alloc(size);
+		lun->cw_weak = mem_alloc(sector_size + free_size + ecc_bytes);
+	}
+	/* erased codeword has no valid parity, a few zero bits are tolerated */
+	ecc->erased_max = ecc->lun[0].bch ? ecc->lun[0].bch->t : ecc->ecc_bytes;
+	nand->ecc = ecc;
+	return 0;
+}
+
+
+static inline unsigned char *nand_ecc_parity(struct nand_base *nand, unsigned char *buf, int i)
+{
+	struct nand_ecc *ecc = nand->ecc;
+
+	return buf + nand->page_size + ecc->free_size + i * ecc->ecc_bytes;
+}
+
+
+/*
+ * data of codeword i, page data and free spare are gathered for the
+ * last codeword
+ *
+ * Returns data of codeword, its length in len
+ */
+static unsigned char *nand_ecc_data(struct nand_base *nand, struct nand_ecc_lun *lun,
+					unsigned char *buf, int i, int *len)
+{
+	struct nand_ecc *ecc = nand->ecc;
+
+	if (i < ecc->sector_num - 1) {
+		*len = ecc->sector_size;
+		return buf + i * ecc->sector_size;
+	}
+	memcpy(lun->buf, buf + i * ecc->sector_size, ecc->sector_size);
+	memcpy(lun->buf + ecc->sector_size, buf + nand->page_size, ecc->free_size);
+	*len = ecc->sector_size + ecc->free_size;
+	return lun->buf;
+}
+
+
+void nand_ecc_encode(struct nand_base *nand, int row, unsigned char *buf)
+{
+	int i, len;
+	unsigned char *data;
+	struct nand_ecc *ecc = nand->ecc;
+	struct nand_ecc_lun *lun = &ecc->lun[nand_row_lun(nand, row)];
+
+	pthread_mutex_lock(&lun->lock);
+	for (i = 0; i < ecc->sector_num; i++) {
+		data = nand_ecc_data(nand, lun, buf, i, &len);
+		if (lun->bch)
+			bch_encode(lun->bch, data, len, nand_ecc_parity(nand, buf, i));
+		else
+			ldpc_encode(lun->ldpc, data, len, nand_ecc_parity(nand, buf, i));
+	}
+	pthread_mutex_unlock(&lun->lock);
+}
+
+
+/* Returns corrected bits of a codeword, negative if uncorrectable */
+static int nand_ecc_decode(struct nand_base *nand, struct nand_ecc_lun *lun, unsigned char *data,
+					int len, unsigned char *parity, unsigned char *weak)
+{
+	int i, ret, iter, zero = 0;
+	unsigned char x;
+	struct nand_ecc *ecc = nand->ecc;
+
+	if (lun->bch) {
+		ret = bch_decode(lun->bch, data, len, parity);
+	} else {
+		ret = ldpc_decode(lun->ldpc, data, len, parity, weak, &iter);
+		__atomic_add_fetch(&ecc->iter_num, iter, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&ecc->decode_time, iter * NAND_ECC_ITER_TIME, __ATOMIC_RELAXED);
+		nand_clock_add(nand, iter * NAND_ECC_ITER_TIME);
+	}
+	if (ret >= 0)
+		return ret;
+
+	for (i = 0; i < len + ecc->ecc_bytes && zero <= ecc->erased_max; i++) {
+		for (x = ~(i < len ? data[i] : parity[i - len]); x; x &= x - 1)
+			zero++;
+	}
+	if (zero > ecc->erased_max)
+		return -1;
+	memset(data, 0xFF, len);
+	memset(parity, 0xFF, ecc->ecc_bytes);
+	return zero;
+}
+
+
+/* flip err_bit random bits of a page sensed with err_bit errors */
+static void nand_ecc_flip(struct nand_base *nand, struct nand_ecc_lun *lun, unsigned char *buf,
+					int err_bit)
+{
+	int i, bit, size = nand->page_size + nand->spare_size;
+
+	for (i = 0; i < err_bit; i++) {
+		bit = rand_r(&lun->seed) % (size << 3);
+		buf[bit >> 3] ^= 0x80 >> (bit & 7);
+	}
+}
+
+
+/*
+ * soft sensing re-reads the page at read retry levels around the current
+ * one, 1 below, 1 above, 2 below and so on, or at the current level when
+ * the device has no such level; bits where a sensing disagrees with the
+ * hard read are near the read threshold and marked weak
+ * @row: row of the page
+ * @buf: page of the hard read
+ */
+static void nand_ecc_soft_read(struct nand_base *nand, int row, unsigned char *buf)
+{
+	int i, k, ret, lun = nand_row_lun(nand, row), size = nand->page_size + nand->spare_size;
+	unsigned char level[NAND_FEATURE_PARAM_NUM] = {0}, shift[NAND_FEATURE_PARAM_NUM];
+	unsigned char *sense;
+	struct nand_ops *ops;
+	struct nand_ecc *ecc = nand->ecc;
+	struct nand_ecc_lun *l = &ecc->lun[lun];
+
+	__atomic_add_fetch(&ecc->soft_num, 1, __ATOMIC_RELAXED);
+	memset(l->weak, 0, size);
+	nand_get_feature(nand, lun, NAND_FEATURE_READ_RETRY, level);
+	ops = nand_ops_alloc(2, size);
+	for (i = 0; i < NAND_ECC_SOFT_READ; i++) {
+		memcpy(shift, level, NAND_FEATURE_PARAM_NUM);
+		k = (i & 1) ? level[0] + i / 2 + 1 : level[0] - i / 2 - 1;
+		shift[0] = k;
+		if (k < 0 || nand_set_feature(nand, lun, NAND_FEATURE_READ_RETRY, shift))
+			shift[0] = level[0];
+		ops->cmdq[0].row = -1;
+		ops->cmdq[0].cmd = CMD_READ_1ST;
+		ops->cmdq[1].row = row;
+		ops->cmdq[1].cmd = CMD_READ_2ND;
+		ret = nand_cmd(nand, ops);
+		if (shift[0] != level[0])
+			nand_set_feature(nand, lun, NAND_FEATURE_READ_RETRY, level);
+		if (ret < 0)
+			continue;
+		sense = ops->buffer;
+		nand_ecc_flip(nand, l, sense, ret);
+		for (k = 0; k < size; k++)
+			l->weak[k] |= sense[k] ^ buf[k];
+	}
+	nand_ops_free(ops);
+}
+
+
+int nand_ecc_correct(struct nand_base *nand, int row, unsigned char *buf, int err_bit)
+{
+	int i, ret, len, corrected = 0;
+	unsigned char *data, *parity;
+	bool soft = FALSE;
+	struct nand_ecc *ecc = nand->ecc;
+	struct nand_ecc_lun *lun = &ecc->lun[nand_row_lun(nand, row)];
+
+	__atomic_add_fetch(&ecc->read_num, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ecc->bitflip_num, err_bit, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&lun->lock);
+	nand_ecc_flip(nand, lun, buf, err_bit);
+
+	for (i = 0; i < ecc->sector_num; i++) {
+		data = nand_ecc_data(nand, lun, buf, i, &len);
+		parity = nand_ecc_parity(nand, buf, i);
+		ret = nand_ecc_decode(nand, lun, data, len, parity, NULL);
+		if (ret < 0 && ecc->type == NAND_ECC_LDPC_SOFT) {
+			/* hard decision fails, retry the codeword with soft information */
+			if (!soft)
+				nand_ecc_soft_read(nand, row, buf);
+			soft = TRUE;
+			memcpy(lun->cw_weak, lun->weak + i * ecc->sector_size, ecc->sector_size);
+			memcpy(lun->cw_weak + ecc->sector_size, lun->weak + nand->page_size, len - ecc->sector_size);
+			memcpy(lun->cw_weak + len, lun->weak + (parity - buf), ecc->ecc_bytes);
+			ret = nand_ecc_decode(nand, lun, data, len, parity, lun->cw_weak);
+		}
+		if (ret < 0) {
+			__atomic_add_fetch(&ecc->fail_num, 1, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&lun->lock);
+			return ret;
+		}
+		if (ret && data == lun->buf) {
+			memcpy(buf + i * ecc->sector_size, data, ecc->sector_size);
+			memcpy(buf + nand->page_size, data + ecc->sector_size, ecc->free_size);
+		}
+		corrected += ret;
+	}
+	pthread_mutex_unlock(&lun->lock);
+	__atomic_add_fetch(&ecc->corrected_num, corrected, __ATOMIC_RELAXED);
+	return corrected;
+}
+
+
+void nand_ecc_dump(struct nand_base *nand, FILE *fp)
+{
+	struct nand_ecc *ecc = nand->ecc;
+	struct bch *bch;
+	struct ldpc *ldpc;
+
+	if (!ecc)
+		return;
+	bch = ecc->lun[0].bch;
+	ldpc = ecc->lun[0].ldpc;
+	if (bch)
+		fprintf(fp, "ecc: BCH m %d t %d", bch->m, bch->t);
+	else
+		fprintf(fp, "ecc: LDPC%s z %d base %dx%d", ecc->type == NAND_ECC_LDPC_SOFT ? " soft" : "",
+				ldpc->z, ldpc->mb, ldpc->kb + ldpc->mb);
+	fprintf(fp, ", %d x %d bytes sector, %d bytes parity, %d bytes free spare, %d LUN codecs\n",
+				ecc->sector_num, ecc->sector_size, ecc->ecc_bytes, ecc->free_size, ecc->lun_num);
+	fprintf(fp, "ecc read: %llu bitflip: %llu corrected: %llu uncorrectable: %llu\n",
+				ecc->read_num, ecc->bitflip_num, ecc->corrected_num, ecc->fail_num);
+	if (ldpc)
+		fprintf(fp, "ecc iteration: %llu soft read: %llu decode time: %llu us\n",
+				ecc->iter_num, ecc->soft_num, ecc->decode_time / 1000);
+}
@@ -0,0 +1,116 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NAND_ECC_H__
+#define __NAND_ECC_H__
+
+#include "bch.h"
+#include "ldpc.h"
+#include "nand.h"
+
+#define NAND_ECC_LDPC_ITER				20
+#define NAND_ECC_ITER_TIME				250 // ns of a LDPC iteration over a codeword
+#define NAND_ECC_SOFT_READ				2 // extra sensings at shifted read retry levels
+
+enum nand_ecc_type {
+	NAND_ECC_BCH,
+	NAND_ECC_LDPC, // hard decision
+	NAND_ECC_LDPC_SOFT, // soft decision after hard decision fails
+};
+
+/*
+ * page is split to sectors, each sector is a BCH or LDPC codeword with its
+ * parity packed at the tail of spare area in sector order:
+ *
+ * | sector 0 | ... | sector n-1 | free spare | parity 0 | ... | parity n-1 |
+ *
+ * the free spare head, where FTL keeps its OOB, is protected by the
+ * codeword of the last sector
+ */
+/* codec and buffers of a LUN, pages of different LUNs are corrected in parallel */
+struct nand_ecc_lun {
+	pthread_mutex_t lock; // threads on the same LUN
+	unsigned int seed; // rand_r state of bitflip injection
+	struct bch *bch;
+	struct ldpc *ldpc;
+	unsigned char *buf; // last codeword: last sector and free spare
+	unsigned char *weak; // bitmap of weak bits over page and spare
+	unsigned char *cw_weak; // weak bits of a codeword
+};
+
+/* statistics are updated atomically by LUNs */
+struct nand_ecc {
+	int type;
+	int sector_size;
+	int sector_num;
+	int ecc_bytes; // parity bytes of a sector
+	int free_size; // unprotected by parity of its own, spare head
+	int erased_max; // zero bits of an erased codeword
+	int lun_num;
+	struct nand_ecc_lun *lun;
+	unsigned long long read_num;
+	unsigned long long bitflip_num; // injected
+	unsigned long long corrected_num; // corrected bits
+	unsigned long long fail_num; // uncorrectable sectors
+	unsigned long long iter_num; // LDPC iterations
+	unsigned long long soft_num; // pages read with soft decision
+	unsigned long long decode_time; // ns
+};
+
+
+/*
+ * nand_ecc_enable - compute parity on program and correct on read, in
+ *                   place of the ecc_required threshold; LDPC decoding
+ *                   advances nand clock by its iterations, and soft
+ *                   decision re-reads the page at shifted read retry levels
+ * @nand: created nand_base object
+ * @type: enum nand_ecc_type
+ * @sector_size: data bytes of a codeword, page size must be its multiple
+ * @strength: correctable bits of a BCH sector, or parity bytes of a LDPC sector
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int nand_ecc_enable(struct nand_base *nand, int type, int sector_size, int strength);
+void nand_ecc_disable(struct nand_base *nand);
+
+
+/*
+ * nand_ecc_encode - fill parity of a page
+ * @nand: nand_base object with ECC enabled
+ * @row: row the page is programmed to, picks the codec of its LUN
+ * @buf: page data followed by spare area
+ */
+void nand_ecc_encode(struct nand_base *nand, int row, unsigned char *buf);
+
+
+/*
+ * nand_ecc_correct - flip random bits of a page, then correct it
+ * @nand: nand_base object with ECC enabled
+ * @row: row the page is read from, soft decision senses it again
+ * @buf: page data followed by spare area
+ * @err_bit: bits to flip over page and spare
+ *
+ * Returns corrected bit number, negative if any sector is uncorrectable
+ */
+int nand_ecc_correct(struct nand_base *nand, int row, unsigned char *buf, int err_bit);
+
+
+void nand_ecc_dump(struct nand_base *nand, FILE *fp);
+#endif // __NAND_ECC_H__
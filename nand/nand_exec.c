@@ -0,0 +1,394 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE // for pthread_setaffinity_np
+#include <sched.h>
+#include "common.h"
+#include "nand.h"
+#include "nand_exec.h"
+
+
+/* worker of current thread, jobs of no LUN submitted by a worker stay local */
+static __thread struct exec_worker *exec_self;
+
+
+/* one more LUN or job to take, wake an idle worker */
+static void exec_ready_add(struct exec *exec)
+{
+	__atomic_add_fetch(&exec->ready, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&exec->idle, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&exec->lock);
+		pthread_cond_signal(&exec->ready_cond);
+		pthread_mutex_unlock(&exec->lock);
+	}
+}
+
+
+static void exec_lun_push(struct exec *exec, struct exec_worker *w, struct exec_lun *lun)
+{
+	pthread_mutex_lock(&w->lock);
+	lun->next = NULL;
+	if (w->run_tail)
+		w->run_tail->next = lun;
+	else
+		w->run_head = lun;
+	w->run_tail = lun;
+	w->run_num++;
+	pthread_mutex_unlock(&w->lock);
+	exec_ready_add(exec);
+}
+
+
+static void exec_job_push(struct exec *exec, struct exec_worker *w, struct exec_job *job)
+{
+	pthread_mutex_lock(&w->lock);
+	job->next = NULL;
+	if (w->job_tail)
+		w->job_tail->next = job;
+	else
+		w->job_head = job;
+	w->job_tail = job;
+	w->job_num++;
+	pthread_mutex_unlock(&w->lock);
+	exec_ready_add(exec);
+}
+
+
+/* take a LUN or a job of no LUN from own lists, job_first to alternate them */
+static bool exec_pop(struct exec *exec, struct exec_worker *w, bool job_first,
+					struct exec_lun **lun, struct exec_job **job)
+{
+	*lun = NULL;
+	*job = NULL;
+	pthread_mutex_lock(&w->lock);
+	if (w->job_head && (job_first || !w->run_head)) {
+		*job = w->job_head;
+		w->job_head = (*job)->next;
+		if (!w->job_head)
+			w->job_tail = NULL;
+		w->job_num--;
+	} else if (w->run_head) {
+		*lun = w->run_head;
+		w->run_head = (*lun)->next;
+		if (!w->run_head)
+			w->run_tail = NULL;
+		w->run_num--;
+	}
+	pthread_mutex_unlock(&w->lock);
+	if (!*lun && !*job)
+		return FALSE;
+	__atomic_sub_fetch(&exec->ready, 1, __ATOMIC_SEQ_CST);
+	return TRUE;
+}
+
+
+/*
+ * move half of the LUNs ready on the first busy worker to own run list, or
+ * a batch of its jobs of no LUN; a LUN keeps its order as it is never on
+ * two lists
+ */
+static bool exec_steal(struct exec *exec, struct exec_worker *w)
+{
+	int i, n, lun_num = 0, job_num = 0, self = w - exec->worker;
+	struct exec_worker *v;
+	struct exec_lun *lun_head = NULL, *lun_tail = NULL;
+	struct exec_job *job_head = NULL, *job_tail = NULL;
+
+	for (i = 1; i < exec->worker_num && !lun_head && !job_head; i++) {
+		v = &exec->worker[(self + i) % exec->worker_num];
+		pthread_mutex_lock(&v->lock);
+		if (v->run_head) {
+			lun_num = n = (v->run_num + 1) / 2;
+			v->run_num -= n;
+			lun_head = lun_tail = v->run_head;
+			while (--n)
+				lun_tail = lun_tail->next;
+			v->run_head = lun_tail->next;
+			if (!v->run_head)
+				v->run_tail = NULL;
+			lun_tail->next = NULL;
+		} else if (v->job_head) {
+			job_num = n = MIN((v->job_num + 1) / 2, EXEC_STEAL_BATCH);
+			v->job_num -= n;
+			job_head = job_tail = v->job_head;
+			while (--n)
+				job_tail = job_tail->next;
+			v->job_head = job_tail->next;
+			if (!v->job_head)
+				v->job_tail = NULL;
+			job_tail->next = NULL;
+		}
+		pthread_mutex_unlock(&v->lock);
+	}
+	if (!lun_head && !job_head)
+		return FALSE;
+
+	pthread_mutex_lock(&w->lock);
+	if (lun_head) {
+		if (w->run_tail)
+			w->run_tail->next = lun_head;
+		else
+			w->run_head = lun_head;
+		w->run_tail = lun_tail;
+		w->run_num += lun_num;
+		w->steal_lun += lun_num;
+	} else {
+		if (w->job_tail)
+			w->job_tail->next = job_head;
+		else
+			w->job_head = job_head;
+		w->job_tail = job_tail;
+		w->job_num += job_num;
+		w->steal_job += job_num;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return TRUE;
+}
+
+
+static void exec_job_run(struct exec *exec, struct exec_worker *w, struct exec_job *job)
+{
+	switch (job->op) {
+	case EXEC_READ:
+		job->ret = nand_read_page(exec->nand, job->row, job->col, job->data, job->oob);
+		break;
+	case EXEC_PROGRAM:
+		job->ret = nand_write_page(exec->nand, job->row, job->col, job->data, job->oob);
+		break;
+	case EXEC_ERASE:
+		job->ret = nand_erase_block(exec->nand, job->row);
+		break;
+	default:
+		job->ret = 0;
+		break;
+	}
+	w->run++;
+	/* job may be freed or submitted again by callback */
+	if (job->cb)
+		job->cb(exec, job);
+	if (!__atomic_sub_fetch(&exec->pending, 1, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&exec->lock);
+		pthread_cond_broadcast(&exec->done_cond);
+		pthread_mutex_unlock(&exec->lock);
+	}
+}
+
+
+/* run a batch of jobs of a LUN, a LUN with jobs left goes back to the run list */
+static void exec_lun_run(struct exec *exec, struct exec_worker *w, struct exec_lun *lun)
+{
+	int i;
+	struct exec_job *job;
+
+	for (i = 0; i < EXEC_LUN_BATCH; i++) {
+		pthread_mutex_lock(&lun->lock);
+		job = lun->head;
+		if (!job) {
+			lun->queued = FALSE;
+			pthread_mutex_unlock(&lun->lock);
+			return;
+		}
+		lun->head = job->next;
+		if (!lun->head)
+			lun->tail = NULL;
+		pthread_mutex_unlock(&lun->lock);
+		exec_job_run(exec, w, job);
+	}
+
+	pthread_mutex_lock(&lun->lock);
+	if (!lun->head) {
+		lun->queued = FALSE;
+		pthread_mutex_unlock(&lun->lock);
+		return;
+	}
+	pthread_mutex_unlock(&lun->lock);
+	exec_lun_push(exec, w, lun);
+}
+
+
+static void *exec_worker_thread(void *arg)
+{
+	struct exec_worker *w = arg;
+	struct exec *exec = w->exec;
+	struct exec_lun *lun;
+	struct exec_job *job;
+	bool job_first = FALSE;
+
+	exec_self = w;
+	while (1) {
+		job_first = !job_first;
+		if (exec_pop(exec, w, job_first, &lun, &job) ||
+			(exec_steal(exec, w) && exec_pop(exec, w, job_first, &lun, &job))) {
+			if (lun)
+				exec_lun_run(exec, w, lun);
+			else
+				exec_job_run(exec, w, job);
+			continue;
+		}
+
+		pthread_mutex_lock(&exec->lock);
+		__atomic_add_fetch(&exec->idle, 1, __ATOMIC_SEQ_CST);
+		while (!exec->stop && !__atomic_load_n(&exec->ready, __ATOMIC_SEQ_CST))
+			pthread_cond_wait(&exec->ready_cond, &exec->lock);
+		__atomic_sub_fetch(&exec->idle, 1, __ATOMIC_SEQ_CST);
+		if (exec->stop) {
+			pthread_mutex_unlock(&exec->lock);
+			break;
+		}
+		pthread_mutex_unlock(&exec->lock);
+	}
+	return NULL;
+}
+
+
+struct exec *exec_create(struct nand_base *nand, int worker_num, const int *cpu)
+{
+	int i;
+	cpu_set_t set;
+	struct exec *exec;
+	struct exec_worker *w;
+
+	if (!nand || worker_num < 1 || worker_num > EXEC_WORKER_MAX)
+		return NULL;
+
+	exec = mem_alloc(sizeof(struct exec));
+	exec->nand = nand;
+	exec->lun_num = nand->lun_num;
+	exec->lun = mem_alloc(exec->lun_num * sizeof(struct exec_lun));
+	for (i = 0; i < exec->lun_num; i++)
+		pthread_mutex_init(&exec->lun[i].lock, NULL);
+	exec->worker = aligned_alloc(64, worker_num * sizeof(struct exec_worker));
+	ASSERT(exec->worker);
+	memset(exec->worker, 0, worker_num * sizeof(struct exec_worker));
+	pthread_mutex_init(&exec->lock, NULL);
+	pthread_cond_init(&exec->ready_cond, NULL);
+	pthread_cond_init(&exec->done_cond, NULL);
+
+	exec->worker_num = worker_num;
+	for (i = 0; i < worker_num; i++) {
+		w = &exec->worker[i];
+		pthread_mutex_init(&w->lock, NULL);
+		w->exec = exec;
+		w->cpu = cpu ? cpu[i] : -1;
+	}
+	/* started workers steal from all, lists of others are empty */
+	for (exec->thread_num = 0; exec->thread_num < worker_num; exec->thread_num++) {
+		w = &exec->worker[exec->thread_num];
+		if (pthread_create(&w->thread, NULL, exec_worker_thread, w)) {
+			LOG(LOG_ERR, "create worker %d fail", exec->thread_num);
+			exec_delete(exec);
+			return NULL;
+		}
+		if (w->cpu < 0)
+			continue;
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		if (pthread_setaffinity_np(w->thread, sizeof(set), &set))
+			LOG(LOG_WARN, "bind worker %d to cpu %d fail", exec->thread_num, w->cpu);
+	}
+	return exec;
+}
+
+
+void exec_submit(struct exec *exec, struct exec_job *job)
+{
+	int lun;
+	bool push = FALSE;
+	struct exec_worker *w;
+	struct exec_lun *l;
+
+	__atomic_add_fetch(&exec->pending, 1, __ATOMIC_SEQ_CST);
+	job->next = NULL;
+	lun = job->op == EXEC_CALL ? job->lun : nand_row_lun(exec->nand, job->row);
+	if (lun == EXEC_LUN_ANY) {
+		w = exec_self;
+		if (!w || w->exec != exec)
+			w = &exec->worker[__atomic_fetch_add(&exec->next, 1, __ATOMIC_RELAXED) %
+							exec->worker_num];
+		exec_job_push(exec, w, job);
+		return;
+	}
+
+	ASSERT(lun >= 0 && lun < exec->lun_num);
+	l = &exec->lun[lun];
+	pthread_mutex_lock(&l->lock);
+	if (l->tail)
+		l->tail->next = job;
+	else
+		l->head = job;
+	l->tail = job;
+	if (!l->queued) {
+		l->queued = TRUE;
+		push = TRUE;
+	}
+	pthread_mutex_unlock(&l->lock);
+	/* an idle LUN goes to its home worker, others steal it when busy */
+	if (push)
+		exec_lun_push(exec, &exec->worker[lun % exec->worker_num], l);
+}
+
+
+void exec_wait(struct exec *exec)
+{
+	pthread_mutex_lock(&exec->lock);
+	while (__atomic_load_n(&exec->pending, __ATOMIC_SEQ_CST))
+		pthread_cond_wait(&exec->done_cond, &exec->lock);
+	pthread_mutex_unlock(&exec->lock);
+}
+
+
+void exec_dump(struct exec *exec, FILE *fp)
+{
+	int i;
+	struct exec_worker *w;
+
+	fprintf(fp, "exec: %d workers, %d LUNs\n", exec->worker_num, exec->lun_num);
+	for (i = 0; i < exec->worker_num; i++) {
+		w = &exec->worker[i];
+		fprintf(fp, "worker %d cpu %d: run %llu steal lun %llu job %llu\n", i, w->cpu,
+				w->run, w->steal_lun, w->steal_job);
+	}
+}
+
+
+void exec_delete(struct exec *exec)
+{
+	int i;
+
+	exec_wait(exec);
+	pthread_mutex_lock(&exec->lock);
+	exec->stop = TRUE;
+	pthread_cond_broadcast(&exec->ready_cond);
+	pthread_mutex_unlock(&exec->lock);
+	for (i = 0; i < exec->thread_num; i++)
+		pthread_join(exec->worker[i].thread, NULL);
+
+	for (i = 0; i < exec->worker_num; i++)
+		pthread_mutex_destroy(&exec->worker[i].lock);
+
+	for (i = 0; i < exec->lun_num; i++)
+		pthread_mutex_destroy(&exec->lun[i].lock);
+	pthread_mutex_destroy(&exec->lock);
+	pthread_cond_destroy(&exec->ready_cond);
+	pthread_cond_destroy(&exec->done_cond);
+	free(exec->worker);
+	mem_free(exec->lun);
+	mem_free(exec);
+}
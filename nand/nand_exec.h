@@ -0,0 +1,151 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NAND_EXEC_H__
+#define __NAND_EXEC_H__
+
+#include <pthread.h>
+#include "nand.h"
+
+#define EXEC_WORKER_MAX					64
+#define EXEC_LUN_ANY					-1 // job of no LUN order, e.g. compression
+#define EXEC_LUN_BATCH					16 // jobs of a LUN run before other LUNs get a turn
+#define EXEC_STEAL_BATCH				8 // jobs of no LUN taken by one steal
+
+
+enum exec_op {
+	EXEC_READ, // nand_read_page
+	EXEC_PROGRAM, // nand_write_page
+	EXEC_ERASE, // nand_erase_block
+	EXEC_CALL // callback only
+};
+
+
+struct exec;
+struct exec_job;
+
+typedef void (*EXEC_CALLBACK)(struct exec *exec, struct exec_job *job);
+
+/* owned by submitter until the callback, jobs of a LUN complete in order */
+struct exec_job {
+	struct exec_job *next;
+	int op;
+	int lun; // EXEC_CALL only, EXEC_LUN_ANY for none; nand ops use LUN of row
+	int row;
+	int col;
+	void *data;
+	void *oob;
+	int ret; // return of nand op
+	EXEC_CALLBACK cb; // after op, NULL for none
+	void *userdata;
+};
+
+
+/* ordered queue of a LUN, on one run list or running on one worker at most */
+struct exec_lun {
+	pthread_mutex_t lock;
+	struct exec_job *head;
+	struct exec_job *tail;
+	struct exec_lun *next; // run list
+	bool queued; // on a run list or running
+};
+
+
+struct exec_worker {
+	pthread_mutex_t lock; // run list and job list
+	struct exec_lun *run_head; // LUNs of jobs
+	struct exec_lun *run_tail;
+	int run_num;
+	struct exec_job *job_head; // jobs of no LUN
+	struct exec_job *job_tail;
+	int job_num;
+	struct exec *exec;
+	pthread_t thread;
+	int cpu; // -1 for any
+	unsigned long long run; // jobs done
+	unsigned long long steal_lun; // LUN queues stolen from others
+	unsigned long long steal_job;
+} __attribute__((aligned(64)));
+
+
+/*
+ * LUNs are spread over workers by index, a worker runs its own LUNs in
+ * turn, an idle worker steals LUN queues or jobs of no LUN from others
+ */
+struct exec {
+	struct nand_base *nand;
+	int worker_num;
+	int thread_num; // workers started
+	int lun_num;
+	struct exec_lun *lun;
+	struct exec_worker *worker;
+	unsigned int next; // worker of next job of no LUN from outside
+	int ready; // LUNs on run lists and jobs of no LUN
+	int idle; // workers waiting for ready
+	bool stop;
+	unsigned long long pending; // submitted and not completed
+	pthread_mutex_t lock;
+	pthread_cond_t ready_cond;
+	pthread_cond_t done_cond;
+};
+
+
+/*
+ * exec_create - create work stealing executor of a nand
+ * @nand: created nand_base object, commands of different LUNs run in parallel
+ * @worker_num: worker threads, 1 ~ EXEC_WORKER_MAX
+ * @cpu: CPU of every worker, NULL or -1 for no affinity
+ *
+ * Returns executor object if success, otherwise NULL
+ */
+struct exec *exec_create(struct nand_base *nand, int worker_num, const int *cpu);
+
+
+/*
+ * exec_submit - queue a job, jobs of the same LUN run in submission order,
+ *               may be called from any thread and from callbacks
+ * @exec: executor object
+ * @job: job to run, not touched by submitter until its callback
+ */
+void exec_submit(struct exec *exec, struct exec_job *job);
+
+
+/*
+ * exec_wait - wait until all submitted jobs are completed
+ * @exec: executor object, not called from callbacks
+ */
+void exec_wait(struct exec *exec);
+
+
+/*
+ * exec_dump - print jobs and steals of every worker
+ * @exec: executor object
+ * @fp: output file
+ */
+void exec_dump(struct exec *exec, FILE *fp);
+
+
+/*
+ * exec_delete - wait for submitted jobs and destory the executor
+ * @exec: executor object
+ */
+void exec_delete(struct exec *exec);
+
+#endif // __NAND_EXEC_H__
@@ -0,0 +1,197 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sched.h>
+#include "common.h"
+#include "nand.h"
+#include "nand_queue.h"
+
+
+static void queue_cmd_run(struct nand_queue *queue, struct queue_cmd *cmd)
+{
+	switch (cmd->op) {
+	case QUEUE_READ:
+		cmd->ret = nand_read_page(queue->nand, cmd->row, cmd->col, cmd->data, cmd->oob);
+		break;
+	case QUEUE_PROGRAM:
+		cmd->ret = nand_write_page(queue->nand, cmd->row, cmd->col, cmd->data, cmd->oob);
+		break;
+	case QUEUE_ERASE:
+		cmd->ret = nand_erase_block(queue->nand, cmd->row);
+		break;
+	default:
+		cmd->ret = 0;
+		break;
+	}
+	if (cmd->cb)
+		cmd->cb(queue, cmd);
+}
+
+
+/* run committed commands in order, slots go back to producers after a pass */
+static int queue_drain(struct nand_queue *queue)
+{
+	int i, n;
+	struct ring *ring = queue->ring;
+
+	n = ring_peek(ring, QUEUE_DRAIN_MAX);
+	if (!n)
+		return 0;
+	for (i = 0; i < n; i++)
+		queue_cmd_run(queue, ring_entry(ring, ring->head + i));
+	ring_release(ring, n);
+	queue->drain++;
+	queue->max_drain = MAX(queue->max_drain, n);
+
+	__atomic_add_fetch(&queue->done, n, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&queue->waiter, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&queue->lock);
+		pthread_cond_broadcast(&queue->done_cond);
+		pthread_mutex_unlock(&queue->lock);
+	}
+	return n;
+}
+
+
+/*
+ * an empty ring is polled a while before sleeping; sleep is published
+ * before the ring is checked again, a producer commits before it reads
+ * sleep, so one of them sees the other
+ */
+static void *queue_thread(void *arg)
+{
+	struct nand_queue *queue = arg;
+	int spin = 0;
+
+	while (1) {
+		if (queue_drain(queue)) {
+			spin = 0;
+			continue;
+		}
+		if (++spin < QUEUE_SPIN) {
+			sched_yield();
+			continue;
+		}
+		spin = 0;
+
+		__atomic_store_n(&queue->sleep, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (ring_peek(queue->ring, 1)) {
+			__atomic_store_n(&queue->sleep, 0, __ATOMIC_RELAXED);
+			continue;
+		}
+		pthread_mutex_lock(&queue->lock);
+		while (__atomic_load_n(&queue->sleep, __ATOMIC_RELAXED) && !queue->stop)
+			pthread_cond_wait(&queue->bell_cond, &queue->lock);
+		if (queue->stop) {
+			pthread_mutex_unlock(&queue->lock);
+			break;
+		}
+		pthread_mutex_unlock(&queue->lock);
+	}
+	return NULL;
+}
+
+
+struct nand_queue *nand_queue_create(struct nand_base *nand, unsigned int size)
+{
+	struct nand_queue *queue;
+
+	if (!nand)
+		return NULL;
+
+	queue = mem_alloc(sizeof(struct nand_queue));
+	queue->nand = nand;
+	queue->ring = ring_create(size, sizeof(struct queue_cmd));
+	if (!queue->ring) {
+		mem_free(queue);
+		return NULL;
+	}
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->bell_cond, NULL);
+	pthread_cond_init(&queue->done_cond, NULL);
+	if (pthread_create(&queue->thread, NULL, queue_thread, queue)) {
+		LOG(LOG_ERR, "create consumer fail");
+		pthread_mutex_destroy(&queue->lock);
+		pthread_cond_destroy(&queue->bell_cond);
+		pthread_cond_destroy(&queue->done_cond);
+		ring_delete(queue->ring);
+		mem_free(queue);
+		return NULL;
+	}
+	return queue;
+}
+
+
+void nand_queue_doorbell(struct nand_queue *queue)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&queue->sleep, __ATOMIC_RELAXED))
+		return;
+	pthread_mutex_lock(&queue->lock);
+	if (__atomic_load_n(&queue->sleep, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&queue->sleep, 0, __ATOMIC_RELAXED);
+		queue->doorbell++;
+		pthread_cond_signal(&queue->bell_cond);
+	}
+	pthread_mutex_unlock(&queue->lock);
+}
+
+
+/* slots reserved by others count too, they are done after their producers commit */
+void nand_queue_wait(struct nand_queue *queue)
+{
+	unsigned long long tail = __atomic_load_n(&queue->ring->tail, __ATOMIC_RELAXED);
+
+	nand_queue_doorbell(queue);
+	pthread_mutex_lock(&queue->lock);
+	__atomic_add_fetch(&queue->waiter, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&queue->done, __ATOMIC_SEQ_CST) < tail)
+		pthread_cond_wait(&queue->done_cond, &queue->lock);
+	__atomic_sub_fetch(&queue->waiter, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+
+void nand_queue_dump(struct nand_queue *queue, FILE *fp)
+{
+	unsigned long long done = __atomic_load_n(&queue->done, __ATOMIC_SEQ_CST);
+
+	fprintf(fp, "queue: %u slots, %llu commands, %llu doorbells, %llu passes, %.1f per pass, max %llu\n",
+			queue->ring->size, done, queue->doorbell, queue->drain,
+			queue->drain ? (double)done / queue->drain : 0, queue->max_drain);
+}
+
+
+void nand_queue_delete(struct nand_queue *queue)
+{
+	nand_queue_wait(queue);
+	pthread_mutex_lock(&queue->lock);
+	queue->stop = TRUE;
+	pthread_cond_signal(&queue->bell_cond);
+	pthread_mutex_unlock(&queue->lock);
+	pthread_join(queue->thread, NULL);
+
+	pthread_mutex_destroy(&queue->lock);
+	pthread_cond_destroy(&queue->bell_cond);
+	pthread_cond_destroy(&queue->done_cond);
+	ring_delete(queue->ring);
+	mem_free(queue);
+}
@@ -0,0 +1,158 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NAND_QUEUE_H__
+#define __NAND_QUEUE_H__
+
+#include <pthread.h>
+#include "ring.h"
+#include "nand.h"
+
+#define QUEUE_DRAIN_MAX					64 // commands taken by one pass of consumer
+#define QUEUE_SPIN						128 // empty polls before consumer sleeps
+
+
+enum queue_op {
+	QUEUE_READ, // nand_read_page
+	QUEUE_PROGRAM, // nand_write_page
+	QUEUE_ERASE, // nand_erase_block
+	QUEUE_NOP // callback only
+};
+
+
+struct nand_queue;
+struct queue_cmd;
+
+typedef void (*QUEUE_CALLBACK)(struct nand_queue *queue, struct queue_cmd *cmd);
+
+/* lives in a ring slot, filled by producer in place */
+struct queue_cmd {
+	int op;
+	int row;
+	int col;
+	void *data;
+	void *oob;
+	int ret; // return of nand op, valid in callback
+	QUEUE_CALLBACK cb; // after op in consumer thread, NULL for none
+	void *userdata;
+};
+
+
+/*
+ * submission queue of a device, host threads submit without lock and one
+ * consumer thread runs the commands in ring order; a doorbell wakes the
+ * consumer only if it sleeps, so producers of a busy queue touch no lock
+ */
+struct nand_queue {
+	struct nand_base *nand;
+	struct ring *ring;
+	pthread_t thread;
+	int sleep; // consumer waits for doorbell
+	int waiter; // threads in nand_queue_wait
+	bool stop;
+	unsigned long long done; // commands completed
+	pthread_mutex_t lock;
+	pthread_cond_t bell_cond;
+	pthread_cond_t done_cond;
+	unsigned long long doorbell; // doorbells that woke the consumer
+	unsigned long long drain; // passes of consumer
+	unsigned long long max_drain; // most commands of a pass
+};
+
+
+/*
+ * nand_queue_create - create submission queue and its consumer
+ * @nand: created nand_base object, queues of a device run in parallel
+ * @size: ring slots
+ *
+ * Returns queue object if success, otherwise NULL
+ */
+struct nand_queue *nand_queue_create(struct nand_base *nand, unsigned int size);
+
+
+/*
+ * nand_queue_reserve - reserve slots for commands, waits while queue is full
+ * @queue: queue object
+ * @num: command number, no more than ring slots
+ *
+ * Returns position of first command
+ */
+static inline unsigned long long nand_queue_reserve(struct nand_queue *queue, int num)
+{
+	return ring_reserve(queue->ring, num);
+}
+
+
+/*
+ * nand_queue_cmd - command of a reserved slot
+ * @queue: queue object
+ * @pos: position of slot
+ *
+ * Returns command to fill
+ */
+static inline struct queue_cmd *nand_queue_cmd(struct nand_queue *queue, unsigned long long pos)
+{
+	return ring_entry(queue->ring, pos);
+}
+
+
+/*
+ * nand_queue_commit - hand filled commands to consumer, not running them
+ *                     until a doorbell if consumer sleeps
+ * @queue: queue object
+ * @pos: position of first command
+ * @num: command number
+ */
+static inline void nand_queue_commit(struct nand_queue *queue, unsigned long long pos, int num)
+{
+	ring_commit(queue->ring, pos, num);
+}
+
+
+/*
+ * nand_queue_doorbell - wake consumer for committed commands, one call for
+ *                       a batch of commits
+ * @queue: queue object
+ */
+void nand_queue_doorbell(struct nand_queue *queue);
+
+
+/*
+ * nand_queue_wait - wait until commands committed before are completed
+ * @queue: queue object, not called from callbacks
+ */
+void nand_queue_wait(struct nand_queue *queue);
+
+
+/*
+ * nand_queue_dump - print commands, doorbells and drain passes
+ * @queue: queue object
+ * @fp: output file
+ */
+void nand_queue_dump(struct nand_queue *queue, FILE *fp);
+
+
+/*
+ * nand_queue_delete - wait for committed commands and destory the queue
+ * @queue: queue object
+ */
+void nand_queue_delete(struct nand_queue *queue);
+
+#endif // __NAND_QUEUE_H__
@@ -0,0 +1,423 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "common.h"
+#include "nand.h"
+#include "nand_sched.h"
+
+
+static char *sched_op_name[SCHED_OP_NUM] = {
+	"read",
+	"program",
+	"erase",
+	"feature",
+};
+
+
+static void sched_queue_push(struct sched_queue *q, struct sched_cmd *cmd)
+{
+	cmd->next = NULL;
+	if (q->tail)
+		q->tail->next = cmd;
+	else
+		q->head = cmd;
+	q->tail = cmd;
+}
+
+
+static struct sched_cmd *sched_queue_pop(struct sched_queue *q)
+{
+	struct sched_cmd *cmd = q->head;
+
+	if (cmd) {
+		q->head = cmd->next;
+		if (!q->head)
+			q->tail = NULL;
+		cmd->next = NULL;
+	}
+	return cmd;
+}
+
+
+/* commands are recycled, pool chunks are linked by their first pointer */
+static struct sched_cmd *sched_cmd_alloc(struct sched *s)
+{
+	int i;
+	void **chunk;
+	struct sched_cmd *cmd;
+
+	if (!s->free) {
+		chunk = mem_alloc(sizeof(void *) + SCHED_POOL_NUM * sizeof(struct sched_cmd));
+		*chunk = s->pool;
+		s->pool = chunk;
+		cmd = (struct sched_cmd *)(chunk + 1);
+		for (i = 0; i < SCHED_POOL_NUM; i++) {
+			cmd[i].next = s->free;
+			s->free = &cmd[i];
+		}
+	}
+	cmd = s->free;
+	s->free = cmd->next;
+	return cmd;
+}
+
+
+static void sched_cmd_free(struct sched *s, struct sched_cmd *cmd)
+{
+	cmd->next = s->free;
+	s->free = cmd;
+}
+
+
+static unsigned int sched_stage_time(struct sched *s, struct sched_cmd *cmd)
+{
+	switch (cmd->stage) {
+	case STAGE_CMD:
+		if (cmd->op == SCHED_PROGRAM)
+			return s->timing.t_cmd + nand_xfer_time(&s->timing, s->xfer_size);
+		return s->timing.t_cmd;
+	case STAGE_ARRAY:
+		if (cmd->latency)
+			return cmd->latency;
+		if (cmd->op == SCHED_READ)
+			return s->timing.t_r;
+		if (cmd->op == SCHED_PROGRAM)
+			return s->timing.t_prog;
+		return s->timing.t_bers;
+	case STAGE_DATA:
+		return nand_xfer_time(&s->timing, s->xfer_size);
+	default:
+		ASSERT(0);
+	}
+	return 0;
+}
+
+
+static void sched_event(struct sched *s, struct sched_cmd *cmd, unsigned int time)
+{
+	cmd->event.key = s->now + time;
+	heap_push(s->event, &cmd->event);
+}
+
+
+static void sched_channel_start(struct sched *s, struct sched_channel *ch,
+								struct sched_cmd *cmd)
+{
+	unsigned int time;
+
+	time = sched_stage_time(s, cmd);
+	ch->busy = 1;
+	ch->busy_time += time;
+	sched_event(s, cmd, time);
+}
+
+
+/* cmd->stage is the stage waiting for channel */
+static void sched_channel_request(struct sched *s, struct sched_cmd *cmd)
+{
+	struct sched_channel *ch = &s->channel[cmd->die / s->die_num];
+
+	if (ch->busy)
+		sched_queue_push(&ch->wait, cmd);
+	else
+		sched_channel_start(s, ch, cmd);
+}
+
+
+static void sched_channel_release(struct sched *s, struct sched_cmd *cmd)
+{
+	struct sched_cmd *next;
+	struct sched_channel *ch = &s->channel[cmd->die / s->die_num];
+
+	ch->busy = 0;
+	next = sched_queue_pop(&ch->wait);
+	if (next)
+		sched_channel_start(s, ch, next);
+}
+
+
+static void sched_die_start(struct sched *s, struct sched_die *die)
+{
+	struct sched_cmd *cmd;
+
+	if (die->active)
+		return;
+	cmd = sched_queue_pop(&die->wait);
+	if (!cmd)
+		return;
+	die->active = cmd;
+	die->start = s->now;
+	cmd->stage = STAGE_CMD;
+	sched_channel_request(s, cmd);
+}
+
+
+static void sched_complete(struct sched *s, struct sched_cmd *cmd)
+{
+	unsigned long long latency;
+	struct sched_die *die = &s->die[cmd->die];
+	struct sched_stat *stat = &s->stat[cmd->op];
+
+	latency = s->now - cmd->submit;
+	stat->count++;
+	stat->latency += latency;
+	stat->max_latency = MAX(stat->max_latency, latency);
+	die->busy_time += s->now - die->start;
+	die->count++;
+	die->active = NULL;
+
+	if (cmd->cb)
+		cmd->cb(s, cmd, cmd->userdata);
+	sched_cmd_free(s, cmd);
+	sched_die_start(s, die);
+}
+
+
+static void sched_handle(struct sched *s, struct sched_cmd *cmd)
+{
+	unsigned int time;
+	struct sched_die *die = &s->die[cmd->die];
+
+	switch (cmd->stage) {
+	case STAGE_ARRIVE:
+		sched_queue_push(&die->wait, cmd);
+		sched_die_start(s, die);
+		break;
+	case STAGE_CMD:
+		sched_channel_release(s, cmd);
+		cmd->stage = STAGE_ARRAY;
+		time = sched_stage_time(s, cmd);
+		die->array_time += time;
+		sched_event(s, cmd, time);
+		break;
+	case STAGE_ARRAY:
+		if (cmd->op == SCHED_READ) {
+			cmd->stage = STAGE_DATA;
+			sched_channel_request(s, cmd);
+		} else {
+			sched_complete(s, cmd);
+		}
+		break;
+	case STAGE_DATA:
+		sched_channel_release(s, cmd);
+		sched_complete(s, cmd);
+		break;
+	default:
+		ASSERT(0);
+	}
+}
+
+
+struct sched *sched_create(const struct nand_timing *timing, int xfer_size,
+							int channel_num, int die_num)
+{
+	struct sched *s;
+
+	if (!timing || channel_num <= 0 || die_num <= 0)
+		return NULL;
+
+	s = mem_alloc(sizeof(struct sched));
+	pthread_mutex_init(&s->lock, NULL);
+	s->timing = *timing;
+	s->timing.bus_rate = MAX(s->timing.bus_rate, 1);
+	s->xfer_size = xfer_size;
+	s->channel_num = channel_num;
+	s->die_num = die_num;
+	s->event = heap_create(channel_num * die_num * 2);
+	s->channel = mem_alloc(channel_num * sizeof(struct sched_channel));
+	s->die = mem_alloc(channel_num * die_num * sizeof(struct sched_die));
+	return s;
+}
+
+
+int sched_submit(struct sched *s, unsigned long long time, int op, int die,
+				unsigned int latency, SCHED_CALLBACK cb, void *userdata)
+{
+	struct sched_cmd *cmd;
+
+	if (op < 0 || op >= SCHED_OP_NUM || die < 0 || die >= s->channel_num * s->die_num) {
+		LOG(LOG_WARN, "invalid command op %d die %d", op, die);
+		return -1;
+	}
+
+	cmd = sched_cmd_alloc(s);
+	cmd->op = op;
+	cmd->die = die;
+	cmd->latency = latency;
+	cmd->cb = cb;
+	cmd->userdata = userdata;
+	cmd->submit = MAX(time, s->now);
+	cmd->stage = STAGE_ARRIVE;
+
+	if (cmd->submit == s->now) {
+		sched_queue_push(&s->die[die].wait, cmd);
+		sched_die_start(s, &s->die[die]);
+	} else {
+		cmd->event.key = cmd->submit;
+		heap_push(s->event, &cmd->event);
+	}
+	return 0;
+}
+
+
+/*
+ * reserve len of bus time at or after time in the first idle gap; slots
+ * that end before low are never reached again, when slots run out the
+ * oldest one is given up and the bus is taken until its end
+ *
+ * Returns start of the reserved time
+ */
+static unsigned long long sched_slot_reserve(struct sched_channel *ch, unsigned long long time,
+										unsigned int len, unsigned long long low)
+{
+	int i, k;
+
+	for (i = 0; i < ch->slot_num && ch->slot[i].end <= low; i++)
+		;
+	if (!i && ch->slot_num == SCHED_SLOT_MAX)
+		i = 1;
+	if (i) {
+		ch->horizon = MAX(ch->horizon, ch->slot[i - 1].end);
+		ch->slot_num -= i;
+		memmove(ch->slot, ch->slot + i, ch->slot_num * sizeof(struct sched_slot));
+	}
+	time = MAX(time, ch->horizon);
+	if (!len)
+		return time;
+
+	for (i = 0; i < ch->slot_num && time + len > ch->slot[i].start; i++)
+		time = MAX(time, ch->slot[i].end);
+	ch->busy_time += len;
+	/* back to back transfers share a slot */
+	if (i > 0 && ch->slot[i - 1].end == time) {
+		ch->slot[i - 1].end += len;
+		if (i < ch->slot_num && ch->slot[i].start == ch->slot[i - 1].end) {
+			ch->slot[i - 1].end = ch->slot[i].end;
+			ch->slot_num--;
+			memmove(ch->slot + i, ch->slot + i + 1, (ch->slot_num - i) * sizeof(struct sched_slot));
+		}
+	} else if (i < ch->slot_num && ch->slot[i].start == time + len) {
+		ch->slot[i].start = time;
+	} else {
+		for (k = ch->slot_num; k > i; k--)
+			ch->slot[k] = ch->slot[k - 1];
+		ch->slot[i].start = time;
+		ch->slot[i].end = time + len;
+		ch->slot_num++;
+	}
+	return time;
+}
+
+
+unsigned long long sched_issue(struct sched *s, int op, int die, unsigned int bus_in,
+						unsigned int array, unsigned int bus_out, unsigned int background)
+{
+	int i;
+	unsigned long long start, time, low, latency;
+	struct sched_die *d = &s->die[die];
+	struct sched_channel *ch = &s->channel[die / s->die_num];
+	struct sched_stat *stat = &s->stat[op];
+
+	pthread_mutex_lock(&s->lock);
+	/* no die issues a command before its last one completes */
+	for (i = 0, low = d->free; i < s->channel_num * s->die_num; i++)
+		low = MIN(low, s->die[i].free);
+
+	start = d->free;
+	time = sched_slot_reserve(ch, start, bus_in, low) + bus_in;
+	time = MAX(time, d->ready) + array;
+	d->array_time += array + background;
+	d->ready = time + background;
+	if (bus_out)
+		time = sched_slot_reserve(ch, time, bus_out, low) + bus_out;
+	d->free = time;
+	d->busy_time += time - start;
+	d->count++;
+
+	latency = time - start;
+	stat->count++;
+	stat->latency += latency;
+	stat->max_latency = MAX(stat->max_latency, latency);
+	s->now = MAX(s->now, time);
+	pthread_mutex_unlock(&s->lock);
+	return time;
+}
+
+
+unsigned long long sched_run(struct sched *s, unsigned long long until)
+{
+	struct heap_node *node;
+
+	while ((node = heap_top(s->event)) != NULL) {
+		if (node->key > until)
+			break;
+		heap_pop(s->event);
+		s->now = node->key;
+		s->event_num++;
+		sched_handle(s, container_of(node, struct sched_cmd, event));
+	}
+	return s->now;
+}
+
+
+void sched_dump(struct sched *s, FILE *fp)
+{
+	int i;
+	double now;
+	struct sched_die *die;
+	struct sched_stat *stat;
+
+	now = s->now ? (double)s->now : 1.0;
+	fprintf(fp, "simulated time: %llu ns, events: %llu\n", s->now, s->event_num);
+	for (i = 0; i < SCHED_OP_NUM; i++) {
+		stat = &s->stat[i];
+		if (!stat->count)
+			continue;
+		fprintf(fp, "%-8s count: %llu avg latency: %llu ns max latency: %llu ns iops: %.0f\n",
+					sched_op_name[i], stat->count, stat->latency / stat->count,
+					stat->max_latency, stat->count * 1e9 / now);
+	}
+	for (i = 0; i < s->channel_num; i++) {
+		fprintf(fp, "channel %d: bus %.2f%%\n", i,
+					s->channel[i].busy_time * 100.0 / now);
+	}
+	for (i = 0; i < s->channel_num * s->die_num; i++) {
+		die = &s->die[i];
+		fprintf(fp, "die %d: array %.2f%% busy %.2f%% cmd %llu\n", i,
+					die->array_time * 100.0 / now,
+					die->busy_time * 100.0 / now, die->count);
+	}
+}
+
+
+void sched_delete(struct sched *s)
+{
+	void **chunk;
+
+	while (s->pool) {
+		chunk = s->pool;
+		s->pool = *chunk;
+		mem_free(chunk);
+	}
+	mem_free(s->die);
+	mem_free(s->channel);
+	heap_delete(s->event);
+	pthread_mutex_destroy(&s->lock);
+	mem_free(s);
+}
@@ -0,0 +1,209 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NAND_SCHED_H__
+#define __NAND_SCHED_H__
+
+#include "heap.h"
+#include "nand.h"
+
+#define SCHED_RUN_ALL					(~0ULL)
+#define SCHED_POOL_NUM					4096
+#define SCHED_SLOT_MAX					64 // reserved bus slots of a channel in issue mode
+
+
+enum sched_op {
+	SCHED_READ,
+	SCHED_PROGRAM,
+	SCHED_ERASE,
+	SCHED_FEATURE, // issue mode only, get/set feature
+	SCHED_OP_NUM
+};
+
+/*
+ * read:    [CMD] channel -> [ARRAY] die -> [DATA] channel
+ * program: [CMD + data in] channel -> [ARRAY] die
+ * erase:   [CMD] channel -> [ARRAY] die
+ */
+enum sched_stage {
+	STAGE_ARRIVE,
+	STAGE_CMD,
+	STAGE_ARRAY,
+	STAGE_DATA
+};
+
+
+struct sched;
+struct sched_cmd;
+
+typedef void (*SCHED_CALLBACK)(struct sched *s, struct sched_cmd *cmd, void *userdata);
+
+struct sched_cmd {
+	struct heap_node event; // key: time of current stage end
+	struct sched_cmd *next; // die or channel wait queue
+	int op;
+	int die;
+	int stage;
+	unsigned int latency; // array time, zero for timing default
+	unsigned long long submit;
+	SCHED_CALLBACK cb;
+	void *userdata;
+};
+
+
+struct sched_queue {
+	struct sched_cmd *head;
+	struct sched_cmd *tail;
+};
+
+
+/* bus time reserved by an issued command, [start, end) */
+struct sched_slot {
+	unsigned long long start;
+	unsigned long long end;
+};
+
+
+struct sched_channel {
+	struct sched_queue wait;
+	int busy;
+	unsigned long long busy_time;
+	/* issue mode: reserved slots in time order, the bus is taken before horizon */
+	struct sched_slot slot[SCHED_SLOT_MAX];
+	int slot_num;
+	unsigned long long horizon;
+};
+
+
+struct sched_die {
+	struct sched_queue wait;
+	struct sched_cmd *active;
+	unsigned long long start;
+	unsigned long long array_time; // R/B# busy
+	unsigned long long busy_time; // occupied by a command
+	unsigned long long count;
+	unsigned long long free; // issue mode: last issued command completes
+	unsigned long long ready; // issue mode: array busy until, cache operation runs on
+};
+
+
+struct sched_stat {
+	unsigned long long count;
+	unsigned long long latency;
+	unsigned long long max_latency;
+};
+
+
+/*
+ * two modes on the same channels and dies: sched_submit/sched_run play
+ * synthetic workloads in event order, like test_sched; sched_issue times a
+ * command of a nand device at once, every device has its own scheduler of
+ * one channel and a die per LUN that nand_cmd goes through
+ */
+struct sched {
+	pthread_mutex_t lock; // issue mode, commands of different dies come from different threads
+	struct nand_timing timing;
+	int xfer_size;
+	int channel_num;
+	int die_num; // per channel
+	unsigned long long now;
+	unsigned long long event_num;
+	struct heap *event;
+	struct sched_cmd *free;
+	void *pool;
+	struct sched_channel *channel;
+	struct sched_die *die;
+	struct sched_stat stat[SCHED_OP_NUM];
+};
+
+
+/*
+ * sched_create - create discrete-event scheduler of channels and dies
+ * @timing: nand timing of every die
+ * @xfer_size: data size of one page transfer on channel
+ * @channel_num: channel number
+ * @die_num: die number per channel
+ *
+ * Returns scheduler object if success, otherwise NULL
+ */
+struct sched *sched_create(const struct nand_timing *timing, int xfer_size,
+							int channel_num, int die_num);
+
+
+/*
+ * sched_submit - submit a command to a die
+ * @s: scheduler object
+ * @time: arrival time in ns, no earlier than current time
+ * @op: enum sched_op
+ * @die: global die index, channel = die / die_num
+ * @latency: array time in ns, zero for timing default
+ * @cb: called at command completion, may submit new command
+ * @userdata: import user info
+ *
+ * Returns zero if success, otherwise non-zero
+ */
+int sched_submit(struct sched *s, unsigned long long time, int op, int die,
+				unsigned int latency, SCHED_CALLBACK cb, void *userdata);
+
+
+/*
+ * sched_issue - time a command in issue mode: commands of a die queue back
+ *               to back, each stage waits for its channel or die; a command
+ *               issued later in a die idle so far still takes idle bus time
+ *               in between reserved slots
+ * @s: scheduler object
+ * @op: enum sched_op, for statistics
+ * @die: global die index, channel = die / die_num
+ * @bus_in: command, address and data in on channel, zero for none
+ * @array: die busy after bus_in until data out, it waits the last array work
+ * @bus_out: data out on channel, zero for none
+ * @background: array work left after completion, e.g. next page of cache read
+ *
+ * Returns completion time in ns
+ */
+unsigned long long sched_issue(struct sched *s, int op, int die, unsigned int bus_in,
+						unsigned int array, unsigned int bus_out, unsigned int background);
+
+
+/*
+ * sched_run - process events in time order
+ * @s: scheduler object
+ * @until: stop after this time, SCHED_RUN_ALL for all events
+ *
+ * Returns current simulated time in ns
+ */
+unsigned long long sched_run(struct sched *s, unsigned long long until);
+
+
+/*
+ * sched_dump - print utilisation and latency statistics
+ * @s: scheduler object
+ * @fp: output file
+ */
+void sched_dump(struct sched *s, FILE *fp);
+
+
+/*
+ * sched_delete - destory the scheduler
+ * @s: scheduler object
+ */
+void sched_delete(struct sched *s);
+
+#endif // __NAND_SCHED_H__
@@ -0,0 +1,206 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#include <pthread.h>
+#include "common.h"
+#include "arena.h"
+#include "nand.h"
+
+#define THREAD_MAX			64
+#define SLOT_NUM			256 // live objects of a thread
+#define SIZE_MAX_SHIFT		14 // objects up to 16 KB, like ops and trace buffers
+#define ROUND_MAX			8 // rounds to reach steady state
+
+struct worker {
+	pthread_t thread;
+	int id;
+	int loop;
+	int arena; // arena_alloc, otherwise mem_alloc
+	unsigned int seed;
+	void *slot[SLOT_NUM];
+	unsigned long long nsec;
+	int error;
+};
+
+static struct worker g_worker[THREAD_MAX];
+static int g_thread_num;
+static pthread_barrier_t g_barrier;
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void *obj_alloc(struct worker *w, unsigned int *size)
+{
+	unsigned char *p;
+
+	*size = 16 + rand_r(&w->seed) % (1 << (4 + rand_r(&w->seed) % (SIZE_MAX_SHIFT - 3)));
+	p = w->arena ? arena_alloc(*size) : mem_alloc(*size);
+	/* first and last byte tell the owner, a broken size class overlaps them */
+	p[0] = p[*size - 1] = w->id;
+	*(unsigned int *)(p + 4) = *size;
+	return p;
+}
+
+static void obj_free(struct worker *w, void *mem)
+{
+	unsigned char *p = mem;
+	unsigned int size = *(unsigned int *)(p + 4);
+
+	if (p[0] != p[size - 1])
+		w->error++;
+	if (w->arena)
+		arena_free(mem);
+	else
+		mem_free(mem);
+}
+
+/*
+ * objects are replaced at random, then a thread frees the live objects of
+ * its neighbour, so free lists move between threads
+ */
+static void *alloc_thread(void *arg)
+{
+	struct worker *w = arg, *next = &g_worker[(w->id + 1) % g_thread_num];
+	unsigned long long start;
+	unsigned int size;
+	int i, j;
+
+	for (i = 0; i < SLOT_NUM; i++)
+		w->slot[i] = obj_alloc(w, &size);
+	start = now_nsec();
+	for (i = 0; i < w->loop; i++) {
+		j = rand_r(&w->seed) % SLOT_NUM;
+		obj_free(w, w->slot[j]);
+		w->slot[j] = obj_alloc(w, &size);
+	}
+	w->nsec = now_nsec() - start;
+	pthread_barrier_wait(&g_barrier);
+	for (i = 0; i < SLOT_NUM; i++)
+		obj_free(w, next->slot[i]);
+	return NULL;
+}
+
+static void run(int arena, int loop, const char *name)
+{
+	int i, error = 0;
+	unsigned long long nsec = 0;
+
+	pthread_barrier_init(&g_barrier, NULL, g_thread_num);
+	for (i = 0; i < g_thread_num; i++) {
+		g_worker[i].id = i;
+		g_worker[i].loop = loop;
+		g_worker[i].arena = arena;
+		g_worker[i].seed = i + 1;
+		g_worker[i].error = 0;
+		pthread_create(&g_worker[i].thread, NULL, alloc_thread, &g_worker[i]);
+	}
+	for (i = 0; i < g_thread_num; i++) {
+		pthread_join(g_worker[i].thread, NULL);
+		nsec += g_worker[i].nsec;
+		error += g_worker[i].error;
+	}
+	pthread_barrier_destroy(&g_barrier);
+	printf("%s: %d threads, %.1f ns per alloc and free, error %d\n", name, g_thread_num,
+			(double)nsec / g_thread_num / loop, error);
+}
+
+static void stat_print(const char *name, struct arena_stat *s)
+{
+	printf("%s: alloc %llu free %llu sys %llu (%llu KB) depot %llu\n", name,
+			s->alloc, s->free, s->sys, s->sys_bytes >> 10, s->depot);
+}
+
+/*
+ * malloc and arena are compared by threads replacing objects of random
+ * size; arena rounds are repeated until one calls no malloc, free lists
+ * of threads settle in a few rounds; then page reads of a nand must not
+ * call malloc either
+ */
+int main(int argc, char *argv[])
+{
+	int i, row, page_num_per_block, loop, error = 0;
+	struct arena_stat warm, s;
+	struct nand_base *nand;
+	void *data, *oob;
+
+	if (argc != 4) {
+		printf("[Usage]: %s [nand_name] [thread_num] [loop]\n", argv[0]);
+		return 0;
+	}
+	g_thread_num = atoi(argv[2]);
+	loop = atoi(argv[3]);
+	if (g_thread_num < 1 || g_thread_num > THREAD_MAX || loop < 1) {
+		printf("thread_num 1 ~ %d\n", THREAD_MAX);
+		return -1;
+	}
+
+	run(FALSE, loop, "malloc");
+	arena_get_stat(&warm);
+	for (i = 0; i < ROUND_MAX; i++) {
+		run(TRUE, loop, "arena");
+		arena_get_stat(&s);
+		stat_print("arena", &s);
+		if (s.alloc != s.free)
+			error++;
+		if (i && s.sys == warm.sys)
+			break;
+		warm = s;
+	}
+	if (i == ROUND_MAX)
+		error++;
+
+	nand = nand_init(COMMON, argv[1]);
+	if (!nand) {
+		printf("init nand fail\n");
+		return -1;
+	}
+	page_num_per_block = nand->block_size / nand->page_size;
+	data = mem_alloc(nand->page_size);
+	oob = mem_alloc(nand->spare_size);
+	row = page_num_per_block;
+	nand_erase_block(nand, row);
+	for (i = 0; i < page_num_per_block; i++) {
+		*(int *)data = *(int *)oob = row + i;
+		nand_write_page(nand, row + i, 0, data, oob);
+	}
+	nand_read_page(nand, row, 0, data, oob);
+	arena_get_stat(&warm);
+	for (i = 0; i < loop; i++) {
+		nand_read_page(nand, row + i % page_num_per_block, 0, data, oob);
+		if (*(int *)data != row + i % page_num_per_block)
+			error++;
+	}
+	arena_get_stat(&s);
+	stat_print("nand read", &s);
+	if (s.sys != warm.sys)
+		error++;
+
+	mem_free(oob);
+	mem_free(data);
+	nand_deinit(COMMON, nand);
+	printf("%s\n", error ? "arena test fail" : "arena test pass");
+	return error ? -1 : 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "nand.h"
+#include "nand_array.h"
+#include "test_util.h"
+
+/* simulated time of array is the busiest device */
+static unsigned long long array_clock(struct nand_array *array)
+{
+	int i;
+	unsigned long long clock = 0;
+
+	for (i = 0; i < array->dev_num; i++)
+		clock = MAX(clock, __atomic_load_n(&array->dev[i].nand->clock, __ATOMIC_RELAXED));
+	return clock;
+}
+
+/*
+ * sequential write and read back of array blocks: block 0 is skipped,
+ * a bad block of any device skips the array block; data and spare carry
+ * the logical page; bandwidth is given in host time and simulated time,
+ * the latter scales with devices as they are busy at the same time
+ */
+int main(int argc, char *argv[])
+{
+	int i, j, dev_num, stripe_page, mode, block_num, page_num, done = 0, error = 0;
+	unsigned int page;
+	unsigned long long clock, size;
+	double start, sec;
+	char *name[ARRAY_DEV_MAX];
+	unsigned int *data, *oob, *p;
+	int *good;
+	struct nand_array *array;
+
+	if (argc != 6) {
+		printf("[Usage]: %s [nand_name] [dev_num] [stripe_page] [parity] [block_num]\n", argv[0]);
+		printf("devices are [nand_name]_0 ~ [nand_name]_[dev_num - 1]\n");
+		return 0;
+	}
+
+	dev_num = atoi(argv[2]);
+	stripe_page = atoi(argv[3]);
+	mode = atoi(argv[4]) ? ARRAY_PARITY : ARRAY_STRIPE;
+	block_num = atoi(argv[5]);
+	if (dev_num < 1 || dev_num > ARRAY_DEV_MAX || strlen(argv[1]) + 5 >= NAND_NAME_MAX ||
+		block_num < 1) {
+		printf("dev_num 1 ~ %d, nand_name shorter than %d\n", ARRAY_DEV_MAX, NAND_NAME_MAX - 5);
+		return -1;
+	}
+
+	for (i = 0; i < dev_num; i++) {
+		name[i] = mem_alloc(NAND_NAME_MAX);
+		sprintf(name[i], "%s_%d", argv[1], i);
+		if (copy_info(argv[1], name[i])) {
+			printf("copy "NAND_INFO_FOLDER"/%s.ini fail\n", argv[1]);
+			return -1;
+		}
+	}
+	array = nand_array_create(name, dev_num, stripe_page, mode, 1);
+	if (!array) {
+		printf("create array fail\n");
+		return -1;
+	}
+
+	block_num = MIN(block_num, array->block_num - 1);
+	page_num = array->page_num / array->block_num;
+	data = mem_alloc(page_num * array->page_size);
+	oob = mem_alloc(page_num * array->spare_size);
+	good = mem_alloc((block_num + 1) * sizeof(int));
+
+	clock = array_clock(array);
+	start = now_sec();
+	for (i = 1; i <= block_num; i++) {
+		if (nand_array_erase(array, i) != FLASH_OK)
+			continue;
+		page = i * page_num;
+		for (j = 0; j < page_num; j++) {
+			p = (unsigned int *)((char *)data + j * array->page_size);
+			p[0] = p[1] = page + j;
+			p = (unsigned int *)((char *)oob + j * array->spare_size);
+			p[0] = page + j;
+		}
+		if (nand_array_write(array, page, page_num, data, oob) != FLASH_OK) {
+			error++;
+			continue;
+		}
+		good[i] = 1;
+		done++;
+	}
+	sec = now_sec() - start;
+	clock = array_clock(array) - clock;
+	size = (unsigned long long)done * page_num * array->page_size;
+	printf("write %d blocks: %.1f MB/s host, %.1f MB/s simulated\n", done,
+			size / sec / 1e6, clock ? size * 1e3 / clock : 0);
+
+	clock = array_clock(array);
+	start = now_sec();
+	for (i = 1; i <= block_num; i++) {
+		if (!good[i])
+			continue;
+		page = i * page_num;
+		memset(data, 0, page_num * array->page_size);
+		if (nand_array_read(array, page, page_num, data, oob) < FLASH_BITFLIP) {
+			error++;
+			continue;
+		}
+		for (j = 0; j < page_num; j++) {
+			p = (unsigned int *)((char *)data + j * array->page_size);
+			if (p[0] != page + j || p[1] != page + j ||
+				*(unsigned int *)((char *)oob + j * array->spare_size) != page + j)
+				error++;
+		}
+	}
+	sec = now_sec() - start;
+	clock = array_clock(array) - clock;
+	printf("read %d blocks: %.1f MB/s host, %.1f MB/s simulated\n", done,
+			size / sec / 1e6, clock ? size * 1e3 / clock : 0);
+
+	/*
+	 * parity mode rejects a write neither starting a stripe nor continuing
+	 * one, and a new stripe while another is open in block 0
+	 */
+	if (mode == ARRAY_PARITY) {
+		if (nand_array_write(array, page_num + 1, 1, data, oob) == FLASH_OK)
+			error++;
+		if (nand_array_erase(array, 0) == FLASH_OK &&
+			array->stripe_page * array->data_num > 1 &&
+			(nand_array_write(array, 0, 1, data, oob) != FLASH_OK ||
+			nand_array_write(array, page_num, 1, data, oob) == FLASH_OK))
+			error++;
+	}
+
+	nand_array_dump(array, stdout);
+	printf("%s, error: %d\n", error || !done ? "array test fail" : "array test pass", error);
+	mem_free(good);
+	mem_free(oob);
+	mem_free(data);
+	nand_array_delete(array);
+	for (i = 0; i < dev_num; i++)
+		mem_free(name[i]);
+	return error || !done ? -1 : 0;
+}
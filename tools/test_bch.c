@@ -0,0 +1,193 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "bch.h"
+
+#define ECC_MAX			((BCH_M_MAX * BCH_T_MAX + 7) >> 3)
+#define BENCH_BYTES		(16 << 20)
+#define BENCH_BATCH		64
+
+/* flip num distinct bits over data and parity */
+static void flip_bits(unsigned char *data, int len, unsigned char *ecc, int ecc_bits, int num)
+{
+	int i, j, k, pos[BCH_T_MAX + 1];
+
+	for (i = 0; i < num; i++) {
+		k = rand() % (len * 8 + ecc_bits);
+		for (j = 0; j < i && pos[j] != k; j++)
+			;
+		if (j < i) {
+			i--;
+			continue;
+		}
+		pos[i] = k;
+		if (k < len * 8) {
+			data[k >> 3] ^= 0x80 >> (k & 7);
+		} else {
+			k -= len * 8;
+			ecc[k >> 3] ^= 0x80 >> (k & 7);
+		}
+	}
+}
+
+
+/* err < 0 for encode, codewords are corrupted a batch ahead out of timing */
+static double bench(struct bch *bch, unsigned char *data, int len,
+				unsigned char *ecc, int err)
+{
+	int i, j, loop = BENCH_BYTES / len / BENCH_BATCH;
+	unsigned char *buf, *rbuf;
+	clock_t start, total = 0;
+
+	buf = mem_alloc(BENCH_BATCH * len);
+	rbuf = mem_alloc(BENCH_BATCH * ECC_MAX);
+	for (i = 0; i < loop; i++) {
+		for (j = 0; j < BENCH_BATCH; j++) {
+			memcpy(buf + j * len, data, len);
+			memcpy(rbuf + j * ECC_MAX, ecc, bch->ecc_bytes);
+			if (err > 0)
+				flip_bits(buf + j * len, len, rbuf + j * ECC_MAX, bch->ecc_bits, err);
+		}
+		start = clock();
+		for (j = 0; j < BENCH_BATCH; j++) {
+			if (err < 0)
+				bch_encode(bch, buf + j * len, len, rbuf + j * ECC_MAX);
+			else
+				bch_decode(bch, buf + j * len, len, rbuf + j * ECC_MAX);
+		}
+		total += clock() - start;
+	}
+	mem_free(buf);
+	mem_free(rbuf);
+	return (double)loop * BENCH_BATCH * len / (1 << 20) /
+			((double)MAX(total, 1) / CLOCKS_PER_SEC);
+}
+
+
+/*
+ * codewords with 0 ~ t + 1 errors, up to t are corrected
+ *
+ * Returns failed decode number
+ */
+static int verify(struct bch *bch, unsigned char *data, unsigned char *buf, int len,
+					int loop, int *detect)
+{
+	int i, e, ret, fail = 0;
+	unsigned char ecc[ECC_MAX], rbuf[ECC_MAX];
+
+	srand(0);
+	*detect = 0;
+	for (i = 0; i < loop; i++) {
+		for (e = 0; e < len; e++)
+			data[e] = rand();
+		bch_encode(bch, data, len, ecc);
+		for (e = 0; e <= bch->t + 1; e++) {
+			memcpy(buf, data, len);
+			memcpy(rbuf, ecc, bch->ecc_bytes);
+			flip_bits(buf, len, rbuf, bch->ecc_bits, e);
+			ret = bch_decode(bch, buf, len, rbuf);
+			if (e > bch->t) {
+				/* beyond t errors may be miscorrected to another codeword */
+				*detect += ret < 0;
+				continue;
+			}
+			if (ret != e || memcmp(buf, data, len) || memcmp(rbuf, ecc, bch->ecc_bytes)) {
+				printf("loop %d: %d errors decode fail, ret %d\n", i, e, ret);
+				fail++;
+			}
+		}
+	}
+	return fail;
+}
+
+
+/*
+ * parity of the scalar table walk over lengths of every remainder mod 8,
+ * both decreasing by 7 bytes then by 1
+ *
+ * Returns mismatched length number
+ */
+static int verify_encode(struct bch *bch, unsigned char *data, int len, int type)
+{
+	int l, fail = 0;
+	unsigned char ecc[ECC_MAX], ref[ECC_MAX];
+
+	for (l = 0; l < len; l++)
+		data[l] = rand();
+	for (l = len; l > 0; l -= l > 24 ? 7 : 1) {
+		bch_select(bch, BCH_SCALAR);
+		bch_encode(bch, data, l, ref);
+		bch_select(bch, type);
+		bch_encode(bch, data, l, ecc);
+		if (memcmp(ecc, ref, bch->ecc_bytes)) {
+			printf("%s: parity of %d bytes mismatch\n", bch_name(bch), l);
+			fail++;
+		}
+	}
+	return fail;
+}
+
+
+/* every implementation supported by CPU is verified and benchmarked */
+int main(int argc, char *argv[])
+{
+	int type, len, t, loop, ret, fail = 0, detect;
+	unsigned char *data, *buf, ecc[ECC_MAX];
+	struct bch *bch;
+
+	if (argc != 4) {
+		printf("[Usage]: %s [data_bytes] [t] [loop]\n", argv[0]);
+		return 0;
+	}
+
+	len = atoi(argv[1]);
+	t = atoi(argv[2]);
+	loop = atoi(argv[3]);
+	bch = bch_create(len, t);
+	if (!bch) {
+		printf("create bch fail!\n");
+		return -1;
+	}
+	printf("m:%d t:%d data:%d parity:%d bits(%d bytes)\n",
+		bch->m, bch->t, len, bch->ecc_bits, bch->ecc_bytes);
+
+	data = mem_alloc(len);
+	buf = mem_alloc(len);
+	for (type = BCH_SCALAR; type < BCH_TYPE_NUM; type++) {
+		if (bch_select(bch, type))
+			continue;
+		ret = verify_encode(bch, data, len, type);
+		ret += verify(bch, data, buf, len, loop, &detect);
+		printf("%s: %d loops, %d fail, %d of %d beyond t detected\n",
+				bch_name(bch), loop, ret, detect, loop);
+		fail += ret;
+
+		bch_encode(bch, data, len, ecc);
+		printf("%s: encode %.1f MB/s, decode clean %.1f MB/s, decode %d errors %.1f MB/s\n",
+				bch_name(bch), bench(bch, data, len, ecc, -1), bench(bch, data, len, ecc, 0),
+				t, bench(bch, data, len, ecc, t));
+	}
+
+	mem_free(buf);
+	mem_free(data);
+	bch_delete(bch);
+	return fail ? -2 : 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include "common.h"
+#include "cache.h"
+
+#define THREAD_MAX		64
+
+struct worker {
+	pthread_t thread;
+	struct cache *cache;
+	unsigned int key_base; // first key owned by worker
+	unsigned int key_num;
+	unsigned int *hot; // resident keys to get
+	int op_num;
+	unsigned int seed;
+	int error;
+	int miss;
+};
+
+static int g_evict;
+
+static int evict_key(unsigned int key, void *buf, void *userdata)
+{
+	if (*(unsigned int *)buf != key)
+		(*(int *)userdata)++;
+	__atomic_add_fetch(&g_evict, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* hits of resident keys shared by threads, buffers carry their keys */
+static void *get_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int *buf, key;
+	int i;
+
+	for (i = 0; i < w->op_num; i++) {
+		key = w->hot[rand_r(&w->seed) % w->key_num];
+		buf = cache_get(w->cache, key);
+		if (!buf) {
+			w->miss++;
+			continue;
+		}
+		if (*buf != key)
+			w->error++;
+		cache_put(buf);
+	}
+	return NULL;
+}
+
+/* get or set of keys owned by worker, more keys than buffers */
+static void *set_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int *buf, key;
+	int i;
+
+	for (i = 0; i < w->op_num; i++) {
+		key = w->key_base + rand_r(&w->seed) % w->key_num;
+		buf = cache_get(w->cache, key);
+		if (!buf) {
+			w->miss++;
+			buf = cache_set(w->cache, key, evict_key, &w->error);
+			*buf = key;
+		}
+		if (*buf != key)
+			w->error++;
+		cache_put(buf);
+	}
+	return NULL;
+}
+
+/* Returns resident keys in [first, first + num), error counts wrong data */
+static int resident(struct cache *cache, unsigned int first, int num, int *error)
+{
+	int i, n = 0;
+	unsigned int *buf;
+
+	for (i = 0; i < num; i++) {
+		buf = cache_get(cache, first + i);
+		if (!buf)
+			continue;
+		if (*buf != first + i)
+			(*error)++;
+		cache_put(buf);
+		n++;
+	}
+	return n;
+}
+
+static double run(struct worker *w, int n, void *(*fn)(void *))
+{
+	int i;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; i++)
+		pthread_create(&w[i].thread, NULL, fn, &w[i]);
+	for (i = 0; i < n; i++)
+		pthread_join(w[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * sharded cache: single thread set, get, eviction and removal, then
+ * threads get and set their own keys through shared shards, then read
+ * hit throughput by 1, 2, 4 ... thread_max threads
+ */
+int main(int argc, char *argv[])
+{
+	int i, n, num, shard_num, thread_max, op_num, error = 0;
+	unsigned int *buf, *hot;
+	double sec, rate, base = 0;
+	struct cache *cache;
+	struct worker *w;
+
+	if (argc != 5) {
+		printf("[Usage]: %s [num] [shard_num] [thread_max] [op_num]\n", argv[0]);
+		return 0;
+	}
+
+	num = atoi(argv[1]);
+	shard_num = atoi(argv[2]);
+	thread_max = atoi(argv[3]);
+	op_num = atoi(argv[4]);
+	if (thread_max < 1 || thread_max > THREAD_MAX || num < 2 * thread_max) {
+		printf("thread_max 1 ~ %d, num no less than 2 * thread_max\n", THREAD_MAX);
+		return -1;
+	}
+	cache = cache_create(sizeof(unsigned int), num, shard_num);
+	if (!cache) {
+		printf("create cache fail!\n");
+		return -1;
+	}
+
+	/* shards fill unevenly, a key is either resident or evicted */
+	for (i = 0; i < num; i++) {
+		buf = cache_set(cache, i, evict_key, &error);
+		*buf = i;
+		cache_put(buf);
+	}
+	if (resident(cache, 0, num, &error) + g_evict != num) {
+		printf("[1]resident and evicted are not %d\n", num);
+		error++;
+	}
+	for (i = num; i < 2 * num; i++) {
+		buf = cache_set(cache, i, evict_key, &error);
+		*buf = i;
+		cache_put(buf);
+	}
+	n = resident(cache, 0, 2 * num, &error);
+	if (n > num || n + g_evict != 2 * num) {
+		printf("[2]resident %d evicted %d of %d\n", n, g_evict, 2 * num);
+		error++;
+	}
+	/* the last key is always resident */
+	i = 2 * num - 1;
+	if (cache_remove(cache, i) || cache_get(cache, i) || !cache_remove(cache, i)) {
+		printf("[3]error remove key %d\n", i);
+		error++;
+	}
+	cache_flush(cache, evict_key, &error);
+	if (g_evict != 2 * num - 1 || resident(cache, 0, 2 * num, &error)) {
+		printf("[4]error flush, evicted %d\n", g_evict);
+		error++;
+	}
+
+	w = mem_alloc(thread_max * sizeof(struct worker));
+	for (i = 0; i < thread_max; i++) {
+		w[i].cache = cache;
+		w[i].key_base = i * num;
+		w[i].key_num = num / thread_max * 2;
+		w[i].op_num = op_num / thread_max;
+		w[i].seed = i + 1;
+	}
+	sec = run(w, thread_max, set_thread);
+	for (i = 0; i < thread_max; i++)
+		error += w[i].error;
+	printf("%d threads get or set %d keys each: %.3f s\n", thread_max, w[0].key_num, sec);
+	cache_flush(cache, NULL, NULL);
+
+	/* a shard keeps its share of keys 0 ~ num - 1, no more is evicted */
+	for (i = 0; i < num; i++) {
+		buf = cache_set(cache, i, NULL, NULL);
+		*buf = i;
+		cache_put(buf);
+	}
+	hot = mem_alloc(num * sizeof(unsigned int));
+	for (i = 0, n = 0; i < num; i++) {
+		if (resident(cache, i, 1, &error))
+			hot[n++] = i;
+	}
+	for (i = 0; i < thread_max; i++) {
+		w[i].hot = hot;
+		w[i].key_num = n;
+	}
+	for (n = 1; n <= thread_max; n <<= 1) {
+		for (i = 0; i < n; i++) {
+			w[i].op_num = op_num / n;
+			w[i].error = w[i].miss = 0;
+		}
+		sec = run(w, n, get_thread);
+		rate = op_num / n * n / sec;
+		for (i = 0; i < n; i++)
+			error += w[i].error + w[i].miss;
+		if (n == 1)
+			base = rate;
+		printf("threads: %2d, hits/s: %.0f, speedup: %.2f\n", n, rate, rate / base);
+	}
+
+	cache_dump(cache, stdout);
+	printf("%s, error: %d\n", error ? "cache test fail" : "cache test pass", error);
+	mem_free(hot);
+	mem_free(w);
+	cache_delete(cache);
+	return error ? -1 : 0;
+}
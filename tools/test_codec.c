@@ -0,0 +1,109 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "arena.h"
+#include "file.h"
+#include "test_util.h"
+#include "brotli/encode.h"
+#include "brotli/decode.h"
+
+/*
+ * blocks are compressed and decompressed by one-shot brotli calls, then
+ * twice by data_compress and data_decompress of file, which reuse thread
+ * state and arena memory; the second pass makes no malloc call
+ */
+int main(int argc, char *argv[])
+{
+	int i, size, block_num, out_size, error = 0;
+	size_t comp_size, plain_size;
+	unsigned char *in, *comp, *out;
+	double start, enc[2] = {0}, dec[2] = {0};
+	struct arena_stat warm, s;
+
+	if (argc != 3) {
+		printf("[Usage]: %s [block_size] [block_num]\n", argv[0]);
+		printf("block_size in KB\n");
+		return 0;
+	}
+	size = atoi(argv[1]) << 10;
+	block_num = atoi(argv[2]);
+	if (size <= 0 || block_num < 1) {
+		printf("block_size at least 1, block_num at least 1\n");
+		return -1;
+	}
+
+	in = mem_alloc(size);
+	comp = mem_alloc(size);
+	out = mem_alloc(size);
+	for (i = 0; i < block_num; i++) {
+		fill_block(in, size, i, 2048, FALSE);
+		comp_size = size;
+		start = now_sec();
+		if (!BrotliEncoderCompress(BROTLI_DEFAULT_QUALITY, BROTLI_DEFAULT_WINDOW,
+				BROTLI_DEFAULT_MODE, size, in, &comp_size, comp)) {
+			error++;
+			continue;
+		}
+		enc[0] += now_sec() - start;
+		plain_size = size;
+		start = now_sec();
+		if (BrotliDecoderDecompress(comp_size, comp, &plain_size, out) !=
+			BROTLI_DECODER_RESULT_SUCCESS || plain_size != (size_t)size || memcmp(in, out, size))
+			error++;
+		dec[0] += now_sec() - start;
+	}
+	printf("one-shot: encode %.3f ms decode %.3f ms per block, error %d\n",
+			enc[0] * 1000 / block_num, dec[0] * 1000 / block_num, error);
+
+	/* first pass warms up free lists of all sizes brotli asks, second is timed */
+	for (i = 0; i < block_num * 2; i++) {
+		if (i == block_num) {
+			arena_get_stat(&warm);
+			enc[1] = dec[1] = 0;
+		}
+		fill_block(in, size, i % block_num, 2048, FALSE);
+		out_size = size;
+		start = now_sec();
+		data_compress((char *)in, size, (char *)comp, &out_size, COMPRESS_BROTLI);
+		enc[1] += now_sec() - start;
+		comp_size = out_size;
+		out_size = size;
+		start = now_sec();
+		data_decompress((char *)comp, comp_size, (char *)out, &out_size, COMPRESS_BROTLI);
+		dec[1] += now_sec() - start;
+		if (out_size != size || memcmp(in, out, size))
+			error++;
+	}
+	arena_get_stat(&s);
+	printf("reused: encode %.3f ms decode %.3f ms per block, ratio %.1f%%, error %d\n",
+			enc[1] * 1000 / block_num, dec[1] * 1000 / block_num,
+			100.0 * comp_size / size, error);
+	printf("arena: alloc %llu malloc in second pass %llu (%llu KB in all)\n",
+			s.alloc - warm.alloc, s.sys - warm.sys, s.sys_bytes >> 10);
+	if (s.sys != warm.sys)
+		error++;
+
+	mem_free(out);
+	mem_free(comp);
+	mem_free(in);
+	printf("%s\n", error ? "codec test fail" : "codec test pass");
+	return error ? -1 : 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#include "common.h"
+#include "nand.h"
+#include "nand_exec.h"
+#include "file.h"
+
+#define ROUND_JOB_NUM		1024 // jobs in flight, waited by round
+#define HOT_RATIO			90 // percent of reads to hot LUNs
+#define COMPRESS_RATIO		16 // a compression job of no LUN per reads
+#define LUN_BLOCK_NUM		2 // programmed blocks of a LUN, kept in block cache
+
+struct test_job {
+	struct exec_job job;
+	int seq; // submission order of LUN
+	int out_size;
+	unsigned int *data;
+	unsigned int *oob;
+};
+
+struct test_ctx {
+	struct nand_base *nand;
+	int *expect; // next seq of LUN
+	int *row; // programmed rows
+	int row_num;
+	int *erase_ok; // of block
+	unsigned char *pattern; // source of compression
+	int order_error;
+	int error;
+};
+
+static struct test_ctx g_ctx;
+
+/* callbacks of a LUN are serialized, of different LUNs run in parallel */
+static void check_order(struct test_job *t)
+{
+	int lun = nand_row_lun(g_ctx.nand, t->job.row);
+
+	if (t->seq != g_ctx.expect[lun]++)
+		__atomic_add_fetch(&g_ctx.order_error, 1, __ATOMIC_RELAXED);
+}
+
+static void erase_done(struct exec *exec, struct exec_job *job)
+{
+	struct test_job *t = container_of(job, struct test_job, job);
+	int page_num_per_block = g_ctx.nand->block_size / g_ctx.nand->page_size;
+
+	check_order(t);
+	g_ctx.erase_ok[job->row / page_num_per_block] = job->ret == FLASH_OK;
+}
+
+static void program_done(struct exec *exec, struct exec_job *job)
+{
+	struct test_job *t = container_of(job, struct test_job, job);
+	int page_num_per_block = g_ctx.nand->block_size / g_ctx.nand->page_size;
+
+	check_order(t);
+	if (job->ret == FLASH_OK && g_ctx.erase_ok[job->row / page_num_per_block])
+		g_ctx.row[__atomic_fetch_add(&g_ctx.row_num, 1, __ATOMIC_RELAXED)] = job->row;
+}
+
+static void read_done(struct exec *exec, struct exec_job *job)
+{
+	struct test_job *t = container_of(job, struct test_job, job);
+
+	check_order(t);
+	if (job->ret < FLASH_BITFLIP || t->data[0] != job->row || t->oob[0] != job->row)
+		__atomic_add_fetch(&g_ctx.error, 1, __ATOMIC_RELAXED);
+}
+
+static void compress_done(struct exec *exec, struct exec_job *job)
+{
+	struct test_job *t = container_of(job, struct test_job, job);
+
+	t->out_size = g_ctx.nand->page_size;
+	data_compress((char *)g_ctx.pattern, g_ctx.nand->page_size, (char *)t->data,
+				&t->out_size, COMPRESS_BROTLI);
+	if (t->out_size <= 0 || t->out_size > g_ctx.nand->page_size)
+		__atomic_add_fetch(&g_ctx.error, 1, __ATOMIC_RELAXED);
+}
+
+static void job_init(struct test_job *t, int op, int row, EXEC_CALLBACK cb)
+{
+	int lun = nand_row_lun(g_ctx.nand, row);
+
+	memset(&t->job, 0, sizeof(t->job));
+	t->job.op = op;
+	t->job.row = row;
+	t->job.data = t->data;
+	t->job.oob = t->oob;
+	t->job.cb = cb;
+	if (op == EXEC_CALL)
+		t->job.lun = EXEC_LUN_ANY;
+	else
+		t->seq = g_ctx.expect[g_ctx.nand->lun_num + lun]++;
+}
+
+/*
+ * skewed load through the executor by 1, 2, 4 ... worker_num workers:
+ * every good block is erased and programmed in LUN order, then reads go
+ * mostly to hot LUNs that all start on worker 0, with compression jobs of
+ * no LUN mixed in; other workers only help by stealing
+ */
+int main(int argc, char *argv[])
+{
+	int i, j, n, k, worker_max, job_num, hot_num, hot_row_num;
+	int page_num_per_block, block_num_per_lun;
+	int *hot_row;
+	unsigned int seed = 1;
+	double sec, rate, base = 0;
+	struct timespec start, end;
+	struct test_job *t;
+	struct exec *exec;
+	struct nand_base *nand;
+
+	if (argc != 5) {
+		printf("[Usage]: %s [nand_name] [worker_num] [job_num] [hot_lun]\n", argv[0]);
+		return 0;
+	}
+
+	worker_max = atoi(argv[2]);
+	job_num = atoi(argv[3]);
+	hot_num = atoi(argv[4]);
+	if (worker_max < 1 || worker_max > EXEC_WORKER_MAX || job_num < 1 || hot_num < 1) {
+		printf("worker_num 1 ~ %d, job_num and hot_lun no less than 1\n", EXEC_WORKER_MAX);
+		return -1;
+	}
+
+	nand = nand_init(COMMON, argv[1]);
+	if (!nand) {
+		printf("Nand init fail, please check the config file\n");
+		return -1;
+	}
+
+	g_ctx.nand = nand;
+	/* expect of LUNs, followed by submitted of LUNs */
+	g_ctx.expect = mem_alloc(2 * nand->lun_num * sizeof(int));
+	g_ctx.row = mem_alloc(nand->block_num * sizeof(int));
+	g_ctx.erase_ok = mem_alloc(nand->block_num * sizeof(int));
+	g_ctx.pattern = mem_alloc(nand->page_size);
+	for (i = 0; i < nand->page_size; i++)
+		g_ctx.pattern[i] = i % 251 < 64 ? 0 : i % 7;
+	t = mem_alloc(ROUND_JOB_NUM * sizeof(struct test_job));
+	for (i = 0; i < ROUND_JOB_NUM; i++) {
+		t[i].data = mem_alloc(nand->page_size);
+		t[i].oob = mem_alloc(nand->spare_size);
+	}
+
+	/*
+	 * first blocks of every LUN but block 0, erase and program of a block
+	 * are ordered by its LUN
+	 */
+	exec = exec_create(nand, worker_max, NULL);
+	page_num_per_block = nand->block_size / nand->page_size;
+	block_num_per_lun = nand->block_num / nand->lun_num;
+	for (i = 1, j = 0; i < nand->block_num; i++) {
+		if (i % block_num_per_lun >= LUN_BLOCK_NUM)
+			continue;
+		n = i * page_num_per_block;
+		job_init(&t[j], EXEC_ERASE, n, erase_done);
+		job_init(&t[j + 1], EXEC_PROGRAM, n, program_done);
+		t[j + 1].data[0] = t[j + 1].oob[0] = n;
+		j += 2;
+		if (j == ROUND_JOB_NUM) {
+			for (k = 0; k < j; k++)
+				exec_submit(exec, &t[k].job);
+			exec_wait(exec);
+			j = 0;
+		}
+	}
+	for (k = 0; k < j; k++)
+		exec_submit(exec, &t[k].job);
+	exec_delete(exec);
+	printf("lun: %d, programmed pages: %d\n", nand->lun_num, g_ctx.row_num);
+
+	/* hot LUNs 0, worker_max, 2 * worker_max ... have worker 0 as home */
+	hot_row = mem_alloc(nand->block_num * sizeof(int));
+	for (i = 0, hot_row_num = 0; i < g_ctx.row_num; i++) {
+		n = nand_row_lun(nand, g_ctx.row[i]);
+		if (n % worker_max == 0 && n / worker_max < hot_num)
+			hot_row[hot_row_num++] = g_ctx.row[i];
+	}
+	if (!hot_row_num) {
+		printf("no programmed page in hot LUNs\n");
+		g_ctx.error++;
+	}
+
+	for (n = 1; n <= worker_max && hot_row_num; n <<= 1) {
+		exec = exec_create(nand, n, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < job_num; i += ROUND_JOB_NUM) {
+			for (j = 0; j < ROUND_JOB_NUM && i + j < job_num; j++) {
+				if ((i + j) % COMPRESS_RATIO == COMPRESS_RATIO - 1)
+					job_init(&t[j], EXEC_CALL, 0, compress_done);
+				else if (rand_r(&seed) % 100 < HOT_RATIO)
+					job_init(&t[j], EXEC_READ, hot_row[rand_r(&seed) % hot_row_num],
+							read_done);
+				else
+					job_init(&t[j], EXEC_READ, g_ctx.row[rand_r(&seed) % g_ctx.row_num],
+							read_done);
+			}
+			for (k = 0; k < j; k++)
+				exec_submit(exec, &t[k].job);
+			exec_wait(exec);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		sec = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+		rate = job_num / sec;
+		if (n == 1)
+			base = rate;
+		printf("workers: %2d, jobs/s: %.0f, speedup: %.2f\n", n, rate, rate / base);
+		exec_dump(exec, stdout);
+		exec_delete(exec);
+	}
+
+	printf("%s, error: %d order error: %d\n",
+			g_ctx.error || g_ctx.order_error ? "exec test fail" : "exec test pass",
+			g_ctx.error, g_ctx.order_error);
+	for (i = 0; i < ROUND_JOB_NUM; i++) {
+		mem_free(t[i].oob);
+		mem_free(t[i].data);
+	}
+	mem_free(t);
+	mem_free(hot_row);
+	mem_free(g_ctx.pattern);
+	mem_free(g_ctx.erase_ok);
+	mem_free(g_ctx.row);
+	mem_free(g_ctx.expect);
+	nand_deinit(COMMON, nand);
+	return g_ctx.error || g_ctx.order_error ? -1 : 0;
+}
@@ -58,15 +58,20 @@ int main(int argc, char *argv[])
 		buf[0] = '0' + i;
 		printf("2\n");
 		file_write(test_file, i);
+		file_put(test_file, buf);
 	}
 	printf("3\n");
 	buf = NULL;
 	buf = file_write_cache(test_file, i);
 	memcpy(buf, data_pattern, len);
 	buf[0] = '0' + i;
+	file_put(test_file, buf);
 	printf("4\n");
 	buf = file_read(test_file, 0);
-	printf("buf[0]=%02x, buf[1]=%02x, buf[2]=%02x\n", buf[0], buf[1], buf[2]);
+	if (buf) {
+		printf("buf[0]=%02x, buf[1]=%02x, buf[2]=%02x\n", buf[0], buf[1], buf[2]);
+		file_put(test_file, buf);
+	}
 	printf("5\n");
 	file_flush(test_file);
 	file_delete(test_file);
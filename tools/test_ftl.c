@@ -0,0 +1,285 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "nand.h"
+#include "ftl.h"
+
+#define SCAN_THREAD_NUM		4
+#define TRIM_SECTOR_MAX		8
+#define VERSION_TRIMMED		0x80000000 // sector is trimmed after the version
+#define PRESSURE_OP_RATIO	10
+
+
+/* version goes on after a trim */
+static void write_version(unsigned int *version, unsigned int lba, unsigned int *data)
+{
+	version[lba] = (version[lba] & ~VERSION_TRIMMED) + 1;
+	data[0] = lba;
+	data[1] = version[lba];
+}
+
+
+static void trim_version(struct ftl *ftl, unsigned int *version, unsigned int lba, int num)
+{
+	int i;
+
+	ftl_trim(ftl, lba, num);
+	for (i = 0; i < num; i++) {
+		if (version[lba + i])
+			version[lba + i] |= VERSION_TRIMMED;
+	}
+}
+
+
+/* check the last version of sectors, trimmed ones read zero as unmapped */
+static int check_version(struct ftl *ftl, unsigned int *version, unsigned int *data)
+{
+	unsigned int lba;
+
+	for (lba = 0; lba < ftl->lba_num; lba++) {
+		data[0] = data[1] = 0xFFFFFFFF;
+		if (ftl_read(ftl, lba, 1, data)) {
+			printf("read fail at lba %u\n", lba);
+			continue;
+		}
+		if (version[lba] & VERSION_TRIMMED) {
+			if (data[0] || data[1]) {
+				printf("[Error]trimmed lba %u read %u:%u\n", lba, data[0], data[1]);
+				return -1;
+			}
+		} else if (version[lba] && (data[0] != lba || data[1] != version[lba])) {
+			printf("[Error]lba %u read %u:%u expect version %u\n", lba,
+					data[0], data[1], version[lba]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* storage of free blocks is released, no block file is left */
+static int check_free_file(struct ftl *ftl, const char *name)
+{
+	int block;
+	char path[NAND_NAME_MAX + 16];
+
+	for (block = 0; block < ftl->block_num; block++) {
+		if (ftl->block[block].state != BLOCK_FREE)
+			continue;
+		sprintf(path, "%s/%d", name, block);
+		if (!access(path, F_OK)) {
+			printf("[Error]free block %d keeps file %s\n", block, path);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/* sequential fill, then random overwrite with 80% of writes on 20% of sectors */
+static int overwrite(struct ftl *ftl, unsigned int *version, unsigned int *data,
+						unsigned long long write_num)
+{
+	int num;
+	unsigned int lba;
+	unsigned long long i;
+
+	for (i = 0; i < write_num; i++) {
+		if (i < ftl->lba_num)
+			lba = i;
+		else if (rand() % 100 < 80)
+			lba = rand() % (ftl->lba_num / 5);
+		else
+			lba = ftl->lba_num / 5 + rand() % (ftl->lba_num - ftl->lba_num / 5);
+		write_version(version, lba, data);
+		if (ftl_write(ftl, lba, 1, data)) {
+			printf("write fail at lba %u\n", lba);
+			return -1;
+		}
+		if (i % 64 == 0) {
+			lba = rand() % ftl->lba_num;
+			num = 1 + rand() % TRIM_SECTOR_MAX;
+			trim_version(ftl, version, lba, MIN(num, ftl->lba_num - lba));
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * sequential fill, then random overwrite with 80% of writes on 20% of sectors
+ * and a few short trims, check the last version of sectors, rewrite whole
+ * blocks in the upper half and trim the half, which frees those blocks, then
+ * check again after a crash, when mapping is rebuilt from spare area;
+ * at last demand-paged mapping runs short of free blocks: one cached
+ * translation page, little over-provisioning and every sector written twice
+ */
+int main(int argc, char *argv[])
+{
+	int i, num, op_ratio, policy, size, map_cache, stream_num, error = 0;
+	unsigned int lba, *version;
+	unsigned long long write_num, reclaim;
+	clock_t start;
+	unsigned int *data;
+	struct ftl *ftl;
+	struct nand_base *nand;
+
+	if (argc != 8) {
+		printf("[Usage]: %s [nand_name] [op_ratio] [write_num] [gc_policy] [wl_threshold] [map_cache] [stream_num]\n",
+				argv[0]);
+		printf("gc_policy: 0 greedy, 1 cost-benefit, 2 windowed\n");
+		printf("map_cache: cached translation pages, 0 for all mapping in memory\n");
+		printf("stream_num: open host write blocks by update frequency\n");
+		return 0;
+	}
+
+	nand = nand_init(COMMON, argv[1]);
+	if (!nand) {
+		printf("Nand init fail, please check the config file\n");
+		return -1;
+	}
+
+	op_ratio = atoi(argv[2]);
+	write_num = strtoull(argv[3], NULL, 0);
+	policy = atoi(argv[4]);
+	map_cache = atoi(argv[6]);
+	stream_num = atoi(argv[7]);
+	ftl = ftl_create(nand, op_ratio, map_cache, stream_num);
+	if (!ftl) {
+		printf("create ftl fail!\n");
+		nand_deinit(COMMON, nand);
+		return -2;
+	}
+	ftl_gc_policy(ftl, policy, 0);
+	ftl_wl_threshold(ftl, atoi(argv[5]));
+
+	size = nand->page_size;
+	data = mem_alloc(size);
+	version = mem_alloc(ftl->lba_num * sizeof(unsigned int));
+
+	srand(0);
+	start = clock();
+	if (overwrite(ftl, version, data, write_num) || check_version(ftl, version, data))
+		error++;
+
+	lba = ftl->lba_num / 2;
+	trim_version(ftl, version, lba, 1);
+	if (check_version(ftl, version, data))
+		error++;
+
+	/* a sequential run on one stream fills whole blocks with the upper half only */
+	num = MIN(3 * ftl->page_num_per_block, ftl->lba_num - lba);
+	for (i = 0; i < num; i++) {
+		write_version(version, lba + i, data);
+		if (ftl_write_stream(ftl, lba + i, 1, data, 0)) {
+			printf("write fail at lba %u\n", lba + i);
+			error++;
+			break;
+		}
+	}
+
+	/* upper half is trimmed, blocks holding only it are freed with their storage */
+	reclaim = ftl->stat.reclaim;
+	trim_version(ftl, version, lba, ftl->lba_num - lba);
+	printf("trim lba %u ~ %u reclaim: %llu blocks\n", lba, ftl->lba_num - 1,
+			ftl->stat.reclaim - reclaim);
+	if (ftl->stat.reclaim == reclaim || check_free_file(ftl, argv[1])) {
+		printf("[Error]trimmed blocks are not freed\n");
+		error++;
+	}
+	if (check_version(ftl, version, data)) {
+		printf("[Error]trim corrupts other sectors\n");
+		error++;
+	}
+
+	printf("host time: %.3f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+	ftl_dump(ftl, stdout);
+
+	/* trim is not kept in spare, an older version may come back at mount */
+	for (lba = 0; lba < ftl->lba_num; lba++) {
+		if (version[lba] & VERSION_TRIMMED)
+			version[lba] = 0;
+	}
+
+	/*
+	 * crash after a flush: nothing of ftl is kept, and nand is left without
+	 * deinit, so no page map is written; the reopened nand finds programmed
+	 * pages by scanning spare
+	 */
+	ftl_flush(ftl);
+	ftl_delete(ftl);
+	nand = nand_init(COMMON, argv[1]);
+	start = clock();
+	ftl = nand ? ftl_mount(nand, op_ratio, map_cache, stream_num, SCAN_THREAD_NUM) : NULL;
+	if (!ftl) {
+		printf("mount ftl fail!\n");
+		mem_free(version);
+		mem_free(data);
+		if (nand)
+			nand_deinit(COMMON, nand);
+		return -3;
+	}
+	printf("mount time: %.3f s scan: %llu pages simulated time: %llu us\n",
+			(double)(clock() - start) / CLOCKS_PER_SEC, ftl->stat.mount_page,
+			ftl->stat.mount_time / 1000);
+	if (!check_version(ftl, version, data))
+		printf("mapping rebuilt\n");
+	else
+		error++;
+
+	/* pages found by the scan are not programmed again */
+	for (i = 0; i < ftl->lba_num / 4; i++) {
+		lba = rand() % ftl->lba_num;
+		write_version(version, lba, data);
+		if (ftl_write(ftl, lba, 1, data)) {
+			printf("write fail at lba %u after mount\n", lba);
+			error++;
+			break;
+		}
+	}
+	if (check_version(ftl, version, data))
+		error++;
+
+	/* evicted translation pages need free blocks while GC runs short of them */
+	ftl_delete(ftl);
+	mem_free(version);
+	ftl = ftl_create(nand, PRESSURE_OP_RATIO, 1, 1);
+	if (!ftl) {
+		printf("create ftl fail!\n");
+		mem_free(data);
+		nand_deinit(COMMON, nand);
+		return -2;
+	}
+	version = mem_alloc(ftl->lba_num * sizeof(unsigned int));
+	if (overwrite(ftl, version, data, 2ULL * ftl->lba_num) ||
+		check_version(ftl, version, data)) {
+		printf("[Error]demand-paged mapping fails under pressure\n");
+		error++;
+	}
+	printf("pressure op: %d%% map cache: 1 gc: %llu map write: %llu waf: %.3f\n",
+			PRESSURE_OP_RATIO, ftl->stat.gc, ftl->stat.map_write, ftl_waf(ftl));
+
+	mem_free(version);
+	mem_free(data);
+	ftl_delete(ftl);
+	nand_deinit(COMMON, nand);
+	printf("%s, error: %d\n", error ? "ftl test fail" : "ftl test pass", error);
+	return error ? -1 : 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "ldpc.h"
+
+#define BENCH_BYTES		(16 << 20)
+#define BENCH_BATCH		64
+#define STEP_NUM		8
+#define WEAK_PERCENT	90 // flipped bits found near read threshold by soft read
+
+/* flip num random bits over data and parity, mark them and as many others weak */
+static void flip_bits(unsigned char *data, int len, unsigned char *parity, int parity_bytes,
+				unsigned char *weak, int num)
+{
+	int i, k, bits = (len + parity_bytes) * 8;
+
+	memset(weak, 0, len + parity_bytes);
+	for (i = 0; i < num; i++) {
+		k = rand() % bits;
+		if (k < len * 8)
+			data[k >> 3] ^= 0x80 >> (k & 7);
+		else
+			parity[(k - len * 8) >> 3] ^= 0x80 >> ((k - len * 8) & 7);
+		if (rand() % 100 < WEAK_PERCENT)
+			weak[k >> 3] |= 0x80 >> (k & 7);
+		k = rand() % bits;
+		weak[k >> 3] |= 0x80 >> (k & 7);
+	}
+}
+
+
+static double bench(struct ldpc *ldpc, unsigned char *data, int len, unsigned char *parity,
+				bool decode)
+{
+	int i, j, iter, loop = BENCH_BYTES / len / BENCH_BATCH;
+	unsigned char *buf, *pbuf;
+	clock_t start, total = 0;
+
+	buf = mem_alloc(BENCH_BATCH * len);
+	pbuf = mem_alloc(BENCH_BATCH * ldpc->parity_bytes);
+	for (i = 0; i < loop; i++) {
+		for (j = 0; j < BENCH_BATCH; j++) {
+			memcpy(buf + j * len, data, len);
+			memcpy(pbuf + j * ldpc->parity_bytes, parity, ldpc->parity_bytes);
+		}
+		start = clock();
+		for (j = 0; j < BENCH_BATCH; j++) {
+			if (decode)
+				ldpc_decode(ldpc, buf + j * len, len, pbuf + j * ldpc->parity_bytes,
+							NULL, &iter);
+			else
+				ldpc_encode(ldpc, buf + j * len, len, pbuf + j * ldpc->parity_bytes);
+		}
+		total += clock() - start;
+	}
+	mem_free(buf);
+	mem_free(pbuf);
+	return (double)loop * BENCH_BATCH * len / (1 << 20) /
+			((double)MAX(total, 1) / CLOCKS_PER_SEC);
+}
+
+
+/*
+ * sweep - decode loop codewords for each error count of the sweep
+ * @ldpc: ldpc codec
+ * @data: data of the clean codeword
+ * @len: data bytes
+ * @parity: parity of the clean codeword
+ * @loop: codewords for each error count
+ *
+ * Returns codewords decoded to another codeword
+ */
+static int sweep(struct ldpc *ldpc, unsigned char *data, int len, unsigned char *parity, int loop)
+{
+	int i, s, e, ret, soft, iter, step, fail, iter_sum, mismatch = 0;
+	int parity_bytes = ldpc->parity_bytes;
+	unsigned char *buf, *pbuf, *weak;
+	clock_t start;
+
+	buf = mem_alloc(len);
+	pbuf = mem_alloc(parity_bytes);
+	weak = mem_alloc(len + parity_bytes);
+	step = MAX((len + parity_bytes) * 8 / 50 / STEP_NUM, 1);
+	for (soft = 0; soft < 2; soft++) {
+		for (s = 1; s <= STEP_NUM; s++) {
+			e = s * step;
+			fail = iter_sum = 0;
+			start = clock();
+			for (i = 0; i < loop; i++) {
+				memcpy(buf, data, len);
+				memcpy(pbuf, parity, parity_bytes);
+				flip_bits(buf, len, pbuf, parity_bytes, weak, e);
+				ret = ldpc_decode(ldpc, buf, len, pbuf, soft ? weak : NULL, &iter);
+				iter_sum += iter;
+				if (ret < 0)
+					fail++;
+				else if (memcmp(buf, data, len) || memcmp(pbuf, parity, parity_bytes))
+					mismatch++;
+			}
+			printf("%s %4d bits: fail %d/%d avg iter %.2f %.1f MB/s\n", soft ? "soft" : "hard",
+				e, fail, loop, (double)iter_sum / loop, (double)loop * len / (1 << 20) /
+				((double)MAX(clock() - start, 1) / CLOCKS_PER_SEC));
+		}
+	}
+	mem_free(weak);
+	mem_free(pbuf);
+	mem_free(buf);
+	return mismatch;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int i, ret, iter, len, parity_bytes, loop, type, mismatch = 0;
+	unsigned char *data, *parity;
+	struct ldpc *ldpc;
+
+	if (argc != 5) {
+		printf("[Usage]: %s [data_bytes] [parity_bytes] [max_iter] [loop]\n", argv[0]);
+		return 0;
+	}
+
+	len = atoi(argv[1]);
+	parity_bytes = atoi(argv[2]);
+	loop = atoi(argv[4]);
+	ldpc = ldpc_create(len, parity_bytes, atoi(argv[3]));
+	if (!ldpc) {
+		printf("create ldpc fail!\n");
+		return -1;
+	}
+	printf("z:%d base:%dx%d data:%d parity:%d max_iter:%d\n", ldpc->z, ldpc->mb,
+		ldpc->kb + ldpc->mb, len, parity_bytes, ldpc->max_iter);
+
+	srand(0);
+	data = mem_alloc(len);
+	parity = mem_alloc(parity_bytes);
+	for (i = 0; i < len; i++)
+		data[i] = rand();
+	ldpc_encode(ldpc, data, len, parity);
+	ret = ldpc_decode(ldpc, data, len, parity, NULL, &iter);
+	printf("clean codeword: ret %d iter %d\n", ret, iter);
+
+	/* sweep error bits up to 2% of codeword, each implementation sees the same errors */
+	for (type = LDPC_SCALAR; type < LDPC_TYPE_NUM; type++) {
+		if (ldpc_select(ldpc, type))
+			continue;
+		printf("layer %s:\n", ldpc_name(ldpc));
+		srand(1);
+		mismatch += sweep(ldpc, data, len, parity, loop);
+	}
+	ldpc_select(ldpc, LDPC_AUTO);
+	/* beyond the code capability a few may converge to another codeword */
+	printf("miscorrected: %d\n", mismatch);
+
+	printf("encode: %.1f MB/s\n", bench(ldpc, data, len, parity, FALSE));
+	printf("decode clean: %.1f MB/s\n", bench(ldpc, data, len, parity, TRUE));
+
+	mem_free(parity);
+	mem_free(data);
+	ldpc_delete(ldpc);
+	return 0;
+}
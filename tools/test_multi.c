@@ -0,0 +1,151 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include "common.h"
+#include "nand.h"
+#include "test_util.h"
+
+#define DEV_MAX			256
+
+struct dev {
+	pthread_t thread;
+	int id;
+	char name[NAND_NAME_MAX];
+	int page_num;
+	int page; // pages programmed and read back
+	int error;
+};
+
+/* every device is driven by its own thread, data carries device and row */
+static void *dev_thread(void *arg)
+{
+	struct dev *dev = arg;
+	struct nand_base *nand;
+	unsigned int *data, *oob;
+	int row, page_num_per_block, i;
+
+	nand = nand_init(COMMON, dev->name);
+	if (!nand) {
+		dev->error++;
+		return NULL;
+	}
+	page_num_per_block = nand->block_size / nand->page_size;
+	data = mem_alloc(nand->page_size);
+	oob = mem_alloc(nand->spare_size);
+
+	/* skip block 0 */
+	for (row = page_num_per_block; dev->page < dev->page_num &&
+			row < nand->block_num * page_num_per_block; row++) {
+		if (row % page_num_per_block == 0 && nand_erase_block(nand, row) != FLASH_OK) {
+			row += page_num_per_block - 1;
+			continue;
+		}
+		for (i = 0; i < nand->page_size / 4; i++)
+			data[i] = dev->id ^ row ^ i;
+		oob[0] = row;
+		if (nand_write_page(nand, row, 0, data, oob) != FLASH_OK) {
+			dev->error++;
+			continue;
+		}
+		memset(data, 0, nand->page_size);
+		if (nand_read_page(nand, row, 0, data, oob) < FLASH_BITFLIP || oob[0] != row) {
+			dev->error++;
+			continue;
+		}
+		for (i = 0; i < nand->page_size / 4; i++) {
+			if (data[i] != (dev->id ^ row ^ i)) {
+				dev->error++;
+				break;
+			}
+		}
+		dev->page++;
+	}
+
+	mem_free(oob);
+	mem_free(data);
+	nand_deinit(COMMON, nand);
+	return NULL;
+}
+
+/*
+ * independent devices in one process: devices are created from copies of a
+ * nand info, each thread programs and reads its own device, then every
+ * device must have its own metadata and command trace
+ */
+int main(int argc, char *argv[])
+{
+	int i, dev_num, page_num, error = 0;
+	unsigned long long page = 0;
+	double sec;
+	char name[NAND_NAME_MAX + 32];
+	struct dev *dev;
+
+	if (argc != 4) {
+		printf("[Usage]: %s [nand_name] [dev_num] [page_num]\n", argv[0]);
+		printf("devices are [nand_name]_0 ~ [nand_name]_[dev_num - 1]\n");
+		return 0;
+	}
+
+	dev_num = atoi(argv[2]);
+	page_num = atoi(argv[3]);
+	if (dev_num < 1 || dev_num > DEV_MAX || strlen(argv[1]) + 5 >= NAND_NAME_MAX) {
+		printf("dev_num 1 ~ %d, nand_name shorter than %d\n", DEV_MAX, NAND_NAME_MAX - 5);
+		return -1;
+	}
+
+	dev = mem_alloc(dev_num * sizeof(struct dev));
+	for (i = 0; i < dev_num; i++) {
+		dev[i].id = i;
+		sprintf(dev[i].name, "%s_%d", argv[1], i);
+		dev[i].page_num = page_num;
+		if (copy_info(argv[1], dev[i].name)) {
+			printf("copy "NAND_INFO_FOLDER"/%s.ini fail\n", argv[1]);
+			mem_free(dev);
+			return -1;
+		}
+	}
+
+	sec = now_sec();
+	for (i = 0; i < dev_num; i++)
+		pthread_create(&dev[i].thread, NULL, dev_thread, &dev[i]);
+	for (i = 0; i < dev_num; i++)
+		pthread_join(dev[i].thread, NULL);
+	sec = now_sec() - sec;
+
+	for (i = 0; i < dev_num; i++) {
+		page += dev[i].page;
+		error += dev[i].error;
+		sprintf(name, "%s/page_map.bin", dev[i].name);
+		if (access(name, 0)) {
+			printf("%s is missing\n", name);
+			error++;
+		}
+		sprintf(name, NAND_TRACE_FILE_NAME, dev[i].name);
+		if (access(name, 0)) {
+			printf("%s is missing\n", name);
+			error++;
+		}
+	}
+	printf("%d devices, %llu pages in %.3f s, error: %d\n", dev_num, page, sec, error);
+	printf("%s\n", error ? "multi device test fail" : "multi device test pass");
+	mem_free(dev);
+	return error ? -1 : 0;
+}
@@ -20,6 +20,7 @@
 
 #include "common.h"
 #include "nand.h"
+#include "nand_ecc.h"
 
 /* need set common_nand.c
  *com_nand->block_file = file_create(name, (com_nand->base.page_size +
@@ -30,6 +31,212 @@
 
 static int g_first_row = -1;
 
+/* sequential block access with and without cache register */
+static void cache_test(struct nand_base *nand, int row)
+{
+	int i, ret, size, num;
+	unsigned long long clock;
+	struct nand_ops *ops, *page_ops;
+
+	size = nand->page_size + nand->spare_size;
+	num = nand->block_size / nand->page_size;
+	page_ops = nand_ops_alloc(2, size);
+	ops = nand_ops_alloc(num * 2, num * size);
+
+	/* page program */
+	nand_erase_block(nand, row);
+	clock = nand->clock;
+	page_ops->cmdq[0].cmd = CMD_PROGRAM_1ST;
+	page_ops->cmdq[1].cmd = CMD_PROGRAM_2ND;
+	for (i = 0; i < num; i++) {
+		memset(page_ops->buffer, i, size);
+		page_ops->cmdq[1].row = row + i;
+		nand_cmd(nand, page_ops);
+	}
+	printf("page program: %llu us\n", (nand->clock - clock) / 1000);
+
+	/* page read */
+	clock = nand->clock;
+	page_ops->cmdq[0].cmd = CMD_READ_1ST;
+	page_ops->cmdq[1].cmd = CMD_READ_2ND;
+	for (i = 0; i < num; i++) {
+		page_ops->cmdq[1].row = row + i;
+		nand_cmd(nand, page_ops);
+	}
+	printf("page read: %llu us\n", (nand->clock - clock) / 1000);
+
+	/* cache program: 80h-15h ... 80h-10h */
+	nand_erase_block(nand, row);
+	clock = nand->clock;
+	for (i = 0; i < num; i++) {
+		memset((char *)ops->buffer + i * size, i, size);
+		ops->cmdq[i * 2].cmd = CMD_PROGRAM_1ST;
+		ops->cmdq[i * 2 + 1].cmd = (i == num - 1) ? CMD_PROGRAM_2ND : CMD_CACHE_PROGRAM_2ND;
+		ops->cmdq[i * 2 + 1].row = row + i;
+	}
+	ret = nand_cmd(nand, ops);
+	printf("cache program: %llu us ret %d\n", (nand->clock - clock) / 1000, ret);
+
+	/* cache read: 00h-30h 31h ... 3Fh */
+	clock = nand->clock;
+	memset(ops->buffer, 0, num * size);
+	ops->cmd_num = num + 2;
+	ops->cmdq[0].cmd = CMD_READ_1ST;
+	ops->cmdq[1].cmd = CMD_READ_2ND;
+	ops->cmdq[1].row = row;
+	for (i = 2; i < num + 1; i++)
+		ops->cmdq[i].cmd = CMD_READ_CACHE_SEQ;
+	ops->cmdq[num + 1].cmd = CMD_READ_CACHE_END;
+	ret = nand_cmd(nand, ops);
+	printf("cache read: %llu us ret %d\n", (nand->clock - clock) / 1000, ret);
+	for (i = 0; i < num; i++) {
+		if (((unsigned char *)ops->buffer)[i * size] != (i & 0xFF) ||
+			((unsigned char *)ops->buffer)[i * size + size - 1] != (i & 0xFF)) {
+			printf("[Error cache]read != write %d\n", row + i);
+			break;
+		}
+	}
+
+	/* copyback every page to next block, inject data to the last page */
+	nand_erase_block(nand, row + num);
+	memset(page_ops->buffer, 0x5A, size);
+	for (i = 0; i < num; i++) {
+		ret = nand_copyback_page(nand, row + i, row + num + i, nand->page_size,
+								(i == num - 1) ? page_ops->buffer : NULL);
+		if (ret) {
+			printf("copyback fail at %d\n", row + i);
+			break;
+		}
+	}
+	page_ops->cmdq[0].cmd = CMD_READ_1ST;
+	page_ops->cmdq[1].cmd = CMD_READ_2ND;
+	for (i = 0; i < num; i++) {
+		page_ops->cmdq[1].row = row + num + i;
+		nand_cmd(nand, page_ops);
+		if (((unsigned char *)page_ops->buffer)[0] != (i & 0xFF) ||
+			((unsigned char *)page_ops->buffer)[size - 1] !=
+			((i == num - 1) ? 0x5A : (i & 0xFF))) {
+			printf("[Error copyback]read != write %d\n", row + num + i);
+			break;
+		}
+	}
+
+	/* 31h without 30h must fail */
+	ops->cmd_num = 1;
+	ops->cmdq[0].cmd = CMD_READ_CACHE_SEQ;
+	ret = nand_cmd(nand, ops);
+	printf("invalid cache read ret %d\n", ret);
+
+	nand_ops_free(ops);
+	nand_ops_free(page_ops);
+}
+
+/* program order and pseudo-SLC block */
+static void cell_test(struct nand_base *nand, int row)
+{
+	int i, ret, num;
+	unsigned long long clock;
+	char *data, *oob;
+
+	num = nand->block_size / nand->page_size;
+	data = mem_alloc(nand->page_size);
+	oob = mem_alloc(nand->spare_size);
+
+	nand_erase_block(nand, row);
+	ret = nand_write_page(nand, row + 1, 0, data, oob);
+	printf("cell type %d out of order program ret %d\n", nand->cell_type, ret);
+
+	nand_slc_mode(nand, true);
+	nand_erase_block(nand, row);
+	nand_slc_mode(nand, false);
+	clock = nand->clock;
+	for (i = 0; i < num / nand->cell_type; i++)
+		nand_write_page(nand, row + i, 0, data, oob);
+	printf("SLC mode program %d pages: %llu us\n", i, (nand->clock - clock) / 1000);
+	if (i < num) {
+		ret = nand_write_page(nand, row + i, 0, data, oob);
+		printf("SLC mode program out of range ret %d\n", ret);
+	}
+
+	nand_erase_block(nand, row);
+	clock = nand->clock;
+	for (i = 0; i < num / nand->cell_type; i++)
+		nand_write_page(nand, row + i, 0, data, oob);
+	printf("native program %d pages: %llu us\n", i, (nand->clock - clock) / 1000);
+	mem_free(data);
+	mem_free(oob);
+}
+
+/* read a page at every read retry level until the level is rejected */
+static void retry_test(struct nand_base *nand, int row)
+{
+	int ret, level;
+	char *data, *oob;
+	unsigned char param[NAND_FEATURE_PARAM_NUM] = {0};
+
+	data = mem_alloc(nand->page_size);
+	oob = mem_alloc(nand->spare_size);
+	for (level = 0; ; level++) {
+		param[0] = level;
+		if (nand_set_feature(nand, -1, NAND_FEATURE_READ_RETRY, param))
+			break;
+		ret = nand_read_page(nand, row, 0, data, oob);
+		printf("retry level %d read ret %d\n", level, ret);
+	}
+	param[0] = 0;
+	nand_set_feature(nand, nand->lun_num - 1, NAND_FEATURE_READ_RETRY, param);
+	param[0] = 0xFF;
+	ret = nand_get_feature(nand, nand->lun_num - 1, NAND_FEATURE_READ_RETRY, param);
+	printf("lun %d retry level %d ret %d\n", nand->lun_num - 1, param[0], ret);
+	nand_set_feature(nand, -1, NAND_FEATURE_READ_RETRY, param);
+	nand_dump(nand, stdout);
+	mem_free(data);
+	mem_free(oob);
+}
+
+/* parity in spare, random bit flips over page and spare are corrected */
+static void ecc_test(struct nand_base *nand, int row, int type, int strength)
+{
+	int i, ret, err, step, size;
+	unsigned long long clock;
+	unsigned char *buf, *rb_buf;
+
+	if (nand_ecc_enable(nand, type, MIN(1024, nand->page_size), strength)) {
+		printf("spare can't hold parity\n");
+		return;
+	}
+	size = nand->page_size + nand->spare_size;
+	buf = mem_alloc(size);
+	rb_buf = mem_alloc(size);
+	for (i = 0; i < nand->page_size; i++)
+		buf[i] = rand();
+	memset(buf + nand->page_size, 0xA5, nand->spare_size);
+
+	nand_erase_block(nand, row);
+	ret = nand_write_page(nand, row, 0, buf, buf + nand->page_size);
+	ret |= nand_read_page(nand, row, 0, rb_buf, rb_buf + nand->page_size);
+	printf("ecc page read ret %d, data %s\n", ret,
+		memcmp(buf, rb_buf, nand->page_size) ? "mismatch" : "match");
+	ret = nand_read_page(nand, row + 1, 0, rb_buf, rb_buf + nand->page_size);
+	printf("ecc erased page read ret %d\n", ret);
+
+	/* spare is overwritten by parity from the free spare on, pad bits of parity are not corrected */
+	nand_ecc_encode(nand, row, buf);
+	step = MAX(size * 8 / 1000, 1);
+	for (err = 0; err <= step * 8; err += step) {
+		memcpy(rb_buf, buf, size);
+		clock = nand->clock;
+		ret = nand_ecc_correct(nand, row, rb_buf, err);
+		printf("ecc %d bitflips: ret %d, %llu ns, data %s\n", err, ret, nand->clock - clock,
+			ret < 0 ? "uncorrectable" : memcmp(buf, rb_buf, nand->page_size +
+			nand->ecc->free_size) ? "mismatch" : "match");
+	}
+	nand_dump(nand, stdout);
+	nand_ecc_disable(nand);
+	mem_free(buf);
+	mem_free(rb_buf);
+}
+
 int main(int argc, char *argv[])
 {
 	int ret, i, j, row;
@@ -140,6 +347,18 @@ int main(int argc, char *argv[])
 			break;
 		}
 	}
+	printf("\ncache register test:\n");
+	cache_test(nand, (g_first_row + page_num_per_block) % ((nand->block_num - 1) * page_num_per_block));
+	printf("\ncell type test:\n");
+	cell_test(nand, (g_first_row + page_num_per_block) % ((nand->block_num - 1) * page_num_per_block));
+	printf("\nread retry test:\n");
+	retry_test(nand, g_first_row);
+	printf("\nBCH test:\n");
+	ecc_test(nand, g_first_row, NAND_ECC_BCH, nand->ecc_required / 4);
+	printf("\nLDPC test:\n");
+	ecc_test(nand, g_first_row, NAND_ECC_LDPC, nand->spare_size / (nand->page_size / 1024) * 3 / 4 & ~7);
+	printf("\nLDPC soft decision test:\n");
+	ecc_test(nand, g_first_row, NAND_ECC_LDPC_SOFT, nand->spare_size / (nand->page_size / 1024) * 3 / 4 & ~7);
 	printf("=====End Test=====\n");
 	mem_free(data);
 	mem_free(oob);
@@ -0,0 +1,307 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "common.h"
+#include "nand.h"
+#include "ftl.h"
+#include "nbd.h"
+
+#define OP_RATIO		10
+#define QUEUE_DEPTH		16 // in flight requests of client, one per region
+#define SECTOR_SIZE		512
+#define SECTOR_MAX		128 // sectors of a request
+
+struct slot {
+	unsigned long long base; // region of slot, no overlap with others
+	unsigned long long offset;
+	unsigned int length;
+	unsigned short type;
+	unsigned char *buf;
+};
+
+static struct nbd *g_nbd;
+static unsigned long long g_size;
+static unsigned char *g_shadow; // expected content
+static struct slot g_slot[QUEUE_DEPTH];
+
+static void put_be(unsigned char *p, unsigned long long v, int bytes)
+{
+	while (bytes--) {
+		p[bytes] = v;
+		v >>= 8;
+	}
+}
+
+static unsigned long long get_be(const unsigned char *p, int bytes)
+{
+	unsigned long long v = 0;
+
+	while (bytes--)
+		v = (v << 8) | *p++;
+	return v;
+}
+
+static int xfer(int fd, void *buf, unsigned int len, bool out)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = out ? send(fd, p, len, MSG_NOSIGNAL) : recv(fd, p, len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void *serve_thread(void *arg)
+{
+	return (void *)(long)nbd_serve(g_nbd);
+}
+
+/* fixed newstyle with NBD_OPT_GO, returns export size */
+static long long handshake(int fd)
+{
+	unsigned char buf[64];
+	unsigned int type, len;
+	long long size = -1;
+
+	if (xfer(fd, buf, 18, FALSE) || get_be(buf, 8) != 0x4e42444d41474943ULL)
+		return -1;
+	put_be(buf, 3, 4); // fixed newstyle, no zeroes
+	put_be(buf + 4, 0x49484156454f5054ULL, 8);
+	put_be(buf + 12, 7, 4); // NBD_OPT_GO
+	put_be(buf + 16, 6, 4);
+	memset(buf + 20, 0, 6); // default export, no info request
+	if (xfer(fd, buf, 26, TRUE))
+		return -1;
+
+	while (1) {
+		if (xfer(fd, buf, 20, FALSE))
+			return -1;
+		type = get_be(buf + 12, 4);
+		len = get_be(buf + 16, 4);
+		if (len > sizeof(buf) || xfer(fd, buf, len, FALSE))
+			return -1;
+		if (type == 1) // NBD_REP_ACK
+			return size;
+		if (type != 3) // NBD_REP_INFO
+			return -1;
+		if (get_be(buf, 2) == 0) // NBD_INFO_EXPORT
+			size = get_be(buf + 2, 8);
+	}
+}
+
+static int send_req(int fd, int i, unsigned short type, unsigned short flags,
+					unsigned long long offset, unsigned int length, void *data)
+{
+	unsigned char hdr[28];
+
+	put_be(hdr, 0x25609513, 4);
+	put_be(hdr + 4, flags, 2);
+	put_be(hdr + 6, type, 2);
+	put_be(hdr + 8, i, 8);
+	put_be(hdr + 16, offset, 8);
+	put_be(hdr + 24, length, 4);
+	if (xfer(fd, hdr, sizeof(hdr), TRUE))
+		return -1;
+	return type == NBD_CMD_WRITE ? xfer(fd, data, length, TRUE) : 0;
+}
+
+/* random request in region of slot, shadow is updated when sent */
+static int issue(int fd, int i, unsigned long long region)
+{
+	struct slot *s = &g_slot[i];
+	unsigned long long first, end;
+	int r = rand() % 100, j;
+	unsigned short flags = 0;
+
+	s->offset = s->base + (unsigned long long)(rand() % (region / SECTOR_SIZE)) * SECTOR_SIZE;
+	s->length = (1 + rand() % SECTOR_MAX) * SECTOR_SIZE;
+	s->length = MIN(s->length, s->base + region - s->offset);
+	if (r < 50) {
+		s->type = NBD_CMD_WRITE;
+		/* a few writes ask to be durable before reply */
+		if (r < 5)
+			flags = NBD_CMD_FLAG_FUA;
+		for (j = 0; j < s->length; j++)
+			s->buf[j] = rand();
+		memcpy(g_shadow + s->offset, s->buf, s->length);
+	} else if (r < 90) {
+		s->type = NBD_CMD_READ;
+	} else if (r < 97) {
+		s->type = NBD_CMD_TRIM;
+		first = (s->offset + g_nbd->page_size - 1) / g_nbd->page_size * g_nbd->page_size;
+		end = (s->offset + s->length) / g_nbd->page_size * g_nbd->page_size;
+		if (end > first)
+			memset(g_shadow + first, 0, end - first);
+	} else {
+		s->type = NBD_CMD_FLUSH;
+		s->offset = 0;
+		s->length = 0;
+	}
+	return send_req(fd, i, s->type, flags, s->offset, s->length, s->buf);
+}
+
+static int run_client(const char *path, unsigned long long req_num)
+{
+	struct sockaddr_un addr;
+	struct timespec start, end;
+	unsigned char hdr[16];
+	unsigned long long region, sent = 0, done = 0, bytes = 0;
+	double time;
+	struct slot *s;
+	int fd, i, ret = -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("connect %s fail\n", path);
+		return -1;
+	}
+	if (handshake(fd) != g_size) {
+		printf("handshake fail\n");
+		goto out;
+	}
+
+	region = g_size / QUEUE_DEPTH / g_nbd->page_size * g_nbd->page_size;
+	g_shadow = mem_alloc(g_size);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < QUEUE_DEPTH; i++) {
+		g_slot[i].base = region * i;
+		g_slot[i].buf = mem_alloc(SECTOR_MAX * SECTOR_SIZE);
+		if (sent < req_num && !issue(fd, i, region))
+			sent++;
+	}
+
+	while (done < sent) {
+		if (xfer(fd, hdr, sizeof(hdr), FALSE) || get_be(hdr, 4) != 0x67446698) {
+			printf("receive reply fail\n");
+			goto out;
+		}
+		i = get_be(hdr + 8, 8);
+		s = &g_slot[i];
+		if (get_be(hdr + 4, 4)) {
+			printf("request %d at %llu error %llu\n", s->type, s->offset, get_be(hdr + 4, 4));
+			goto out;
+		}
+		if (s->type == NBD_CMD_READ) {
+			if (xfer(fd, s->buf, s->length, FALSE))
+				goto out;
+			if (memcmp(s->buf, g_shadow + s->offset, s->length)) {
+				printf("data mismatch at %llu length %u\n", s->offset, s->length);
+				goto out;
+			}
+		}
+		if (s->type == NBD_CMD_READ || s->type == NBD_CMD_WRITE)
+			bytes += s->length;
+		done++;
+		if (sent < req_num) {
+			if (issue(fd, i, region))
+				goto out;
+			sent++;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	time = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%llu requests in %.3f s, %.0f IOPS, %.2f MB/s\n", done, time,
+			done / time, bytes / time / (1 << 20));
+	ret = send_req(fd, 0, NBD_CMD_DISC, 0, 0, 0, NULL);
+
+out:
+	for (i = 0; i < QUEUE_DEPTH; i++)
+		mem_free(g_slot[i].buf);
+	mem_free(g_shadow);
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct nand_base *nand;
+	struct ftl *ftl;
+	pthread_t thread;
+	unsigned long long req_num;
+	void *serve_ret;
+	int ret;
+
+	if (argc != 4) {
+		printf("[Usage]: %s [nand_name] [socket_path] [request_num]\n", argv[0]);
+		printf("request_num 0 serves one external client, e.g.\n");
+		printf("\tnbd-client -unix [socket_path] /dev/nbd0 -b [page_size]\n");
+		return 0;
+	}
+
+	nand = nand_init(COMMON, argv[1]);
+	if (!nand) {
+		printf("Nand init fail, please check the config file\n");
+		return -1;
+	}
+	ftl = ftl_create(nand, OP_RATIO, 0, 1);
+	if (!ftl) {
+		printf("create ftl fail!\n");
+		nand_deinit(COMMON, nand);
+		return -2;
+	}
+	g_nbd = nbd_create(ftl, argv[2]);
+	if (!g_nbd) {
+		printf("create nbd server on %s fail!\n", argv[2]);
+		ftl_delete(ftl);
+		nand_deinit(COMMON, nand);
+		return -3;
+	}
+	g_size = g_nbd->size;
+
+	req_num = strtoull(argv[3], NULL, 0);
+	if (!req_num) {
+		printf("serving %llu bytes on %s\n", g_size, argv[2]);
+		ret = nbd_serve(g_nbd);
+	} else {
+		srand(0);
+		pthread_create(&thread, NULL, serve_thread, NULL);
+		ret = run_client(argv[2], req_num);
+		pthread_join(thread, &serve_ret);
+		ret = ret ? ret : (int)(long)serve_ret;
+		/* flush and FUA writes of a batch share one flush of the FTL */
+		if (!ret && (!g_nbd->stat.fua || ftl->stat.flush != g_nbd->stat.flush ||
+				!g_nbd->stat.flush || g_nbd->stat.flush >
+				g_nbd->stat.cmd[NBD_CMD_FLUSH] + g_nbd->stat.fua))
+			ret = -1;
+	}
+
+	printf("%s\n", ret ? "nbd test fail" : "nbd test pass");
+	nbd_dump(g_nbd, stdout);
+	ftl_dump(ftl, stdout);
+	nbd_delete(g_nbd);
+	ftl_delete(ftl);
+	nand_deinit(COMMON, nand);
+	return ret;
+}
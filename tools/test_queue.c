@@ -0,0 +1,301 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "nand.h"
+#include "nand_queue.h"
+
+#define QUEUE_SIZE			4096
+#define PRODUCER_MAX		64
+
+struct producer {
+	pthread_t thread;
+	int block; // programmed block, 0 for none
+	int cmd_num;
+	int batch;
+	unsigned long long seq; // next NOP of this producer expected by consumer
+	unsigned long long order_error;
+	unsigned long long nsec; // CPU time of submission
+	int erase_ok;
+	int error;
+	unsigned char *program_ok; // of page
+	unsigned int *data;
+	unsigned int *oob;
+};
+
+static struct nand_queue *g_queue;
+static struct nand_base *g_nand;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct queue_cmd g_list[QUEUE_SIZE]; // submission under mutex, for comparison
+static unsigned long long g_list_tail;
+
+static unsigned long long thread_nsec(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* commands of a producer run in its submission order */
+static void nop_done(struct nand_queue *queue, struct queue_cmd *cmd)
+{
+	struct producer *p = cmd->userdata;
+
+	if ((unsigned long long)cmd->row != p->seq++)
+		p->order_error++;
+}
+
+static void *nop_thread(void *arg)
+{
+	struct producer *p = arg;
+	struct queue_cmd *cmd;
+	unsigned long long pos, start;
+	int i, j, n;
+
+	start = thread_nsec();
+	for (i = 0; i < p->cmd_num; i += n) {
+		n = MIN(p->batch, p->cmd_num - i);
+		pos = nand_queue_reserve(g_queue, n);
+		for (j = 0; j < n; j++) {
+			cmd = nand_queue_cmd(g_queue, pos + j);
+			cmd->op = QUEUE_NOP;
+			cmd->row = i + j;
+			cmd->cb = nop_done;
+			cmd->userdata = p;
+		}
+		nand_queue_commit(g_queue, pos, n);
+		nand_queue_doorbell(g_queue);
+	}
+	p->nsec = thread_nsec() - start;
+	return NULL;
+}
+
+/* the same commands copied to a list under one mutex, nothing runs them */
+static void *mutex_thread(void *arg)
+{
+	struct producer *p = arg;
+	struct queue_cmd *cmd;
+	unsigned long long start;
+	int i;
+
+	start = thread_nsec();
+	for (i = 0; i < p->cmd_num; i++) {
+		pthread_mutex_lock(&g_lock);
+		cmd = &g_list[g_list_tail++ % QUEUE_SIZE];
+		cmd->op = QUEUE_NOP;
+		cmd->row = i;
+		cmd->cb = nop_done;
+		cmd->userdata = p;
+		pthread_mutex_unlock(&g_lock);
+	}
+	p->nsec = thread_nsec() - start;
+	return NULL;
+}
+
+static void erase_done(struct nand_queue *queue, struct queue_cmd *cmd)
+{
+	struct producer *p = cmd->userdata;
+
+	p->erase_ok = cmd->ret == FLASH_OK;
+}
+
+static void program_done(struct nand_queue *queue, struct queue_cmd *cmd)
+{
+	struct producer *p = cmd->userdata;
+	int page_num_per_block = g_nand->block_size / g_nand->page_size;
+
+	p->program_ok[cmd->row % page_num_per_block] = p->erase_ok && cmd->ret == FLASH_OK;
+}
+
+static void read_done(struct nand_queue *queue, struct queue_cmd *cmd)
+{
+	struct producer *p = cmd->userdata;
+	unsigned int *data = cmd->data, *oob = cmd->oob;
+
+	if (cmd->ret < FLASH_BITFLIP || data[0] != (unsigned int)cmd->row ||
+		data[g_nand->page_size / 4 - 1] != (unsigned int)cmd->row || oob[0] != (unsigned int)cmd->row)
+		p->error++;
+}
+
+/* erase and program a block in one batch, read it back in another */
+static void *nand_thread(void *arg)
+{
+	struct producer *p = arg;
+	struct queue_cmd *cmd;
+	unsigned long long pos;
+	int i, row, n, page_num_per_block = g_nand->block_size / g_nand->page_size;
+	int word_num = g_nand->page_size / 4, oob_num = g_nand->spare_size / 4;
+	unsigned long long start = thread_nsec();
+
+	row = p->block * page_num_per_block;
+	pos = nand_queue_reserve(g_queue, page_num_per_block + 1);
+	cmd = nand_queue_cmd(g_queue, pos);
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->op = QUEUE_ERASE;
+	cmd->row = row;
+	cmd->cb = erase_done;
+	cmd->userdata = p;
+	for (i = 0; i < page_num_per_block; i++) {
+		p->data[i * word_num] = p->data[(i + 1) * word_num - 1] = row + i;
+		p->oob[i * oob_num] = row + i;
+		cmd = nand_queue_cmd(g_queue, pos + i + 1);
+		cmd->op = QUEUE_PROGRAM;
+		cmd->row = row + i;
+		cmd->col = 0;
+		cmd->data = p->data + i * word_num;
+		cmd->oob = p->oob + i * oob_num;
+		cmd->cb = program_done;
+		cmd->userdata = p;
+	}
+	nand_queue_commit(g_queue, pos, page_num_per_block + 1);
+	nand_queue_wait(g_queue);
+	if (!p->erase_ok)
+		goto out;
+
+	memset(p->data, 0, page_num_per_block * g_nand->page_size);
+	memset(p->oob, 0, page_num_per_block * g_nand->spare_size);
+	for (i = n = 0; i < page_num_per_block; i++)
+		n += p->program_ok[i];
+	if (!n)
+		goto out;
+	pos = nand_queue_reserve(g_queue, n);
+	for (i = 0; i < page_num_per_block; i++) {
+		if (!p->program_ok[i])
+			continue;
+		cmd = nand_queue_cmd(g_queue, pos++);
+		cmd->op = QUEUE_READ;
+		cmd->row = row + i;
+		cmd->col = 0;
+		cmd->data = p->data + i * word_num;
+		cmd->oob = p->oob + i * oob_num;
+		cmd->cb = read_done;
+		cmd->userdata = p;
+	}
+	nand_queue_commit(g_queue, pos - n, n);
+	nand_queue_wait(g_queue);
+out:
+	p->nsec = thread_nsec() - start;
+	return NULL;
+}
+
+static void run(struct producer *p, int producer_num, void *(*fn)(void *), const char *name)
+{
+	int i;
+	unsigned long long nsec = 0, num = 0;
+
+	/* idle consumer goes to sleep, the first doorbell has to wake it */
+	usleep(10000);
+	for (i = 0; i < producer_num; i++) {
+		p[i].seq = 0;
+		pthread_create(&p[i].thread, NULL, fn, &p[i]);
+	}
+	for (i = 0; i < producer_num; i++) {
+		pthread_join(p[i].thread, NULL);
+		nsec += p[i].nsec;
+		num += p[i].cmd_num;
+	}
+	if (fn == nop_thread)
+		nand_queue_wait(g_queue);
+	printf("%s: %d producers, %.1f ns per command\n", name, producer_num, (double)nsec / num);
+}
+
+/*
+ * producers submit NOP commands through the ring in batches, their CPU
+ * time per command is submission overhead, compared to a list under one
+ * mutex; then every producer erases, programs and reads back a block
+ * through the same queue
+ */
+int main(int argc, char *argv[])
+{
+	int i, producer_num, cmd_num, batch, nand_num, page_num_per_block;
+	int order_error = 0, error = 0, done = 0;
+	struct producer *p;
+
+	if (argc != 5) {
+		printf("[Usage]: %s [nand_name] [producer_num] [cmd_num] [batch]\n", argv[0]);
+		printf("cmd_num of every producer, batch commands per reserve and doorbell\n");
+		return 0;
+	}
+
+	producer_num = atoi(argv[2]);
+	cmd_num = atoi(argv[3]);
+	batch = atoi(argv[4]);
+	if (producer_num < 1 || producer_num > PRODUCER_MAX || cmd_num < 1 || batch < 1 ||
+		batch > QUEUE_SIZE) {
+		printf("producer_num 1 ~ %d, batch 1 ~ %d\n", PRODUCER_MAX, QUEUE_SIZE);
+		return -1;
+	}
+
+	g_nand = nand_init(COMMON, argv[1]);
+	if (!g_nand) {
+		printf("init nand fail\n");
+		return -1;
+	}
+	g_queue = nand_queue_create(g_nand, QUEUE_SIZE);
+	page_num_per_block = g_nand->block_size / g_nand->page_size;
+	p = mem_alloc(producer_num * sizeof(struct producer));
+	for (i = 0; i < producer_num; i++) {
+		p[i].cmd_num = cmd_num;
+		p[i].batch = batch;
+	}
+
+	run(p, producer_num, mutex_thread, "mutex list");
+	for (i = 0; i < producer_num; i++)
+		p[i].batch = 1;
+	run(p, producer_num, nop_thread, "ring batch 1");
+	for (i = 0; i < producer_num; i++)
+		p[i].batch = batch;
+	run(p, producer_num, nop_thread, "ring");
+	for (i = 0; i < producer_num; i++) {
+		order_error += p[i].order_error;
+		if (p[i].seq != (unsigned long long)cmd_num)
+			order_error++;
+	}
+	nand_queue_dump(g_queue, stdout);
+
+	/* block 0 is left alone */
+	nand_num = MIN(producer_num, g_nand->block_num - 1);
+	for (i = 0; i < nand_num; i++) {
+		p[i].block = i + 1;
+		p[i].cmd_num = page_num_per_block * 2 + 1;
+		p[i].program_ok = mem_alloc(page_num_per_block);
+		p[i].data = mem_alloc(page_num_per_block * g_nand->page_size);
+		p[i].oob = mem_alloc(page_num_per_block * g_nand->spare_size);
+	}
+	run(p, nand_num, nand_thread, "nand");
+	for (i = 0; i < nand_num; i++) {
+		error += p[i].error;
+		done += p[i].erase_ok;
+		mem_free(p[i].oob);
+		mem_free(p[i].data);
+		mem_free(p[i].program_ok);
+	}
+	nand_queue_dump(g_queue, stdout);
+	printf("%d blocks verified, order error: %d, error: %d\n", done, order_error, error);
+	printf("%s\n", order_error || error || !done ? "queue test fail" : "queue test pass");
+
+	mem_free(p);
+	nand_queue_delete(g_queue);
+	nand_deinit(COMMON, g_nand);
+	return order_error || error || !done ? -1 : 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "xor.h"
+#include "nand.h"
+#include "nand_array.h"
+#include "test_util.h"
+
+#define XOR_BENCH_SIZE		(1 << 20)
+#define XOR_BENCH_LOOP		256
+
+/* every implementation must give the same result as scalar code */
+static int xor_bench(void)
+{
+	static const char *name[XOR_TYPE_NUM] = {"auto", "scalar", "avx2", "avx512"};
+	unsigned char *dst, *src, *ref;
+	double start, sec;
+	int i, type, error = 0;
+
+	dst = mem_alloc(XOR_BENCH_SIZE);
+	src = mem_alloc(XOR_BENCH_SIZE);
+	ref = mem_alloc(XOR_BENCH_SIZE);
+	for (i = 0; i < XOR_BENCH_SIZE; i++) {
+		src[i] = i * 7;
+		ref[i] = (i * 13) ^ (i * 7);
+	}
+	for (type = XOR_SCALAR; type < XOR_TYPE_NUM; type++) {
+		if (xor_select(type)) {
+			printf("xor %s: not supported\n", name[type]);
+			continue;
+		}
+		/* odd size and offset take the tail path */
+		for (i = 0; i < XOR_BENCH_SIZE; i++)
+			dst[i] = i * 13;
+		xor_block(dst + 1, src + 1, XOR_BENCH_SIZE - 3);
+		if (dst[0] != 0 || memcmp(dst + 1, ref + 1, XOR_BENCH_SIZE - 3) ||
+			dst[XOR_BENCH_SIZE - 2] != (unsigned char)((XOR_BENCH_SIZE - 2) * 13)) {
+			printf("xor %s: mismatch\n", name[type]);
+			error++;
+		}
+		start = now_sec();
+		for (i = 0; i < XOR_BENCH_LOOP; i++)
+			xor_block(dst, src, XOR_BENCH_SIZE);
+		sec = now_sec() - start;
+		printf("xor %s: %.2f GB/s\n", name[type], (double)XOR_BENCH_SIZE * XOR_BENCH_LOOP / sec / 1e9);
+	}
+	xor_select(XOR_AUTO);
+	mem_free(ref);
+	mem_free(src);
+	mem_free(dst);
+	return error;
+}
+
+static void fill(struct nand_array *array, unsigned int page, int num, void *data, void *oob)
+{
+	int i;
+	unsigned int *p;
+
+	for (i = 0; i < num; i++) {
+		p = (unsigned int *)((char *)data + i * array->page_size);
+		p[0] = p[1] = page + i;
+		p = (unsigned int *)((char *)oob + i * array->spare_size);
+		p[0] = page + i;
+	}
+}
+
+static int verify(struct nand_array *array, unsigned int page, int num, void *data, void *oob)
+{
+	int i, error = 0;
+	unsigned int *p;
+
+	memset(data, 0, num * array->page_size);
+	if (nand_array_read(array, page, num, data, oob) < FLASH_BITFLIP)
+		return num;
+	for (i = 0; i < num; i++) {
+		p = (unsigned int *)((char *)data + i * array->page_size);
+		if (p[0] != page + i || p[1] != page + i ||
+			*(unsigned int *)((char *)oob + i * array->spare_size) != page + i)
+			error++;
+	}
+	return error;
+}
+
+/*
+ * RAIN over devices taken as dies: array blocks are written a page at a
+ * time or a block at a time, parity is built up as stripes fill; a die is
+ * failed, its pages are read from peers and written blocks are rebuilt to
+ * a new die; XOR implementations are checked and timed first
+ */
+int main(int argc, char *argv[])
+{
+	int i, j, dev_num, stripe_page, block_num, page_num, fail_dev, done = 0, error = 0;
+	unsigned int page;
+	unsigned long long degraded;
+	char *name[ARRAY_DEV_MAX + 1];
+	void *data, *oob;
+	int *good;
+	struct nand_array *array;
+
+	if (argc != 5) {
+		printf("[Usage]: %s [nand_name] [dev_num] [stripe_page] [block_num]\n", argv[0]);
+		printf("dies are [nand_name]_0 ~ [nand_name]_[dev_num - 1], [nand_name]_r replaces one\n");
+		return 0;
+	}
+
+	dev_num = atoi(argv[2]);
+	stripe_page = atoi(argv[3]);
+	block_num = atoi(argv[4]);
+	if (dev_num < 3 || dev_num > ARRAY_DEV_MAX || strlen(argv[1]) + 5 >= NAND_NAME_MAX ||
+		block_num < 1) {
+		printf("dev_num 3 ~ %d, nand_name shorter than %d\n", ARRAY_DEV_MAX, NAND_NAME_MAX - 5);
+		return -1;
+	}
+
+	error += xor_bench();
+
+	for (i = 0; i <= dev_num; i++) {
+		name[i] = mem_alloc(NAND_NAME_MAX);
+		if (i < dev_num)
+			sprintf(name[i], "%s_%d", argv[1], i);
+		else
+			sprintf(name[i], "%s_r", argv[1]);
+		if (copy_info(argv[1], name[i])) {
+			printf("copy "NAND_INFO_FOLDER"/%s.ini fail\n", argv[1]);
+			return -1;
+		}
+	}
+	array = nand_array_create(name, dev_num, stripe_page, ARRAY_PARITY, 1);
+	if (!array) {
+		printf("create array fail\n");
+		return -1;
+	}
+
+	block_num = MIN(block_num, array->block_num - 1);
+	page_num = array->page_num / array->block_num;
+	data = mem_alloc(page_num * array->page_size);
+	oob = mem_alloc(page_num * array->spare_size);
+	good = mem_alloc((block_num + 1) * sizeof(int));
+
+	/* odd blocks a page at a time through open stripes, even blocks at once */
+	for (i = 1; i <= block_num; i++) {
+		if (nand_array_erase(array, i) != FLASH_OK)
+			continue;
+		page = i * page_num;
+		fill(array, page, page_num, data, oob);
+		for (j = 0; j < page_num; j += i & 1 ? 1 : page_num) {
+			if (nand_array_write(array, page + j, i & 1 ? 1 : page_num,
+								(char *)data + j * array->page_size,
+								(char *)oob + j * array->spare_size) != FLASH_OK)
+				break;
+		}
+		if (j < page_num) {
+			error++;
+			continue;
+		}
+		good[i] = 1;
+		done++;
+	}
+	for (i = 1; i <= block_num; i++)
+		error += good[i] ? verify(array, i * page_num, page_num, data, oob) : 0;
+	printf("write %d blocks, read back error: %d\n", done, error);
+
+	/* a die fails, all its pages come from peers */
+	fail_dev = dev_num / 2;
+	nand_array_fail(array, fail_dev);
+	degraded = array->stat.degraded_read;
+	for (i = 1; i <= block_num; i++)
+		error += good[i] ? verify(array, i * page_num, page_num, data, oob) : 0;
+	degraded = array->stat.degraded_read - degraded;
+	printf("die %d failed, degraded read: %llu pages, error: %d\n", fail_dev, degraded, error);
+	if (done && !degraded)
+		error++;
+
+	if (nand_array_rebuild(array, fail_dev, name[dev_num]) != FLASH_OK)
+		error++;
+	degraded = array->stat.degraded_read;
+	for (i = 1; i <= block_num; i++)
+		error += good[i] ? verify(array, i * page_num, page_num, data, oob) : 0;
+	printf("die %d rebuilt: %llu pages in %.3f ms, simulated %.3f ms, error: %d\n", fail_dev,
+			array->stat.rebuild_page, array->stat.rebuild_time / 1e6,
+			array->stat.rebuild_clock / 1e6, error);
+	if (array->stat.degraded_read != degraded)
+		error++;
+
+	nand_array_dump(array, stdout);
+	printf("%s, error: %d\n", error || !done ? "rain test fail" : "rain test pass", error);
+	mem_free(good);
+	mem_free(oob);
+	mem_free(data);
+	nand_array_delete(array);
+	for (i = 0; i <= dev_num; i++)
+		mem_free(name[i]);
+	return error || !done ? -1 : 0;
+}
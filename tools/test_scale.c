@@ -0,0 +1,160 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include "common.h"
+#include "nand.h"
+#include "nand_ecc.h"
+
+#define THREAD_MAX		64
+
+struct reader {
+	pthread_t thread;
+	struct nand_base *nand;
+	int *row; // programmed rows
+	int row_num;
+	int read_num;
+	unsigned int seed;
+	int error;
+};
+
+/* random reads of programmed rows, spare carries the row */
+static void *read_thread(void *arg)
+{
+	struct reader *r = arg;
+	struct nand_base *nand = r->nand;
+	unsigned int *data, *oob;
+	int i, row;
+
+	data = mem_alloc(nand->page_size);
+	oob = mem_alloc(nand->spare_size);
+	for (i = 0; i < r->read_num; i++) {
+		row = r->row[rand_r(&r->seed) % r->row_num];
+		if (nand_read_page(nand, row, 0, data, oob) < FLASH_BITFLIP ||
+			oob[0] != row || data[0] != row)
+			r->error++;
+	}
+	mem_free(oob);
+	mem_free(data);
+	return NULL;
+}
+
+/*
+ * random page read throughput of one device by 1, 2, 4 ... thread_max threads:
+ * a page of every good block is programmed, then each round splits
+ * read_num reads to its threads; LUNs are locked apart, reads of
+ * different LUNs run in parallel, so does ECC of each LUN when ecc_type
+ * (enum nand_ecc_type) is given
+ */
+int main(int argc, char *argv[])
+{
+	int i, n, thread_max, read_num, ecc_type = -1, row_num = 0, error = 0;
+	int page_num_per_block;
+	int *row;
+	double sec, rate, base = 0;
+	unsigned int *data, *oob;
+	struct timespec start, end;
+	struct reader *r;
+	struct nand_base *nand;
+
+	if (argc != 4 && argc != 5) {
+		printf("[Usage]: %s [nand_name] [thread_max] [read_num] [ecc_type]\n", argv[0]);
+		return 0;
+	}
+
+	thread_max = atoi(argv[2]);
+	read_num = atoi(argv[3]);
+	if (argc == 5)
+		ecc_type = atoi(argv[4]);
+	if (thread_max < 1 || thread_max > THREAD_MAX || read_num < thread_max) {
+		printf("thread_max 1 ~ %d, read_num no less than thread_max\n", THREAD_MAX);
+		return -1;
+	}
+
+	nand = nand_init(COMMON, argv[1]);
+	if (!nand) {
+		printf("Nand init fail, please check the config file\n");
+		return -1;
+	}
+	/* strength as test_nand: a quarter of ecc_required, 3/4 of spare per 1KB */
+	if (ecc_type >= 0 && nand_ecc_enable(nand, ecc_type, MIN(1024, nand->page_size),
+			ecc_type == NAND_ECC_BCH ? nand->ecc_required / 4 :
+			nand->spare_size / (nand->page_size / 1024) * 3 / 4 & ~7)) {
+		printf("spare can't hold parity\n");
+		nand_deinit(COMMON, nand);
+		return -1;
+	}
+
+	/* skip block 0 */
+	page_num_per_block = nand->block_size / nand->page_size;
+	row = mem_alloc(nand->block_num * sizeof(int));
+	data = mem_alloc(nand->page_size);
+	oob = mem_alloc(nand->spare_size);
+	for (i = 1; i < nand->block_num; i++) {
+		n = i * page_num_per_block;
+		if (nand_erase_block(nand, n) != FLASH_OK)
+			continue;
+		data[0] = oob[0] = n;
+		if (nand_write_page(nand, n, 0, data, oob) == FLASH_OK)
+			row[row_num++] = n;
+	}
+	mem_free(oob);
+	mem_free(data);
+	printf("lun: %d, programmed pages: %d\n", nand->lun_num, row_num);
+	if (!row_num) {
+		mem_free(row);
+		nand_deinit(COMMON, nand);
+		return -1;
+	}
+
+	r = mem_alloc(thread_max * sizeof(struct reader));
+	for (n = 1; n <= thread_max; n <<= 1) {
+		for (i = 0; i < n; i++) {
+			r[i].nand = nand;
+			r[i].row = row;
+			r[i].row_num = row_num;
+			r[i].read_num = read_num / n;
+			r[i].seed = i + 1;
+			r[i].error = 0;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < n; i++)
+			pthread_create(&r[i].thread, NULL, read_thread, &r[i]);
+		for (i = 0; i < n; i++)
+			pthread_join(r[i].thread, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		sec = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+		rate = read_num / n * n / sec;
+		for (i = 0; i < n; i++)
+			error += r[i].error;
+		if (n == 1)
+			base = rate;
+		printf("threads: %2d, reads/s: %.0f, speedup: %.2f\n", n, rate, rate / base);
+	}
+
+	nand_dump(nand, stdout);
+	printf("%s, error: %d\n", error ? "scale test fail" : "scale test pass", error);
+	mem_free(r);
+	mem_free(row);
+	nand_deinit(COMMON, nand);
+	return error ? -1 : 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "nand.h"
+#include "nand_sched.h"
+
+#define QUEUE_DEPTH		4
+
+static unsigned long long g_remain;
+
+static int random_op(void)
+{
+	int r = rand() % 100;
+
+	if (r < 70)
+		return SCHED_READ;
+	if (r < 97)
+		return SCHED_PROGRAM;
+	return SCHED_ERASE;
+}
+
+/* closed loop: keep QUEUE_DEPTH commands outstanding on every die */
+static void cmd_done(struct sched *s, struct sched_cmd *cmd, void *userdata)
+{
+	if (!g_remain)
+		return;
+	g_remain--;
+	sched_submit(s, s->now, random_op(), cmd->die, 0, cmd_done, NULL);
+}
+
+/*
+ * a page read on every LUN goes through the scheduler of the device, array
+ * time of LUNs overlaps and only the bus transfers queue up
+ *
+ * Returns zero if the reads take less than tR of every LUN in a row
+ */
+static int lun_test(struct nand_base *nand)
+{
+	int i, ret = 0, rows_per_lun;
+	unsigned long long clock, serial;
+	char *data, *oob;
+
+	data = mem_alloc(nand->page_size);
+	oob = mem_alloc(nand->spare_size);
+	rows_per_lun = nand->block_num / nand->lun_num * (nand->block_size / nand->page_size);
+	clock = nand->clock;
+	for (i = 0; i < nand->lun_num; i++)
+		nand_read_page(nand, i * rows_per_lun, 0, data, oob);
+	clock = nand->clock - clock;
+	serial = (unsigned long long)nand->lun_num * (nand->timing.t_cmd + nand->timing.t_r +
+				nand_xfer_time(&nand->timing, nand->page_size + nand->spare_size));
+	if (nand->lun_num > 1 && clock >= serial)
+		ret = -1;
+	printf("read of %d LUNs: %llu ns, one by one: %llu ns\n", nand->lun_num, clock, serial);
+	mem_free(oob);
+	mem_free(data);
+	return ret;
+}
+
+/* synthetic workload takes only timing of the nand config, lun_test reads the device */
+int main(int argc, char *argv[])
+{
+	int i, ret, ch_num, die_num;
+	clock_t start;
+	struct sched *s;
+	struct nand_base *nand;
+
+	if (argc != 5) {
+		printf("[Usage]: %s [nand_name] [channel_num] [die_num] [cmd_num]\n", argv[0]);
+		return 0;
+	}
+
+	nand = nand_init(COMMON, argv[1]);
+	if (!nand) {
+		printf("Nand init fail, please check the config file\n");
+		return -1;
+	}
+
+	ch_num = atoi(argv[2]);
+	die_num = atoi(argv[3]);
+	g_remain = strtoull(argv[4], NULL, 0);
+	s = sched_create(&nand->timing, nand->page_size + nand->spare_size, ch_num, die_num);
+	if (!s) {
+		printf("create scheduler fail!\n");
+		nand_deinit(COMMON, nand);
+		return -2;
+	}
+
+	srand(0);
+	start = clock();
+	for (i = 0; i < ch_num * die_num * QUEUE_DEPTH && g_remain; i++, g_remain--)
+		sched_submit(s, 0, random_op(), i % (ch_num * die_num), 0, cmd_done, NULL);
+	sched_run(s, SCHED_RUN_ALL);
+
+	printf("host time: %.3f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+	sched_dump(s, stdout);
+	sched_delete(s);
+
+	ret = lun_test(nand);
+	printf("%s\n", ret ? "lun test fail" : "lun test pass");
+	nand_deinit(COMMON, nand);
+	return ret;
+}
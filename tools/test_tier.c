@@ -0,0 +1,151 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "file.h"
+#include "test_util.h"
+
+#define READ_ROUND			3
+#define DISCARD_RATIO		8 // one of blocks is discarded
+
+
+/* Returns number of wrong blocks, discarded ones must not be found */
+static int check(struct file_info *info, unsigned char *expect, int block_num, bool shuffle)
+{
+	int i, id, error = 0;
+	unsigned int seed = 1;
+	unsigned char *buf;
+
+	for (i = 0; i < block_num; i++) {
+		id = shuffle ? rand_r(&seed) % block_num : i;
+		buf = file_read(info, id);
+		if (id % DISCARD_RATIO == DISCARD_RATIO - 1 && expect[0] == 0xFF) {
+			if (buf) {
+				error++;
+				file_put(info, buf);
+			}
+			continue;
+		}
+		fill_block(expect + 1, info->size, id, 1024, TRUE);
+		if (!buf || memcmp(buf, expect + 1, info->size))
+			error++;
+		if (buf)
+			file_put(info, buf);
+	}
+	return error;
+}
+
+
+/*
+ * blocks are written through a small cache, so every block is evicted;
+ * eviction only compresses by the fast codec, the sink thread writes
+ * files in background; blocks are read back from every tier, some are
+ * discarded, then a flush leaves all blocks cold and a new file object
+ * reads them from files
+ */
+int main(int argc, char *argv[])
+{
+	int i, r, size, block_num, cache_num, out_size, error = 0;
+	unsigned char *expect, *comp, *buf;
+	double start, write_sec, read_sec, slow_sec;
+	struct file_info *info;
+
+	if (argc != 5) {
+		printf("[Usage]: %s [name] [block_size] [block_num] [cache_num]\n", argv[0]);
+		printf("block_size in KB\n");
+		return 0;
+	}
+	size = atoi(argv[2]) << 10;
+	block_num = atoi(argv[3]);
+	cache_num = atoi(argv[4]);
+	if (size <= 0 || cache_num < 1 || block_num <= 4 * cache_num) {
+		printf("block_size and cache_num at least 1, block_num more than 4 cache_num\n");
+		return -1;
+	}
+
+	/* first byte of expect tells whether discarded blocks are gone */
+	expect = mem_alloc(size + 1);
+	comp = mem_alloc(size);
+	fill_block(expect + 1, size, 0, 1024, TRUE);
+	start = now_sec();
+	out_size = size;
+	data_compress((char *)expect + 1, size, (char *)comp, &out_size, COMPRESS_BROTLI);
+	slow_sec = now_sec() - start;
+
+	info = file_create(argv[1], size, cache_num, COMPRESS_BROTLI);
+	start = now_sec();
+	for (i = 0; i < block_num; i++) {
+		buf = file_write_cache(info, i);
+		fill_block(buf, size, i, 1024, TRUE);
+		file_put(info, buf);
+	}
+	write_sec = now_sec() - start;
+	printf("\nwrite: %.3f ms per block, brotli of a block %.3f ms, ratio %.1f%%\n",
+			write_sec * 1000 / block_num, slow_sec * 1000, 100.0 * out_size / size);
+
+	start = now_sec();
+	for (r = 0; r < READ_ROUND; r++)
+		error += check(info, expect, block_num, TRUE);
+	read_sec = now_sec() - start;
+	printf("read: %.3f ms per block, error %d\n",
+			read_sec * 1000 / block_num / READ_ROUND, error);
+	file_dump(info, stdout);
+
+	for (i = DISCARD_RATIO - 1; i < block_num; i += DISCARD_RATIO)
+		file_discard(info, i);
+	expect[0] = 0xFF;
+	error += check(info, expect, block_num, TRUE);
+
+	/* flush waits for the sink thread, which may lag behind reads */
+	file_flush(info);
+	file_dump(info, stdout);
+	if (info->warm_num || info->warm_bytes || !info->demote || !info->promote || !info->sink)
+		error++;
+	file_delete(info);
+
+	/* files alone hold every block now, unmodified ones are only dropped */
+	info = file_create(argv[1], size, cache_num, COMPRESS_BROTLI);
+	error += check(info, expect, block_num, FALSE);
+	printf("\n");
+	file_dump(info, stdout);
+	if (info->cold_read != block_num - block_num / DISCARD_RATIO || info->demote ||
+		info->direct || !info->clean)
+		error++;
+
+	/* a modified block is written back */
+	buf = file_modify(info, 0);
+	buf[0] ^= 0xFF;
+	file_put(info, buf);
+	file_flush(info);
+	file_delete(info);
+	info = file_create(argv[1], size, cache_num, COMPRESS_BROTLI);
+	buf = file_read(info, 0);
+	fill_block(expect + 1, size, 0, 1024, TRUE);
+	if (!buf || buf[0] != (expect[1] ^ 0xFF) || memcmp(buf + 1, expect + 2, size - 1))
+		error++;
+	if (buf)
+		file_put(info, buf);
+	file_delete(info);
+
+	mem_free(comp);
+	mem_free(expect);
+	printf("\n%s, error: %d\n", error ? "tier test fail" : "tier test pass", error);
+	return error ? -1 : 0;
+}
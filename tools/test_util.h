@@ -0,0 +1,89 @@
+/*
+ * BeanSim : Nand Flash Simulator by File Operations
+ * Authors: Bean.Li<lishizelibin@163.com>
+ *
+ * This file is part of BeanSim.
+ *
+ * BeanSim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeanSim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeanSim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+
+#include <time.h>
+#include "common.h"
+#include "nand.h"
+
+/* helpers shared by test tools, each tool is a single source file */
+
+/* Returns zero if NandInfo/src.ini is copied to NandInfo/dst.ini */
+static inline int copy_info(const char *src, const char *dst)
+{
+	char buf[256];
+	FILE *in, *out;
+	size_t n;
+
+	sprintf(buf, NAND_INFO_FOLDER"/%s.ini", src);
+	in = fopen(buf, "r");
+	if (!in)
+		return -1;
+	sprintf(buf, NAND_INFO_FOLDER"/%s.ini", dst);
+	out = fopen(buf, "w");
+	if (!out) {
+		fclose(in);
+		return -1;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+		fwrite(buf, 1, n, out);
+	fclose(in);
+	fclose(out);
+	return 0;
+}
+
+
+/* Returns seconds of monotonic clock */
+static inline double now_sec(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+
+/*
+ * fill_block - data like block files: the head of every 4 KB carries data,
+ *              the rest is erased
+ * @buf: buffer of size bytes
+ * @block: block number, the data depends on it
+ * @head: data bytes of every 4 KB
+ * @random: random bytes if TRUE, otherwise a compressible pattern of block
+ *          and offset
+ */
+static inline void fill_block(unsigned char *buf, int size, int block, int head, bool random)
+{
+	int i, j;
+	unsigned int seed = block + 1;
+
+	memset(buf, 0, size);
+	for (i = 0; i < size; i += 4096) {
+		for (j = 0; j < head && i + j < size; j += random ? 1 : 4) {
+			if (random)
+				buf[i + j] = rand_r(&seed);
+			else
+				*(unsigned int *)(buf + i + j) = (block << 16) + i / 4096 * 31 + j % 64;
+		}
+	}
+}
+#endif // __TEST_UTIL_H__